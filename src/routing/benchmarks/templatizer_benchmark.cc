@@ -0,0 +1,125 @@
+// Compares model::SqlTemplatizer with the boost::regex passes it replaced
+// in QueryParser: four regex_replace calls for the template and a
+// regex_iterator with lookbehind for the arguments.
+//
+// Every query of the trace is templatized by both; the templates have to
+// agree, since the model's query ids are keyed by them. Reported per
+// implementation: ns per query over all rounds.
+//
+// Usage: routing_templatizer_benchmark <trace> [rounds]
+//   The trace holds one query per line, as for trace_file.
+
+#include "speculator/speculation_model/sql_templatizer.h"
+
+#include <boost/regex.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const boost::regex kArgument(R"((?<!OFFSET )(?<!LIMIT )(IN \([^)]+\)|'[^']*'|\b\d+(\.\d+)?\b))");
+// The parser had R"(\'[^']*')", where boost reads \' as the end of the
+// buffer, so string literals stayed in its templates; the templatizer
+// replaces them, as the replayer's template does.
+const boost::regex kString(R"('[^']*')");
+const boost::regex kNumber(R"(\b\d+(\.\d+)?\b)");
+const boost::regex kStrList(R"(IN \(([^)']+)\))");
+const boost::regex kNumList(R"(IN \(([^)0-9]+)\))");
+
+std::string Trim(const std::string &sql) {
+  size_t begin = sql.find_first_not_of(" \t\r\n\f\v");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return sql.substr(begin, sql.find_last_not_of(" \t\r\n\f\v") - begin + 1);
+}
+
+// The replaced QueryParser::ExtractTemplate() and RegexFindAll().
+std::string RegexTemplate(const std::string &sql, std::vector<std::string> *arguments) {
+  std::string sql_template = Trim(sql);
+  sql_template = boost::regex_replace(sql_template, kString, "?v");
+  sql_template = boost::regex_replace(sql_template, kNumber, "?v");
+  sql_template = boost::regex_replace(sql_template, kStrList, "?v");
+  sql_template = boost::regex_replace(sql_template, kNumList, "?v");
+  arguments->clear();
+  for (boost::sregex_iterator iter(sql.begin(), sql.end(), kArgument), end; iter != end; iter++) {
+    arguments->push_back(iter->str());
+  }
+  return sql_template;
+}
+
+std::vector<std::string> ReadTrace(const char *path) {
+  std::vector<std::string> queries;
+  std::ifstream in_file(path);
+  std::string line;
+  while (std::getline(in_file, line)) {
+    if (line.size() > 0) {
+      queries.push_back(line);
+    }
+  }
+  return queries;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <trace> [rounds]\n", argv[0]);
+    return 1;
+  }
+  auto queries = ReadTrace(argv[1]);
+  int rounds = argc > 2 ? atoi(argv[2]) : 10;
+  if (queries.empty() || rounds <= 0) {
+    fprintf(stderr, "No queries in %s\n", argv[1]);
+    return 1;
+  }
+
+  size_t mismatches = 0;
+  size_t checksum = 0;
+  model::SqlTemplatizer templatizer;
+  std::vector<model::SqlValue> values;
+  std::vector<std::string> arguments;
+  for (auto &query : queries) {
+    values.clear();
+    templatizer.Templatize(query, &values);
+    if (templatizer.sql_template() != RegexTemplate(query, &arguments)) {
+      if (mismatches++ < 10) {
+        printf("template mismatch: %s\n  regex:  %s\n  single: %s\n", query.c_str(),
+               RegexTemplate(query, &arguments).c_str(), templatizer.sql_template().c_str());
+      }
+    }
+  }
+
+  auto start = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    for (auto &query : queries) {
+      checksum += RegexTemplate(query, &arguments).size() + arguments.size();
+    }
+  }
+  auto regex_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+  start = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    for (auto &query : queries) {
+      values.clear();
+      templatizer.Templatize(query, &values);
+      checksum += templatizer.sql_template().size() + values.size();
+    }
+  }
+  auto single_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+  double num_total = static_cast<double>(queries.size()) * rounds;
+  printf("%lu queries, %d rounds, %lu template mismatches (checksum %lu)\n",
+         queries.size(), rounds, mismatches, checksum);
+  printf("%-12s %12s\n", "parser", "ns/query");
+  printf("%-12s %12.0f\n", "regex", static_cast<double>(regex_ns.count()) / num_total);
+  printf("%-12s %12.0f\n", "single-pass", static_cast<double>(single_ns.count()) / num_total);
+  return mismatches == 0 ? 0 : 2;
+}
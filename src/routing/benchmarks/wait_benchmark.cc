@@ -0,0 +1,125 @@
+// Compares spinning with spin-then-park waiting on SpscRingBuffer::Read(),
+// the wait every session does for a backend response.
+//
+// Each session thread sends a request to its own simulated backend and
+// waits for the response; the backend answers after a fixed service time.
+// Reported per mode: latency percentiles and the CPU time the session
+// threads burn per query (the backends are not counted).
+//
+// Usage: routing_wait_benchmark [sessions] [queries] [service_us] [spin_budget]
+
+#include "mysqlrouter/spsc_ring_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kRingSize = 1 << 16;
+const size_t kMessageSize = 64;
+
+long ThreadCpuUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+struct SessionResult {
+  std::vector<long> latencies_us;
+  long cpu_us;
+};
+
+void RunBackend(SpscRingBuffer *requests, SpscRingBuffer *responses,
+                int num_queries, int service_us) {
+  char message[kMessageSize];
+  for (int i = 0; i < num_queries; i++) {
+    requests->Read(message, kMessageSize);
+    std::this_thread::sleep_for(std::chrono::microseconds(service_us));
+    responses->Write(message, kMessageSize);
+  }
+}
+
+void RunSession(SpscRingBuffer *requests, SpscRingBuffer *responses,
+                int num_queries, SessionResult *result) {
+  char message[kMessageSize] = {};
+  result->latencies_us.reserve(num_queries);
+  long cpu_start = ThreadCpuUs();
+  for (int i = 0; i < num_queries; i++) {
+    auto start = Clock::now();
+    requests->Write(message, kMessageSize);
+    responses->Read(message, kMessageSize);
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    result->latencies_us.push_back(static_cast<long>(latency.count()));
+  }
+  result->cpu_us = ThreadCpuUs() - cpu_start;
+}
+
+void RunMode(const std::string &name, const WaitPolicy &policy, int num_sessions,
+             int num_queries, int service_us) {
+  std::vector<std::unique_ptr<SpscRingBuffer>> requests;
+  std::vector<std::unique_ptr<SpscRingBuffer>> responses;
+  std::vector<SessionResult> results(num_sessions);
+  for (int i = 0; i < num_sessions; i++) {
+    requests.emplace_back(new SpscRingBuffer(kRingSize));
+    responses.emplace_back(new SpscRingBuffer(kRingSize));
+    // The backends stand in for remote servers and always park.
+    requests.back()->SetWaitPolicy(WaitPolicy::Park(0));
+    responses.back()->SetWaitPolicy(policy);
+  }
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_sessions; i++) {
+    threads.emplace_back(RunBackend, requests[i].get(), responses[i].get(),
+                         num_queries, service_us);
+    threads.emplace_back(RunSession, requests[i].get(), responses[i].get(),
+                         num_queries, &results[i]);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+
+  std::vector<long> latencies;
+  long cpu_us = 0;
+  for (auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+    cpu_us += result.cpu_us;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))];
+  };
+  double num_total = static_cast<double>(latencies.size());
+  printf("%-12s %8ld %8ld %8ld %12.2f %10.0f\n", name.c_str(),
+         percentile(0.5), percentile(0.99), percentile(0.999),
+         static_cast<double>(cpu_us) / num_total,
+         num_total * 1000 / static_cast<double>(std::max<long>(1, elapsed.count())));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int num_sessions = argc > 1 ? atoi(argv[1]) : 8;
+  int num_queries = argc > 2 ? atoi(argv[2]) : 10000;
+  int service_us = argc > 3 ? atoi(argv[3]) : 50;
+  uint32_t spin_budget = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 1000;
+
+  printf("%d sessions, %d queries each, %d us service time, %u hardware threads\n",
+         num_sessions, num_queries, service_us, std::thread::hardware_concurrency());
+  printf("%-12s %8s %8s %8s %12s %10s\n", "mode", "p50(us)", "p99(us)",
+         "p999(us)", "cpu/query(us)", "queries/s");
+  RunMode("spin", WaitPolicy::Spin(), num_sessions, num_queries, service_us);
+  RunMode("park", WaitPolicy::Park(spin_budget), num_sessions, num_queries, service_us);
+  RunMode("park(0)", WaitPolicy::Park(0), num_sessions, num_queries, service_us);
+  return 0;
+}
@@ -24,6 +24,9 @@ public:
   int FileDescriptor() {
     return fd_;
   }
+  void SetNotifier(Notifier *notifier) {
+    sock_ops_->set_notifier(fd_, notifier);
+  }
   ssize_t Recv();
   ssize_t TryRecv();
   ssize_t Send(size_t size);
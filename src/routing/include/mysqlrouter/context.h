@@ -1,10 +1,13 @@
 #ifndef RDMA_CONTEXT_H_
 #define RDMA_CONTEXT_H_
 
+#include "cq_poller_pool.h"
+#include "recv_pool.h"
 #include "spsc_ring_buffer.h"
 
 #include <atomic>
-#include <thread>
+#include <memory>
+#include <vector>
 
 #include <rdma/rdma_cma.h>
 
@@ -17,24 +20,37 @@ public:
   struct ibv_qp *queue_pair;
   struct ibv_context *device_context;
   struct ibv_pd *protection_domain;
+  // Shared with the other queue pairs of the poller.
   struct ibv_cq *completion_queue;
-  struct ibv_comp_channel *completion_channel;
+  CqPoller *poller = nullptr;
+  // Room of the queue pair in the completion queue.
+  int num_cqes;
 
   bool connected;
 
-  char *recv_region;
+  std::unique_ptr<RecvPool> recv_pool;
   struct ibv_mr *recv_mr;
   char *send_region;
   struct ibv_mr *send_mr;
+  // Buffers sent from without a copy.
+  std::vector<struct ibv_mr *> buffer_mrs;
+  uint32_t next_send_header;
+  uint32_t next_send_slot;
+  // The last send out of each send slot, 0 if none.
+  std::vector<uint64_t> send_slot_sends;
 
   int queue_depth;
-  std::atomic<int> unsignaled_sends;
+  // Sends are numbered from 1 in the order they are posted, which is
+  // also their work request id; completions come in the same order.
+  uint64_t num_sends;
+  std::atomic<uint64_t> num_completed_sends;
+  // The last send out of the copy area, 0 if none.
+  uint64_t copy_area_send;
 
-  SpscRingBuffer buffer;
+  // ReceivedMessages, in the order they landed.
+  SpscRecordBuffer buffer{4096};
 
   int num_skips;
-
-  std::thread cq_poller_thread;
 };
 
 #endif // RDMA_CONTEXT_H_
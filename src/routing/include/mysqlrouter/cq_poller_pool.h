@@ -0,0 +1,110 @@
+#ifndef RDMA_CQ_POLLER_POOL_H_
+#define RDMA_CQ_POLLER_POOL_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <infiniband/verbs.h>
+
+class Context;
+
+// The verbs of a completion queue a CqPoller drives, which are
+// ibv_poll_cq() and the completion channel but for tests.
+class CompletionQueue {
+public:
+  virtual ~CompletionQueue() = default;
+
+  virtual struct ibv_cq *cq() = 0;
+  // Number of completions the queue holds before it overruns.
+  virtual int Size() = 0;
+  // Up to max completions into wcs; negative on failure.
+  virtual int Poll(int max, struct ibv_wc *wcs) = 0;
+  // Requests an event for the next completion; false on failure.
+  virtual bool Arm() = 0;
+  // Blocks for the requested event; false on failure.
+  virtual bool Wait() = 0;
+};
+
+// A thread polling one completion queue, which many queue pairs share,
+// and handing each completion to the Context of its queue pair. Lives as
+// long as the process.
+class CqPoller {
+public:
+  // Takes a completion of the queue pair of context.
+  using Handler = std::function<void(Context *context, struct ibv_wc *wc)>;
+
+  CqPoller(std::unique_ptr<CompletionQueue> completion_queue, Handler handler,
+           uint32_t busy_poll_us);
+
+  // Starts the thread on a new completion queue of device; nullptr on
+  // failure.
+  static std::unique_ptr<CqPoller> Create(struct ibv_context *device, Handler handler,
+                                          uint32_t busy_poll_us);
+
+  struct ibv_cq *completion_queue() {
+    return completion_queue_->cq();
+  }
+
+  // Reserves room in the completion queue for a queue pair of num_cqes
+  // outstanding work requests; false if full.
+  bool Reserve(int num_cqes);
+  // Returns the room of a queue pair that was never added.
+  void Release(int num_cqes);
+  // Completions of the queue pair go to context from now on.
+  void Add(uint32_t qp_num, Context *context);
+  // Once this returns, no completion goes to the context of the queue
+  // pair any more, and its num_cqes are released.
+  void Remove(uint32_t qp_num, int num_cqes);
+
+  // Polls until the completion queue fails; the thread of Create().
+  void Run();
+
+private:
+  void Dispatch(struct ibv_wc *wcs, int num_wcs);
+
+  std::unique_ptr<CompletionQueue> completion_queue_;
+  Handler handler_;
+  uint32_t busy_poll_us_;
+  std::atomic<int> num_reserved_;
+  std::shared_mutex mutex_;
+  std::unordered_map<uint32_t, Context *> contexts_;
+};
+
+// The CqPollers of all RDMA connections, num_threads per device, so that
+// the number of threads does not grow with the number of connections.
+// Queue pairs are spread over the pollers round robin; only once all of
+// them are full is another poller started. A poller that runs dry keeps
+// polling for busy_poll_us before it blocks for a completion event again.
+class CqPollerPool {
+public:
+  // Takes effect for the pollers of devices not used yet; 0 threads is
+  // one per core.
+  static void Configure(size_t num_threads, uint32_t busy_poll_us);
+  static CqPollerPool *instance();
+
+  // The poller for a new queue pair on device with room reserved for
+  // num_cqes completions; nullptr on failure. The handler of the first
+  // queue pair on a device is the one of all its pollers.
+  CqPoller *Assign(struct ibv_context *device, int num_cqes, CqPoller::Handler handler);
+
+private:
+  struct Device {
+    std::vector<std::unique_ptr<CqPoller>> pollers;
+    size_t next;
+  };
+
+  CqPollerPool() = default;
+
+  std::mutex mutex_;
+  std::unordered_map<struct ibv_context *, std::unique_ptr<Device>> devices_;
+};
+
+#endif // RDMA_CQ_POLLER_POOL_H_
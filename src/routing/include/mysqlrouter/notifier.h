@@ -0,0 +1,61 @@
+#ifndef UTILS_NOTIFIER_H_
+#define UTILS_NOTIFIER_H_
+
+#include <atomic>
+#include <cstdint>
+
+// How a consumer waits for a condition: poll it up to spin_budget times,
+// then, if park is set, sleep on a Notifier between polls. A park is
+// bounded by park_timeout_us so that sources which cannot notify (plain
+// sockets) are still polled.
+struct WaitPolicy {
+  bool park;
+  uint32_t spin_budget;
+  uint32_t park_timeout_us;
+
+  static WaitPolicy Spin();
+  static WaitPolicy Park(uint32_t spin_budget);
+  static WaitPolicy Default();
+  static void SetDefault(const WaitPolicy &policy);
+};
+
+// A futex-backed wake-up signal. Notify() costs an atomic increment
+// unless someone is parked in Wait(). A process-shared notifier may be
+// placed in shared memory and notified from another process.
+class Notifier {
+public:
+  Notifier() : Notifier(false) {}
+  explicit Notifier(bool process_shared) :
+    epoch_(0), num_waiters_(0), process_shared_(process_shared) {}
+
+  uint32_t Epoch() {
+    return epoch_.load();
+  }
+  void Notify();
+  // Returns when Notify() was called after epoch was read, on timeout or
+  // on a spurious wake-up; the caller re-checks its condition.
+  void Wait(uint32_t epoch, uint32_t timeout_us);
+
+private:
+  std::atomic<uint32_t> epoch_;
+  std::atomic<int> num_waiters_;
+  bool process_shared_;
+};
+
+template<typename Predicate>
+void WaitUntil(const WaitPolicy &policy, Notifier *notifier, Predicate ready) {
+  for (uint32_t i = 0; !policy.park || i < policy.spin_budget; i++) {
+    if (ready()) {
+      return;
+    }
+  }
+  while (true) {
+    uint32_t epoch = notifier->Epoch();
+    if (ready()) {
+      return;
+    }
+    notifier->Wait(epoch, policy.park_timeout_us);
+  }
+}
+
+#endif // UTILS_NOTIFIER_H_
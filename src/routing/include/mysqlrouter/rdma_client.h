@@ -10,17 +10,25 @@ public:
   RdmaClient(std::string hostname, int port);
   Status Connect();
   char *GetRemoteBuffer();
+  // Sends small packets out of a send slot, larger ones straight from a
+  // registered buffer, waiting until they have left, else from a copy.
   ssize_t SendToServer(void *buffer, size_t size);
+  // Lets SendToServer() send straight from buffer, which has to outlive
+  // the connection.
+  Status RegisterBuffer(void *buffer, size_t size);
   void Disconnect();
   Status CancelOustanding();
-  ssize_t Read(void *buffer, size_t size) {
-    return context_->buffer.Read(buffer, size);
-  }
+  // Copies out the next response, or as much of it as fits, and hands
+  // its receive buffer back to the pool once it is drained.
+  ssize_t Read(void *buffer, size_t size);
   bool HasError() {
     return context_->buffer.HasError();
   }
   bool HasData() {
-    return context_->buffer.HasData();
+    return read_offset_ > 0 || context_->buffer.HasData();
+  }
+  void SetNotifier(Notifier *notifier) {
+    context_->buffer.SetNotifier(notifier);
   }
 
 protected:
@@ -29,9 +37,14 @@ protected:
   virtual Status OnConnectRequest(struct rdma_cm_id *id) override;
 
 private:
+  struct ibv_mr *FindBufferRegion(void *buffer, size_t size);
+
   int port_;
   std::string hostname_;
   Context *context_;
+  // The response being read, read_offset_ bytes into it.
+  ReceivedMessage message_;
+  size_t read_offset_;
 };
 
 #endif // RDMA_RDMA_CLIENT_H_
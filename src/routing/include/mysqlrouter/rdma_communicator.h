@@ -51,12 +51,28 @@ public:
   RdmaCommunicator();
   virtual ~RdmaCommunicator() {}
 
-  static Status PostReceive(Context *context);
+  static Status PostReceive(Context *context, uint32_t slot);
+  // Sends size bytes of the copy area, which can be reused once
+  // WaitForSend() returns for context->copy_area_send.
   static Status PostSend(Context *context, size_t size);
+  // Sends size bytes of buffer, which lies in mr, without copying them.
+  // The buffer must not change until WaitForSend() returns for
+  // context->num_sends.
+  static Status PostSend(Context *context, void *buffer, size_t size, struct ibv_mr *mr);
+  // Whether a packet of size bytes fits a send slot.
+  static bool FitsSendSlot(size_t size);
+  // Sends a copy of a packet that fits out of the next send slot, so that
+  // the buffer can be reused right away.
+  static Status PostSendFromSlot(Context *context, const void *buffer, size_t size);
+  // Waits until the poller has seen send, and every send before it,
+  // complete; false once the connection is in error.
+  static bool WaitForSend(Context *context, uint64_t send);
+  // Registers buffer for sends from it until the context is destroyed.
+  static Status RegisterBuffer(Context *context, void *buffer, size_t size);
 
 protected:
+  static Status PostSend(Context *context, struct ibv_sge *sg_list, int num_sge);
   static void OnWorkCompletion(Context *context, struct ibv_wc *wc);
-  static void *PollCompletionQueue(void *context);
 
   virtual Status OnAddressResolved(struct rdma_cm_id *id) = 0;
   virtual Status OnRouteResolved(struct rdma_cm_id *id) = 0;
@@ -0,0 +1,72 @@
+#ifndef RDMA_RECV_POOL_H_
+#define RDMA_RECV_POOL_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+// A message that landed in a slot of a RecvPool, as queued from the
+// completion queue thread to the reader.
+struct ReceivedMessage {
+  uint32_t slot;
+  uint32_t size;
+};
+
+// The receive buffers of a queue pair: num_slots slots of slot_size bytes
+// in one allocation, for a single memory registration. A slot stays
+// posted until a message lands in it, and is posted again once the
+// reader has drained the message, so that the peer can send up to
+// num_slots messages ahead of the reader. Posting is left to a function,
+// which is ibv_post_recv() but for tests.
+class RecvPool {
+public:
+  // Posts the receive of a slot; returns false on failure.
+  using PostFunction = std::function<bool(uint32_t slot)>;
+
+  RecvPool(size_t num_slots, size_t slot_size);
+
+  void SetPostFunction(PostFunction post) {
+    post_ = std::move(post);
+  }
+  char *Region() {
+    return region_.get();
+  }
+  size_t RegionSize() const {
+    return num_slots_ * slot_size_;
+  }
+  size_t NumSlots() const {
+    return num_slots_;
+  }
+  size_t SlotSize() const {
+    return slot_size_;
+  }
+  char *Slot(uint32_t slot) {
+    return region_.get() + slot * slot_size_;
+  }
+  size_t NumPosted() const {
+    return num_posted_.load(std::memory_order_relaxed);
+  }
+
+  // Posts every slot, before the connection is established.
+  bool PostAll();
+  // A message landed in slot, which is the reader's until Release().
+  void OnReceived(uint32_t slot) {
+    assert(slot < num_slots_);
+    num_posted_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  // Posts slot again once its message is drained.
+  bool Release(uint32_t slot);
+
+private:
+  size_t num_slots_;
+  size_t slot_size_;
+  std::unique_ptr<char[]> region_;
+  std::atomic<size_t> num_posted_;
+  PostFunction post_;
+};
+
+#endif // RDMA_RECV_POOL_H_
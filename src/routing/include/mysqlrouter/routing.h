@@ -19,13 +19,16 @@
 #define MYSQLROUTER_ROUTING_INCLUDED
 
 #include "rdma_client.h"
+#include "shm_channel.h"
 #include "mysqlrouter/datatypes.h"
 #include "mysqlrouter/plugin_config.h"
 
 #include <map>
+#include <memory>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #ifdef _WIN32
 typedef long ssize_t;
@@ -88,6 +91,140 @@ extern const unsigned int kDefaultNetBufferLength;
  */
 extern const unsigned int kDefaultClientConnectTimeout;
 
+/** @brief Default number of reactor worker threads
+ *
+ * Number of epoll worker threads used when `io_mode` is `reactor`.
+ *
+ */
+extern const unsigned int kDefaultWorkerThreads;
+
+/** @brief Default spin budget
+ *
+ * Number of polls a session spins on a backend before parking when
+ * `wait_mode` is `park`.
+ *
+ */
+extern const unsigned int kDefaultSpinBudget;
+
+/** @brief Default query trace
+ *
+ * Trace replayed by the log speculator. It is loaded once when the
+ * plugin is initialized and shared by all routes using the same file.
+ * Empty for none, which leaves the log speculator without speculations.
+ *
+ */
+extern const char *const kDefaultTraceFile;
+
+/** @brief Default query set of the model speculator
+ *
+ * One query template per line, after its id in the model.
+ *
+ */
+extern const char *const kDefaultQuerySetFile;
+
+/** @brief Default model of the model speculator
+ *
+ * Graph of query templates and the predictions of their arguments, in
+ * JSON or compiled by routing_convert_model, which is mapped instead of
+ * parsed. It is loaded once with its query set and shared by all routes
+ * using the same files.
+ *
+ */
+extern const char *const kDefaultModelFile;
+
+/** @brief Default interval of the model's online learning
+ *
+ * Milliseconds between merges of the prediction hits observed on live
+ * traffic into the model; 0 disables learning.
+ *
+ */
+extern const unsigned int kDefaultModelLearningInterval;
+
+/** @brief Default minimum of idle server groups per user and schema
+ *
+ * Number of authenticated server groups the pool keeps ready for every
+ * user and schema it has seen.
+ *
+ */
+extern const unsigned int kDefaultPoolMinIdle;
+
+/** @brief Default maximum of idle server groups per user and schema
+ *
+ * 0 disables the server group pool.
+ *
+ */
+extern const unsigned int kDefaultPoolMaxIdle;
+
+/** @brief Default lifetime of a pooled server group in seconds */
+extern const unsigned int kDefaultPoolMaxLifetime;
+
+/** @brief Default pipeline depth
+ *
+ * Number of requests, the client's query and speculations, a session
+ * keeps in flight on each server.
+ *
+ */
+extern const unsigned int kDefaultPipelineDepth;
+
+/** @brief Default hedging percentile
+ *
+ * A client read still unanswered after this percentile of recent read
+ * latencies is also sent to a second idle server. 0 disables hedging.
+ *
+ */
+extern const unsigned int kDefaultHedgePercentile;
+
+/** @brief Default size of the result cache
+ *
+ * Megabytes of read results shared by the sessions of a route. 0 disables
+ * the cache.
+ *
+ */
+extern const unsigned int kDefaultResultCacheSize;
+
+/** @brief Default cost of a wasted speculation
+ *
+ * Percentage of the latency of a query that a wrong speculation of it is
+ * counted as costing; a template is only speculated if it saves more than
+ * it wastes. 0 with kDefaultSpeculationMinConfidence 0 sends every
+ * speculation.
+ *
+ */
+extern const unsigned int kDefaultSpeculationWasteCost;
+
+/** @brief Default minimum hit rate of a speculated query template
+ *
+ * Percentage of predictions of a template that have to hit for it to be
+ * speculated.
+ *
+ */
+extern const unsigned int kDefaultSpeculationMinConfidence;
+
+/** @brief Default destinations reached over shared memory
+ *
+ * Comma separated subset of the destinations that run on this host
+ * behind a shared memory shim; the others are reached over RDMA.
+ *
+ */
+extern const char *const kDefaultShmDestinations;
+
+/** @brief Default number of RDMA completion queue pollers
+ *
+ * Threads per RDMA device polling the completion queues that all RDMA
+ * connections share; 0 is one per core.
+ *
+ */
+extern const unsigned int kDefaultRdmaPollerThreads;
+
+/** @brief Default busy poll time of an RDMA poller
+ *
+ * Microseconds a poller keeps polling its completion queue after the
+ * last completion before it waits for a completion event; 0 waits right
+ * away.
+ *
+ */
+extern const unsigned int kDefaultRdmaBusyPoll;
+
 /** @brief Modes supported by Routing plugin */
 enum class AccessMode {
   kUndefined = 0,
@@ -108,6 +245,74 @@ AccessMode get_access_mode(const std::string&);
  */
 std::string get_access_mode_name(AccessMode access_mode) noexcept;
 
+/** @brief How client sessions are driven by the Routing plugin */
+enum class IoMode {
+  kUndefined = 0,
+  kThreadPerConnection = 1,
+  kReactor = 2,
+};
+
+void get_io_mode_names(std::string*);
+IoMode get_io_mode(const std::string&);
+
+/** @brief Returns literal name of given I/O mode
+ *
+ * @param io_mode I/O mode to look up
+ * @return Name of I/O mode as std::string or empty string
+ */
+std::string get_io_mode_name(IoMode io_mode) noexcept;
+
+/** @brief How sessions wait for a backend response */
+enum class WaitMode {
+  kUndefined = 0,
+  kSpin = 1,
+  kPark = 2,
+};
+
+void get_wait_mode_names(std::string*);
+WaitMode get_wait_mode(const std::string&);
+
+/** @brief Returns literal name of given wait mode
+ *
+ * @param wait_mode Wait mode to look up
+ * @return Name of wait mode as std::string or empty string
+ */
+std::string get_wait_mode_name(WaitMode wait_mode) noexcept;
+
+/** @brief How a wrong write speculation is reverted */
+enum class RollbackMode {
+  kUndefined = 0,
+  kUndo = 1,       // inverse statement generated by the Undoer
+  kSavepoint = 2,  // SAVEPOINT before the write, ROLLBACK TO SAVEPOINT
+};
+
+void get_rollback_mode_names(std::string*);
+RollbackMode get_rollback_mode(const std::string&);
+
+/** @brief Returns literal name of given rollback mode
+ *
+ * @param rollback_mode Rollback mode to look up
+ * @return Name of rollback mode as std::string or empty string
+ */
+std::string get_rollback_mode_name(RollbackMode rollback_mode) noexcept;
+
+/** @brief Where the speculations of a session come from */
+enum class SpeculatorType {
+  kUndefined = 0,
+  kLog = 1,    // replay of the query trace
+  kModel = 2,  // predictions of a GraphModel on live traffic
+};
+
+void get_speculator_type_names(std::string*);
+SpeculatorType get_speculator_type(const std::string&);
+
+/** @brief Returns literal name of given speculator type
+ *
+ * @param speculator_type Speculator type to look up
+ * @return Name of speculator type as std::string or empty string
+ */
+std::string get_speculator_type_name(SpeculatorType speculator_type) noexcept;
+
 /**
  * Sets blocking flag for given socket
  *
@@ -131,6 +336,20 @@ class SocketOperationsBase {
   virtual void close(int fd) = 0;
   virtual void shutdown(int fd) = 0;
 
+  /** @brief Registers a notifier signalled when data arrives on fd
+   *
+   * Transports that cannot signal arrivals ignore this; waiters then rely
+   * on the park timeout of their WaitPolicy.
+   */
+  virtual void set_notifier(int /* fd */, Notifier * /* notifier */) {}
+
+  /** @brief Lets writes from buffer to fd skip the copy into the transport
+   *
+   * Transports that copy every write ignore this. The buffer has to stay
+   * allocated until fd is closed.
+   */
+  virtual void register_buffer(int /* fd */, void * /* buffer */, size_t /* size */) {}
+
   /** @brief Wrapper around socket library write() with a looping logic
    *         making sure the whole buffer got written
    */
@@ -224,6 +443,12 @@ class RdmaOperations : public SocketOperationsBase {
   /** @brief Check whether the connection has data to read */
   bool has_data(int fd) override;
 
+  /** @brief Signal notifier whenever data is pushed to the receive buffer */
+  void set_notifier(int fd, Notifier *notifier) override;
+
+  /** @brief Registers buffer as a memory region of the connection */
+  void register_buffer(int fd, void *buffer, size_t size) override;
+
   /** @brief Thin wrapper around RDMA library close() */
   void close(int fd)  override;
 
@@ -239,6 +464,119 @@ class RdmaOperations : public SocketOperationsBase {
   std::unordered_map<int, RdmaClient*> rdma_fds_;
 };
 
+/** @class ShmOperations
+ * @brief Reaches MySQL servers on this host over shared memory
+ *
+ * Connects to the shim serving the port of the destination, see
+ * ShmChannelName(). Descriptors are numbered from kFdBase so that they
+ * never clash with those of RdmaOperations.
+ */
+class ShmOperations : public SocketOperationsBase {
+ public:
+  static constexpr int kFdBase = 1 << 24;
+
+  static ShmOperations* instance();
+
+  /** @brief Whether fd is a descriptor of this transport */
+  static bool owns(int fd) {
+    return fd >= kFdBase;
+  }
+
+  /** @brief Returns descriptor of a shared memory channel to the MySQL server
+   *
+   * @param addr information of the server we connect with
+   * @param connect_timeout unused; the shim accepts right away or not at all
+   * @param log whether to log errors or not
+   * @return a descriptor, or -1 when no shim serves the port of addr
+   */
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, int connect_timeout, bool log = true) noexcept override;
+
+  /** @brief Sends one record towards the server, waiting for space */
+  ssize_t write(int fd, void *buffer, size_t nbyte) override;
+
+  /** @brief Reads the record of the next response, waiting for one */
+  ssize_t read(int fd, void *buffer, size_t nbyte) override;
+
+  /** @brief Check whether the channel is closed and drained */
+  bool has_error(int fd) override;
+
+  /** @brief Check whether the channel has data to read */
+  bool has_data(int fd) override;
+
+  /** @brief Closes the channel */
+  void close(int fd) override;
+
+  /** @brief Closes the channel */
+  void shutdown(int fd) override;
+ private:
+  ShmOperations(const ShmOperations&) = delete;
+  ShmOperations operator=(const ShmOperations&) = delete;
+  ShmOperations() : current_fd_(kFdBase) {}
+
+  std::shared_ptr<ShmChannel> channel(int fd);
+
+  std::shared_mutex mutex_;
+  int current_fd_;
+  std::unordered_map<int, std::shared_ptr<ShmChannel>> channels_;
+};
+
+/** @class BackendOperations
+ * @brief Picks the transport of each destination
+ *
+ * Destinations added with add_shm_destination() are reached through
+ * ShmOperations, all others through RdmaOperations; every other call
+ * goes to the transport that owns the descriptor.
+ */
+class BackendOperations : public SocketOperationsBase {
+ public:
+
+  static BackendOperations* instance();
+
+  /** @brief Reaches addr over shared memory from now on */
+  void add_shm_destination(const mysqlrouter::TCPAddress &addr);
+
+  int get_mysql_socket(mysqlrouter::TCPAddress addr, int connect_timeout, bool log = true) noexcept override;
+
+  ssize_t write(int fd, void *buffer, size_t nbyte) override {
+    return operations(fd)->write(fd, buffer, nbyte);
+  }
+  ssize_t read(int fd, void *buffer, size_t nbyte) override {
+    return operations(fd)->read(fd, buffer, nbyte);
+  }
+  bool has_error(int fd) override {
+    return operations(fd)->has_error(fd);
+  }
+  bool has_data(int fd) override {
+    return operations(fd)->has_data(fd);
+  }
+  void set_notifier(int fd, Notifier *notifier) override {
+    operations(fd)->set_notifier(fd, notifier);
+  }
+  void register_buffer(int fd, void *buffer, size_t size) override {
+    operations(fd)->register_buffer(fd, buffer, size);
+  }
+  void close(int fd) override {
+    operations(fd)->close(fd);
+  }
+  void shutdown(int fd) override {
+    operations(fd)->shutdown(fd);
+  }
+ private:
+  BackendOperations(const BackendOperations&) = delete;
+  BackendOperations operator=(const BackendOperations&) = delete;
+  BackendOperations() = default;
+
+  SocketOperationsBase *operations(int fd) {
+    if (ShmOperations::owns(fd)) {
+      return ShmOperations::instance();
+    }
+    return RdmaOperations::instance();
+  }
+
+  std::shared_mutex mutex_;
+  std::vector<mysqlrouter::TCPAddress> shm_destinations_;
+};
+
 } // namespace routing
 
 #endif // MYSQLROUTER_ROUTING_INCLUDED
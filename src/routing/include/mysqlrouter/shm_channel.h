@@ -0,0 +1,96 @@
+#ifndef UTILS_SHM_CHANNEL_H_
+#define UTILS_SHM_CHANNEL_H_
+
+#include "notifier.h"
+#include "status.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+const size_t kDefaultShmRingSize = 1 << 22;
+
+// The name a shim serving the MySQL server on port listens on.
+std::string ShmChannelName(int port);
+
+// A connection between two processes on one host over a shared memory
+// segment, with a ring per direction. Each Write() is a record of its
+// own, so that a reader gets back what one Write() sent, as it would
+// over RDMA. Readers and writers that have to wait park on
+// process-shared futexes in the segment.
+//
+// The connecting side creates the segment and hands it to the listening
+// side over a Unix socket in the abstract namespace, which is used for
+// nothing else; the segment goes away once both sides unmapped it.
+class ShmChannel {
+public:
+  ShmChannel(const ShmChannel &other) = delete;
+  ShmChannel &operator=(const ShmChannel &other) = delete;
+  ~ShmChannel();
+
+  // Connects to the listener called name; nullptr if there is none.
+  static std::unique_ptr<ShmChannel> Connect(const std::string &name,
+                                             size_t ring_size = kDefaultShmRingSize);
+
+  void SetWaitPolicy(const WaitPolicy &policy) {
+    wait_policy_ = policy;
+  }
+  // Sends data as one record, which may be empty, blocking until all of
+  // it is in the ring. -1 once closed.
+  ssize_t Write(const void *data, size_t size);
+  // Blocks for the next record and returns up to size bytes of it; what
+  // does not fit comes with the next calls. 0 for an empty record, -1
+  // once closed and drained.
+  ssize_t Read(void *buffer, size_t size);
+  bool HasData();
+  // Closed by either side, with nothing left to read.
+  bool HasError();
+  void Close();
+
+private:
+  struct Ring;
+  struct Segment;
+
+  ShmChannel(Segment *segment, size_t map_size, bool connector);
+
+  bool WriteBytes(const struct iovec *pieces, int num_pieces);
+  // False if closed before all of size arrived.
+  bool ReadBytes(char *buffer, size_t size);
+
+  Segment *segment_;
+  size_t map_size_;
+  Ring *in_;
+  Ring *out_;
+  char *in_data_;
+  char *out_data_;
+  WaitPolicy wait_policy_;
+  // Bytes of the record being read that are still in the ring.
+  uint64_t record_left_;
+
+  friend class ShmListener;
+};
+
+// The listening side of ShmChannel, as run by a server-side shim.
+class ShmListener {
+public:
+  explicit ShmListener(std::string name);
+  ShmListener(const ShmListener &other) = delete;
+  ShmListener &operator=(const ShmListener &other) = delete;
+  ~ShmListener();
+
+  Status Listen();
+  // Blocks for the next connection, skipping those that hand over a bad
+  // segment; nullptr once closed.
+  std::unique_ptr<ShmChannel> Accept();
+  void Close();
+
+private:
+  std::string name_;
+  std::atomic<int> fd_;
+};
+
+#endif // UTILS_SHM_CHANNEL_H_
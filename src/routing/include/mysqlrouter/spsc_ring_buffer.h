@@ -1,18 +1,32 @@
 #ifndef UTILS_SPSC_RING_BUFFER_H_
 #define UTILS_SPSC_RING_BUFFER_H_
 
+#include "notifier.h"
+
 #include <atomic>
 #include <memory>
 
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
 const uint32_t kDefaultBufferSize = 1e+7;
+// Holds a record of the largest size an RDMA message can have.
+const size_t kDefaultRecordBufferSize = 1 << 25;
 
 class SpscRingBuffer {
 public:
   SpscRingBuffer() : SpscRingBuffer(kDefaultBufferSize) {}
   SpscRingBuffer(size_t buf_size);
-  void SignalError() {
-    error_ = true;
+  void SetWaitPolicy(const WaitPolicy &policy) {
+    wait_policy_ = policy;
   }
+  // An additional notifier signalled whenever data arrives, so that a
+  // reader waiting on several buffers can park on a single notifier.
+  void SetNotifier(Notifier *notifier) {
+    notifier_.store(notifier);
+  }
+  void SignalError();
   void ClearError() {
     error_ = false;
   }
@@ -31,11 +45,111 @@ private:
     return buffer_.get() + loc;
   }
 
-  bool error_;
+  void NotifyData();
+
+  std::atomic<bool> error_;
+  WaitPolicy wait_policy_;
+  Notifier data_notifier_;
+  Notifier space_notifier_;
+  std::atomic<Notifier *> notifier_;
   std::atomic<size_t> read_loc_;
   std::atomic<size_t> write_loc_;
   size_t buf_size_;
   std::unique_ptr<char[]> buffer_;
 };
 
+// A single-producer single-consumer queue of records: each Write() is
+// read back whole and on its own, in place. The ring is mapped twice,
+// back to back, so that a record is contiguous even where it wraps.
+// Each side's cursor sits on a cache line of its own with the side's
+// copy of the other cursor, which it only reloads when the copy says the
+// ring is full, or empty.
+class SpscRecordBuffer {
+public:
+  static constexpr size_t kHeaderSize = 8;
+
+  SpscRecordBuffer() : SpscRecordBuffer(kDefaultRecordBufferSize) {}
+  // buf_size is rounded up to a power of two.
+  explicit SpscRecordBuffer(size_t buf_size);
+  SpscRecordBuffer(const SpscRecordBuffer &other) = delete;
+  SpscRecordBuffer &operator=(const SpscRecordBuffer &other) = delete;
+  ~SpscRecordBuffer();
+
+  void SetWaitPolicy(const WaitPolicy &policy) {
+    wait_policy_ = policy;
+  }
+  void SetNotifier(Notifier *notifier) {
+    notifier_.store(notifier);
+  }
+  void SignalError();
+  void ClearError() {
+    error_ = false;
+  }
+  bool HasError() {
+    return error_;
+  }
+  size_t MaxRecordSize() const {
+    return capacity_ - kHeaderSize;
+  }
+
+  // Producer side. Copies data into a record, waiting for space. Returns
+  // false on error or if the record is larger than MaxRecordSize().
+  bool Write(const char *data, size_t size);
+
+  // Consumer side, for the rest.
+  bool HasData() {
+    return read_offset_ > 0 || peek_ != cached_tail_ ||
+        peek_ != (cached_tail_ = tail_.load(std::memory_order_acquire));
+  }
+  // Waits for the record after those peeked so far and points data at
+  // it. Returns false on error.
+  bool Peek(const char **data, size_t *size);
+  // Like Peek(), but returns false right away if there is no record.
+  bool TryPeek(const char **data, size_t *size);
+  // Releases the records peeked so far to the producer.
+  void Commit();
+  // Calls visit(data, size) on up to max_records records there are, and
+  // releases them all at once. Returns how many it visited.
+  template<typename Visitor>
+  size_t Consume(Visitor visit, size_t max_records) {
+    const char *data;
+    size_t size;
+    size_t count = 0;
+    while (count < max_records && TryPeek(&data, &size)) {
+      visit(data, size);
+      count++;
+    }
+    if (count > 0) {
+      Commit();
+    }
+    return count;
+  }
+  // Copies out the next record, or as much of it as fits, for readers of
+  // a byte stream; never two records at once. Not to be mixed with
+  // Peek() between commits.
+  ssize_t Read(void *buffer, ssize_t size);
+
+private:
+  void NotifyData();
+
+  alignas(64) std::atomic<uint64_t> head_;
+  uint64_t cached_tail_;
+  uint64_t peek_;
+  const char *record_;
+  size_t record_size_;
+  size_t read_offset_;
+
+  alignas(64) std::atomic<uint64_t> tail_;
+  uint64_t cached_head_;
+
+  alignas(64) std::atomic<bool> error_;
+  WaitPolicy wait_policy_;
+  Notifier data_notifier_;
+  Notifier space_notifier_;
+  std::atomic<Notifier *> notifier_;
+  size_t capacity_;
+  uint64_t mask_;
+  char *buffer_;
+};
+
 #endif // UTILS_SPSC_RING_BUFFER_H_
@@ -10,7 +10,12 @@
 using routing::SocketOperationsBase;
 
 Connection::Connection(int fd, SocketOperationsBase *sock_ops) : fd_(fd), packet_number_(0),
-    buffer_(new uint8_t[kBufferSize]), buf_(buffer_.get()), sock_ops_(sock_ops) {}
+    buffer_(new uint8_t[kBufferSize]), buf_(buffer_.get()), sock_ops_(sock_ops) {
+  // Queries are built in the buffer; the transport may send them from it.
+  if (fd_ >= 0) {
+    sock_ops_->register_buffer(fd_, buf_, kBufferSize);
+  }
+}
 
 Connection::Connection(Connection &&other) : fd_(other.fd_), packet_number_(other.packet_number_),
     buffer_(std::move(other.buffer_)), buf_(other.buf_), sock_ops_(other.sock_ops_) {
@@ -1,13 +1,16 @@
 #include "mysqlrouter/context.h"
 
 Context::~Context() {
+  if (poller != nullptr) {
+    poller->Remove(queue_pair->qp_num, num_cqes);
+  }
   rdma_destroy_qp(id);
   ibv_dereg_mr(recv_mr);
   ibv_dereg_mr(send_mr);
+  for (auto mr : buffer_mrs) {
+    ibv_dereg_mr(mr);
+  }
   rdma_destroy_id(id);
 
-  cq_poller_thread.detach();
-
-  delete recv_region;
   delete send_region;
 }
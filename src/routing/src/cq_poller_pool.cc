@@ -0,0 +1,212 @@
+#include "mysqlrouter/cq_poller_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+// Room for the outstanding work requests of tens of queue pairs; a
+// poller takes no more queue pairs than fit.
+static const int kCqSize = 1 << 18;
+static const int kPollBatchSize = 32;
+
+// Set once from the routing configuration before any connection is made.
+static size_t num_threads_per_device = 0;
+static uint32_t busy_poll_budget_us = 0;
+
+namespace {
+
+class VerbsCompletionQueue : public CompletionQueue {
+public:
+  VerbsCompletionQueue(struct ibv_comp_channel *channel, struct ibv_cq *cq) :
+      channel_(channel), cq_(cq) {}
+
+  struct ibv_cq *cq() override {
+    return cq_;
+  }
+  int Size() override {
+    return cq_->cqe;
+  }
+  int Poll(int max, struct ibv_wc *wcs) override {
+    return ibv_poll_cq(cq_, max, wcs);
+  }
+  bool Arm() override {
+    return ibv_req_notify_cq(cq_, 0) == 0;
+  }
+  bool Wait() override {
+    struct ibv_cq *event_cq;
+    void *event_context;
+    if (ibv_get_cq_event(channel_, &event_cq, &event_context) != 0) {
+      return false;
+    }
+    ibv_ack_cq_events(event_cq, 1);
+    return true;
+  }
+
+private:
+  struct ibv_comp_channel *channel_;
+  struct ibv_cq *cq_;
+};
+
+} // namespace
+
+CqPoller::CqPoller(std::unique_ptr<CompletionQueue> completion_queue, Handler handler,
+                   uint32_t busy_poll_us) :
+    completion_queue_(std::move(completion_queue)), handler_(std::move(handler)),
+    busy_poll_us_(busy_poll_us), num_reserved_(0) {}
+
+std::unique_ptr<CqPoller> CqPoller::Create(struct ibv_context *device, Handler handler,
+                                           uint32_t busy_poll_us) {
+  int cq_size = kCqSize;
+  struct ibv_device_attr attr;
+  if (ibv_query_device(device, &attr) == 0) {
+    cq_size = std::min(cq_size, attr.max_cqe);
+  }
+  struct ibv_comp_channel *channel = ibv_create_comp_channel(device);
+  if (channel == nullptr) {
+    return nullptr;
+  }
+  struct ibv_cq *cq = ibv_create_cq(device, cq_size, nullptr, channel, 0);
+  if (cq == nullptr) {
+    ibv_destroy_comp_channel(channel);
+    return nullptr;
+  }
+  std::unique_ptr<CqPoller> poller(new CqPoller(
+      std::unique_ptr<CompletionQueue>(new VerbsCompletionQueue(channel, cq)),
+      std::move(handler), busy_poll_us));
+  std::thread(&CqPoller::Run, poller.get()).detach();
+  return poller;
+}
+
+bool CqPoller::Reserve(int num_cqes) {
+  int reserved = num_reserved_.load(std::memory_order_relaxed);
+  do {
+    if (reserved + num_cqes > completion_queue_->Size()) {
+      return false;
+    }
+  } while (!num_reserved_.compare_exchange_weak(reserved, reserved + num_cqes,
+                                                std::memory_order_relaxed));
+  return true;
+}
+
+void CqPoller::Release(int num_cqes) {
+  num_reserved_.fetch_sub(num_cqes, std::memory_order_relaxed);
+}
+
+void CqPoller::Add(uint32_t qp_num, Context *context) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  contexts_[qp_num] = context;
+}
+
+void CqPoller::Remove(uint32_t qp_num, int num_cqes) {
+  {
+    // Waits for a batch being dispatched to the context.
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    contexts_.erase(qp_num);
+  }
+  Release(num_cqes);
+}
+
+void CqPoller::Dispatch(struct ibv_wc *wcs, int num_wcs) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  for (int i = 0; i < num_wcs; i++) {
+    auto iter = contexts_.find(wcs[i].qp_num);
+    // Completions of a queue pair already removed are dropped.
+    if (iter != contexts_.end()) {
+      handler_(iter->second, &wcs[i]);
+    }
+  }
+}
+
+void CqPoller::Run() {
+  struct ibv_wc wcs[kPollBatchSize];
+  auto busy_poll = std::chrono::microseconds(busy_poll_us_);
+  auto last_completion = std::chrono::steady_clock::now();
+
+  while (true) {
+    int num_wcs = completion_queue_->Poll(kPollBatchSize, wcs);
+    if (num_wcs < 0) {
+      std::cerr << "CqPoller: failed to poll the completion queue" << std::endl;
+      return;
+    }
+    if (num_wcs > 0) {
+      Dispatch(wcs, num_wcs);
+      last_completion = std::chrono::steady_clock::now();
+      continue;
+    }
+    if (busy_poll_us_ > 0 && std::chrono::steady_clock::now() - last_completion < busy_poll) {
+      continue;
+    }
+    // Armed before polling once more, so that a completion in between
+    // still raises an event.
+    if (!completion_queue_->Arm()) {
+      std::cerr << "CqPoller: failed to request completion events" << std::endl;
+      return;
+    }
+    num_wcs = completion_queue_->Poll(kPollBatchSize, wcs);
+    if (num_wcs > 0) {
+      Dispatch(wcs, num_wcs);
+      last_completion = std::chrono::steady_clock::now();
+      continue;
+    }
+    if (!completion_queue_->Wait()) {
+      std::cerr << "CqPoller: failed to get a completion event" << std::endl;
+      return;
+    }
+    last_completion = std::chrono::steady_clock::now();
+  }
+}
+
+void CqPollerPool::Configure(size_t num_threads, uint32_t busy_poll_us) {
+  num_threads_per_device = num_threads;
+  busy_poll_budget_us = busy_poll_us;
+}
+
+CqPollerPool *CqPollerPool::instance() {
+  // Never destroyed: its threads poll until the process exits.
+  static CqPollerPool *instance_ = new CqPollerPool;
+  return instance_;
+}
+
+CqPoller *CqPollerPool::Assign(struct ibv_context *device, int num_cqes,
+                               CqPoller::Handler handler) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = devices_[device];
+  if (!entry) {
+    size_t num_threads = num_threads_per_device;
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::unique_ptr<Device> created(new Device);
+    created->next = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+      auto poller = CqPoller::Create(device, handler, busy_poll_budget_us);
+      if (!poller) {
+        break;
+      }
+      created->pollers.push_back(std::move(poller));
+    }
+    if (created->pollers.empty()) {
+      devices_.erase(device);
+      return nullptr;
+    }
+    entry = std::move(created);
+  }
+
+  size_t num_pollers = entry->pollers.size();
+  for (size_t i = 0; i < num_pollers; i++) {
+    CqPoller *poller = entry->pollers[entry->next++ % num_pollers].get();
+    if (poller->Reserve(num_cqes)) {
+      return poller;
+    }
+  }
+  // Every completion queue is full.
+  auto poller = CqPoller::Create(device, std::move(handler), busy_poll_budget_us);
+  if (!poller) {
+    return nullptr;
+  }
+  // Kept even if too small for the queue pair, as its thread runs on.
+  entry->pollers.push_back(std::move(poller));
+  CqPoller *created = entry->pollers.back().get();
+  return created->Reserve(num_cqes) ? created : nullptr;
+}
@@ -0,0 +1,22 @@
+#include "latency_window.h"
+
+#include <algorithm>
+
+void LatencyWindow::Record(std::chrono::steady_clock::duration latency) {
+  if (samples_.size() < kSize) {
+    samples_.push_back(latency);
+  } else {
+    samples_[next_] = latency;
+  }
+  next_ = (next_ + 1) % kSize;
+}
+
+std::chrono::steady_clock::duration LatencyWindow::Percentile(unsigned int percentile) const {
+  if (samples_.size() < kMinSamples) {
+    return std::chrono::steady_clock::duration::max();
+  }
+  auto sorted = samples_;
+  size_t rank = std::min(sorted.size() - 1, sorted.size() * std::min(percentile, 100u) / 100);
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  return sorted[rank];
+}
@@ -0,0 +1,28 @@
+#ifndef ROUTING_SRC_LATENCY_WINDOW_H_
+#define ROUTING_SRC_LATENCY_WINDOW_H_
+
+#include <chrono>
+#include <vector>
+
+// The last kSize latencies recorded, for percentile estimates.
+class LatencyWindow {
+public:
+  static constexpr size_t kSize = 128;
+  // Fewer samples than this are not trusted for a percentile.
+  static constexpr size_t kMinSamples = 16;
+
+  LatencyWindow() : next_(0) {}
+
+  void Record(std::chrono::steady_clock::duration latency);
+  size_t NumSamples() const {
+    return samples_.size();
+  }
+  // percentile in [0, 100]; duration::max() with too few samples.
+  std::chrono::steady_clock::duration Percentile(unsigned int percentile) const;
+
+private:
+  std::vector<std::chrono::steady_clock::duration> samples_;
+  size_t next_;
+};
+
+#endif // ROUTING_SRC_LATENCY_WINDOW_H_
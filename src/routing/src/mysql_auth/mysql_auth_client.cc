@@ -175,19 +175,34 @@ static void store_client_information(MySQLSession *session, uint8_t *data, size_
   }
 }
 
-std::unique_ptr<MySQLSession> AuthenticateClient(Connection *client) {
+std::unique_ptr<MySQLSession> StartClientHandshake(Connection *client) {
   log_debug("Sending authenticate packet ");
   auto session = MySQLHandshake(client);
   if (session.get() == nullptr) {
     log_error("Error sending authenticate packet");
     return nullptr;
   }
+  return std::move(session);
+}
+
+bool FinishClientHandshake(MySQLSession *session, Connection *client) {
   log_debug("Reading client response");
   ssize_t size = client->Recv();
   if (size <= 0) {
     log_error("Error receiving client response");
+    return false;
+  }
+  store_client_information(session, client->Buffer(), size);
+  return true;
+}
+
+std::unique_ptr<MySQLSession> AuthenticateClient(Connection *client) {
+  auto session = StartClientHandshake(client);
+  if (session.get() == nullptr) {
+    return nullptr;
+  }
+  if (!FinishClientHandshake(session.get(), client)) {
     return nullptr;
   }
-  store_client_information(session.get(), client->Buffer(), size);
   return std::move(session);
 }
\ No newline at end of file
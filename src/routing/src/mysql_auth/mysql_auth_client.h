@@ -5,4 +5,9 @@
 
 std::unique_ptr<MySQLSession> AuthenticateClient(Connection *connection);
 
+// Split form of AuthenticateClient() for callers that wait for the
+// client's handshake response on their own (e.g. the reactor).
+std::unique_ptr<MySQLSession> StartClientHandshake(Connection *connection);
+bool FinishClientHandshake(MySQLSession *session, Connection *connection);
+
 #endif // MYSQL_AUTH_MYSQL_AUTH_CLIENT_H_
\ No newline at end of file
@@ -96,6 +96,17 @@ static char *strend(register const char *s)
 //   return 0;
 // }
 
+bool SendBackendAuth(MySQLSession *session, Connection *connection) {
+  // log_debug("Decoding server response");
+  // decode_mysql_server_handshake(session, connection->Buffer());
+  strcpy(session->user, "root");
+  if(send_backend_auth(session, connection) == AUTH_STATE_FAILED) {
+    log_error("Authentication returns failure");
+    return false;
+  }
+  return true;
+}
+
 int AuthWithBackendServers(MySQLSession *session, Connection *connection) {
   log_debug("Authenticating with server %d", connection->FileDescriptor());
   ssize_t size = 0;
@@ -104,11 +115,7 @@ int AuthWithBackendServers(MySQLSession *session, Connection *connection) {
     log_error("Failed to read auth packet from server");
     return -1;
   }
-  // log_debug("Decoding server response");
-  // decode_mysql_server_handshake(session, connection->Buffer());
-  strcpy(session->user, "root");
-  if(send_backend_auth(session, connection) == AUTH_STATE_FAILED) {
-    log_error("Authentication returns failure");
+  if (!SendBackendAuth(session, connection)) {
     return 0;
   }
   return static_cast<int>(connection->Recv());
@@ -5,4 +5,7 @@
 
 int AuthWithBackendServers(MySQLSession *session, Connection *connection);
 
+// Sends the auth packet once the server's greeting is in the buffer.
+bool SendBackendAuth(MySQLSession *session, Connection *connection);
+
 #endif // MYSQL_AUTH_MYSQL_SERVER_H_
\ No newline at end of file
@@ -23,13 +23,16 @@
 #include "dest_metadata_cache.h"
 #include "logger.h"
 #include "mysql_routing.h"
+#include "mysqlrouter/cq_poller_pool.h"
 #include "mysqlrouter/metadata_cache.h"
 #include "mysqlrouter/routing.h"
 #include "mysqlrouter/uri.h"
 #include "mysqlrouter/utils.h"
 #include "plugin_config.h"
 #include "protocol/protocol.h"
+#include "query_utils.h"
 #include "speculator/log_speculator.h"
+#include "speculator/model_speculator.h"
 
 #include <algorithm>
 #include <array>
@@ -79,191 +82,24 @@ using mysqlrouter::URIQuery;
 using mysqlrouter::TCPAddress;
 using mysqlrouter::is_valid_socket_name;
 
-using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
-
 namespace {
 
 int kListenQueueSize = 1024;
 
 const char *kDefaultReplicaSetName = "default";
 const int kAcceptorStopPollInterval_ms = 1000;
-const int kNumIndexDigits = 10;
-const int kNumIdDigits = 10;
-const size_t kSavepointResultBytes = 11;
-
-uint8_t kOkPacket[] = {7, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0};
-
-thread_local int speculation_index = -1;
-std::vector<long> speculation_latency;
-
-void DumpQueryStats(std::vector<std::string> &query_stats,
-                    const std::string &filename) {
-  std::ofstream outfile(filename);
-  for (size_t i = 0; i < query_stats.size(); i++) {
-    auto stat = query_stats[i];
-    outfile << stat << std::endl;
-  }
-}
-
-double Mean(const std::vector<long> &latencies) {
-  double mean = 0;
-  double i = 1;
-  for (auto latency : latencies) {
-    mean += (latency - mean) / i;
-    i++;
-  }
-  return mean;
-}
-
-void DumpLatency(std::vector<std::pair<int, long>> &latencies, const std::string &latency_name) {
-  std::ofstream outfile(latency_name);
-  for (auto &pair : latencies) {
-    outfile << pair.first << ' ' << pair.second << std::endl;
+std::unique_ptr<Speculator> CreateSpeculator(ServerGroup *server_group,
+                                             std::shared_ptr<const TraceStore> trace_store,
+                                             std::shared_ptr<const model::GraphModel> graph_model,
+                                             SchemaCatalog *schema_catalog,
+                                             routing::RollbackMode rollback_mode) {
+  bool use_savepoints = rollback_mode == routing::RollbackMode::kSavepoint;
+  if (graph_model) {
+    return std::unique_ptr<Speculator>(new ModelSpeculator(
+        Undoer(server_group, schema_catalog), std::move(graph_model), use_savepoints));
   }
-}
-
-TimePoint Now() {
-  return std::chrono::high_resolution_clock::now();
-}
-
-long GetDuration(TimePoint &start) {
-  auto end = Now();
-  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-  return static_cast<long>(duration.count());
-}
-
-bool IsQuery(uint8_t *buffer) {
-  return buffer[kMySQLHeaderLen] == static_cast<uint8_t>(COM_QUERY);
-}
-
-int ExtractQueryIndex(const char *buffer) {
-  return atoi(buffer);
-}
-
-int ExtractQueryId(const char *buffer) {
-  return atoi(buffer + kNumIndexDigits);
-}
-
-void ExtractQuery(
-    uint8_t *buffer, std::string &query,
-    int &query_index, int &query_id) {
-  size_t query_size = mysql_get_byte3(buffer) - 1;
-  char *query_buffer = reinterpret_cast<char *>(buffer + kMySQLHeaderLen + 1);
-  query_index = -1;
-  query_id = -1;
-  if (isdigit(query_buffer[0])) {
-    query_index = ExtractQueryIndex(query_buffer);
-    query_id = ExtractQueryId(query_buffer);
-    query_buffer += kNumIndexDigits + kNumIdDigits;
-    query_size -= kNumIndexDigits + kNumIdDigits;
-  }
-  query = std::string(query_buffer, query_size);
-}
-
-int ExtractID(const std::string &query) {
-  // ID=[id] (no square bracket)
-  return atoi(query.c_str() + 2);
-}
-
-std::string ToLower(const std::string &query) {
-  std::string lower = query;
-  std::transform(lower.begin(), lower.end(), lower.begin(), tolower);
-  return std::move(lower);
-}
-
-bool IsRead(const std::string &query) {
-  auto lower = ToLower(query);
-  return lower.find("select") == 0 || lower.find("show") == 0;
-}
-
-bool IsWrite(const std::string &query) {
-  return !IsRead(query);
-}
-
-void SetNeedRollback(std::vector<bool> &need_rollback, bool need) {
-  for (size_t i = 0; i < need_rollback.size(); i++) {
-    need_rollback[i] = need;
-  }
-}
-
-// The reserved_server is necessary because there may be a gap between
-// checking the result has arrived and the checks below.
-bool DoSpeculation(
-  const std::string &query,
-  ServerGroup *server_group,
-  int reserved_server,
-  Speculator *speculator,
-  std::vector<bool> &need_rollback,
-  std::unordered_map<std::string, int> &prefetches) {
-  auto start = Now();
-  prefetches.clear();
-  speculator->TrySpeculate(query, 1);
-  auto speculations = speculator->Speculate(query);
-  if (speculations.size() == 0) {
-    speculation_latency.push_back(GetDuration(start));
-    return true;
-  }
-  bool done = false;
-  auto speculation = speculations[0];
-  auto query_to_send = speculation;
-  auto undo = speculator->GetUndo();
-  speculator->BackupFor(speculation);
-  done = false;
-  if (IsRead(speculation)) {
-    while (!done) {
-      for (size_t i = 0; i < server_group->Size(); i++) {
-        auto index = static_cast<int>(i);
-        if (index == reserved_server ||
-            !server_group->IsReadyForQuery(i)) {
-          continue;
-        }
-        int num_queries = 1;
-        if (need_rollback[i]) {
-          if (undo.size() > 0) {
-            query_to_send = undo + "; " + speculation;
-            num_queries = 2;
-          }
-          need_rollback[i] = false;
-        }
-        log_debug("Sending speculation %s to server %d", query_to_send.c_str(), i);
-        if (!server_group->SendQuery(i, query_to_send, num_queries)) {
-            log_error("Failed to send speculation to server %lu", i);
-          return false;
-        }
-        prefetches[speculation] = index;
-        done = true;
-        break;
-      }
-    }
-  } else {
-    for (size_t i = 0; i < server_group->Size(); i++) {
-      int num_queries = 1;
-      server_group->WaitForServer(i);
-      if (need_rollback[i]) {
-        if (undo.size() > 0) {
-          query_to_send = undo + "; " + speculation;
-          num_queries = 2;
-        } else {
-          query_to_send = speculation;
-        }
-        need_rollback[i] = false;
-      }
-      log_debug("Sending speculation %s to server %d", query_to_send.c_str(), i);
-      if (!server_group->SendQuery(i, query_to_send, num_queries)) {
-        log_error("Failed to send write speculation to server %lu", i);
-        return false;
-      }
-    }
-    prefetches[speculation] = 0;
-  }
-  log_debug("Speculation sent");
-  speculation_latency.push_back(GetDuration(start));
-  return true;
-}
-
-size_t CopyToClient(std::pair<uint8_t*, size_t> &&result, Connection *client) {
-  memcpy(client->Buffer(), result.first, result.second);
-  return result.second;
+  return std::unique_ptr<Speculator>(new LogSpeculator(
+      Undoer(server_group, schema_catalog), std::move(trace_store), use_savepoints));
 }
 
 bool HandleNonQuery(ServerGroup *server_group, Connection *client,
@@ -293,43 +129,46 @@ bool HandleNonQuery(ServerGroup *server_group, Connection *client,
 
 ssize_t HandleSpeculationHit(ServerGroup *server_group,
                           const std::string &query,
-                          int server_index,
+                          StatementType type,
+                          const Prefetch &prefetch,
                           Connection *client,
                           Speculator *speculator,
                           std::vector<bool> &need_rollback,
-                          std::unordered_map<std::string, int> &prefetches) {
+                          Prefetches &prefetches,
+                          ResultCacheClient *result_cache,
+                          SpeculationThrottle *throttle) {
   int server_for_current_query = -1;
   size_t packet_size = 0;
   log_debug("Prediction hits, check for result");
-  if (server_group->IsReadyForQuery(server_index)) {
+  if (server_group->IsResultReady(prefetch.server, prefetch.request)) {
     // Result has been received
     log_debug("Result has already arrived");
-    packet_size = CopyToClient(server_group->GetResult(server_index), client);
+    packet_size = CopyToClient(server_group->GetResult(prefetch.server, prefetch.request), client);
   } else {
     log_debug("Result is pending");
-    server_for_current_query = server_index;
+    server_for_current_query = prefetch.server;
   }
-  if (IsWrite(query)) {
+  if (!IsReadStatement(type)) {
     if (server_for_current_query != -1) {
       log_debug("Waiting for result");
-      server_group->WaitForServer(server_for_current_query);
-      packet_size = CopyToClient(server_group->GetResult(server_for_current_query), client);
+      server_group->WaitForResult(prefetch.server, prefetch.request);
+      packet_size = CopyToClient(server_group->GetResult(prefetch.server, prefetch.request), client);
     }
     log_debug("Sending speculations");
-    if (!DoSpeculation(query, server_group, -1, speculator,
-                       need_rollback, prefetches)) {
+    if (!DoSpeculation(query, type, server_group, -1, speculator,
+                       need_rollback, prefetches, result_cache, throttle)) {
       return -1;
     }
   } else {
     log_debug("Sending speculations");
-    if (!DoSpeculation(query, server_group, server_for_current_query,
-                       speculator, need_rollback, prefetches)) {
+    if (!DoSpeculation(query, type, server_group, server_for_current_query,
+                       speculator, need_rollback, prefetches, result_cache, throttle)) {
       return -1;
     }
     if (server_for_current_query != -1) {
       log_debug("Waiting for result");
-      server_group->WaitForServer(server_for_current_query);
-      packet_size = CopyToClient(server_group->GetResult(server_for_current_query), client);
+      server_group->WaitForResult(prefetch.server, prefetch.request);
+      packet_size = CopyToClient(server_group->GetResult(prefetch.server, prefetch.request), client);
     }
   }
   log_debug("Send results back to client");
@@ -342,36 +181,39 @@ ssize_t HandleSpeculationHit(ServerGroup *server_group,
 
 ssize_t HandleSpeculationMiss(ServerGroup *server_group,
                               const std::string &query,
+                              StatementType type,
                               Connection *client,
                               Speculator *speculator,
                               std::vector<bool> &need_rollback,
-                              std::unordered_map<std::string, int> &prefetches) {
+                              Prefetches &prefetches,
+                              ResultCacheClient *result_cache,
+                              SpeculationThrottle *throttle) {
   int server = -1;
   ssize_t packet_size;
   bool speculation_is_write = false;
-  auto next_speculation = speculator->TrySpeculate(query, 1);
+  auto next_speculation = speculator->TrySpeculate(query, server_group->Capacity());
   if (next_speculation.size() > 0 && IsWrite(next_speculation[0])) {
     speculation_is_write = true;
   }
   bool previous_is_write = false;
   auto query_to_send = query;
-  auto undo = speculator->GetUndo();
   int num_queries = 1;
+  std::string undo;
   SetNeedRollback(need_rollback, false);
-  for (auto &speculation : prefetches) {
-    if (IsWrite(speculation.first)) {
-      previous_is_write = true;
-      SetNeedRollback(need_rollback, true);
-      if (undo.size() > 0) {
-        query_to_send = undo + "; " + query;
-        num_queries = 2;
-      }
-      break;
+  if (HasWritePrefetch(prefetches)) {
+    previous_is_write = true;
+    SetNeedRollback(need_rollback, true);
+    // Only now is the undo built, pre-image and all.
+    undo = speculator->GetUndo();
+    if (undo.size() > 0) {
+      query_to_send = undo + "; " + query;
+      num_queries = 2;
     }
   }
   // Prediction not hit, send it now.
   log_debug("Prediction fails");
-  if (IsWrite(query)) {
+  result_cache->OnSend(query_to_send);
+  if (!IsReadStatement(type)) {
     server_group->WaitForAll();
     if (previous_is_write) {
       SetNeedRollback(need_rollback, false);
@@ -389,13 +231,16 @@ ssize_t HandleSpeculationMiss(ServerGroup *server_group,
       return -1;
     }
     packet_size = CopyToClient(server_group->GetResult(server), client);
-    if (!DoSpeculation(query, server_group, -1, speculator,
-                       need_rollback, prefetches)) {
+    if (!DoSpeculation(query, type, server_group, -1, speculator,
+                       need_rollback, prefetches, result_cache, throttle)) {
       log_error("Failed to send speculations");
       return -1;
     }
   } else {
-    server = server_group->GetAvailableServer();
+    server = server_group->SelectServer();
+    if (server < 0) {
+      server = server_group->GetAvailableServer();
+    }
     if (server < 0) {
       log_error("Failed to get available server");
       return -1;
@@ -403,31 +248,41 @@ ssize_t HandleSpeculationMiss(ServerGroup *server_group,
     if (previous_is_write) {
       need_rollback[server] = false;
     }
-    log_debug("Sending query %s to server %d", query_to_send.c_str(), server);
-    if (!server_group->SendQuery(server, query_to_send, num_queries)) {
+    // The server may still be busy with speculations, so the undo is a
+    // request of its own rather than a statement the transport skips.
+    if (undo.size() > 0 && !server_group->SendDiscarded(server, undo)) {
+      log_error("Failed to send undo to server");
+      return -1;
+    }
+    log_debug("Sending query %s to server %d", query.c_str(), server);
+    // Held, since speculations may be queued behind it.
+    if (!server_group->SendQuery(server, query, 1, true)) {
       log_error("Failed to send query to server");
       return -1;
     }
+    uint64_t request = server_group->LastRequest(server);
+    // Only a plain read can be answered by another server.
+    server_group->StartRead(server, request, query, !previous_is_write);
     if (speculation_is_write) {
       log_debug("Waiting for result before speculation because the speculation is write");
-      server_group->WaitForServer(server);
-      packet_size = CopyToClient(server_group->GetResult(server), client);
+      server = server_group->WaitForRead(&request);
+      packet_size = CopyToClient(server_group->GetResult(server, request), client);
       log_debug("Got result, doing speculation");
-      if (!DoSpeculation(query, server_group, -1, speculator,
-                         need_rollback, prefetches)) {
+      if (!DoSpeculation(query, type, server_group, -1, speculator,
+                         need_rollback, prefetches, result_cache, throttle)) {
         log_error("Failed to send speculations");
         return -1;
       }
     } else {
       log_debug("Doing speculation before waiting for results");
-      if (!DoSpeculation(query, server_group, server, speculator,
-                         need_rollback, prefetches)) {
+      if (!DoSpeculation(query, type, server_group, server, speculator,
+                         need_rollback, prefetches, result_cache, throttle)) {
         log_error("Failed to send speculations");
         return -1;
       }
       log_debug("Waiting for results");
-      server_group->WaitForServer(server);
-      packet_size = CopyToClient(server_group->GetResult(server), client);
+      server = server_group->WaitForRead(&request);
+      packet_size = CopyToClient(server_group->GetResult(server, request), client);
       log_debug("Got results");
     }
   }
@@ -439,6 +294,35 @@ ssize_t HandleSpeculationMiss(ServerGroup *server_group,
   return packet_size;
 }
 
+// Answers a read from the result cache; 0 if it is not there.
+ssize_t HandleCacheHit(ServerGroup *server_group,
+                       const std::string &query,
+                       StatementType type,
+                       uint64_t fingerprint,
+                       Connection *client,
+                       Speculator *speculator,
+                       std::vector<bool> &need_rollback,
+                       Prefetches &prefetches,
+                       ResultCacheClient *result_cache,
+                       SpeculationThrottle *throttle) {
+  size_t packet_size = result_cache->Lookup(query, fingerprint, type, client->Buffer(),
+                                            Connection::kBufferSize);
+  if (packet_size == 0) {
+    return 0;
+  }
+  log_debug("Result is cached");
+  if (!DoSpeculation(query, type, server_group, -1, speculator,
+                     need_rollback, prefetches, result_cache, throttle)) {
+    return -1;
+  }
+  log_debug("Send results back to client");
+  if (client->Send(packet_size) <= 0) {
+    log_error("Write to client fails");
+    return -1;
+  }
+  return packet_size;
+}
+
 } // namespace
 
 MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
@@ -469,7 +353,19 @@ MySQLRouting::MySQLRouting(routing::AccessMode mode, uint16_t port,
       info_handled_routes_(0),
       socket_operations_(socket_operations),
       rdma_operations_(rdma_operations),
-      protocol_(Protocol::create(protocol, socket_operations, rdma_operations)) {
+      protocol_(Protocol::create(protocol, socket_operations, rdma_operations)),
+      io_mode_(routing::IoMode::kThreadPerConnection),
+      rollback_mode_(routing::RollbackMode::kUndo),
+      worker_threads_(routing::kDefaultWorkerThreads),
+      pipeline_depth_(routing::kDefaultPipelineDepth),
+      hedge_percentile_(routing::kDefaultHedgePercentile),
+      schema_catalog_(std::make_shared<SchemaCatalog>()),
+      result_cache_(new ResultCache(static_cast<size_t>(routing::kDefaultResultCacheSize) << 20)) {
+  set_speculation_throttle(routing::kDefaultSpeculationWasteCost,
+                           routing::kDefaultSpeculationMinConfidence);
+
+  set_server_group_pool(routing::kDefaultPoolMinIdle, routing::kDefaultPoolMaxIdle,
+                        routing::kDefaultPoolMaxLifetime);
 
   assert(socket_operations_ != nullptr);
 
@@ -572,7 +468,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   string extra_msg = "";
   bool handshake_done = false;
   Connection client_connection(client, routing::SocketOperations::instance());
-  std::unordered_map<std::string, int> prefetches;
+  Prefetches prefetches;
   bool has_begun = false;
   int ID = -1;
   size_t num_misses = 0;
@@ -585,17 +481,36 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   std::string query_stat;
   bool previous_is_write = false;
 
-  auto server_group = destination_->GetServerGroup();
-  if (server_group.get() == nullptr) {
-    return;
-  }
-  speculator_.reset(new LogSpeculator(Undoer(server_group.get()), "/users/POTaDOS/SQP/trace/lobsters.sql"));
-
   std::cerr << "Initiate authentication" << std::endl;
-  if (!server_group->Authenticate(&client_connection)) {
+  auto mysql_session = AuthenticateClient(&client_connection);
+  if (mysql_session.get() == nullptr) {
     return;
   }
+  auto pool_key = ServerGroupPool::Key(*mysql_session);
+  auto server_group = server_group_pool_->Acquire(pool_key, *mysql_session);
+  if (server_group.get() != nullptr) {
+    if (!server_group->AcceptClient(&client_connection)) {
+      return;
+    }
+  } else {
+    server_group = server_group_pool_->Create();
+    if (server_group.get() == nullptr) {
+      return;
+    }
+    if (!server_group->AuthenticateBackends(std::move(mysql_session), &client_connection)) {
+      return;
+    }
+  }
+  auto speculator = ::CreateSpeculator(server_group.get(), trace_store_, graph_model_,
+                                       schema_catalog_.get(), rollback_mode_);
+  speculator->Prepare();
+  ResultCacheClient result_cache(result_cache_.get());
+  result_cache.SetSchema(server_group->Schema());
+  SpeculationThrottle throttle(throttle_options_);
   handshake_done = true;
+  // Whether the servers are left between two requests, so that the group
+  // can go back to the pool.
+  bool reusable = false;
 
   std::vector<bool> all_false(server_group->Size(), false);
   need_rollback = all_false;
@@ -649,6 +564,7 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
     bytes_read = client_connection.Recv();
     if (bytes_read <= 0) {
       log_error("Read from client fails");
+      reusable = true;
       break;
     }
     if (::IsQuery(client_connection.Buffer())) {
@@ -662,60 +578,85 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
         client_connection.Send(kOkPacket, sizeof(kOkPacket));
         continue;
       }
-      bool is_begin = query == "BEGIN";
+      auto type = ClassifyStatement(query);
+      bool is_begin = type == StatementType::kBegin;
       if (is_begin) {
         SetNeedRollback(need_rollback, false);
       }
       has_begun = has_begun || is_begin;
-      speculator_->CheckBegin(query);
-      speculator_->SetQueryIndex(query_index);
+      speculator->CheckBegin(query);
+      speculator->SetQueryIndex(query_index);
       log_debug("Query is %s", query.c_str());
-      auto iter = prefetches.find(query);
       ssize_t packet_size = -1;
-      if (IsRead(query)) {
+      if (IsReadStatement(type)) {
         query_stat = "R,";
       } else {
         query_stat = "W,";
       }
-      previous_is_write = false;
-      for (auto &speculation : prefetches) {
-        if (IsWrite(speculation.first)) {
-          previous_is_write = true;
-        }
-      }
+      previous_is_write = HasWritePrefetch(prefetches);
       if (previous_is_write) {
         query_stat += "W," + std::to_string(speculation_index) + ",";
       } else {
         query_stat += "R," + std::to_string(speculation_index) + ",";
       }
-      bool hit = iter != prefetches.end();
+      Prefetch prefetch;
+      uint64_t fingerprint = PrefetchTable::Fingerprint(query);
+      throttle.Observe(query, fingerprint);
+      bool hit = prefetches.Take(query, fingerprint, &prefetch);
+      bool cached = false;
+      // Read before the query is sent, unless it was sent speculatively.
+      uint64_t cache_version = hit ? prefetch.cache_version : result_cache.Version();
       if (hit) {
         query_stat += "H,";
-        packet_size = ::HandleSpeculationHit(server_group.get(), query, iter->second,
-                                             &client_connection, speculator_.get(),
-                                             need_rollback, prefetches);
+        packet_size = ::HandleSpeculationHit(server_group.get(), query, type, prefetch,
+                                             &client_connection, speculator.get(),
+                                             need_rollback, prefetches, &result_cache,
+                                         &throttle);
       } else {
-        query_stat += "M,";
-        packet_size = ::HandleSpeculationMiss(server_group.get(), query, &client_connection,
-                                              speculator_.get(), need_rollback, prefetches);
+        if (!previous_is_write) {
+          packet_size = ::HandleCacheHit(server_group.get(), query, type, fingerprint,
+                                         &client_connection, speculator.get(),
+                                         need_rollback, prefetches, &result_cache,
+                                             &throttle);
+          cached = packet_size != 0;
+        }
+        if (cached) {
+          query_stat += "C,";
+        } else {
+          query_stat += "M,";
+          packet_size = ::HandleSpeculationMiss(server_group.get(), query, type,
+                                                &client_connection, speculator.get(),
+                                                need_rollback, prefetches, &result_cache,
+                                                &throttle);
+        }
       }
       if (packet_size < 0) {
         break;
       }
-      if (query != "BEGIN" && query != "commit") {
+      if (!cached) {
+        result_cache.Insert(query, fingerprint, type, cache_version,
+                            client_connection.Buffer(), static_cast<size_t>(packet_size));
+      }
+      speculator->OnResult(client_connection.Buffer(), static_cast<size_t>(packet_size));
+      result_cache.OnResult(type);
+      if (!hit && !cached) {
+        throttle.OnMiss(GetDuration(query_start), previous_is_write);
+      }
+      bool is_begin_or_commit = is_begin || type == StatementType::kCommit;
+      if (!is_begin_or_commit) {
         num_queries++;
-        if (!hit) {
+        if (!hit && !cached) {
           num_misses++;
         }
       }
       bytes_down += packet_size;
       if (has_begun) {
         auto latency = GetDuration(query_start);
-        if (IsRead(query)) {
+        if (IsReadStatement(type)) {
           read_latencies.push_back(std::make_pair(query_id, latency));
           query_process_latencies.push_back(std::make_pair(query_id, latency));
           query_stat += std::to_string(query_id) + "," + std::to_string(latency);
-        } else if (query != "BEGIN" && query != "commit") {
+        } else if (!is_begin_or_commit) {
           write_latencies.push_back(std::make_pair(query_id, latency));
           query_process_latencies.push_back(std::make_pair(query_id, latency));
           query_stat += std::to_string(query_id) + "," + std::to_string(latency);
@@ -725,6 +666,13 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
         query_stats.push_back(query_stat);
       }
     } else {
+      if (server_group_pool_->Enabled() &&
+          server_group->IsExitPacket(client_connection.Buffer(), bytes_read)) {
+        // Not forwarded: the servers stay logged in for the next client.
+        reusable = true;
+        break;
+      }
+      result_cache.OnPacket();
       if (!::HandleNonQuery(server_group.get(), &client_connection, bytes_read, bytes_up, bytes_down)) {
         break;
       }
@@ -732,12 +680,22 @@ void MySQLRouting::routing_select_thread(int client, const sockaddr_storage& cli
   } // while (true)
 
   client_connection.Disconnect();
+  speculator.reset();
+  server_group->LogStats();
+  if (reusable) {
+    server_group_pool_->Release(pool_key, std::move(server_group));
+  }
   DumpQueryStats(query_stats, "query_stats" + std::to_string(ID));
   DumpLatency(query_process_latencies, "query_process" + std::to_string(ID));
   DumpLatency(read_latencies, "read_process" + std::to_string(ID));
   DumpLatency(write_latencies, "write_process" + std::to_string(ID));
   log_info("%lu misses out of %lu queries", num_misses, num_queries);
-  log_info("Average speculation overhead: %f", Mean(speculation_latency));
+  if (throttle.Enabled()) {
+    throttle.Dump("speculation_estimates" + std::to_string(ID));
+    log_info("%lu of %lu speculations throttled", throttle.num_throttled(),
+             throttle.num_sent() + throttle.num_throttled());
+  }
+  log_info("Average speculation overhead: %f", MeanSpeculationLatency());
 
   if (!handshake_done) {
     auto ip_array = in_addr_to_array(client_addr);
@@ -805,6 +763,27 @@ void MySQLRouting::start_acceptor() {
   int nfds = 0;
 
   destination_->start();
+  server_group_pool_->Start();
+
+  if (io_mode_ == routing::IoMode::kReactor) {
+    auto trace_store = trace_store_;
+    auto graph_model = graph_model_;
+    auto schema_catalog = schema_catalog_;
+    auto rollback_mode = rollback_mode_;
+    auto speculator_factory = [trace_store, graph_model, schema_catalog, rollback_mode](
+        ServerGroup *server_group) {
+      return ::CreateSpeculator(server_group, trace_store, graph_model, schema_catalog.get(),
+                                rollback_mode);
+    };
+    reactor_.reset(new Reactor(name, server_group_pool_.get(), speculator_factory,
+                               result_cache_.get(), throttle_options_, worker_threads_,
+                               &info_active_routes_));
+    if (!reactor_->Start()) {
+      log_error("[%s] Failed to start reactor workers", name.c_str());
+      return;
+    }
+    log_info("[%s] using %u reactor workers", name.c_str(), worker_threads_);
+  }
 
   if (service_tcp_ > 0) {
     routing::set_socket_blocking(service_tcp_, false);
@@ -894,9 +873,24 @@ void MySQLRouting::start_acceptor() {
         continue;
       }
 
-      std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
+      if (reactor_) {
+        ++info_handled_routes_;
+        reactor_->Dispatch(sock_client);
+      } else {
+        std::thread(&MySQLRouting::routing_select_thread, this, sock_client, client_addr).detach();
+      }
     }
   } // while (!stopping())
+  if (reactor_) {
+    reactor_->Stop();
+    log_info("[%s] reactor: peak of %lu sessions using %lu bytes", name.c_str(),
+             reactor_->PeakSessions(), reactor_->PeakMemoryFootprint());
+  }
+  server_group_pool_->Stop();
+  if (server_group_pool_->Enabled()) {
+    log_info("[%s] server group pool: %lu hits, %lu misses", name.c_str(),
+             server_group_pool_->hits(), server_group_pool_->misses());
+  }
   log_info("[%s] stopped", name.c_str());
 }
 
@@ -1080,10 +1074,99 @@ void MySQLRouting::set_destinations_from_csv(const string &csv) {
   }
 }
 
+void MySQLRouting::set_shm_destinations(const std::string &csv) {
+  std::stringstream ss(csv);
+  std::string part;
+  while (std::getline(ss, part, ',')) {
+    mysqlrouter::trim(part);
+    if (part.empty()) {
+      continue;
+    }
+    auto info = mysqlrouter::split_addr_port(part);
+    if (info.second == 0) {
+      info.second = Protocol::get_default_port(protocol_->get_type());
+    }
+    TCPAddress addr(info.first, info.second);
+    if (!addr.is_valid()) {
+      throw std::runtime_error(string_format("Shared memory destination '%s' is invalid", addr.str().c_str()));
+    }
+    routing::BackendOperations::instance()->add_shm_destination(addr);
+    log_info("[%s] reaching %s over shared memory", name.c_str(), addr.str().c_str());
+  }
+}
+
 void MySQLRouting::set_root_password(const std::string &root_password) {
   root_password_ = root_password;
 }
 
+void MySQLRouting::set_io_mode(routing::IoMode io_mode, unsigned int worker_threads) {
+  io_mode_ = io_mode;
+  worker_threads_ = worker_threads;
+}
+
+void MySQLRouting::set_rollback_mode(routing::RollbackMode rollback_mode) {
+  rollback_mode_ = rollback_mode;
+}
+
+void MySQLRouting::set_wait_mode(routing::WaitMode wait_mode, unsigned int spin_budget) {
+  if (wait_mode == routing::WaitMode::kSpin) {
+    WaitPolicy::SetDefault(WaitPolicy::Spin());
+  } else {
+    WaitPolicy::SetDefault(WaitPolicy::Park(spin_budget));
+  }
+}
+
+void MySQLRouting::set_rdma_pollers(unsigned int threads, unsigned int busy_poll_us) {
+  CqPollerPool::Configure(threads, busy_poll_us);
+}
+
+void MySQLRouting::set_trace_store(std::shared_ptr<const TraceStore> trace_store) {
+  trace_store_ = std::move(trace_store);
+}
+
+void MySQLRouting::set_graph_model(std::shared_ptr<const model::GraphModel> graph_model) {
+  graph_model_ = std::move(graph_model);
+}
+
+void MySQLRouting::set_model_learning_interval(unsigned int milliseconds) {
+  if (graph_model_ && milliseconds > 0) {
+    graph_model_->learner().Start(std::chrono::milliseconds(milliseconds));
+    log_info("[%s] learning model every %u ms", name.c_str(), milliseconds);
+  }
+}
+
+void MySQLRouting::set_server_group_pool(unsigned int min_idle, unsigned int max_idle,
+                                         unsigned int max_lifetime) {
+  auto factory = [this]() {
+    auto server_group = destination_->GetServerGroup();
+    if (server_group.get() != nullptr) {
+      server_group->SetPipelineDepth(pipeline_depth_.load());
+      server_group->SetHedgePercentile(hedge_percentile_.load());
+    }
+    return server_group;
+  };
+  server_group_pool_.reset(new ServerGroupPool(factory, min_idle, max_idle,
+                                               std::chrono::seconds(max_lifetime)));
+}
+
+void MySQLRouting::set_pipeline_depth(unsigned int pipeline_depth) {
+  pipeline_depth_ = pipeline_depth;
+}
+
+void MySQLRouting::set_hedge_percentile(unsigned int hedge_percentile) {
+  hedge_percentile_ = hedge_percentile;
+}
+
+void MySQLRouting::set_result_cache_size(unsigned int megabytes) {
+  result_cache_.reset(new ResultCache(static_cast<size_t>(megabytes) << 20));
+}
+
+void MySQLRouting::set_speculation_throttle(unsigned int waste_cost,
+                                            unsigned int min_confidence) {
+  throttle_options_.waste_cost = waste_cost / 100.0;
+  throttle_options_.min_confidence = min_confidence / 100.0;
+}
+
 int MySQLRouting::set_destination_connect_timeout(int seconds) {
   if (seconds <= 0 || seconds > UINT16_MAX) {
     auto err = string_format("[%s] tried to set destination_connect_timeout using invalid value, was '%d'",
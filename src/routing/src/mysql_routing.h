@@ -35,7 +35,14 @@
 #include "plugin_config.h"
 #include "utils.h"
 #include "mysqlrouter/routing.h"
+#include "reactor.h"
+#include "result_cache.h"
+#include "server_group_pool.h"
+#include "speculation_throttle.h"
+#include "speculator/schema_catalog.h"
+#include "speculator/speculation_model/graph_model.h"
 #include "speculator/speculator.h"
+#include "speculator/trace_store.h"
 
 #include <array>
 #include <atomic>
@@ -134,7 +141,7 @@ public:
                unsigned int connect_timeout = routing::kDefaultClientConnectTimeout,
                unsigned int net_buffer_length = routing::kDefaultNetBufferLength,
                routing::SocketOperationsBase *socket_operations = routing::SocketOperations::instance(),
-               routing::SocketOperationsBase *rdma_operations = routing::RdmaOperations::instance());
+               routing::SocketOperationsBase *rdma_operations = routing::BackendOperations::instance());
 
   /** @brief Starts the service and accept incoming connections
    *
@@ -174,10 +181,118 @@ public:
    */
   void set_destinations_from_csv(const std::string &csv);
 
+  /** @brief Reaches some destinations over shared memory
+   *
+   * The destinations have to run on this host behind the shared memory
+   * shim; all others stay on RDMA.
+   *
+   * Example of destinations:
+   *   "127.0.0.1:3306,127.0.0.1:3307"
+   *
+   * @param csv destinations as comma-separated-values; empty for none
+   */
+  void set_shm_destinations(const std::string &csv);
+
   void set_destinations_from_uri(const mysqlrouter::URI &uri);
 
   void set_root_password(const std::string &root_password);
 
+  /** @brief Sets how client sessions are driven
+   *
+   * @param io_mode thread per connection or epoll reactor
+   * @param worker_threads number of reactor workers (reactor mode only)
+   */
+  void set_io_mode(routing::IoMode io_mode, unsigned int worker_threads);
+
+  /** @brief Sets how sessions wait for backend responses
+   *
+   * The policy is process wide: it applies to every server connection
+   * created afterwards.
+   *
+   * @param wait_mode spin, or spin then park
+   * @param spin_budget number of polls before parking
+   */
+  void set_wait_mode(routing::WaitMode wait_mode, unsigned int spin_budget);
+
+  /** @brief Sets the threads polling RDMA completion queues
+   *
+   * Process wide like the wait mode: it applies to the pollers of RDMA
+   * devices not used yet.
+   *
+   * @param threads pollers per device; 0 for one per core
+   * @param busy_poll_us microseconds a poller polls before waiting for events
+   */
+  void set_rdma_pollers(unsigned int threads, unsigned int busy_poll_us);
+
+  /** @brief Sets how wrong write speculations are reverted
+   *
+   * @param rollback_mode inverse statement from the Undoer, or savepoint
+   */
+  void set_rollback_mode(routing::RollbackMode rollback_mode);
+
+  /** @brief Sets the trace replayed by the speculators of this route
+   *
+   * The store is shared; each session only keeps a cursor into it.
+   *
+   * @param trace_store trace loaded with TraceStore::Get()
+   */
+  void set_trace_store(std::shared_ptr<const TraceStore> trace_store);
+
+  /** @brief Makes the sessions of this route predict with a model
+   *
+   * Instead of replaying the trace, each session feeds its queries and
+   * their results to a predictor over the shared model.
+   *
+   * @param graph_model model loaded with model::GraphModel::Get()
+   */
+  void set_graph_model(std::shared_ptr<const model::GraphModel> graph_model);
+
+  /** @brief Makes the model learn from the queries of its sessions
+   *
+   * The model is shared, so learning started by any route serves all
+   * routes using it.
+   *
+   * @param milliseconds interval between merges of what was learned; 0
+   *        leaves learning off
+   */
+  void set_model_learning_interval(unsigned int milliseconds);
+
+  /** @brief Sets up the pool of authenticated server groups
+   *
+   * @param min_idle idle groups kept ready per user and schema
+   * @param max_idle idle groups kept at most per user and schema; 0 disables the pool
+   * @param max_lifetime seconds after which a group is closed instead of reused
+   */
+  void set_server_group_pool(unsigned int min_idle, unsigned int max_idle,
+                             unsigned int max_lifetime);
+
+  /** @brief Sets how many requests a session keeps in flight per server
+   *
+   * @param pipeline_depth 1 for a single speculation per query
+   */
+  void set_pipeline_depth(unsigned int pipeline_depth);
+
+  /** @brief Sets after which percentile of recent latency a read is hedged
+   *
+   * @param hedge_percentile 0 disables hedging
+   */
+  void set_hedge_percentile(unsigned int hedge_percentile);
+
+  /** @brief Sets up the result cache shared by the sessions of this route
+   *
+   * @param megabytes size of the cache; 0 disables it
+   */
+  void set_result_cache_size(unsigned int megabytes);
+
+  /** @brief Sets when a speculation is worth sending
+   *
+   * @param waste_cost percentage of a wasted speculation's latency counted
+   *        against it
+   * @param min_confidence percentage of hits below which a query template
+   *        is not speculated; both 0 send every speculation
+   */
+  void set_speculation_throttle(unsigned int waste_cost, unsigned int min_confidence);
+
   /** @brief Descriptive name of the connection routing */
   const std::string name;
 
@@ -318,7 +433,6 @@ private:
   int service_tcp_;
   /** @brief Socket descriptor of the named socket service */
   int service_named_socket_;
-  std::unique_ptr<Speculator> speculator_;
   /** @brief Destination object to use when getting next connection */
   std::unique_ptr<RouteDestination> destination_;
   /** @brief Whether we were asked to stop */
@@ -341,6 +455,30 @@ private:
   /** @brief object to handle protocol specific stuff */
   std::unique_ptr<BaseProtocol> protocol_;
   std::string root_password_;
+  /** @brief How client sessions are driven */
+  routing::IoMode io_mode_;
+  /** @brief How wrong write speculations are reverted */
+  routing::RollbackMode rollback_mode_;
+  /** @brief Number of reactor workers */
+  unsigned int worker_threads_;
+  /** @brief Requests in flight per server */
+  std::atomic<unsigned int> pipeline_depth_;
+  /** @brief Latency percentile after which client reads are hedged */
+  std::atomic<unsigned int> hedge_percentile_;
+  /** @brief Authenticated server groups shared by the sessions of this route */
+  std::unique_ptr<ServerGroupPool> server_group_pool_;
+  /** @brief Epoll workers when io_mode_ is reactor */
+  std::unique_ptr<Reactor> reactor_;
+  /** @brief Trace shared by the speculators of all sessions */
+  std::shared_ptr<const TraceStore> trace_store_;
+  /** @brief Model shared by the speculators of all sessions, if set */
+  std::shared_ptr<const model::GraphModel> graph_model_;
+  /** @brief Key columns the undos of all sessions find rows by */
+  std::shared_ptr<SchemaCatalog> schema_catalog_;
+  /** @brief Read results shared by all sessions */
+  std::unique_ptr<ResultCache> result_cache_;
+  /** @brief Thresholds of the speculation throttle of every session */
+  SpeculationThrottle::Options throttle_options_;
 
 #ifdef FRIEND_TEST
   FRIEND_TEST(RoutingTests, bug_24841281);
@@ -0,0 +1,53 @@
+#include "mysqlrouter/notifier.h"
+
+#include <climits>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const uint32_t kDefaultSpinBudget = 1000;
+static const uint32_t kDefaultParkTimeoutUs = 1000;
+
+// Set once from the routing configuration before any connection is made.
+static WaitPolicy default_policy = WaitPolicy::Park(kDefaultSpinBudget);
+
+static long Futex(std::atomic<uint32_t> *addr, int op, uint32_t value,
+                  const struct timespec *timeout) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), op, value,
+                 timeout, nullptr, 0);
+}
+
+WaitPolicy WaitPolicy::Spin() {
+  return WaitPolicy{false, 0, 0};
+}
+
+WaitPolicy WaitPolicy::Park(uint32_t spin_budget) {
+  return WaitPolicy{true, spin_budget, kDefaultParkTimeoutUs};
+}
+
+WaitPolicy WaitPolicy::Default() {
+  return default_policy;
+}
+
+void WaitPolicy::SetDefault(const WaitPolicy &policy) {
+  default_policy = policy;
+}
+
+void Notifier::Notify() {
+  epoch_.fetch_add(1);
+  if (num_waiters_.load() > 0) {
+    Futex(&epoch_, process_shared_ ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+  }
+}
+
+void Notifier::Wait(uint32_t epoch, uint32_t timeout_us) {
+  struct timespec timeout;
+  timeout.tv_sec = timeout_us / 1000000;
+  timeout.tv_nsec = (timeout_us % 1000000) * 1000;
+  num_waiters_.fetch_add(1);
+  // Returns right away if Notify() has bumped the epoch since it was read.
+  Futex(&epoch_, process_shared_ ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, epoch, &timeout);
+  num_waiters_.fetch_sub(1);
+}
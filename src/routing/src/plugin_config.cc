@@ -51,12 +51,40 @@ RoutingPluginConfig::RoutingPluginConfig(const mysql_harness::ConfigSection *sec
       max_connect_errors(get_uint_option<uint32_t>(section, "max_connect_errors", 1, UINT32_MAX)),
       client_connect_timeout(get_uint_option<uint32_t>(section, "client_connect_timeout", 2, 31536000)),
       net_buffer_length(get_uint_option<uint32_t>(section, "net_buffer_length", 1024, 1048576)),
-      root_password(get_option_string(section, "root_password")) {
+      root_password(get_option_string(section, "root_password")),
+      io_mode(get_option_io_mode(section, "io_mode")),
+      worker_threads(get_uint_option<uint16_t>(section, "worker_threads", 1)),
+      wait_mode(get_option_wait_mode(section, "wait_mode")),
+      spin_budget(get_uint_option<uint32_t>(section, "spin_budget", 0, UINT32_MAX)),
+      trace_file(get_option_string(section, "trace_file")),
+      speculator(get_option_speculator_type(section, "speculator")),
+      query_set_file(get_option_string(section, "query_set_file")),
+      model_file(get_option_string(section, "model_file")),
+      model_learning_interval(
+          get_uint_option<uint32_t>(section, "model_learning_interval", 0, 3600000)),
+      pool_min_idle(get_uint_option<uint16_t>(section, "pool_min_idle", 0)),
+      pool_max_idle(get_uint_option<uint16_t>(section, "pool_max_idle", 0)),
+      pool_max_lifetime(get_uint_option<uint32_t>(section, "pool_max_lifetime", 1, UINT32_MAX)),
+      pipeline_depth(get_uint_option<uint16_t>(section, "pipeline_depth", 1, 64)),
+      hedge_percentile(get_uint_option<uint16_t>(section, "hedge_percentile", 0, 99)),
+      result_cache_size(get_uint_option<uint32_t>(section, "result_cache_size", 0, 65536)),
+      speculation_waste_cost(
+          get_uint_option<uint16_t>(section, "speculation_waste_cost", 0, 10000)),
+      speculation_min_confidence(
+          get_uint_option<uint16_t>(section, "speculation_min_confidence", 0, 100)),
+      rollback_mode(get_option_rollback_mode(section, "rollback_mode")),
+      shm_destinations(get_option_string(section, "shm_destinations")),
+      rdma_poller_threads(get_uint_option<uint16_t>(section, "rdma_poller_threads", 0, 1024)),
+      rdma_busy_poll(get_uint_option<uint32_t>(section, "rdma_busy_poll", 0, 1000000)) {
 
   // either bind_address or socket needs to be set, or both
   if (!bind_address.port && !named_socket.is_set()) {
     throw invalid_argument("either bind_address or socket option needs to be supplied, or both");
   }
+
+  if (pool_min_idle > pool_max_idle) {
+    throw invalid_argument(get_log_prefix("pool_min_idle") + " can not be larger than pool_max_idle");
+  }
 }
 
 
@@ -69,6 +97,27 @@ string RoutingPluginConfig::get_default(const string &option) {
       {"max_connect_errors", to_string(routing::kDefaultMaxConnectErrors)},
       {"client_connect_timeout", to_string(routing::kDefaultClientConnectTimeout)},
       {"net_buffer_length", to_string(routing::kDefaultNetBufferLength)},
+      {"io_mode", routing::get_io_mode_name(routing::IoMode::kThreadPerConnection)},
+      {"worker_threads", to_string(routing::kDefaultWorkerThreads)},
+      {"wait_mode", routing::get_wait_mode_name(routing::WaitMode::kPark)},
+      {"rollback_mode", routing::get_rollback_mode_name(routing::RollbackMode::kUndo)},
+      {"spin_budget", to_string(routing::kDefaultSpinBudget)},
+      {"trace_file", routing::kDefaultTraceFile},
+      {"speculator", routing::get_speculator_type_name(routing::SpeculatorType::kLog)},
+      {"query_set_file", routing::kDefaultQuerySetFile},
+      {"model_file", routing::kDefaultModelFile},
+      {"model_learning_interval", to_string(routing::kDefaultModelLearningInterval)},
+      {"pool_min_idle", to_string(routing::kDefaultPoolMinIdle)},
+      {"pool_max_idle", to_string(routing::kDefaultPoolMaxIdle)},
+      {"pool_max_lifetime", to_string(routing::kDefaultPoolMaxLifetime)},
+      {"pipeline_depth", to_string(routing::kDefaultPipelineDepth)},
+      {"hedge_percentile", to_string(routing::kDefaultHedgePercentile)},
+      {"result_cache_size", to_string(routing::kDefaultResultCacheSize)},
+      {"speculation_waste_cost", to_string(routing::kDefaultSpeculationWasteCost)},
+      {"speculation_min_confidence", to_string(routing::kDefaultSpeculationMinConfidence)},
+      {"shm_destinations", routing::kDefaultShmDestinations},
+      {"rdma_poller_threads", to_string(routing::kDefaultRdmaPollerThreads)},
+      {"rdma_busy_poll", to_string(routing::kDefaultRdmaBusyPoll)},
   };
 
   auto it = defaults.find(option);
@@ -109,6 +158,70 @@ routing::AccessMode RoutingPluginConfig::get_option_mode(
   return result;
 }
 
+routing::IoMode RoutingPluginConfig::get_option_io_mode(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_io_mode_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::IoMode result = routing::get_io_mode(value);
+  if (result == routing::IoMode::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
+routing::WaitMode RoutingPluginConfig::get_option_wait_mode(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_wait_mode_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::WaitMode result = routing::get_wait_mode(value);
+  if (result == routing::WaitMode::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
+routing::RollbackMode RoutingPluginConfig::get_option_rollback_mode(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_rollback_mode_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::RollbackMode result = routing::get_rollback_mode(value);
+  if (result == routing::RollbackMode::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
+routing::SpeculatorType RoutingPluginConfig::get_option_speculator_type(
+    const mysql_harness::ConfigSection *section, const string &option) {
+  string valid;
+  routing::get_speculator_type_names(&valid);
+
+  string value = get_option_string(section, option);
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+  routing::SpeculatorType result = routing::get_speculator_type(value);
+  if (result == routing::SpeculatorType::kUndefined) {
+    throw invalid_argument(get_log_prefix(option) + " is invalid; valid are " +
+                           valid + " (was '" + value + "')");
+  }
+  return result;
+}
+
 Protocol::Type RoutingPluginConfig::get_protocol(const mysql_harness::ConfigSection *section,
                                                  const std::string &option) {
   std::string name;
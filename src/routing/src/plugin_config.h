@@ -80,11 +80,59 @@ public:
   const unsigned int net_buffer_length;
   /** @brief root password */
   const std::string root_password;
+  /** @brief `io_mode` option read from configuration section */
+  const routing::IoMode io_mode;
+  /** @brief `worker_threads` option read from configuration section */
+  const unsigned int worker_threads;
+  /** @brief `wait_mode` option read from configuration section */
+  const routing::WaitMode wait_mode;
+  /** @brief `spin_budget` option read from configuration section */
+  const unsigned int spin_budget;
+  /** @brief `trace_file` option read from configuration section */
+  const std::string trace_file;
+  /** @brief `speculator` option read from configuration section */
+  const routing::SpeculatorType speculator;
+  /** @brief `query_set_file` option read from configuration section */
+  const std::string query_set_file;
+  /** @brief `model_file` option read from configuration section */
+  const std::string model_file;
+  /** @brief `model_learning_interval` option read from configuration section */
+  const unsigned int model_learning_interval;
+  /** @brief `pool_min_idle` option read from configuration section */
+  const unsigned int pool_min_idle;
+  /** @brief `pool_max_idle` option read from configuration section */
+  const unsigned int pool_max_idle;
+  /** @brief `pool_max_lifetime` option read from configuration section */
+  const unsigned int pool_max_lifetime;
+  /** @brief `pipeline_depth` option read from configuration section */
+  const unsigned int pipeline_depth;
+  /** @brief `hedge_percentile` option read from configuration section */
+  const unsigned int hedge_percentile;
+  /** @brief `result_cache_size` option read from configuration section */
+  const unsigned int result_cache_size;
+  /** @brief `speculation_waste_cost` option read from configuration section */
+  const unsigned int speculation_waste_cost;
+  /** @brief `speculation_min_confidence` option read from configuration section */
+  const unsigned int speculation_min_confidence;
+  /** @brief `rollback_mode` option read from configuration section */
+  const routing::RollbackMode rollback_mode;
+  /** @brief `shm_destinations` option read from configuration section */
+  const std::string shm_destinations;
+  /** @brief `rdma_poller_threads` option read from configuration section */
+  const unsigned int rdma_poller_threads;
+  /** @brief `rdma_busy_poll` option read from configuration section */
+  const unsigned int rdma_busy_poll;
 
 protected:
 
 private:
   routing::AccessMode get_option_mode(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::IoMode get_option_io_mode(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::WaitMode get_option_wait_mode(const mysql_harness::ConfigSection *section, const std::string &option);
+  routing::RollbackMode get_option_rollback_mode(const mysql_harness::ConfigSection *section,
+                                                 const std::string &option);
+  routing::SpeculatorType get_option_speculator_type(const mysql_harness::ConfigSection *section,
+                                                     const std::string &option);
   std::string get_option_destinations(const mysql_harness::ConfigSection *section, const std::string &option,
                                       const Protocol::Type &protocol_type);
   Protocol::Type get_protocol(const mysql_harness::ConfigSection *section, const std::string &option);
@@ -0,0 +1,143 @@
+#include "prefetch_table.h"
+
+#include <utility>
+
+#include <cstring>
+
+namespace {
+
+const size_t kInitialSlots = 16;
+const uint64_t kMul1 = 0x9e3779b97f4a7c15ULL;
+const uint64_t kMul2 = 0xc2b2ae3d27d4eb4fULL;
+
+uint64_t Mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64_t Rotate(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Load(const char *data) {
+  uint64_t word;
+  memcpy(&word, data, sizeof(word));
+  return word;
+}
+
+uint64_t Round(uint64_t lane, uint64_t word) {
+  return Rotate(lane ^ (word * kMul2), 31) * kMul1;
+}
+
+} // namespace
+
+uint64_t PrefetchTable::Fingerprint(const char *data, size_t size) {
+  // Four independent lanes of eight bytes each, so that the multiplies of
+  // a long query overlap; queries differ mostly in their arguments, so
+  // every byte counts.
+  uint64_t lane0 = size * kMul1;
+  uint64_t lane1 = kMul2;
+  uint64_t lane2 = Rotate(kMul1, 17);
+  uint64_t lane3 = Rotate(kMul2, 41);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    lane0 = Round(lane0, Load(data + i));
+    lane1 = Round(lane1, Load(data + i + 8));
+    lane2 = Round(lane2, Load(data + i + 16));
+    lane3 = Round(lane3, Load(data + i + 24));
+  }
+  uint64_t hash = lane0 ^ Rotate(lane1, 16) ^ Rotate(lane2, 32) ^ Rotate(lane3, 48);
+  for (; i + 8 <= size; i += 8) {
+    hash = Round(hash, Load(data + i));
+  }
+  if (i < size) {
+    uint64_t word = 0;
+    memcpy(&word, data + i, size - i);
+    hash = Round(hash, word);
+  }
+  return Mix(hash);
+}
+
+PrefetchTable::PrefetchTable() : slots_(kInitialSlots), size_(0) {}
+
+size_t PrefetchTable::Probe(const std::string &query, uint64_t fingerprint) const {
+  size_t mask = slots_.size() - 1;
+  size_t index = Home(fingerprint);
+  while (slots_[index].used) {
+    auto &slot = slots_[index];
+    if (slot.fingerprint == fingerprint && slot.query == query) {
+      break;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+const Prefetch *PrefetchTable::Find(const std::string &query, uint64_t fingerprint) const {
+  auto &slot = slots_[Probe(query, fingerprint)];
+  return slot.used ? &slot.prefetch : nullptr;
+}
+
+bool PrefetchTable::Take(const std::string &query, uint64_t fingerprint, Prefetch *prefetch) {
+  size_t index = Probe(query, fingerprint);
+  if (!slots_[index].used) {
+    return false;
+  }
+  *prefetch = slots_[index].prefetch;
+  EraseSlot(index);
+  return true;
+}
+
+void PrefetchTable::Insert(const std::string &query, uint64_t fingerprint,
+                           const Prefetch &prefetch) {
+  if ((size_ + 1) * 2 > slots_.size()) {
+    Grow();
+  }
+  auto &slot = slots_[Probe(query, fingerprint)];
+  if (!slot.used) {
+    slot.used = true;
+    slot.fingerprint = fingerprint;
+    // Reuses the capacity left by the slot's previous query.
+    slot.query.assign(query);
+    size_++;
+  }
+  slot.prefetch = prefetch;
+}
+
+void PrefetchTable::EraseSlot(size_t index) {
+  size_t mask = slots_.size() - 1;
+  size_t hole = index;
+  size_t next = (hole + 1) & mask;
+  while (slots_[next].used) {
+    // An entry may fill the hole unless its home lies cyclically in
+    // (hole, next], where it would become unreachable.
+    size_t home = Home(slots_[next].fingerprint);
+    bool stays = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+    if (!stays) {
+      std::swap(slots_[hole], slots_[next]);
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  slots_[hole].used = false;
+  size_--;
+}
+
+void PrefetchTable::Grow() {
+  std::vector<Slot> old_slots(slots_.size() * 2);
+  old_slots.swap(slots_);
+  for (auto &old_slot : old_slots) {
+    if (!old_slot.used) {
+      continue;
+    }
+    size_t index = Home(old_slot.fingerprint);
+    while (slots_[index].used) {
+      index = (index + 1) & (slots_.size() - 1);
+    }
+    slots_[index] = std::move(old_slot);
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef ROUTING_SRC_PREFETCH_TABLE_H_
+#define ROUTING_SRC_PREFETCH_TABLE_H_
+
+#include "statement_type.h"
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// A speculatively sent query: the server it was sent to, the number of
+// the request holding its result there, what the query does, and the
+// ResultCache version it was sent at.
+struct Prefetch {
+  int server;
+  uint64_t request;
+  StatementType type;
+  uint64_t cache_version;
+};
+
+// Maps speculatively sent queries to where their results will be.
+//
+// An open-addressing table with linear probing, keyed by a 64-bit
+// fingerprint of the query text that the caller computes once per query;
+// the text itself is only compared when fingerprints match. Erased slots
+// keep their string, so once the table has warmed up neither lookups nor
+// inserts allocate. It holds a few pipelines' worth of queries and grows
+// past half full.
+class PrefetchTable {
+public:
+  static uint64_t Fingerprint(const char *data, size_t size);
+  static uint64_t Fingerprint(const std::string &query) {
+    return Fingerprint(query.data(), query.size());
+  }
+
+  PrefetchTable();
+
+  size_t size() const {
+    return size_;
+  }
+  bool empty() const {
+    return size_ == 0;
+  }
+  const Prefetch *Find(const std::string &query, uint64_t fingerprint) const;
+  // Removes the query and returns where its result is; false if absent.
+  bool Take(const std::string &query, uint64_t fingerprint, Prefetch *prefetch);
+  // Adds or replaces the query.
+  void Insert(const std::string &query, uint64_t fingerprint, const Prefetch &prefetch);
+
+  // visit(query, prefetch) for every entry.
+  template <typename Visit>
+  void ForEach(Visit visit) const {
+    for (auto &slot : slots_) {
+      if (slot.used) {
+        visit(slot.query, slot.prefetch);
+      }
+    }
+  }
+  // Removes every entry for which remove(query, fingerprint, prefetch)
+  // returns true.
+  template <typename Remove>
+  void EraseIf(Remove remove);
+
+private:
+  struct Slot {
+    bool used;
+    uint64_t fingerprint;
+    std::string query;
+    Prefetch prefetch;
+  };
+
+  size_t Home(uint64_t fingerprint) const {
+    return static_cast<size_t>(fingerprint) & (slots_.size() - 1);
+  }
+  // Slot of the query, or of the empty slot ending its probe sequence.
+  size_t Probe(const std::string &query, uint64_t fingerprint) const;
+  // Backward-shift deletion: no tombstones, probe sequences stay short.
+  void EraseSlot(size_t index);
+  void Grow();
+
+  std::vector<Slot> slots_;
+  size_t size_;
+};
+
+template <typename Remove>
+void PrefetchTable::EraseIf(Remove remove) {
+  // Start after an empty slot, so that the entries EraseSlot() shifts
+  // back are always ones not visited yet.
+  size_t mask = slots_.size() - 1;
+  size_t start = 0;
+  while (slots_[start].used) {
+    start++;
+  }
+  for (size_t n = 1; n <= slots_.size(); n++) {
+    size_t index = (start + n) & mask;
+    while (slots_[index].used &&
+           remove(slots_[index].query, slots_[index].fingerprint, slots_[index].prefetch)) {
+      EraseSlot(index);
+    }
+  }
+}
+
+#endif // ROUTING_SRC_PREFETCH_TABLE_H_
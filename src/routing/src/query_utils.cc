@@ -0,0 +1,342 @@
+#include "query_utils.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const int kNumIndexDigits = 10;
+const int kNumIdDigits = 10;
+
+// Shared by the sessions of every worker thread.
+std::atomic<long> speculation_latency_sum(0);
+std::atomic<long> speculation_latency_count(0);
+
+int ExtractQueryIndex(const char *buffer) {
+  return atoi(buffer);
+}
+
+int ExtractQueryId(const char *buffer) {
+  return atoi(buffer + kNumIndexDigits);
+}
+
+void RecordSpeculationLatency(long latency) {
+  speculation_latency_sum.fetch_add(latency, std::memory_order_relaxed);
+  speculation_latency_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+uint8_t kOkPacket[11] = {7, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0};
+
+thread_local int speculation_index = -1;
+
+TimePoint Now() {
+  return std::chrono::high_resolution_clock::now();
+}
+
+long GetDuration(TimePoint &start) {
+  auto end = Now();
+  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+  return static_cast<long>(duration.count());
+}
+
+double Mean(const std::vector<long> &latencies) {
+  double mean = 0;
+  double i = 1;
+  for (auto latency : latencies) {
+    mean += (static_cast<double>(latency) - mean) / i;
+    i++;
+  }
+  return mean;
+}
+
+double MeanSpeculationLatency() {
+  long count = speculation_latency_count.load(std::memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  return static_cast<double>(speculation_latency_sum.load(std::memory_order_relaxed)) /
+         static_cast<double>(count);
+}
+
+void DumpQueryStats(std::vector<std::string> &query_stats,
+                    const std::string &filename) {
+  std::ofstream outfile(filename);
+  for (size_t i = 0; i < query_stats.size(); i++) {
+    auto stat = query_stats[i];
+    outfile << stat << std::endl;
+  }
+}
+
+void DumpLatency(std::vector<std::pair<int, long>> &latencies, const std::string &latency_name) {
+  std::ofstream outfile(latency_name);
+  for (auto &pair : latencies) {
+    outfile << pair.first << ' ' << pair.second << std::endl;
+  }
+}
+
+bool IsQuery(uint8_t *buffer) {
+  return buffer[kMySQLHeaderLen] == static_cast<uint8_t>(COM_QUERY);
+}
+
+void ExtractQuery(
+    uint8_t *buffer, std::string &query,
+    int &query_index, int &query_id) {
+  size_t query_size = mysql_get_byte3(buffer) - 1;
+  char *query_buffer = reinterpret_cast<char *>(buffer + kMySQLHeaderLen + 1);
+  query_index = -1;
+  query_id = -1;
+  if (isdigit(query_buffer[0])) {
+    query_index = ExtractQueryIndex(query_buffer);
+    query_id = ExtractQueryId(query_buffer);
+    query_buffer += kNumIndexDigits + kNumIdDigits;
+    query_size -= kNumIndexDigits + kNumIdDigits;
+  }
+  query = std::string(query_buffer, query_size);
+}
+
+int ExtractID(const std::string &query) {
+  // ID=[id] (no square bracket)
+  return atoi(query.c_str() + 2);
+}
+
+bool IsRead(const std::string &query) {
+  return IsReadStatement(ClassifyStatement(query));
+}
+
+bool IsWrite(const std::string &query) {
+  return !IsRead(query);
+}
+
+bool HasWritePrefetch(const Prefetches &prefetches) {
+  bool has_write = false;
+  prefetches.ForEach([&has_write](const std::string &, const Prefetch &prefetch) {
+    has_write = has_write || !IsReadStatement(prefetch.type);
+  });
+  return has_write;
+}
+
+void SetNeedRollback(std::vector<bool> &need_rollback, bool need) {
+  for (size_t i = 0; i < need_rollback.size(); i++) {
+    need_rollback[i] = need;
+  }
+}
+
+namespace {
+
+// Discards the prefetches that are not among the speculations. Reads
+// that have already been answered are cached for the other sessions.
+void DiscardStale(ServerGroup *server_group, Prefetches &prefetches,
+                  const std::vector<std::string> &speculations,
+                  const std::vector<uint64_t> &fingerprints,
+                  ResultCacheClient *result_cache) {
+  prefetches.EraseIf([&](const std::string &query, uint64_t fingerprint,
+                          const Prefetch &prefetch) {
+    for (size_t i = 0; i < fingerprints.size(); i++) {
+      if (fingerprints[i] == fingerprint && speculations[i] == query) {
+        return false;
+      }
+    }
+    if (prefetch.type == StatementType::kSelect && result_cache->Usable() &&
+        server_group->IsResultReady(prefetch.server, prefetch.request)) {
+      auto result = server_group->GetResult(prefetch.server, prefetch.request);
+      if (result.first != nullptr) {
+        result_cache->Insert(query, fingerprint, prefetch.type, prefetch.cache_version,
+                             result.first, result.second);
+      }
+      return true;
+    }
+    server_group->Discard(prefetch.server, prefetch.request);
+    return true;
+  });
+}
+
+// Keeps the speculations worth sending. As without throttling, a write
+// is only sent first, so the ones after a write are not even scored.
+void Throttle(SpeculationThrottle *throttle, std::vector<std::string> &speculations) {
+  std::vector<uint64_t> fingerprints;
+  for (auto &speculation : speculations) {
+    fingerprints.push_back(PrefetchTable::Fingerprint(speculation));
+  }
+  throttle->Predict(speculations, fingerprints);
+  std::vector<std::string> admitted;
+  for (size_t i = 0; i < speculations.size(); i++) {
+    if (IsWrite(speculations[i])) {
+      if (i == 0 && throttle->Admit(i, true)) {
+        admitted.push_back(std::move(speculations[i]));
+      }
+      break;
+    }
+    if (throttle->Admit(i, false)) {
+      admitted.push_back(std::move(speculations[i]));
+    }
+  }
+  speculations = std::move(admitted);
+}
+
+} // namespace
+
+bool CanSpeculate(const std::string &query, ServerGroup *server_group,
+                  int reserved_server, Speculator *speculator,
+                  SpeculationThrottle *throttle) {
+  auto speculations = speculator->TrySpeculate(query, server_group->Capacity());
+  if (speculations.size() == 0) {
+    return true;
+  }
+  if (IsWrite(speculations[0])) {
+    // Not worth waiting for the servers if it will not be sent.
+    if (throttle->Enabled() && !throttle->Worthwhile(speculations[0], true)) {
+      return true;
+    }
+    for (size_t i = 0; i < server_group->Size(); i++) {
+      if (!server_group->IsReadyForQuery(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return server_group->PickServer(reserved_server) != -1;
+}
+
+bool DoSpeculation(
+  const std::string &query,
+  StatementType type,
+  ServerGroup *server_group,
+  int reserved_server,
+  Speculator *speculator,
+  std::vector<bool> &need_rollback,
+  Prefetches &prefetches,
+  ResultCacheClient *result_cache,
+  SpeculationThrottle *throttle) {
+  auto start = Now();
+  int depth = server_group->Capacity();
+  speculator->TrySpeculate(query, depth);
+  auto speculations = speculator->Speculate(query, depth);
+  if (throttle->Enabled()) {
+    Throttle(throttle, speculations);
+  }
+  auto first_type = speculations.size() > 0 ? ClassifyStatement(speculations[0])
+                                            : StatementType::kOther;
+
+  // Reads prefetched before a write would return stale results.
+  bool keep_prefetches = IsReadStatement(type) && speculations.size() > 0 &&
+                         IsReadStatement(first_type);
+  std::vector<uint64_t> fingerprints;
+  if (keep_prefetches) {
+    for (auto &speculation : speculations) {
+      fingerprints.push_back(PrefetchTable::Fingerprint(speculation));
+    }
+  }
+  DiscardStale(server_group, prefetches, speculations, fingerprints, result_cache);
+  if (speculations.size() == 0) {
+    RecordSpeculationLatency(GetDuration(start));
+    return true;
+  }
+  // Built lazily by the speculator, and only needed before BackupFor()
+  // moves on to the next speculation.
+  std::string undo;
+  if (std::find(need_rollback.begin(), need_rollback.end(), true) != need_rollback.end()) {
+    undo = speculator->GetUndo();
+    result_cache->OnSpeculate(undo);
+  }
+
+  if (!IsReadStatement(first_type)) {
+    auto &speculation = speculations[0];
+    result_cache->OnSpeculate(speculation);
+    std::string savepoint;
+    for (size_t i = 0; i < server_group->Size(); i++) {
+      int num_queries = 1;
+      auto query_to_send = speculation;
+      server_group->WaitForServer(i);
+      if (i == 0) {
+        // The pre-image BackupFor() may pipeline here has to see the
+        // rollback, so that one goes on its own.
+        if (need_rollback[0] && undo.size() > 0 && !server_group->SendDiscarded(0, undo)) {
+          log_error("Failed to send undo to server 0");
+          return false;
+        }
+        need_rollback[0] = false;
+        speculator->BackupFor(speculation);
+        savepoint = speculator->GetSavepoint();
+      }
+      // Only the speculation's result reaches the pipeline, see
+      // ServerGroup::SendQuery().
+      if (savepoint.size() > 0) {
+        query_to_send = savepoint + "; " + query_to_send;
+        num_queries++;
+      }
+      if (need_rollback[i]) {
+        if (undo.size() > 0) {
+          query_to_send = undo + "; " + query_to_send;
+          num_queries++;
+        }
+        need_rollback[i] = false;
+      }
+      log_debug("Sending speculation %s to server %d", query_to_send.c_str(), i);
+      if (!server_group->SendQuery(i, query_to_send, num_queries, i == 0)) {
+        log_error("Failed to send write speculation to server %lu", i);
+        return false;
+      }
+    }
+    prefetches.Insert(speculation, PrefetchTable::Fingerprint(speculation),
+                      Prefetch{0, server_group->LastRequest(0), first_type, 0});
+    throttle->OnWriteSent(GetDuration(start));
+    log_debug("Speculation sent");
+    RecordSpeculationLatency(GetDuration(start));
+    return true;
+  }
+  speculator->BackupFor(speculations[0]);
+
+  for (size_t j = 0; j < speculations.size(); j++) {
+    auto &speculation = speculations[j];
+    auto speculation_type = j == 0 ? first_type : ClassifyStatement(speculation);
+    if (!IsReadStatement(speculation_type)) {
+      // Only sent once the reads before it have been asked for.
+      break;
+    }
+    uint64_t fingerprint = keep_prefetches ? fingerprints[j]
+                                           : PrefetchTable::Fingerprint(speculation);
+    if (prefetches.Find(speculation, fingerprint) != nullptr) {
+      continue;
+    }
+    // The first speculation waits for a server, as it always has; the
+    // rest of the chain only fills pipelines that have room.
+    int server = j == 0 ? server_group->WaitForSelectServer(reserved_server)
+                        : server_group->SelectServer(reserved_server);
+    if (server == -1) {
+      break;
+    }
+    // The server may be busy, so the undo goes as a request of its own.
+    if (need_rollback[server]) {
+      if (undo.size() > 0 && !server_group->SendDiscarded(server, undo)) {
+        log_error("Failed to send undo to server %d", server);
+        return false;
+      }
+      need_rollback[server] = false;
+    }
+    uint64_t cache_version = result_cache->Version();
+    log_debug("Sending speculation %s to server %d", speculation.c_str(), server);
+    if (!server_group->SendQuery(server, speculation, 1, true)) {
+      log_error("Failed to send speculation to server %d", server);
+      return false;
+    }
+    prefetches.Insert(speculation, fingerprint,
+                      Prefetch{server, server_group->LastRequest(server), speculation_type,
+                               cache_version});
+  }
+  log_debug("Speculation sent");
+  RecordSpeculationLatency(GetDuration(start));
+  return true;
+}
+
+size_t CopyToClient(std::pair<uint8_t*, size_t> &&result, Connection *client) {
+  memcpy(client->Buffer(), result.first, result.second);
+  return result.second;
+}
@@ -0,0 +1,72 @@
+#ifndef ROUTING_SRC_QUERY_UTILS_H_
+#define ROUTING_SRC_QUERY_UTILS_H_
+
+#include "mysqlrouter/connection.h"
+#include "prefetch_table.h"
+#include "result_cache.h"
+#include "server_group.h"
+#include "speculation_throttle.h"
+#include "speculator/speculator.h"
+#include "statement_type.h"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Helpers shared by the thread-per-connection path and the reactor
+// sessions for classifying client queries and issuing speculations.
+
+using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
+
+using Prefetches = PrefetchTable;
+
+extern uint8_t kOkPacket[11];
+extern thread_local int speculation_index;
+
+TimePoint Now();
+long GetDuration(TimePoint &start);
+double Mean(const std::vector<long> &latencies);
+double MeanSpeculationLatency();
+
+void DumpQueryStats(std::vector<std::string> &query_stats,
+                    const std::string &filename);
+void DumpLatency(std::vector<std::pair<int, long>> &latencies,
+                 const std::string &latency_name);
+
+bool IsQuery(uint8_t *buffer);
+void ExtractQuery(uint8_t *buffer, std::string &query,
+                  int &query_index, int &query_id);
+int ExtractID(const std::string &query);
+// For queries classified once, prefer the StatementType.
+bool IsRead(const std::string &query);
+bool IsWrite(const std::string &query);
+// Whether one of the prefetches is a write.
+bool HasWritePrefetch(const Prefetches &prefetches);
+
+void SetNeedRollback(std::vector<bool> &need_rollback, bool need);
+
+// Whether DoSpeculation() can run right now without spinning on a
+// server: a write speculation needs every server idle, a read one
+// needs room in the pipeline of a server other than the reserved one,
+// or of the reserved one if pipelines are deeper than one request. A
+// write the throttle would not send needs nothing.
+bool CanSpeculate(const std::string &query, ServerGroup *server_group,
+                  int reserved_server, Speculator *speculator,
+                  SpeculationThrottle *throttle);
+
+// Sends the next speculations: a write to every server, or a chain of up
+// to PipelineDepth() reads, each on the server expected to answer first.
+// Prefetches that are still part of the chain are kept, the others are
+// discarded, their results going to the result cache if they are in.
+// The reserved_server is necessary because there may be a gap between
+// checking the result has arrived and the checks below. Speculations
+// the throttle does not admit are not sent.
+bool DoSpeculation(const std::string &query, StatementType type, ServerGroup *server_group,
+                   int reserved_server, Speculator *speculator,
+                   std::vector<bool> &need_rollback, Prefetches &prefetches,
+                   ResultCacheClient *result_cache, SpeculationThrottle *throttle);
+
+size_t CopyToClient(std::pair<uint8_t*, size_t> &&result, Connection *client);
+
+#endif // ROUTING_SRC_QUERY_UTILS_H_
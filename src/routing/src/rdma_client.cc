@@ -1,5 +1,6 @@
 #include "mysqlrouter/rdma_client.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -23,7 +24,30 @@ static void ShowBinaryData(const char *data, size_t len) {
 }
 
 RdmaClient::RdmaClient(std::string hostname, int port) :
-    port_(port), hostname_(hostname), context_(nullptr) {}
+    port_(port), hostname_(hostname), context_(nullptr), read_offset_(0) {}
+
+ssize_t RdmaClient::Read(void *buffer, size_t size) {
+  if (read_offset_ == 0) {
+    const char *record;
+    size_t record_size;
+    if (!context_->buffer.Peek(&record, &record_size)) {
+      return -1;
+    }
+    memcpy(&message_, record, sizeof(message_));
+    context_->buffer.Commit();
+  }
+  // Copied straight out of the slot the message landed in.
+  size_t read_size = std::min<size_t>(size, message_.size - read_offset_);
+  memcpy(buffer, context_->recv_pool->Slot(message_.slot) + sizeof(size_t) + read_offset_, read_size);
+  read_offset_ += read_size;
+  if (read_offset_ == message_.size) {
+    read_offset_ = 0;
+    if (!context_->recv_pool->Release(message_.slot)) {
+      context_->buffer.SignalError();
+    }
+  }
+  return static_cast<ssize_t>(read_size);
+}
 
 Status RdmaClient::Connect() {
   struct addrinfo *addr;
@@ -56,21 +80,31 @@ char *RdmaClient::GetRemoteBuffer() {
 }
 
 ssize_t RdmaClient::SendToServer(void *buffer, size_t size) {
-  // This is the tricky part: recv has to be posted before a send is
-  // posted on the other side. Although we set rnr_retry_count to
-  // infinity, if this happens a lot, there will be a huge performance
-  // degradation. Therefore, we pre-post a receive before the send.
-  auto s = PostReceive(context_);
-  if (!s.ok()) {
-    return -1;
-  }
+  // The receives for the responses are kept posted by the pool.
   if (size == 0) {
     context_->num_skips++;
     return 0;
   }
-  *(reinterpret_cast<size_t *>(context_->send_region)) = size;
-  memcpy(context_->send_region + sizeof(size), buffer, size);
-  s = PostSend(context_, size + sizeof(size));
+  Status s;
+  struct ibv_mr *mr = nullptr;
+  if (FitsSendSlot(size)) {
+    s = PostSendFromSlot(context_, buffer, size);
+  } else if ((mr = FindBufferRegion(buffer, size)) != nullptr) {
+    // The caller reuses the buffer once this returns, say for the
+    // response, so a send straight from it has to have left by then.
+    s = PostSend(context_, buffer, size, mr);
+    if (s.ok() && !WaitForSend(context_, context_->num_sends)) {
+      return -1;
+    }
+  } else {
+    // The previous copy may not have left yet.
+    if (!WaitForSend(context_, context_->copy_area_send)) {
+      return -1;
+    }
+    *(reinterpret_cast<size_t *>(context_->send_region)) = size;
+    memcpy(context_->send_region + sizeof(size), buffer, size);
+    s = PostSend(context_, size + sizeof(size));
+  }
   if (s.ok()) {
     // std::cerr << size << " bytes sent" << std::endl;
     // ShowBinaryData(reinterpret_cast<char *>(buffer), size);
@@ -80,6 +114,21 @@ ssize_t RdmaClient::SendToServer(void *buffer, size_t size) {
   }
 }
 
+Status RdmaClient::RegisterBuffer(void *buffer, size_t size) {
+  return RdmaCommunicator::RegisterBuffer(context_, buffer, size);
+}
+
+struct ibv_mr *RdmaClient::FindBufferRegion(void *buffer, size_t size) {
+  auto begin = reinterpret_cast<char *>(buffer);
+  for (auto mr : context_->buffer_mrs) {
+    auto mr_begin = reinterpret_cast<char *>(mr->addr);
+    if (begin >= mr_begin && begin + size <= mr_begin + mr->length) {
+      return mr;
+    }
+  }
+  return nullptr;
+}
+
 void RdmaClient::Disconnect() {
   rdma_disconnect(cm_id_);
   struct rdma_cm_event *event = nullptr;
@@ -115,7 +164,9 @@ Status RdmaClient::OnAddressResolved(struct rdma_cm_id *id) {
     return status_or.status();
   }
   context_ = status_or.Take();
-  RETURN_IF_ERROR(PostReceive(context_));
+  if (!context_->recv_pool->PostAll()) {
+    return Status::Err("Failed to post the receive buffers");
+  }
   ERROR_IF_NON_ZERO(rdma_resolve_route(id, kTimeoutInMs));
 
   return Status::Ok();
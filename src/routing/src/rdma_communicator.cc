@@ -11,6 +11,13 @@
 const size_t kMaxBufferSize = kMySQLMaxPacketLen + sizeof(size_t);
 // const int kMaxBufferSize = 1000;
 const int kQueueDepth = 2048;
+// Responses the server can send ahead of the reader. Every slot takes
+// kMaxBufferSize of registered memory.
+const size_t kNumRecvSlots = 4;
+// Packets that fit, length included, are copied into the next of these
+// send slots, which is only reused kNumSendSlots sends later.
+const size_t kSendSlotSize = 16 * 1024;
+const size_t kNumSendSlots = 64;
 
 static void ShowBinaryData(const char *data, size_t len) {
   std::stringstream ss;
@@ -24,16 +31,6 @@ static void ShowBinaryData(const char *data, size_t len) {
   std::cerr << "Data received from backend is " << ss.str() << std::endl;
 }
 
-static void Retry(Context *context, bool is_recv) {
-  if (is_recv) {
-    RdmaCommunicator::PostReceive(context);
-    return;
-  }
-  size_t size = *(reinterpret_cast<size_t *>(context->recv_region));
-  RdmaCommunicator::PostSend(context, size + sizeof(size_t));
-  return;
-}
-
 static void ShowQpState(Context *context) {
   struct ibv_qp_attr attr;
   struct ibv_qp_init_attr init_attr;
@@ -132,83 +129,136 @@ void RdmaCommunicator::OnWorkCompletion(Context *context, struct ibv_wc *wc) {
     context->buffer.SignalError();
     return;
   }
+  if (wc->opcode == IBV_WC_SEND) {
+    context->num_completed_sends.store(wc->wr_id, std::memory_order_release);
+    return;
+  }
   if (wc->opcode & IBV_WC_RECV) {
-    size_t size = *(reinterpret_cast<size_t *>(context->recv_region));
-    // std::cerr << "Response of size " << size << " received, pushing to the buffer" << std::endl;
-    if (size == kMySQLMaxPacketLen) {
-      PostReceive(context);
-    }
-    // ShowBinaryData(context->recv_region + sizeof(size_t), size);
+    ReceivedMessage message;
+    message.slot = static_cast<uint32_t>(wc->wr_id);
+    context->recv_pool->OnReceived(message.slot);
+    size_t size = *(reinterpret_cast<size_t *>(context->recv_pool->Slot(message.slot)));
+    message.size = static_cast<uint32_t>(size);
+    // ShowBinaryData(context->recv_pool->Slot(message.slot) + sizeof(size_t), size);
+    bool skip = size == 0;
     if (context->num_skips > 0) {
       context->num_skips--;
-    } else {
-      context->buffer.Write(context->recv_region + sizeof(size_t), size);
+      skip = true;
     }
-  }
-}
-
-void *RdmaCommunicator::PollCompletionQueue(void *arg) {
-  Context *context = (Context *) arg;
-  struct ibv_cq *cq = context->completion_queue;
-  struct ibv_cq *ev_cq;
-  struct ibv_wc wc;
-  Context *queue_context;
-
-  while (true) {
-    RETURN_IF_NON_ZERO(ibv_get_cq_event(context->completion_channel, &ev_cq, reinterpret_cast<void **>(&queue_context)));
-    ibv_ack_cq_events(ev_cq, 1);
-    RETURN_IF_NON_ZERO(ibv_req_notify_cq(ev_cq, 0));
-
-    while (ibv_poll_cq(cq, 1, &wc) > 0) {
-      OnWorkCompletion(context, &wc);
+    if (skip) {
+      if (!context->recv_pool->Release(message.slot)) {
+        context->buffer.SignalError();
+      }
+    } else if (!context->buffer.Write(reinterpret_cast<const char *>(&message), sizeof(message))) {
+      context->buffer.SignalError();
     }
   }
-
-  return nullptr;
 }
 
-Status RdmaCommunicator::PostReceive(Context *context) {
+Status RdmaCommunicator::PostReceive(Context *context, uint32_t slot) {
   struct ibv_recv_wr wr, *bad_wr = nullptr;
   struct ibv_sge sge;
 
+  wr.wr_id = slot;
   wr.next = nullptr;
   wr.sg_list = &sge;
   wr.num_sge = 1;
 
-  sge.addr = reinterpret_cast<uintptr_t>(context->recv_region);
-  sge.length = kMaxBufferSize;
+  sge.addr = reinterpret_cast<uintptr_t>(context->recv_pool->Slot(slot));
+  sge.length = static_cast<uint32_t>(context->recv_pool->SlotSize());
   sge.lkey = context->recv_mr->lkey;
   ERROR_IF_NON_ZERO(ibv_post_recv(context->queue_pair, &wr, &bad_wr));
   return Status::Ok();
 }
 
 Status RdmaCommunicator::PostSend(Context *context, size_t size) {
-  struct ibv_send_wr wr, *bad_wr = nullptr;
   struct ibv_sge sge;
 
-  memset(&wr, 0, sizeof(wr));
+  sge.addr = reinterpret_cast<uintptr_t>(context->send_region);
+  sge.length = static_cast<uint32_t>(size);
+  sge.lkey = context->send_mr->lkey;
+  RETURN_IF_ERROR(PostSend(context, &sge, 1));
+  context->copy_area_send = context->num_sends;
+  return Status::Ok();
+}
 
-  // We need to do at least one signaled send per kQueueDepth sends.
-  int send_flags = 0;
-  int num_unsignaled_sends = ++context->unsignaled_sends;
-  if (num_unsignaled_sends == kQueueDepth - 10) {
-    send_flags = IBV_SEND_SIGNALED;
-    context->unsignaled_sends = 0;
-  }
+bool RdmaCommunicator::FitsSendSlot(size_t size) {
+  return sizeof(size_t) + size <= kSendSlotSize;
+}
 
-  wr.opcode = IBV_WR_SEND;
-  wr.sg_list = &sge;
-  wr.num_sge = 1;
-  wr.send_flags = send_flags;
+Status RdmaCommunicator::PostSendFromSlot(Context *context, const void *buffer, size_t size) {
+  uint32_t slot = context->next_send_slot++ % kNumSendSlots;
+  // Normally long done, as the send queue drains in order.
+  if (!WaitForSend(context, context->send_slot_sends[slot])) {
+    return Status::Err("Connection failed before a send slot was free");
+  }
+  char *data = context->send_region + kMaxBufferSize + kQueueDepth * sizeof(size_t) +
+      slot * kSendSlotSize;
+  *(reinterpret_cast<size_t *>(data)) = size;
+  memcpy(data + sizeof(size_t), buffer, size);
 
-  sge.addr = reinterpret_cast<uintptr_t>(context->send_region);
-  sge.length = static_cast<uint32_t>(size);
+  struct ibv_sge sge;
+  sge.addr = reinterpret_cast<uintptr_t>(data);
+  sge.length = static_cast<uint32_t>(sizeof(size_t) + size);
   sge.lkey = context->send_mr->lkey;
+  RETURN_IF_ERROR(PostSend(context, &sge, 1));
+  context->send_slot_sends[slot] = context->num_sends;
+  return Status::Ok();
+}
+
+Status RdmaCommunicator::PostSend(Context *context, void *buffer, size_t size, struct ibv_mr *mr) {
+  struct ibv_sge sges[2];
+
+  // The length goes out of a header slot of its own past the copy area,
+  // which is only reused kQueueDepth sends later, once the send that used
+  // it has left the queue.
+  char *header = context->send_region + kMaxBufferSize +
+      (context->next_send_header++ % kQueueDepth) * sizeof(size_t);
+  *(reinterpret_cast<size_t *>(header)) = size;
+
+  sges[0].addr = reinterpret_cast<uintptr_t>(header);
+  sges[0].length = sizeof(size_t);
+  sges[0].lkey = context->send_mr->lkey;
+  sges[1].addr = reinterpret_cast<uintptr_t>(buffer);
+  sges[1].length = static_cast<uint32_t>(size);
+  sges[1].lkey = mr->lkey;
+  return PostSend(context, sges, 2);
+}
+
+Status RdmaCommunicator::PostSend(Context *context, struct ibv_sge *sg_list, int num_sge) {
+  struct ibv_send_wr wr, *bad_wr = nullptr;
+
+  memset(&wr, 0, sizeof(wr));
+
+  // Every send is signaled, as the memory it goes out of is reused once
+  // it completes.
+  wr.wr_id = context->num_sends + 1;
+  wr.opcode = IBV_WR_SEND;
+  wr.sg_list = sg_list;
+  wr.num_sge = num_sge;
+  wr.send_flags = IBV_SEND_SIGNALED;
 
   while (!context->connected) {
     // Left empry.
   }
   ERROR_IF_NON_ZERO(ibv_post_send(context->queue_pair, &wr, &bad_wr));
+  context->num_sends++;
+  return Status::Ok();
+}
+
+bool RdmaCommunicator::WaitForSend(Context *context, uint64_t send) {
+  while (context->num_completed_sends.load(std::memory_order_acquire) < send) {
+    if (context->buffer.HasError()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Status RdmaCommunicator::RegisterBuffer(Context *context, void *buffer, size_t size) {
+  struct ibv_mr *mr;
+  ERROR_IF_ZERO(mr = ibv_reg_mr(context->protection_domain, buffer, size, IBV_ACCESS_LOCAL_WRITE));
+  context->buffer_mrs.push_back(mr);
   return Status::Ok();
 }
 
@@ -218,22 +268,35 @@ Status RdmaCommunicator::InitContext(Context *context, struct rdma_cm_id *id) {
   context->event_channel = event_channel_;
   context->device_context = id->verbs;
   ERROR_IF_ZERO(context->protection_domain = ibv_alloc_pd(context->device_context));
-  ERROR_IF_ZERO(context->completion_channel = ibv_create_comp_channel(context->device_context));
-  ERROR_IF_ZERO(context->completion_queue =
-    ibv_create_cq(context->device_context, 64, nullptr, context->completion_channel, 0));
-  ERROR_IF_NON_ZERO(ibv_req_notify_cq(context->completion_queue, 0));
-  context->cq_poller_thread = std::thread(RdmaCommunicator::PollCompletionQueue, context);
+  // Every send and receive may complete before the poller gets to them.
+  int num_cqes = 2 * kQueueDepth;
+  CqPoller *poller;
+  ERROR_IF_ZERO(poller = CqPollerPool::instance()->Assign(context->device_context, num_cqes,
+                                                           &RdmaCommunicator::OnWorkCompletion));
+  context->completion_queue = poller->completion_queue();
 
   struct ibv_qp_init_attr queue_pair_attr;
   BuildQueuePairAttr(context, &queue_pair_attr);
-  ERROR_IF_NON_ZERO(rdma_create_qp(id, context->protection_domain, &queue_pair_attr));
+  int created = rdma_create_qp(id, context->protection_domain, &queue_pair_attr);
+  if (created != 0) {
+    poller->Release(num_cqes);
+  }
+  ERROR_IF_NON_ZERO(created);
   context->queue_pair = id->qp;
+  context->poller = poller;
+  context->num_cqes = num_cqes;
+  poller->Add(context->queue_pair->qp_num, context);
 
   id->context = context;
 
   RETURN_IF_ERROR(RegisterMemoryRegion(context));
   context->queue_depth = kQueueDepth;
-  context->unsignaled_sends = 0;
+  context->next_send_header = 0;
+  context->next_send_slot = 0;
+  context->send_slot_sends.assign(kNumSendSlots, 0);
+  context->num_sends = 0;
+  context->num_completed_sends = 0;
+  context->copy_area_send = 0;
   context->num_skips = 0;
   return Status::Ok();
 }
@@ -257,7 +320,8 @@ void RdmaCommunicator::BuildQueuePairAttr(Context *context, struct ibv_qp_init_a
 
   attributes->cap.max_send_wr = kQueueDepth;
   attributes->cap.max_recv_wr = kQueueDepth;
-  attributes->cap.max_send_sge = 1;
+  // The length and the packet of a send from a registered buffer.
+  attributes->cap.max_send_sge = 2;
   attributes->cap.max_recv_sge = 1;
 }
 
@@ -269,19 +333,26 @@ void RdmaCommunicator::BuildParams(struct rdma_conn_param *params) {
 }
 
 Status RdmaCommunicator::RegisterMemoryRegion(Context *context) {
-  context->recv_region = reinterpret_cast<char *>(malloc(kMaxBufferSize * sizeof(char)));
-  context->send_region = reinterpret_cast<char *>(malloc(kMaxBufferSize * sizeof(char)));
+  context->recv_pool.reset(new RecvPool(kNumRecvSlots, kMaxBufferSize));
+  context->recv_pool->SetPostFunction([context](uint32_t slot) {
+    return PostReceive(context, slot).ok();
+  });
+  // Copies of large packets from unregistered buffers, the send headers,
+  // then the send slots.
+  size_t send_region_size = kMaxBufferSize + kQueueDepth * sizeof(size_t) +
+      kNumSendSlots * kSendSlotSize;
+  context->send_region = reinterpret_cast<char *>(malloc(send_region_size * sizeof(char)));
 
   ERROR_IF_ZERO(context->recv_mr = ibv_reg_mr(
     context->protection_domain,
-    context->recv_region,
-    kMaxBufferSize,
+    context->recv_pool->Region(),
+    context->recv_pool->RegionSize(),
     IBV_ACCESS_LOCAL_WRITE));
 
   ERROR_IF_ZERO(context->send_mr = ibv_reg_mr(
     context->protection_domain,
     context->send_region,
-    kMaxBufferSize,
+    send_region_size,
     IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ));
 
   return Status::Ok();
@@ -0,0 +1,330 @@
+#include "reactor.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static const int kMaxEvents = 64;
+// How long an idle worker sleeps in epoll_wait() before checking
+// whether it has been stopped.
+static const int kIdleWaitMs = 100;
+static const int kParkTimeoutMs = 1;
+// How often the memory footprint of the sessions is recomputed.
+static const std::chrono::seconds kFootprintInterval(1);
+
+ReactorWorker::ReactorWorker(const std::string &name, ServerGroupPool *server_group_pool,
+                             SpeculatorFactory speculator_factory,
+                             ResultCache *result_cache,
+                             const SpeculationThrottle::Options &throttle_options,
+                             std::atomic<uint16_t> *active_routes) :
+    name_(name), server_group_pool_(server_group_pool),
+    speculator_factory_(std::move(speculator_factory)),
+    result_cache_(result_cache), throttle_options_(throttle_options),
+    active_routes_(active_routes), epoll_fd_(-1), wakeup_fd_(-1),
+    stopping_(false), num_sessions_(0), memory_footprint_(0), peak_sessions_(0),
+    peak_memory_footprint_(0), wait_policy_(WaitPolicy::Default()) {}
+
+ReactorWorker::~ReactorWorker() {
+  Stop();
+  if (wakeup_fd_ >= 0) {
+    close(wakeup_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    close(epoll_fd_);
+  }
+}
+
+bool ReactorWorker::Start() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    log_error("[%s] epoll_create1 failed: %s", name_.c_str(), strerror(errno));
+    return false;
+  }
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeup_fd_ < 0) {
+    log_error("[%s] eventfd failed: %s", name_.c_str(), strerror(errno));
+    return false;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = wakeup_fd_;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event) < 0) {
+    log_error("[%s] epoll_ctl failed: %s", name_.c_str(), strerror(errno));
+    return false;
+  }
+  thread_ = std::thread(&ReactorWorker::Run, this);
+  return true;
+}
+
+void ReactorWorker::Stop() {
+  stopping_.store(true);
+  if (wakeup_fd_ >= 0) {
+    uint64_t one = 1;
+    if (write(wakeup_fd_, &one, sizeof(one)) < 0) {
+      log_debug("[%s] Failed to wake up reactor worker", name_.c_str());
+    }
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void ReactorWorker::AddClient(int client_fd) {
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_clients_.push_back(client_fd);
+  }
+  uint64_t one = 1;
+  if (write(wakeup_fd_, &one, sizeof(one)) < 0) {
+    log_error("[%s] Failed to wake up reactor worker", name_.c_str());
+  }
+}
+
+void ReactorWorker::AcceptPending() {
+  std::vector<int> clients;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    clients.swap(pending_clients_);
+  }
+  for (auto client_fd : clients) {
+    // The servers are picked once the client has sent its user and schema.
+    std::unique_ptr<Session> session(new Session(
+        Connection(client_fd, routing::SocketOperations::instance()),
+        server_group_pool_, speculator_factory_, result_cache_, throttle_options_));
+    if (!session->Start()) {
+      continue;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = client_fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &event) < 0) {
+      log_error("[%s] epoll_ctl failed: %s", name_.c_str(), strerror(errno));
+      continue;
+    }
+    num_sessions_++;
+    ++*active_routes_;
+    if (num_sessions_.load(std::memory_order_relaxed) > PeakSessions()) {
+      peak_sessions_.store(num_sessions_.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+    }
+    sessions_[client_fd] = Entry{std::move(session), true, false};
+  }
+}
+
+bool ReactorWorker::Arm(int fd) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.fd = fd;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+    log_error("[%s] epoll_ctl failed: %s", name_.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void ReactorWorker::Update(int fd, Entry &entry) {
+  Session *session = entry.session.get();
+  if (!session->IsClosed() && session->NeedsPolling()) {
+    if (!entry.polling) {
+      entry.polling = true;
+      polling_.push_back(fd);
+    }
+    return;
+  }
+  if (!session->IsClosed() && !entry.armed) {
+    entry.armed = Arm(fd);
+    if (!entry.armed) {
+      session->Close();
+    }
+  }
+  if (session->IsClosed() && !entry.polling) {
+    // Reaped before new clients are added, since a new client may be
+    // given the descriptor of a closed one.
+    Reap(session);
+    sessions_.erase(fd);
+  }
+}
+
+bool ReactorWorker::PollSessions() {
+  bool progress = false;
+  for (size_t i = 0; i < polling_.size();) {
+    int fd = polling_[i];
+    auto iter = sessions_.find(fd);
+    Session *session = iter == sessions_.end() ? nullptr : iter->second.session.get();
+    if (session != nullptr && session->NeedsPolling() && session->Poll()) {
+      progress = true;
+    }
+    if (session != nullptr && !session->IsClosed() && session->NeedsPolling()) {
+      i++;
+      continue;
+    }
+    polling_[i] = polling_.back();
+    polling_.pop_back();
+    if (session != nullptr) {
+      iter->second.polling = false;
+      Update(fd, iter->second);
+    }
+  }
+  return progress;
+}
+
+void ReactorWorker::Reap(Session *session) {
+  num_sessions_--;
+  --*active_routes_;
+  log_debug("[%s] Session stopped (up:%zub;down:%zub)", name_.c_str(),
+            session->bytes_up(), session->bytes_down());
+}
+
+// Sessions only get their servers after the client handshake and may hand
+// them back to the pool before they are reaped, so the footprint is
+// recomputed instead of being tracked per session.
+void ReactorWorker::UpdateMemoryFootprint() {
+  size_t footprint = 0;
+  for (auto &entry : sessions_) {
+    footprint += entry.second.session->MemoryFootprint();
+  }
+  if (footprint > PeakMemoryFootprint()) {
+    peak_memory_footprint_.store(footprint, std::memory_order_relaxed);
+  }
+  if (footprint != memory_footprint_.load(std::memory_order_relaxed)) {
+    memory_footprint_.store(footprint, std::memory_order_relaxed);
+    log_debug("[%s] Worker has %lu sessions using %lu bytes", name_.c_str(),
+              NumSessions(), footprint);
+  }
+}
+
+void ReactorWorker::Run() {
+  struct epoll_event events[kMaxEvents];
+  uint32_t idle_polls = 0;
+  auto next_footprint = std::chrono::steady_clock::now();
+  while (!stopping_.load()) {
+    int timeout = kIdleWaitMs;
+    if (!polling_.empty()) {
+      bool park = wait_policy_.park && idle_polls >= wait_policy_.spin_budget;
+      timeout = park ? kParkTimeoutMs : 0;
+    }
+    int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_error("[%s] epoll_wait failed: %s", name_.c_str(), strerror(errno));
+      break;
+    }
+    bool has_new_clients = false;
+    for (int i = 0; i < num_events; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wakeup_fd_) {
+        uint64_t count;
+        while (read(wakeup_fd_, &count, sizeof(count)) > 0) {}
+        has_new_clients = true;
+        continue;
+      }
+      auto iter = sessions_.find(fd);
+      if (iter == sessions_.end()) {
+        continue;
+      }
+      // Disarmed until Update() finds the session waiting for the client.
+      iter->second.armed = false;
+      if ((events[i].events & EPOLLIN) == 0) {
+        iter->second.session->Close();
+      } else {
+        iter->second.session->OnClientReadable();
+      }
+      Update(fd, iter->second);
+    }
+    bool progress = PollSessions() || num_events > 0;
+    idle_polls = progress ? 0 : idle_polls + 1;
+    if (has_new_clients) {
+      AcceptPending();
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_footprint) {
+      UpdateMemoryFootprint();
+      next_footprint = now + kFootprintInterval;
+    }
+  }
+  for (auto &entry : sessions_) {
+    entry.second.session->Close();
+    Reap(entry.second.session.get());
+  }
+  sessions_.clear();
+  polling_.clear();
+  memory_footprint_.store(0, std::memory_order_relaxed);
+}
+
+Reactor::Reactor(const std::string &name, ServerGroupPool *server_group_pool,
+                 SpeculatorFactory speculator_factory, ResultCache *result_cache,
+                 const SpeculationThrottle::Options &throttle_options,
+                 size_t num_workers, std::atomic<uint16_t> *active_routes) : next_worker_(0) {
+  for (size_t i = 0; i < num_workers; i++) {
+    workers_.emplace_back(new ReactorWorker(name, server_group_pool, speculator_factory,
+                                            result_cache, throttle_options, active_routes));
+  }
+}
+
+Reactor::~Reactor() {
+  Stop();
+}
+
+bool Reactor::Start() {
+  for (auto &worker : workers_) {
+    if (!worker->Start()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Reactor::Stop() {
+  for (auto &worker : workers_) {
+    worker->Stop();
+  }
+}
+
+void Reactor::Dispatch(int client_fd) {
+  workers_[next_worker_]->AddClient(client_fd);
+  next_worker_ = (next_worker_ + 1) % workers_.size();
+}
+
+size_t Reactor::NumSessions() {
+  size_t num_sessions = 0;
+  for (auto &worker : workers_) {
+    num_sessions += worker->NumSessions();
+  }
+  return num_sessions;
+}
+
+size_t Reactor::MemoryFootprint() {
+  size_t footprint = 0;
+  for (auto &worker : workers_) {
+    footprint += worker->MemoryFootprint();
+  }
+  return footprint;
+}
+
+size_t Reactor::PeakSessions() {
+  size_t peak = 0;
+  for (auto &worker : workers_) {
+    peak += worker->PeakSessions();
+  }
+  return peak;
+}
+
+size_t Reactor::PeakMemoryFootprint() {
+  size_t peak = 0;
+  for (auto &worker : workers_) {
+    peak += worker->PeakMemoryFootprint();
+  }
+  return peak;
+}
@@ -0,0 +1,113 @@
+#ifndef ROUTING_SRC_REACTOR_H_
+#define ROUTING_SRC_REACTOR_H_
+
+#include "server_group_pool.h"
+#include "session.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Drives client sessions from a fixed pool of epoll workers instead of a
+// thread per connection. Client sockets are watched with epoll, one shot,
+// and only re-armed once their session waits for the client again, so
+// that a client sending early or hanging up does not wake the worker.
+// Backend connections have no pollable descriptor, so a worker keeps
+// polling the sessions waiting on the servers, and once the spin budget
+// of the wait policy is used up without progress it polls once per
+// kParkTimeoutMs instead.
+class ReactorWorker {
+public:
+  ReactorWorker(const std::string &name, ServerGroupPool *server_group_pool,
+                SpeculatorFactory speculator_factory, ResultCache *result_cache,
+                const SpeculationThrottle::Options &throttle_options,
+                std::atomic<uint16_t> *active_routes);
+  ~ReactorWorker();
+
+  bool Start();
+  void Stop();
+  void AddClient(int client_fd);
+  size_t NumSessions() {
+    return num_sessions_.load(std::memory_order_relaxed);
+  }
+  size_t MemoryFootprint() {
+    return memory_footprint_.load(std::memory_order_relaxed);
+  }
+  size_t PeakSessions() {
+    return peak_sessions_.load(std::memory_order_relaxed);
+  }
+  size_t PeakMemoryFootprint() {
+    return peak_memory_footprint_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Entry {
+    std::unique_ptr<Session> session;
+    // Whether the client descriptor is armed in epoll.
+    bool armed;
+    // Whether the descriptor is in polling_.
+    bool polling;
+  };
+
+  void Run();
+  void AcceptPending();
+  // Called after the session of fd ran: reaps it once closed, lists it
+  // for polling while it waits on the servers, and arms its client
+  // descriptor otherwise.
+  void Update(int fd, Entry &entry);
+  bool Arm(int fd);
+  // Polls the sessions waiting on the servers; returns whether any made
+  // progress.
+  bool PollSessions();
+  void Reap(Session *session);
+  void UpdateMemoryFootprint();
+
+  std::string name_;
+  ServerGroupPool *server_group_pool_;
+  SpeculatorFactory speculator_factory_;
+  ResultCache *result_cache_;
+  SpeculationThrottle::Options throttle_options_;
+  std::atomic<uint16_t> *active_routes_;
+  int epoll_fd_;
+  int wakeup_fd_;
+  std::atomic<bool> stopping_;
+  std::thread thread_;
+  std::mutex pending_mutex_;
+  std::vector<int> pending_clients_;
+  std::unordered_map<int, Entry> sessions_;
+  // Client descriptors of the sessions waiting on the servers.
+  std::vector<int> polling_;
+  std::atomic<size_t> num_sessions_;
+  std::atomic<size_t> memory_footprint_;
+  std::atomic<size_t> peak_sessions_;
+  std::atomic<size_t> peak_memory_footprint_;
+  WaitPolicy wait_policy_;
+};
+
+class Reactor {
+public:
+  Reactor(const std::string &name, ServerGroupPool *server_group_pool,
+          SpeculatorFactory speculator_factory, ResultCache *result_cache,
+          const SpeculationThrottle::Options &throttle_options, size_t num_workers, std::atomic<uint16_t> *active_routes);
+  ~Reactor();
+
+  bool Start();
+  void Stop();
+  void Dispatch(int client_fd);
+  size_t NumSessions();
+  size_t MemoryFootprint();
+  // Sums of the peaks of every worker.
+  size_t PeakSessions();
+  size_t PeakMemoryFootprint();
+
+private:
+  std::vector<std::unique_ptr<ReactorWorker>> workers_;
+  size_t next_worker_;
+};
+
+#endif // ROUTING_SRC_REACTOR_H_
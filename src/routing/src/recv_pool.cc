@@ -0,0 +1,24 @@
+#include "mysqlrouter/recv_pool.h"
+
+RecvPool::RecvPool(size_t num_slots, size_t slot_size) :
+    num_slots_(num_slots), slot_size_(slot_size), region_(new char[num_slots * slot_size]),
+    num_posted_(0) {}
+
+bool RecvPool::PostAll() {
+  for (uint32_t slot = 0; slot < num_slots_; slot++) {
+    if (!Release(slot)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RecvPool::Release(uint32_t slot) {
+  // Counted first: the message may land before post_() returns.
+  num_posted_.fetch_add(1, std::memory_order_relaxed);
+  if (!post_(slot)) {
+    num_posted_.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,560 @@
+#include "result_cache.h"
+#include "prefetch_table.h"
+
+#include "mysqlrouter/mysql_constant.h"
+
+#include <algorithm>
+
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+// A name, lower case and without quotes or qualifier, or a symbol.
+struct Token {
+  char symbol;
+  std::string name;
+};
+
+const char *kLockingWords[] = {"into", "for", "lock"};
+
+// Never the same result twice, with or without parentheses.
+const char *kVolatileWords[] = {
+  "current_date", "current_time", "current_timestamp", "current_user",
+  "localtime", "localtimestamp", "utc_date", "utc_time", "utc_timestamp",
+};
+
+// Only when called.
+const char *kVolatileFunctions[] = {
+  "now", "sysdate", "curdate", "curtime", "unix_timestamp", "rand", "uuid",
+  "uuid_short", "last_insert_id", "found_rows", "row_count", "connection_id",
+  "user", "session_user", "system_user", "database", "schema", "sleep",
+  "get_lock", "release_lock", "is_free_lock", "is_used_lock",
+};
+
+// Ends the table list of a FROM clause. Joins do not: a join condition
+// may be followed by more tables.
+const char *kClauseWords[] = {
+  "where", "group", "having", "order", "limit", "union", "window", "procedure",
+};
+
+template <size_t N>
+bool IsOneOf(const std::string &word, const char *(&words)[N]) {
+  for (auto candidate : words) {
+    if (word == candidate) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsNameChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+size_t SkipIgnorable(const std::string &sql, size_t pos) {
+  while (pos < sql.size()) {
+    char c = sql[pos];
+    if (isspace(static_cast<unsigned char>(c))) {
+      pos++;
+    } else if (c == '/' && pos + 1 < sql.size() && sql[pos + 1] == '*') {
+      auto close = sql.find("*/", pos + 2);
+      pos = close == std::string::npos ? sql.size() : close + 2;
+    } else if (c == '#' || (c == '-' && pos + 2 < sql.size() && sql[pos + 1] == '-' &&
+                            isspace(static_cast<unsigned char>(sql[pos + 2])))) {
+      auto newline = sql.find('\n', pos);
+      pos = newline == std::string::npos ? sql.size() : newline + 1;
+    } else {
+      break;
+    }
+  }
+  return pos;
+}
+
+// Past the quoted string or identifier starting at pos; appends the
+// contents to name if given.
+size_t SkipQuoted(const std::string &sql, size_t pos, std::string *name) {
+  char quote = sql[pos++];
+  while (pos < sql.size()) {
+    char c = sql[pos++];
+    if (c == '\\' && quote != '`' && pos < sql.size()) {
+      pos++;
+    } else if (c == quote) {
+      if (pos < sql.size() && sql[pos] == quote) {
+        pos++;
+      } else {
+        break;
+      }
+    } else if (name != nullptr) {
+      name->push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+    }
+  }
+  return pos;
+}
+
+// Past the name at pos, which is stored lower case.
+size_t ReadName(const std::string &sql, size_t pos, std::string *name) {
+  name->clear();
+  if (sql[pos] == '`') {
+    return SkipQuoted(sql, pos, name);
+  }
+  while (pos < sql.size() && IsNameChar(sql[pos])) {
+    name->push_back(static_cast<char>(tolower(static_cast<unsigned char>(sql[pos]))));
+    pos++;
+  }
+  return pos;
+}
+
+std::vector<Token> Tokenize(const std::string &sql) {
+  std::vector<Token> tokens;
+  size_t pos = SkipIgnorable(sql, 0);
+  while (pos < sql.size()) {
+    char c = sql[pos];
+    if (c == '`' || IsNameChar(c)) {
+      tokens.push_back(Token{0, std::string()});
+      pos = ReadName(sql, pos, &tokens.back().name);
+      // Only the last part of a qualified name is kept.
+      while (pos + 1 < sql.size() && sql[pos] == '.' &&
+             (sql[pos + 1] == '`' || IsNameChar(sql[pos + 1]))) {
+        pos = ReadName(sql, pos + 1, &tokens.back().name);
+      }
+    } else if (c == '\'' || c == '"') {
+      tokens.push_back(Token{'\'', std::string()});
+      pos = SkipQuoted(sql, pos, nullptr);
+    } else {
+      tokens.push_back(Token{c, std::string()});
+      pos++;
+    }
+    pos = SkipIgnorable(sql, pos);
+  }
+  return tokens;
+}
+
+bool IsName(const std::vector<Token> &tokens, size_t i, const char *name = nullptr) {
+  return i < tokens.size() && tokens[i].symbol == 0 &&
+         (name == nullptr || tokens[i].name == name);
+}
+
+void AddTable(const std::string &table, std::vector<std::string> *tables) {
+  if (std::find(tables->begin(), tables->end(), table) == tables->end()) {
+    tables->push_back(table);
+  }
+}
+
+// The tables written by the statement in tokens [begin, end).
+bool StatementWrites(const std::vector<Token> &tokens, size_t begin, size_t end,
+                     std::vector<std::string> *tables) {
+  static const char *kNoTables[] = {
+    "select", "show", "begin", "start", "commit", "rollback", "savepoint",
+    "release", "set",
+  };
+  static const char *kModifiers[] = {
+    "low_priority", "delayed", "high_priority", "quick", "ignore",
+  };
+  if (begin == end) {
+    return true;
+  }
+  if (!IsName(tokens, begin)) {
+    return false;
+  }
+  auto &verb = tokens[begin].name;
+  if (IsOneOf(verb, kNoTables)) {
+    return true;
+  }
+  size_t i = begin + 1;
+  while (i < end && IsName(tokens, i) && IsOneOf(tokens[i].name, kModifiers)) {
+    i++;
+  }
+  if (verb == "insert" || verb == "replace") {
+    if (IsName(tokens, i, "into")) {
+      i++;
+    }
+  } else if (verb == "delete") {
+    // Multi-table deletes name their tables before FROM.
+    if (!IsName(tokens, i, "from")) {
+      return false;
+    }
+    i++;
+  } else if (verb != "update") {
+    return false;
+  }
+  if (i >= end || !IsName(tokens, i)) {
+    return false;
+  }
+  AddTable(tokens[i].name, tables);
+  if (verb == "insert" || verb == "replace") {
+    return true;
+  }
+  // Only single-table updates and deletes are understood.
+  for (i++; i < end; i++) {
+    if (IsName(tokens, i, "set") || IsName(tokens, i, "where") ||
+        IsName(tokens, i, "order") || IsName(tokens, i, "limit")) {
+      break;
+    }
+    if (tokens[i].symbol == ',' || IsName(tokens, i, "join") || IsName(tokens, i, "using")) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StartsWithWord(const std::string &sql, const char *word) {
+  size_t pos = SkipIgnorable(sql, 0);
+  size_t length = strlen(word);
+  if (sql.size() - pos < length || strncasecmp(sql.c_str() + pos, word, length) != 0) {
+    return false;
+  }
+  return pos + length == sql.size() || !IsNameChar(sql[pos + length]);
+}
+
+// The value of SET autocommit = ..., if the statement sets it.
+bool AutocommitValue(const std::string &sql, bool *enabled) {
+  auto tokens = Tokenize(sql);
+  for (size_t i = 0; i + 2 < tokens.size(); i++) {
+    if (IsName(tokens, i, "autocommit") && tokens[i + 1].symbol == '=' &&
+        IsName(tokens, i + 2)) {
+      auto &value = tokens[i + 2].name;
+      *enabled = value != "0" && value != "off" && value != "false";
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsResultSet(const uint8_t *result, size_t size) {
+  if (size <= static_cast<size_t>(kMySQLHeaderLen)) {
+    return false;
+  }
+  // Otherwise an OK, an error, or a LOCAL INFILE request.
+  uint8_t first = result[kMySQLHeaderLen];
+  return first != 0x00 && first != 0xff && first != 0xfb;
+}
+
+} // namespace
+
+bool ResultCache::ReadTables(const std::string &query, std::vector<std::string> *tables) {
+  auto tokens = Tokenize(query);
+  if (!IsName(tokens, 0, "select")) {
+    return false;
+  }
+  bool expect_table = false;
+  // Depth of the parentheses the FROM list being read is at, or -1.
+  int list_depth = -1;
+  int depth = 0;
+  for (size_t i = 1; i < tokens.size(); i++) {
+    auto &token = tokens[i];
+    if (token.symbol != 0) {
+      switch (token.symbol) {
+      case '(':
+        if (expect_table) {
+          // A derived table.
+          return false;
+        }
+        depth++;
+        break;
+      case ')':
+        if (depth == list_depth) {
+          list_depth = -1;
+        }
+        depth--;
+        break;
+      case ',':
+        expect_table = depth == list_depth;
+        break;
+      case ';':
+      case '@':
+        return false;
+      default:
+        break;
+      }
+      continue;
+    }
+    auto &word = token.name;
+    if (expect_table) {
+      AddTable(word, tables);
+      expect_table = false;
+    } else if (word == "from") {
+      expect_table = true;
+      list_depth = depth;
+    } else if (word == "join" || word == "straight_join") {
+      expect_table = true;
+    } else if (IsOneOf(word, kClauseWords)) {
+      if (depth == list_depth) {
+        list_depth = -1;
+      }
+    } else if (IsOneOf(word, kLockingWords) || IsOneOf(word, kVolatileWords)) {
+      return false;
+    } else if (i + 1 < tokens.size() && tokens[i + 1].symbol == '(' &&
+               IsOneOf(word, kVolatileFunctions)) {
+      return false;
+    }
+  }
+  return !expect_table;
+}
+
+bool ResultCache::WrittenTables(const std::string &sql, std::vector<std::string> *tables) {
+  auto tokens = Tokenize(sql);
+  size_t begin = 0;
+  for (size_t i = 0; i <= tokens.size(); i++) {
+    if (i < tokens.size() && tokens[i].symbol != ';') {
+      continue;
+    }
+    if (!StatementWrites(tokens, begin, i, tables)) {
+      return false;
+    }
+    begin = i + 1;
+  }
+  return true;
+}
+
+ResultCache::ResultCache(size_t capacity) :
+    capacity_(capacity), shard_capacity_(capacity / kNumShards), version_(1),
+    flushed_(0), table_versions_(new std::atomic<uint64_t>[kNumTableSlots]),
+    shards_(new Shard[kNumShards]), hits_(0), misses_(0) {
+  static_assert(kNumShards == 16, "ShardFor() takes the top 4 bits of the key");
+  for (size_t i = 0; i < kNumTableSlots; i++) {
+    table_versions_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t ResultCache::Key(const std::string &schema, uint64_t fingerprint) {
+  return fingerprint ^ (PrefetchTable::Fingerprint(schema) * 0x9e3779b97f4a7c15ULL);
+}
+
+uint32_t ResultCache::TableSlot(const std::string &table) {
+  return static_cast<uint32_t>(PrefetchTable::Fingerprint(table) % kNumTableSlots);
+}
+
+bool ResultCache::IsValid(const std::vector<uint32_t> &table_slots, uint64_t version) const {
+  if (flushed_.load(std::memory_order_acquire) > version) {
+    return false;
+  }
+  for (auto slot : table_slots) {
+    if (table_versions_[slot].load(std::memory_order_acquire) > version) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ResultCache::Erase(Shard &shard, std::unordered_map<uint64_t, Entry>::iterator it) {
+  shard.bytes -= Cost(it->second);
+  shard.lru.erase(it->second.lru);
+  shard.entries.erase(it);
+}
+
+size_t ResultCache::Lookup(const std::string &schema, const std::string &query,
+                           uint64_t fingerprint, uint8_t *buffer, size_t size) {
+  if (!Enabled()) {
+    return 0;
+  }
+  uint64_t key = Key(schema, fingerprint);
+  auto &shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end() || it->second.query != query || it->second.schema != schema) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+  auto &entry = it->second;
+  if (!IsValid(entry.table_slots, entry.version)) {
+    Erase(shard, it);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+  if (entry.result.size() > size) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+  memcpy(buffer, entry.result.data(), entry.result.size());
+  shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return entry.result.size();
+}
+
+void ResultCache::Insert(const std::string &schema, const std::string &query,
+                         uint64_t fingerprint, uint64_t version,
+                         const uint8_t *result, size_t size) {
+  if (!Enabled() || query.size() + size > shard_capacity_ || !IsResultSet(result, size)) {
+    return;
+  }
+  std::vector<std::string> tables;
+  if (!ReadTables(query, &tables)) {
+    return;
+  }
+  std::vector<uint32_t> table_slots;
+  for (auto &table : tables) {
+    table_slots.push_back(TableSlot(table));
+  }
+  // Written while the query was in flight: the result may predate it.
+  if (!IsValid(table_slots, version)) {
+    return;
+  }
+  uint64_t key = Key(schema, fingerprint);
+  auto &shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(key);
+  if (it != shard.entries.end()) {
+    Erase(shard, it);
+  }
+  size_t cost = query.size() + size;
+  while (shard.bytes + cost > shard_capacity_) {
+    Erase(shard, shard.entries.find(shard.lru.back()));
+  }
+  shard.lru.push_front(key);
+  auto &entry = shard.entries[key];
+  entry.schema = schema;
+  entry.query = query;
+  entry.table_slots = std::move(table_slots);
+  entry.version = version;
+  entry.result.assign(reinterpret_cast<const char *>(result), size);
+  entry.lru = shard.lru.begin();
+  shard.bytes += cost;
+}
+
+void ResultCache::Invalidate(const std::string &table) {
+  if (!Enabled()) {
+    return;
+  }
+  uint64_t version = version_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  auto &slot = table_versions_[TableSlot(table)];
+  uint64_t current = slot.load(std::memory_order_relaxed);
+  while (current < version &&
+         !slot.compare_exchange_weak(current, version, std::memory_order_acq_rel)) {
+  }
+}
+
+void ResultCache::InvalidateAll() {
+  if (!Enabled()) {
+    return;
+  }
+  uint64_t version = version_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  uint64_t current = flushed_.load(std::memory_order_relaxed);
+  while (current < version &&
+         !flushed_.compare_exchange_weak(current, version, std::memory_order_acq_rel)) {
+  }
+}
+
+size_t ResultCache::bytes() const {
+  size_t bytes = 0;
+  for (size_t i = 0; i < kNumShards; i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    bytes += shards_[i].bytes;
+  }
+  return bytes;
+}
+
+ResultCacheClient::ResultCacheClient(ResultCache *cache) :
+    cache_(cache), tracking_(false), reading_(false), autocommit_(true),
+    in_transaction_(false) {}
+
+void ResultCacheClient::SetSchema(const char *schema) {
+  schema_ = schema;
+  tracking_ = cache_ != nullptr && cache_->Enabled();
+  reading_ = tracking_;
+}
+
+void ResultCacheClient::OnSend(const std::string &sql) {
+  if (tracking_) {
+    Track(sql, &written_);
+  }
+}
+
+void ResultCacheClient::OnSpeculate(const std::string &sql) {
+  if (tracking_) {
+    Track(sql, &speculated_);
+  }
+}
+
+void ResultCacheClient::Track(const std::string &sql, Writes *writes) {
+  auto type = ClassifyStatement(sql);
+  if (type == StatementType::kSet) {
+    bool enabled;
+    if (AutocommitValue(sql, &enabled)) {
+      autocommit_ = enabled;
+    }
+    return;
+  }
+  if (type == StatementType::kOther && StartsWithWord(sql, "use")) {
+    reading_ = false;
+    return;
+  }
+  if (IsReadStatement(type) && sql.find(';') == std::string::npos) {
+    return;
+  }
+  std::vector<std::string> tables;
+  if (!ResultCache::WrittenTables(sql, &tables)) {
+    writes->all = true;
+    cache_->InvalidateAll();
+    return;
+  }
+  for (auto &table : tables) {
+    cache_->Invalidate(table);
+    AddTable(table, &writes->tables);
+  }
+}
+
+void ResultCacheClient::OnPacket() {
+  if (!tracking_) {
+    return;
+  }
+  written_.all = true;
+  reading_ = false;
+  cache_->InvalidateAll();
+}
+
+void ResultCacheClient::OnResult(StatementType type) {
+  if (!tracking_) {
+    return;
+  }
+  switch (type) {
+  case StatementType::kBegin:
+    // Commits the transaction before it, if any.
+    Flush();
+    in_transaction_ = true;
+    break;
+  case StatementType::kCommit:
+  case StatementType::kRollback:
+  case StatementType::kDdl:
+    Flush();
+    in_transaction_ = false;
+    break;
+  default:
+    if (!in_transaction_ && autocommit_) {
+      Flush();
+    }
+    break;
+  }
+  written_.all = written_.all || speculated_.all;
+  for (auto &table : speculated_.tables) {
+    AddTable(table, &written_.tables);
+  }
+  speculated_ = Writes();
+}
+
+size_t ResultCacheClient::Lookup(const std::string &query, uint64_t fingerprint,
+                                 StatementType type, uint8_t *buffer, size_t size) {
+  if (!Usable() || type != StatementType::kSelect) {
+    return 0;
+  }
+  return cache_->Lookup(schema_, query, fingerprint, buffer, size);
+}
+
+void ResultCacheClient::Insert(const std::string &query, uint64_t fingerprint,
+                               StatementType type, uint64_t version,
+                               const uint8_t *result, size_t size) {
+  if (!Usable() || type != StatementType::kSelect) {
+    return;
+  }
+  cache_->Insert(schema_, query, fingerprint, version, result, size);
+}
+
+void ResultCacheClient::Flush() {
+  if (written_.all) {
+    cache_->InvalidateAll();
+  }
+  for (auto &table : written_.tables) {
+    cache_->Invalidate(table);
+  }
+  written_ = Writes();
+}
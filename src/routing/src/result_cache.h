@@ -0,0 +1,177 @@
+#ifndef ROUTING_SRC_RESULT_CACHE_H_
+#define ROUTING_SRC_RESULT_CACHE_H_
+
+#include "statement_type.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Results of reads shared by every session of a route, as the raw
+// packets the servers sent, so that a query another session already ran,
+// or speculated, is answered without going to the servers.
+//
+// Entries are keyed by schema and query text and bounded in bytes, with
+// an LRU per shard. Writes invalidate per table: every table maps to a
+// slot holding the version at which it was last written, and an entry is
+// only valid while none of the tables it reads has been written since the
+// version its query was sent at. Slots are shared by tables whose names
+// collide, which only ever drops more entries than needed.
+class ResultCache {
+public:
+  // Lower-case names, without schema, of the tables a cacheable read
+  // reads. False for reads that cannot be cached: locking reads, ones
+  // with derived tables, variables or non-deterministic functions. Views
+  // are not expanded, so routes whose clients read views over tables
+  // they write should leave the cache off.
+  static bool ReadTables(const std::string &query, std::vector<std::string> *tables);
+  // Tables written by the statements, separated by ';'. False if some
+  // statement may write tables that are not known, like DDL.
+  static bool WrittenTables(const std::string &sql, std::vector<std::string> *tables);
+
+  // capacity in bytes; 0 disables the cache.
+  explicit ResultCache(size_t capacity);
+
+  bool Enabled() const {
+    return capacity_ > 0;
+  }
+  // To be read before a query is sent, for Insert().
+  uint64_t Version() const {
+    return version_.load(std::memory_order_acquire);
+  }
+  // Copies the result of the query into buffer and returns its size, or
+  // 0 if it is not cached or does not fit.
+  size_t Lookup(const std::string &schema, const std::string &query, uint64_t fingerprint,
+                uint8_t *buffer, size_t size);
+  // Caches the result of a query sent at version, unless a table it reads
+  // has been written since.
+  void Insert(const std::string &schema, const std::string &query, uint64_t fingerprint,
+              uint64_t version, const uint8_t *result, size_t size);
+  void Invalidate(const std::string &table);
+  void InvalidateAll();
+
+  size_t bytes() const;
+  size_t hits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  size_t misses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static const size_t kNumShards = 16;
+  static const size_t kNumTableSlots = 4096;
+
+  struct Entry {
+    std::string schema;
+    std::string query;
+    std::vector<uint32_t> table_slots;
+    uint64_t version;
+    std::string result;
+    std::list<uint64_t>::iterator lru;
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    // Most recently used first.
+    std::list<uint64_t> lru;
+    size_t bytes = 0;
+  };
+
+  static uint64_t Key(const std::string &schema, uint64_t fingerprint);
+  static uint32_t TableSlot(const std::string &table);
+  static size_t Cost(const Entry &entry) {
+    return entry.query.size() + entry.result.size();
+  }
+  Shard &ShardFor(uint64_t key) {
+    return shards_[key >> 60];
+  }
+  bool IsValid(const std::vector<uint32_t> &table_slots, uint64_t version) const;
+  void Erase(Shard &shard, std::unordered_map<uint64_t, Entry>::iterator it);
+
+  size_t capacity_;
+  size_t shard_capacity_;
+  std::atomic<uint64_t> version_;
+  // Version of the last InvalidateAll().
+  std::atomic<uint64_t> flushed_;
+  std::unique_ptr<std::atomic<uint64_t>[]> table_versions_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<size_t> hits_;
+  std::atomic<size_t> misses_;
+};
+
+// One session's use of the shared cache.
+//
+// What a session writes only becomes visible to the others once it is
+// done, and in a transaction once it commits, so the tables it writes
+// are invalidated both when the write is sent and then; in between the
+// session neither reads from the cache nor adds to it, as its own
+// results would show its uncommitted writes. Speculations and undos are
+// sent before the result of the current statement and only done after
+// the next one. An undo is only sent to a server with the next query for
+// it, so a read racing it may still cache a speculative write that was
+// autocommitted; the next write to the table drops it.
+class ResultCacheClient {
+public:
+  explicit ResultCacheClient(ResultCache *cache);
+
+  // The schema the session was authenticated with.
+  void SetSchema(const char *schema);
+  // Whether reads may be answered from, or added to, the cache.
+  bool Usable() const {
+    return reading_ && written_.empty() && speculated_.empty();
+  }
+  uint64_t Version() const {
+    return tracking_ ? cache_->Version() : 0;
+  }
+  // Before statements of the client, separated by ';', are sent.
+  void OnSend(const std::string &sql);
+  // Before a speculation or an undo is sent.
+  void OnSpeculate(const std::string &sql);
+  // A packet that is not a query went to the servers. It may have
+  // written anything, or changed the schema, so the session stops
+  // reading from the cache.
+  void OnPacket();
+  // After the client got the result of its statement.
+  void OnResult(StatementType type);
+
+  size_t Lookup(const std::string &query, uint64_t fingerprint, StatementType type,
+                uint8_t *buffer, size_t size);
+  void Insert(const std::string &query, uint64_t fingerprint, StatementType type,
+              uint64_t version, const uint8_t *result, size_t size);
+
+private:
+  struct Writes {
+    bool all = false;
+    std::vector<std::string> tables;
+
+    bool empty() const {
+      return !all && tables.empty();
+    }
+  };
+
+  void Track(const std::string &sql, Writes *writes);
+  // Invalidates what the session wrote again, now that it is visible.
+  void Flush();
+
+  ResultCache *cache_;
+  std::string schema_;
+  // Whether the writes of the session are tracked.
+  bool tracking_;
+  bool reading_;
+  bool autocommit_;
+  bool in_transaction_;
+  // Sent for statements the client has had the result of.
+  Writes written_;
+  // Sent since the client last had a result.
+  Writes speculated_;
+};
+
+#endif // ROUTING_SRC_RESULT_CACHE_H_
@@ -21,7 +21,9 @@
 #include "logger.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <cstring>
+#include <mutex>
 
 #ifndef _WIN32
 # ifdef __sun
@@ -31,6 +33,7 @@
 # endif
 # include <netdb.h>
 # include <netinet/tcp.h>
+# include <poll.h>
 # include <sys/socket.h>
 #else
 # define WIN32_LEAN_AND_MEAN
@@ -52,6 +55,23 @@ const std::string kDefaultBindAddress = "127.0.0.1";
 const unsigned int kDefaultNetBufferLength = 16384;  // Default defined in latest MySQL Server
 const unsigned long long kDefaultMaxConnectErrors = 100;  // Similar to MySQL Server
 const unsigned int kDefaultClientConnectTimeout = 9; // Default connect_timeout MySQL Server minus 1
+const unsigned int kDefaultWorkerThreads = 4;
+const unsigned int kDefaultSpinBudget = 1000;
+const char *const kDefaultTraceFile = "";
+const char *const kDefaultQuerySetFile = "";
+const char *const kDefaultModelFile = "";
+const char *const kDefaultShmDestinations = "";
+const unsigned int kDefaultRdmaPollerThreads = 0;
+const unsigned int kDefaultRdmaBusyPoll = 0;
+const unsigned int kDefaultModelLearningInterval = 0;
+const unsigned int kDefaultPoolMinIdle = 0;
+const unsigned int kDefaultPoolMaxIdle = 0;
+const unsigned int kDefaultPoolMaxLifetime = 3600;
+const unsigned int kDefaultPipelineDepth = 1;
+const unsigned int kDefaultHedgePercentile = 0;
+const unsigned int kDefaultResultCacheSize = 0;
+const unsigned int kDefaultSpeculationWasteCost = 0;
+const unsigned int kDefaultSpeculationMinConfidence = 0;
 
 const char* const kAccessModeNames[] = {
   nullptr, "read-write", "read-only"
@@ -80,6 +100,122 @@ std::string get_access_mode_name(AccessMode access_mode) noexcept {
   return kAccessModeNames[static_cast<int>(access_mode)];
 }
 
+const char* const kIoModeNames[] = {
+  nullptr, "thread", "reactor"
+};
+
+constexpr size_t kIoModeCount =
+    sizeof(kIoModeNames)/sizeof(*kIoModeNames);
+
+IoMode get_io_mode(const std::string& value) {
+  for (unsigned int i = 1 ; i < kIoModeCount ; ++i)
+    if (strcmp(kIoModeNames[i], value.c_str()) == 0)
+      return static_cast<IoMode>(i);
+  return IoMode::kUndefined;
+}
+
+void get_io_mode_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kIoModeCount) {
+    valid->append(kIoModeNames[i]);
+    if (++i < kIoModeCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_io_mode_name(IoMode io_mode) noexcept {
+  if (io_mode == IoMode::kUndefined)
+    return std::string();
+  return kIoModeNames[static_cast<int>(io_mode)];
+}
+
+const char* const kWaitModeNames[] = {
+  nullptr, "spin", "park"
+};
+
+constexpr size_t kWaitModeCount =
+    sizeof(kWaitModeNames)/sizeof(*kWaitModeNames);
+
+WaitMode get_wait_mode(const std::string& value) {
+  for (unsigned int i = 1 ; i < kWaitModeCount ; ++i)
+    if (strcmp(kWaitModeNames[i], value.c_str()) == 0)
+      return static_cast<WaitMode>(i);
+  return WaitMode::kUndefined;
+}
+
+void get_wait_mode_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kWaitModeCount) {
+    valid->append(kWaitModeNames[i]);
+    if (++i < kWaitModeCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_wait_mode_name(WaitMode wait_mode) noexcept {
+  if (wait_mode == WaitMode::kUndefined)
+    return std::string();
+  return kWaitModeNames[static_cast<int>(wait_mode)];
+}
+
+const char* const kRollbackModeNames[] = {
+  nullptr, "undo", "savepoint"
+};
+
+constexpr size_t kRollbackModeCount =
+    sizeof(kRollbackModeNames)/sizeof(*kRollbackModeNames);
+
+RollbackMode get_rollback_mode(const std::string& value) {
+  for (unsigned int i = 1 ; i < kRollbackModeCount ; ++i)
+    if (strcmp(kRollbackModeNames[i], value.c_str()) == 0)
+      return static_cast<RollbackMode>(i);
+  return RollbackMode::kUndefined;
+}
+
+void get_rollback_mode_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kRollbackModeCount) {
+    valid->append(kRollbackModeNames[i]);
+    if (++i < kRollbackModeCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_rollback_mode_name(RollbackMode rollback_mode) noexcept {
+  if (rollback_mode == RollbackMode::kUndefined)
+    return std::string();
+  return kRollbackModeNames[static_cast<int>(rollback_mode)];
+}
+
+const char* const kSpeculatorTypeNames[] = {
+  nullptr, "log", "model"
+};
+
+constexpr size_t kSpeculatorTypeCount =
+    sizeof(kSpeculatorTypeNames)/sizeof(*kSpeculatorTypeNames);
+
+SpeculatorType get_speculator_type(const std::string& value) {
+  for (unsigned int i = 1 ; i < kSpeculatorTypeCount ; ++i)
+    if (strcmp(kSpeculatorTypeNames[i], value.c_str()) == 0)
+      return static_cast<SpeculatorType>(i);
+  return SpeculatorType::kUndefined;
+}
+
+void get_speculator_type_names(std::string* valid) {
+  unsigned int i = 1;
+  while (i < kSpeculatorTypeCount) {
+    valid->append(kSpeculatorTypeNames[i]);
+    if (++i < kSpeculatorTypeCount)
+      valid->append(", ");
+  }
+}
+
+std::string get_speculator_type_name(SpeculatorType speculator_type) noexcept {
+  if (speculator_type == SpeculatorType::kUndefined)
+    return std::string();
+  return kSpeculatorTypeNames[static_cast<int>(speculator_type)];
+}
+
 void set_socket_blocking(int sock, bool blocking) {
 
   assert(!(sock < 0));
@@ -271,7 +407,12 @@ ssize_t SocketOperations::read(int fd, void *buffer, size_t nbyte) {
 }
 
 bool SocketOperations::has_data(int fd) {
+#ifndef _WIN32
+  struct pollfd pfd = {fd, POLLIN, 0};
+  return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) != 0;
+#else
   return false;
+#endif
 }
 
 void SocketOperations::close(int fd) {
@@ -384,6 +525,26 @@ bool RdmaOperations::has_data(int fd) {
   }
 }
 
+void RdmaOperations::set_notifier(int fd, Notifier *notifier) {
+  std::shared_lock<std::shared_mutex> l(mutex_);
+  auto iter = rdma_fds_.find(fd);
+  if (iter != rdma_fds_.end()) {
+    iter->second->SetNotifier(notifier);
+  }
+}
+
+void RdmaOperations::register_buffer(int fd, void *buffer, size_t size) {
+  std::shared_lock<std::shared_mutex> l(mutex_);
+  auto iter = rdma_fds_.find(fd);
+  if (iter != rdma_fds_.end()) {
+    auto s = iter->second->RegisterBuffer(buffer, size);
+    if (!s.ok()) {
+      // Writes from it are copied instead.
+      log_debug("Failed to register a buffer of RDMA connection %d: %s", fd, s.message().c_str());
+    }
+  }
+}
+
 void RdmaOperations::close(int fd) {
 #ifndef _WIN32
   std::unique_lock<std::shared_mutex> l(mutex_);
@@ -412,4 +573,95 @@ void RdmaOperations::shutdown(int fd) {
 #endif
 }
 
+ShmOperations* ShmOperations::instance() {
+  static ShmOperations instance_;
+  return &instance_;
+}
+
+std::shared_ptr<ShmChannel> ShmOperations::channel(int fd) {
+  std::shared_lock<std::shared_mutex> l(mutex_);
+  auto iter = channels_.find(fd);
+  if (iter == channels_.end()) {
+    return nullptr;
+  }
+  return iter->second;
+}
+
+int ShmOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, bool log) noexcept {
+  std::shared_ptr<ShmChannel> channel = ShmChannel::Connect(ShmChannelName(addr.port));
+  if (!channel) {
+    if (log) {
+      log_debug("No shared memory shim serves %s", addr.str().c_str());
+    }
+    return -1;
+  }
+  std::unique_lock<std::shared_mutex> l(mutex_);
+  int fd = current_fd_++;
+  channels_[fd] = std::move(channel);
+  return fd;
+}
+
+ssize_t ShmOperations::write(int fd, void *buffer, size_t nbyte) {
+  auto channel = this->channel(fd);
+  return channel ? channel->Write(buffer, nbyte) : -1;
+}
+
+ssize_t ShmOperations::read(int fd, void *buffer, size_t nbyte) {
+  auto channel = this->channel(fd);
+  return channel ? channel->Read(buffer, nbyte) : -1;
+}
+
+bool ShmOperations::has_error(int fd) {
+  auto channel = this->channel(fd);
+  return !channel || channel->HasError();
+}
+
+bool ShmOperations::has_data(int fd) {
+  auto channel = this->channel(fd);
+  return channel && channel->HasData();
+}
+
+void ShmOperations::close(int fd) {
+  std::shared_ptr<ShmChannel> channel;
+  {
+    std::unique_lock<std::shared_mutex> l(mutex_);
+    auto iter = channels_.find(fd);
+    if (iter == channels_.end()) {
+      return;
+    }
+    channel = std::move(iter->second);
+    channels_.erase(iter);
+  }
+  // Wakes up a reader still blocked on it; the last one unmaps it.
+  channel->Close();
+}
+
+void ShmOperations::shutdown(int fd) {
+  close(fd);
+}
+
+BackendOperations* BackendOperations::instance() {
+  static BackendOperations instance_;
+  return &instance_;
+}
+
+void BackendOperations::add_shm_destination(const TCPAddress &addr) {
+  std::unique_lock<std::shared_mutex> l(mutex_);
+  if (std::find(shm_destinations_.begin(), shm_destinations_.end(), addr) == shm_destinations_.end()) {
+    shm_destinations_.push_back(addr);
+  }
+}
+
+int BackendOperations::get_mysql_socket(TCPAddress addr, int connect_timeout, bool log) noexcept {
+  bool shm = false;
+  {
+    std::shared_lock<std::shared_mutex> l(mutex_);
+    shm = std::find(shm_destinations_.begin(), shm_destinations_.end(), addr) != shm_destinations_.end();
+  }
+  if (shm) {
+    return ShmOperations::instance()->get_mysql_socket(addr, connect_timeout, log);
+  }
+  return RdmaOperations::instance()->get_mysql_socket(addr, connect_timeout, log);
+}
+
 } // routing
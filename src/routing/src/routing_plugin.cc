@@ -113,6 +113,17 @@ static int init(const mysql_harness::AppInfo *info) {
         RoutingPluginConfig config(section);                // throws std::invalid_argument
         validate_socket_info(err_prefix, section, config);  // throws std::invalid_argument
 
+        // Load the trace or model once here; every route shares it from start()
+        if (config.speculator == routing::SpeculatorType::kModel) {
+          if (model::GraphModel::Get(config.query_set_file, config.model_file) == nullptr) {
+            throw std::invalid_argument(err_prefix + "failed to load model_file '" +
+                                        config.model_file + "' with query_set_file '" +
+                                        config.query_set_file + "'");
+          }
+        } else if (!config.trace_file.empty() && TraceStore::Get(config.trace_file) == nullptr) {
+          throw std::invalid_argument(err_prefix + "failed to load trace_file '" + config.trace_file + "'");
+        }
+
         // ensure that TCP port is unique
         if (config.bind_address.port) {
 
@@ -183,7 +194,24 @@ static void start(const ConfigSection *section) {
     } catch (URIError) {
       r.set_destinations_from_csv(config.destinations);
     }
+    r.set_shm_destinations(config.shm_destinations);
     r.set_root_password(config.root_password);
+    r.set_io_mode(config.io_mode, config.worker_threads);
+    r.set_wait_mode(config.wait_mode, config.spin_budget);
+    r.set_rdma_pollers(config.rdma_poller_threads, config.rdma_busy_poll);
+    r.set_rollback_mode(config.rollback_mode);
+    if (config.speculator == routing::SpeculatorType::kModel) {
+      r.set_graph_model(model::GraphModel::Get(config.query_set_file, config.model_file));
+      r.set_model_learning_interval(config.model_learning_interval);
+    } else if (!config.trace_file.empty()) {
+      r.set_trace_store(TraceStore::Get(config.trace_file));
+    }
+    r.set_server_group_pool(config.pool_min_idle, config.pool_max_idle, config.pool_max_lifetime);
+    r.set_pipeline_depth(config.pipeline_depth);
+    r.set_hedge_percentile(config.hedge_percentile);
+    r.set_result_cache_size(config.result_cache_size);
+    r.set_speculation_throttle(config.speculation_waste_cost,
+                               config.speculation_min_confidence);
     r.start();
   } catch (const std::invalid_argument &exc) {
     log_error(exc.what());
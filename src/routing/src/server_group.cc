@@ -1,24 +1,48 @@
 #include "server_group.h"
 
+#include <algorithm>
 #include <cstring>
 
 static const size_t kExitPacketSize = 5;
 static const uint8_t kExitPacket[] = {1, 0, 0, 0, 1};
+// The OK a server sends at the end of the handshake (sequence number 2).
+static const uint8_t kAuthOkPacket[] = {7, 0, 0, 2, 0, 0, 0, 2, 0, 0, 0};
+// Weight of the newest sample in a server's response time.
+static const double kResponseTimeAlpha = 0.2;
 
-ServerGroup::ServerGroup(const std::vector<int> &server_fds) {
+enum AuthStage {
+  kAwaitGreeting,
+  kAwaitAuthResult,
+  kAuthDone,
+};
+
+ServerGroup::ServerGroup(const std::vector<int> &server_fds,
+                         routing::SocketOperationsBase *sock_ops) :
+    wait_policy_(WaitPolicy::Default()), pipelines_(server_fds.size()), pipeline_depth_(1),
+    hedge_percentile_(0), num_hedged_(0), num_hedge_wins_(0),
+    read_results_(server_fds.size(), 0), created_at_(std::chrono::steady_clock::now()) {
   for (auto fd : server_fds) {
-    server_conns_.emplace_back(fd, routing::RdmaOperations::instance());
-    // Any positive number means ready
-    has_outstanding_request_.push_back(false);
-    read_results_.push_back(0);
+    server_conns_.emplace_back(fd, sock_ops);
+    server_conns_.back().SetNotifier(&notifier_);
+  }
+  for (auto &pipeline : pipelines_) {
+    pipeline.next_request = 0;
+    pipeline.num_pending = 0;
+    pipeline.ewma_ns = 0;
+    pipeline.selections = 0;
   }
 }
 
 bool ServerGroup::Authenticate(Connection *client) {
-  session_ = std::move(AuthenticateClient(client));
-  if (session_.get() == nullptr) {
+  auto session = AuthenticateClient(client);
+  if (session.get() == nullptr) {
     return false;
   }
+  return AuthenticateBackends(std::move(session), client);
+}
+
+bool ServerGroup::AuthenticateBackends(std::unique_ptr<MySQLSession> session, Connection *client) {
+  session_ = std::move(session);
   int server_size = AuthWithBackendServers(session_.get(), &server_conns_[0]);
   if (server_size < 0) {
     log_error("Authentication fails with negative read size");
@@ -36,6 +60,10 @@ bool ServerGroup::Authenticate(Connection *client) {
       return false;
     }
   }
+  if (client == nullptr) {
+    log_debug("Done with authentication with all servers");
+    return true;
+  }
   log_debug("Done with authentication with all servers, sending first response back to client");
   ssize_t size = client->Send(server_conns_[0].Buffer(), server_size);
   if (size < 0) {
@@ -47,29 +75,154 @@ bool ServerGroup::Authenticate(Connection *client) {
   return true;
 }
 
+bool ServerGroup::AcceptClient(Connection *client) {
+  if (client->Send(const_cast<uint8_t *>(kAuthOkPacket), sizeof(kAuthOkPacket)) < 0) {
+    log_error("Sending authentication result to client returns negative read size");
+    return false;
+  }
+  return true;
+}
+
+void ServerGroup::StartAuthentication(std::unique_ptr<MySQLSession> session) {
+  session_ = std::move(session);
+  auth_stages_.assign(server_conns_.size(), kAwaitGreeting);
+}
+
+int ServerGroup::PollAuthentication(Connection *client) {
+  bool done = true;
+  for (size_t i = 0; i < server_conns_.size(); i++) {
+    if (auth_stages_[i] == kAuthDone) {
+      continue;
+    }
+    ssize_t size = server_conns_[i].TryRecv();
+    if (size == -2) {
+      done = false;
+      continue;
+    }
+    if (size <= 0) {
+      log_error("Authentication fails with negative read size");
+      return -1;
+    }
+    if (auth_stages_[i] == kAwaitGreeting) {
+      if (!SendBackendAuth(session_.get(), &server_conns_[i])) {
+        return -1;
+      }
+      auth_stages_[i] = kAwaitAuthResult;
+      done = false;
+    } else {
+      read_results_[i] = size;
+      auth_stages_[i] = kAuthDone;
+    }
+  }
+  if (!done) {
+    return 0;
+  }
+  if (!mysql_is_ok_packet(server_conns_[0].Buffer())) {
+    log_error("Server response is not OK");
+  }
+  log_debug("Done with authentication with all servers, sending first response back to client");
+  if (client->Send(server_conns_[0].Buffer(), read_results_[0]) < 0) {
+    log_error("Sending authentication result to client returns negative read size");
+    return -1;
+  }
+  return 1;
+}
+
+void ServerGroup::PushRequest(size_t server_index, bool hold) {
+  auto &pipeline = pipelines_[server_index];
+  // Results nobody holds on to are only kept until the next request.
+  for (auto iter = pipeline.slots.begin(); iter != pipeline.slots.end();) {
+    if (iter->size != -2 && !iter->held) {
+      iter = pipeline.slots.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  pipeline.slots.push_back(ResultSlot{pipeline.next_request++, hold, false, false, -2, {},
+                                     std::chrono::steady_clock::now()});
+  pipeline.num_pending++;
+}
+
+ServerGroup::ResultSlot *ServerGroup::FindSlot(size_t server_index, uint64_t request) {
+  for (auto &slot : pipelines_[server_index].slots) {
+    if (slot.request == request) {
+      return &slot;
+    }
+  }
+  return nullptr;
+}
+
+bool ServerGroup::ReceiveNext(size_t server_index, bool block) {
+  auto &pipeline = pipelines_[server_index];
+  if (pipeline.num_pending == 0) {
+    return false;
+  }
+  auto &conn = server_conns_[server_index];
+  ResultSlot *received = nullptr;
+  for (auto &slot : pipeline.slots) {
+    if (slot.size == -2) {
+      received = &slot;
+      break;
+    }
+    if (slot.in_buffer) {
+      // The next response overwrites the connection buffer. Only reached
+      // with more than one request in flight, at most once per response.
+      slot.data.assign(conn.Buffer(), conn.Buffer() + slot.size);
+      slot.in_buffer = false;
+    }
+  }
+  ssize_t size = block ? conn.Recv() : conn.TryRecv();
+  if (size == -2) {
+    return false;
+  }
+  pipeline.num_pending--;
+  auto now = std::chrono::steady_clock::now();
+  auto response_time = std::chrono::duration<double, std::nano>(
+      now - std::max(received->sent_at, pipeline.last_response)).count();
+  pipeline.ewma_ns = pipeline.last_response.time_since_epoch().count() == 0
+      ? response_time
+      : pipeline.ewma_ns + kResponseTimeAlpha * (response_time - pipeline.ewma_ns);
+  pipeline.last_response = now;
+  if (received->discarded) {
+    for (auto iter = pipeline.slots.begin(); iter != pipeline.slots.end(); ++iter) {
+      if (&*iter == received) {
+        pipeline.slots.erase(iter);
+        break;
+      }
+    }
+    return true;
+  }
+  received->size = size;
+  received->in_buffer = size > 0;
+  return true;
+}
+
+std::pair<uint8_t*, size_t> ServerGroup::SlotResult(size_t server_index, const ResultSlot &slot) {
+  if (slot.size <= 0) {
+    return std::make_pair(nullptr, 0);
+  }
+  uint8_t *data = slot.in_buffer ? server_conns_[server_index].Buffer()
+                                 : const_cast<uint8_t *>(slot.data.data());
+  return std::make_pair(data, static_cast<size_t>(slot.size));
+}
+
 int ServerGroup::Read(uint8_t *buffer, size_t size) {
   bool error = false;
   // We do a read on all servers, whether there's error or not
-  for (size_t i = 1; i < server_conns_.size(); i++) {
-    read_results_[i] = server_conns_[i].Recv();
-    if (read_results_[i] <= 0) {
+  for (size_t i = 0; i < server_conns_.size(); i++) {
+    while (pipelines_[i].num_pending > 0) {
+      ReceiveNext(i, true);
+    }
+    if (GetResult(i).first == nullptr) {
       error = true;
-    } else {
-      has_outstanding_request_[i] = false;
     }
   }
-  int read_size = static_cast<int>(server_conns_[0].Recv());
-  if (read_size < 0) {
-    error = true;
-  }
-  has_outstanding_request_[0] = false;
-  read_results_[0] = read_size;
   if (error) {
     return -1;
-  } else {
-    memcpy(buffer, server_conns_[0].Buffer(), read_size);
-    return read_size;
   }
+  auto result = GetResult(0);
+  memcpy(buffer, result.first, result.second);
+  return static_cast<int>(result.second);
 }
 
 int ServerGroup::Write(uint8_t *buffer, size_t size) {
@@ -79,7 +232,7 @@ int ServerGroup::Write(uint8_t *buffer, size_t size) {
     if (server_conns_[i].Send(buffer, size) < 0) {
       error = true;
     } else {
-      has_outstanding_request_[i] = true;
+      PushRequest(i, false);
     }
   }
   if (error || IsExitPacket(buffer, size)) {
@@ -90,17 +243,50 @@ int ServerGroup::Write(uint8_t *buffer, size_t size) {
 }
 
 std::pair<uint8_t*, size_t> ServerGroup::GetResult(size_t server_index) {
-  if (has_outstanding_request_[server_index] || read_results_[server_index] <= 0) {
+  auto &pipeline = pipelines_[server_index];
+  if (pipeline.slots.empty() || pipeline.slots.back().request != pipeline.next_request - 1) {
     return std::make_pair(nullptr, 0);
   }
-  return std::make_pair(server_conns_[server_index].Buffer(),
-                        static_cast<size_t>(read_results_[server_index]));
+  return SlotResult(server_index, pipeline.slots.back());
+}
+
+std::pair<uint8_t*, size_t> ServerGroup::GetResult(size_t server_index, uint64_t request) {
+  auto slot = FindSlot(server_index, request);
+  if (slot == nullptr) {
+    return std::make_pair(nullptr, 0);
+  }
+  slot->held = false;
+  return SlotResult(server_index, *slot);
+}
+
+void ServerGroup::Discard(size_t server_index, uint64_t request) {
+  auto &slots = pipelines_[server_index].slots;
+  for (auto iter = slots.begin(); iter != slots.end(); ++iter) {
+    if (iter->request != request) {
+      continue;
+    }
+    if (iter->size == -2) {
+      iter->discarded = true;
+    } else {
+      slots.erase(iter);
+    }
+    return;
+  }
 }
 
-bool ServerGroup::SendQuery(size_t server_index, const std::string &query, int num_queries) {
+bool ServerGroup::SendQuery(size_t server_index, const std::string &query, int num_queries,
+                            bool hold) {
   for (int i = 0; i < num_queries - 1; i++) {
     server_conns_[server_index].Send(0);
   }
+  // The connection buffer is about to be overwritten.
+  for (auto &slot : pipelines_[server_index].slots) {
+    if (slot.in_buffer && slot.held) {
+      slot.data.assign(server_conns_[server_index].Buffer(),
+                       server_conns_[server_index].Buffer() + slot.size);
+      slot.in_buffer = false;
+    }
+  }
   size_t payload_size = 1 + query.length();
   size_t packet_size = kMySQLHeaderLen + payload_size;
   uint8_t *buffer = server_conns_[server_index].Buffer();
@@ -111,10 +297,18 @@ bool ServerGroup::SendQuery(size_t server_index, const std::string &query, int n
   payload++;
   memcpy(payload, query.c_str(), query.length());
   payload[query.length()] = 0;
-  has_outstanding_request_[server_index] = true;
+  PushRequest(server_index, hold);
   return server_conns_[server_index].Send(packet_size) > 0;
 }
 
+bool ServerGroup::SendDiscarded(size_t server_index, const std::string &query) {
+  if (!SendQuery(server_index, query)) {
+    return false;
+  }
+  Discard(server_index, LastRequest(server_index));
+  return true;
+}
+
 bool ServerGroup::Propagate(const std::string &query, size_t source_write_server, int num_queries) {
   bool error = false;
   for (size_t i = 0; i < server_conns_.size(); i++) {
@@ -124,24 +318,25 @@ bool ServerGroup::Propagate(const std::string &query, size_t source_write_server
     WaitForServer(i);
     if (!SendQuery(i, query, num_queries)) {
       error = true;
-    } else {
-      has_outstanding_request_[i] = true;
     }
   }
   return !error;
 }
 
 bool ServerGroup::IsReadyForQuery(size_t server_index) {
-  if (!has_outstanding_request_[server_index]) {
-    return true;
-  }
-  auto res = server_conns_[server_index].TryRecv();
-  read_results_[server_index] = res;
-  if (res != -2) {
-    has_outstanding_request_[server_index] = false;
-    return true;
-  } else {
-    return false;
+  while (ReceiveNext(server_index, false)) {}
+  return pipelines_[server_index].num_pending == 0;
+}
+
+bool ServerGroup::IsResultReady(size_t server_index, uint64_t request) {
+  while (true) {
+    auto slot = FindSlot(server_index, request);
+    if (slot == nullptr || slot->size != -2) {
+      return true;
+    }
+    if (!ReceiveNext(server_index, false)) {
+      return false;
+    }
   }
 }
 
@@ -150,43 +345,96 @@ bool ServerGroup::ForwardToAll(const std::string &query, int num_queries) {
 }
 
 int ServerGroup::GetAvailableServer() {
-  for (size_t i = 0; i < server_conns_.size(); i++) {
-    if (!has_outstanding_request_[i]) {
-      return static_cast<int>(i);
-    }
+  int server = Pick(-1, true);
+  if (server != -1) {
+    pipelines_[server].selections++;
+    return server;
   }
-  bool response = false;
   int responded_server = -1;
-  while (!response) {
+  WaitUntil(wait_policy_, &notifier_, [this, &responded_server] {
     for (size_t i = 0; i < server_conns_.size(); i++) {
-      ssize_t read_res = server_conns_[i].TryRecv();
-      read_results_[i] = read_res;
-      if (read_res > 0) {
-        response = true;
-        has_outstanding_request_[i] = false;
-        responded_server = static_cast<int>(i);
-        break;
-      } else if (read_res != -2) {
-        response = true;
-        has_outstanding_request_[i] = false;
-        responded_server = -1;
-        break;
+      if (IsReadyForQuery(i)) {
+        responded_server = GetResult(i).first != nullptr ? static_cast<int>(i) : -1;
+        return true;
       }
     }
-  }
+    return false;
+  });
   return responded_server;
 }
 
-void ServerGroup::WaitForServer(size_t server_index) {
-  auto &conn = server_conns_[server_index];
-  while (has_outstanding_request_[server_index]) {
-    auto read_res = conn.TryRecv();
-    read_results_[server_index] = read_res;
-    if (read_res != -2) {
-      has_outstanding_request_[server_index] = false;
-      return;
+int ServerGroup::Pick(int reserved_server, bool idle_only) {
+  int best = -1;
+  double best_latency = 0;
+  for (size_t i = 0; i < server_conns_.size(); i++) {
+    bool reserved = static_cast<int>(i) == reserved_server;
+    if (reserved && pipeline_depth_ == 1) {
+      continue;
+    }
+    // Receives whatever has arrived in the meantime.
+    IsReadyForQuery(i);
+    auto &pipeline = pipelines_[i];
+    if (idle_only ? pipeline.num_pending > 0 : !HasCapacity(i)) {
+      continue;
+    }
+    double latency =
+        pipeline.ewma_ns * static_cast<double>(pipeline.num_pending + (reserved ? 2 : 1));
+    if (best == -1 || latency < best_latency ||
+        (latency == best_latency && pipeline.selections < pipelines_[best].selections)) {
+      best = static_cast<int>(i);
+      best_latency = latency;
     }
   }
+  return best;
+}
+
+int ServerGroup::SelectServer(int reserved_server) {
+  int server = Pick(reserved_server, false);
+  if (server != -1) {
+    pipelines_[server].selections++;
+  }
+  return server;
+}
+
+int ServerGroup::WaitForSelectServer(int reserved_server) {
+  int server = Pick(reserved_server, false);
+  if (server == -1) {
+    WaitUntil(wait_policy_, &notifier_, [this, reserved_server, &server] {
+      server = Pick(reserved_server, false);
+      return server != -1;
+    });
+  }
+  pipelines_[server].selections++;
+  return server;
+}
+
+void ServerGroup::LogStats() {
+  std::string selections;
+  for (size_t i = 0; i < pipelines_.size(); i++) {
+    selections += (i > 0 ? " " : "") + std::to_string(pipelines_[i].selections);
+  }
+  log_info("Server selections: %s", selections.c_str());
+  if (num_hedged_ > 0) {
+    log_info("Hedged %lu reads, %lu answered first by the hedge", num_hedged_, num_hedge_wins_);
+  }
+}
+
+void ServerGroup::WaitForServer(size_t server_index) {
+  if (pipelines_[server_index].num_pending == 0) {
+    return;
+  }
+  WaitUntil(wait_policy_, &notifier_, [this, server_index] {
+    return IsReadyForQuery(server_index);
+  });
+}
+
+void ServerGroup::WaitForResult(size_t server_index, uint64_t request) {
+  if (IsResultReady(server_index, request)) {
+    return;
+  }
+  WaitUntil(wait_policy_, &notifier_, [this, server_index, request] {
+    return IsResultReady(server_index, request);
+  });
 }
 
 void ServerGroup::WaitForAll() {
@@ -195,6 +443,147 @@ void ServerGroup::WaitForAll() {
   }
 }
 
+void ServerGroup::StartRead(int server, uint64_t request, const std::string &query, bool hedge) {
+  read_.server = server;
+  read_.request = request;
+  read_.hedge_server = -1;
+  read_.start = std::chrono::steady_clock::now();
+  read_.hedge_at = std::chrono::steady_clock::time_point::max();
+  if (!hedge || hedge_percentile_ == 0 || server_conns_.size() < 2) {
+    return;
+  }
+  auto delay = read_latencies_.Percentile(hedge_percentile_);
+  if (delay != std::chrono::steady_clock::duration::max()) {
+    read_.query = query;
+    read_.hedge_at = read_.start + delay;
+  }
+}
+
+void ServerGroup::Hedge() {
+  // The server being read from is not idle.
+  int server = Pick(-1, true);
+  if (server == -1) {
+    return;
+  }
+  log_debug("Hedging read on server %d after server %d", server, read_.server);
+  pipelines_[server].selections++;
+  if (!SendQuery(server, read_.query, 1, true)) {
+    return;
+  }
+  read_.hedge_server = server;
+  read_.hedge_request = LastRequest(server);
+  num_hedged_++;
+}
+
+int ServerGroup::PollRead(uint64_t *request) {
+  int winner = -1;
+  if (IsResultReady(read_.server, read_.request)) {
+    winner = read_.server;
+    *request = read_.request;
+    if (read_.hedge_server != -1) {
+      Discard(read_.hedge_server, read_.hedge_request);
+    }
+  } else if (read_.hedge_server != -1) {
+    if (IsResultReady(read_.hedge_server, read_.hedge_request)) {
+      winner = read_.hedge_server;
+      *request = read_.hedge_request;
+      Discard(read_.server, read_.request);
+      num_hedge_wins_++;
+    }
+  } else if (std::chrono::steady_clock::now() >= read_.hedge_at) {
+    // Retried on the next poll if no other server is idle yet.
+    Hedge();
+  }
+  if (winner != -1 && hedge_percentile_ > 0) {
+    read_latencies_.Record(std::chrono::steady_clock::now() - read_.start);
+  }
+  return winner;
+}
+
+int ServerGroup::WaitForRead(uint64_t *request) {
+  int winner = PollRead(request);
+  if (winner != -1) {
+    return winner;
+  }
+  WaitUntil(wait_policy_, &notifier_, [this, request, &winner] {
+    winner = PollRead(request);
+    return winner != -1;
+  });
+  return winner;
+}
+
+bool ServerGroup::Reset() {
+  if (session_.get() == nullptr) {
+    return false;
+  }
+  WaitForAll();
+  for (size_t i = 0; i < server_conns_.size(); i++) {
+    if (!ResetServer(i)) {
+      log_debug("Failed to reset server %lu", i);
+      return false;
+    }
+    pipelines_[i].slots.clear();
+  }
+  return true;
+}
+
+bool ServerGroup::ResetServer(size_t server_index) {
+  if (!SendCommand(server_index, COM_RESET_CONNECTION, nullptr)) {
+    return false;
+  }
+  if (!ExpectOk(server_index)) {
+    // Servers older than 5.7.3 answer with an error; re-authenticating
+    // resets the session as well.
+    if (!SendChangeUser(server_index) || !ExpectOk(server_index)) {
+      return false;
+    }
+  }
+  if (session_->db[0] == 0) {
+    return true;
+  }
+  return SendCommand(server_index, COM_INIT_DB, session_->db) && ExpectOk(server_index);
+}
+
+bool ServerGroup::SendCommand(size_t server_index, uint8_t command, const char *argument) {
+  size_t argument_length = argument == nullptr ? 0 : strlen(argument);
+  uint8_t *buffer = server_conns_[server_index].Buffer();
+  mysql_set_byte3(buffer, 1 + argument_length);
+  buffer[kMySQLSeqOffset] = 0;
+  buffer[kMySQLHeaderLen] = command;
+  if (argument_length > 0) {
+    memcpy(buffer + kMySQLHeaderLen + 1, argument, argument_length);
+  }
+  return server_conns_[server_index].Send(kMySQLHeaderLen + 1 + argument_length) > 0;
+}
+
+bool ServerGroup::SendChangeUser(size_t server_index) {
+  // Same credentials as SendBackendAuth(): an empty auth response.
+  uint8_t *buffer = server_conns_[server_index].Buffer();
+  uint8_t *payload = buffer + kMySQLHeaderLen;
+  *payload++ = COM_CHANGE_USER;
+  size_t user_length = strlen(session_->user) + 1;
+  memcpy(payload, session_->user, user_length);
+  payload += user_length;
+  *payload++ = 0;
+  size_t db_length = strlen(session_->db) + 1;
+  memcpy(payload, session_->db, db_length);
+  payload += db_length;
+  mysql_set_byte2(payload, static_cast<uint16_t>(session_->charset));
+  payload += 2;
+  size_t plugin_length = strlen(DEFAULT_MYSQL_AUTH_PLUGIN) + 1;
+  memcpy(payload, DEFAULT_MYSQL_AUTH_PLUGIN, plugin_length);
+  payload += plugin_length;
+  size_t payload_size = static_cast<size_t>(payload - buffer) - kMySQLHeaderLen;
+  mysql_set_byte3(buffer, payload_size);
+  buffer[kMySQLSeqOffset] = 0;
+  return server_conns_[server_index].Send(kMySQLHeaderLen + payload_size) > 0;
+}
+
+bool ServerGroup::ExpectOk(size_t server_index) {
+  ssize_t size = server_conns_[server_index].Recv();
+  return size > 0 && mysql_is_ok_packet(server_conns_[server_index].Buffer());
+}
+
 bool ServerGroup::IsExitPacket(uint8_t *buffer, size_t size) {
   if (size != kExitPacketSize) {
     return false;
@@ -4,37 +4,222 @@
 #include "mysql_auth/mysql_auth_client.h"
 #include "mysql_auth/mysql_auth_server.h"
 #include "mysqlrouter/connection.h"
+#include "mysqlrouter/notifier.h"
+#include "latency_window.h"
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
 #include <vector>
 #include <utility>
 
+#include <climits>
+
+// Connections to every destination of a route, authenticated as one
+// client. Each server has a pipeline of up to PipelineDepth() requests
+// in flight, answered in order; every request gets a number, and its
+// result is kept in a slot until the next request to that server, or,
+// for held requests (prefetches), until it is claimed or discarded.
 class ServerGroup {
 public:
-  ServerGroup(const std::vector<int> &server_fds);
+  // The servers are reached through sock_ops.
+  ServerGroup(const std::vector<int> &server_fds,
+              routing::SocketOperationsBase *sock_ops = routing::BackendOperations::instance());
+
+  void SetPipelineDepth(size_t depth) {
+    pipeline_depth_ = depth > 0 ? depth : 1;
+  }
+  size_t PipelineDepth() const {
+    return pipeline_depth_;
+  }
+  // Client reads that take longer than this percentile of recent read
+  // latencies are sent to a second idle server as well; 0 disables it.
+  void SetHedgePercentile(unsigned int percentile) {
+    hedge_percentile_ = percentile;
+  }
 
   bool Authenticate(Connection *client);
+  // Authenticates with every server on behalf of a client whose handshake
+  // is done. The first server's response is forwarded to client, unless
+  // client is nullptr (groups warmed up by ServerGroupPool).
+  bool AuthenticateBackends(std::unique_ptr<MySQLSession> session, Connection *client);
+  // Finishes the handshake of a client given an already authenticated
+  // group from ServerGroupPool.
+  bool AcceptClient(Connection *client);
+  // Brings every server back to the state right after authentication:
+  // waits for outstanding requests, then rolls back whatever the session
+  // left open, speculative writes included, with COM_RESET_CONNECTION
+  // (COM_CHANGE_USER if the server does not know it) and restores the
+  // schema the group was authenticated with.
+  bool Reset();
+  // Schema the group was authenticated with, "" if none.
+  const char *Schema() const {
+    return session_ ? session_->db : "";
+  }
+  std::chrono::steady_clock::duration Age() const {
+    return std::chrono::steady_clock::now() - created_at_;
+  }
+  // Non-blocking counterpart of Authenticate() once the client handshake
+  // is done: PollAuthentication() returns 1 when every server has
+  // answered and the first response has been sent to the client, 0 while
+  // still pending and -1 on error.
+  void StartAuthentication(std::unique_ptr<MySQLSession> session);
+  int PollAuthentication(Connection *client);
+  size_t MemoryFootprint() {
+    return sizeof(*this) + server_conns_.size() * Connection::kBufferSize;
+  }
   size_t Size() {
     return server_conns_.size();
   }
+  // Requests that fit in all pipelines at once: the most speculations
+  // worth asking a speculator for, as reads go to any server with room.
+  int Capacity() {
+    return static_cast<int>(std::min<size_t>(Size() * pipeline_depth_, INT_MAX));
+  }
   int Read(uint8_t *buffer, size_t size);
   int Write(uint8_t *buffer, size_t size);
+  // Result of the last request sent to the server.
   std::pair<uint8_t*, size_t> GetResult(size_t server_index);
+  // Result of a held request; the slot is released by the next request
+  // sent to the server.
+  std::pair<uint8_t*, size_t> GetResult(size_t server_index, uint64_t request);
 
-  bool SendQuery(size_t server_index, const std::string &query, int num_queries=1);
+  // query holds num_queries statements; the transport drops the results
+  // of all but the last one, so the server must have answered everything
+  // sent before if num_queries > 1. With hold set, the result is kept
+  // until claimed with GetResult() or dropped with Discard(), even if
+  // more requests are sent meanwhile.
+  bool SendQuery(size_t server_index, const std::string &query, int num_queries=1,
+                 bool hold=false);
+  // Sends query as a request of its own whose result is dropped on
+  // arrival, e.g. an undo ahead of the next request to a busy server.
+  bool SendDiscarded(size_t server_index, const std::string &query);
+  // Number of the last request sent to the server.
+  uint64_t LastRequest(size_t server_index) {
+    return pipelines_[server_index].next_request - 1;
+  }
+  void Discard(size_t server_index, uint64_t request);
   bool Propagate(const std::string &query, size_t source_write_server, int num_queries);
+  // Whether every request sent to the server has been answered.
   bool IsReadyForQuery(size_t server_index);
+  // Whether the result of the request has arrived.
+  bool IsResultReady(size_t server_index, uint64_t request);
+  bool HasCapacity(size_t server_index) {
+    return pipelines_[server_index].num_pending < pipeline_depth_;
+  }
+  size_t NumPending(size_t server_index) {
+    return pipelines_[server_index].num_pending;
+  }
   void WaitForServer(size_t server_index);
+  void WaitForResult(size_t server_index, uint64_t request);
   void WaitForAll();
+  // Tracks the client read sent as request to server. With hedge set the
+  // query may be sent to another server (hedging must be enabled, and
+  // the query must read the same rows on every server). Poll returns the
+  // server whose answer came first, setting *request, or -1 while
+  // pending; the other copy is discarded.
+  void StartRead(int server, uint64_t request, const std::string &query, bool hedge);
+  int PollRead(uint64_t *request);
+  int WaitForRead(uint64_t *request);
+  uint64_t num_hedged() const {
+    return num_hedged_;
+  }
+  uint64_t num_hedge_wins() const {
+    return num_hedge_wins_;
+  }
   bool ForwardToAll(const std::string &query, int num_queries=1);
+  // An idle server, the one expected to answer first; otherwise blocks
+  // until some server has answered everything sent to it.
   int GetAvailableServer();
+  // The server expected to answer a new request first, among those with
+  // room in their pipeline: EWMA response time times the requests ahead
+  // of it. The reserved server, whose result the client is waiting for,
+  // counts one request more (it is skipped at depth 1). Ties go to the
+  // server selected least often. -1 if every pipeline is full.
+  // SelectServer() also counts the selection.
+  int PickServer(int reserved_server = -1) {
+    return Pick(reserved_server, false);
+  }
+  int SelectServer(int reserved_server = -1);
+  // SelectServer(), waiting with the wait policy until a pipeline has
+  // room.
+  int WaitForSelectServer(int reserved_server = -1);
+  uint64_t NumSelections(size_t server_index) const {
+    return pipelines_[server_index].selections;
+  }
+  std::chrono::nanoseconds ResponseTime(size_t server_index) const {
+    return std::chrono::nanoseconds(static_cast<int64_t>(pipelines_[server_index].ewma_ns));
+  }
+  // Logs selection and hedging counts.
+  void LogStats();
   bool IsExitPacket(uint8_t *buffer, size_t size);
 
 private:
+  struct ResultSlot {
+    uint64_t request;
+    bool held;
+    bool discarded;
+    // Still in the connection buffer; moved to data before the next
+    // response is received.
+    bool in_buffer;
+    // -2 while pending, < 0 on error
+    ssize_t size;
+    std::vector<uint8_t> data;
+    std::chrono::steady_clock::time_point sent_at;
+  };
+  struct Pipeline {
+    // In the order the requests were sent.
+    std::deque<ResultSlot> slots;
+    uint64_t next_request;
+    size_t num_pending;
+    // Response time, measured from when the server could start on the
+    // request: the later of it being sent and the previous response.
+    double ewma_ns;
+    std::chrono::steady_clock::time_point last_response;
+    uint64_t selections;
+  };
+  struct ClientRead {
+    int server;
+    uint64_t request;
+    // -1 until hedged
+    int hedge_server;
+    uint64_t hedge_request;
+    std::string query;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point hedge_at;
+  };
+
+  void PushRequest(size_t server_index, bool hold);
+  void Hedge();
+  int Pick(int reserved_server, bool idle_only);
+  ResultSlot *FindSlot(size_t server_index, uint64_t request);
+  // Receives the next response of the server; blocks if block is set.
+  // Returns false if nothing has arrived yet.
+  bool ReceiveNext(size_t server_index, bool block);
+  std::pair<uint8_t*, size_t> SlotResult(size_t server_index, const ResultSlot &slot);
+  bool SendCommand(size_t server_index, uint8_t command, const char *argument);
+  bool SendChangeUser(size_t server_index);
+  bool ExpectOk(size_t server_index);
+  bool ResetServer(size_t server_index);
 
+  // Signalled by every server connection on arrival; declared before the
+  // connections so that it outlives them.
+  Notifier notifier_;
+  WaitPolicy wait_policy_;
   std::vector<Connection> server_conns_;
-  std::vector<bool> has_outstanding_request_;
+  std::vector<Pipeline> pipelines_;
+  size_t pipeline_depth_;
+  unsigned int hedge_percentile_;
+  LatencyWindow read_latencies_;
+  ClientRead read_;
+  uint64_t num_hedged_;
+  uint64_t num_hedge_wins_;
+  // Response sizes during authentication.
   std::vector<ssize_t> read_results_;
   std::unique_ptr<MySQLSession> session_;
+  std::vector<int> auth_stages_;
+  std::chrono::steady_clock::time_point created_at_;
 };
 
 #endif // ROUTING_SRC_SERVER_GROUP_H_
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "server_group_pool.h"
+#include "logger.h"
+
+#include <algorithm>
+
+// How often the idle lists are checked for expired groups and topped up
+// when nothing is released in between.
+static const std::chrono::seconds kMaintenanceInterval(1);
+
+ServerGroupPool::ServerGroupPool(Factory factory, size_t min_idle, size_t max_idle,
+                                 std::chrono::seconds max_lifetime) :
+    factory_(std::move(factory)), min_idle_(std::min(min_idle, max_idle)),
+    max_idle_(max_idle), max_lifetime_(max_lifetime), num_released_(0), num_handled_(0),
+    stopping_(false), hits_(0), misses_(0) {}
+
+ServerGroupPool::~ServerGroupPool() {
+  Stop();
+}
+
+std::string ServerGroupPool::Key(const MySQLSession &session) {
+  return std::string(session.user) + "/" + session.db;
+}
+
+void ServerGroupPool::Start() {
+  if (!Enabled() || thread_.joinable()) {
+    return;
+  }
+  stopping_ = false;
+  thread_ = std::thread(&ServerGroupPool::Run, this);
+}
+
+void ServerGroupPool::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  released_cond_.notify_all();
+  handled_cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  // Closed outside the lock, when they go out of scope.
+  std::unordered_map<std::string, IdleList> idle;
+  std::vector<Released> released;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle.swap(idle_);
+    released.swap(released_);
+  }
+}
+
+std::unique_ptr<ServerGroup> ServerGroupPool::Acquire(const std::string &key,
+                                                      const MySQLSession &session) {
+  std::unique_ptr<ServerGroup> server_group;
+  std::vector<std::unique_ptr<ServerGroup>> expired;
+  if (Enabled()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = idle_.find(key);
+    if (iter == idle_.end()) {
+      iter = idle_.emplace(key, IdleList{session, {}, {}}).first;
+    }
+    iter->second.last_used = std::chrono::steady_clock::now();
+    auto &groups = iter->second.groups;
+    while (!groups.empty() && server_group.get() == nullptr) {
+      auto candidate = std::move(groups.back());
+      groups.pop_back();
+      if (IsExpired(*candidate)) {
+        expired.push_back(std::move(candidate));
+      } else {
+        server_group = std::move(candidate);
+      }
+    }
+  }
+  if (server_group.get() != nullptr) {
+    hits_++;
+    log_debug("Server group pool hit for %s", key.c_str());
+  } else {
+    misses_++;
+    log_debug("Server group pool miss for %s", key.c_str());
+  }
+  return server_group;
+}
+
+void ServerGroupPool::Release(const std::string &key, std::unique_ptr<ServerGroup> server_group) {
+  if (!Enabled() || server_group.get() == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return;
+    }
+    released_.emplace_back(key, std::move(server_group));
+    num_released_++;
+  }
+  released_cond_.notify_one();
+}
+
+void ServerGroupPool::Drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t num_released = num_released_;
+  handled_cond_.wait(lock, [this, num_released] {
+    return stopping_ || num_handled_ >= num_released;
+  });
+}
+
+size_t ServerGroupPool::NumIdle() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t num_idle = 0;
+  for (auto &entry : idle_) {
+    num_idle += entry.second.groups.size();
+  }
+  return num_idle;
+}
+
+size_t ServerGroupPool::NumKeys() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_.size();
+}
+
+void ServerGroupPool::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    released_cond_.wait_for(lock, kMaintenanceInterval, [this] {
+      return stopping_ || !released_.empty();
+    });
+    if (stopping_) {
+      break;
+    }
+    std::vector<Released> released;
+    released.swap(released_);
+    lock.unlock();
+    size_t num_released = released.size();
+    ResetReleased(released);
+    released.clear();
+    EvictExpired();
+    lock.lock();
+    num_handled_ += num_released;
+    lock.unlock();
+    handled_cond_.notify_all();
+    size_t num_warmed = WarmUp();
+    if (num_released > 0 || num_warmed > 0) {
+      log_debug("Server group pool: %lu hits, %lu misses, %lu idle",
+                hits(), misses(), NumIdle());
+    }
+    lock.lock();
+  }
+}
+
+void ServerGroupPool::ResetReleased(std::vector<Released> &released) {
+  for (auto &entry : released) {
+    auto &server_group = entry.second;
+    if (IsExpired(*server_group) || !server_group->Reset()) {
+      server_group.reset();
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = idle_.find(entry.first);
+    if (iter != idle_.end() && iter->second.groups.size() < max_idle_) {
+      iter->second.last_used = std::chrono::steady_clock::now();
+      iter->second.groups.push_back(std::move(server_group));
+    }
+  }
+}
+
+void ServerGroupPool::EvictExpired() {
+  std::vector<std::unique_ptr<ServerGroup>> expired;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto entry = idle_.begin(); entry != idle_.end();) {
+    auto &groups = entry->second.groups;
+    for (auto iter = groups.begin(); iter != groups.end();) {
+      if (IsExpired(**iter)) {
+        expired.push_back(std::move(*iter));
+        iter = groups.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    if (groups.empty() && !IsRecent(entry->second)) {
+      entry = idle_.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+}
+
+size_t ServerGroupPool::WarmUp() {
+  std::vector<std::pair<std::string, MySQLSession>> wanted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &entry : idle_) {
+      if (!IsRecent(entry.second)) {
+        continue;
+      }
+      for (size_t i = entry.second.groups.size(); i < min_idle_; i++) {
+        wanted.emplace_back(entry.first, entry.second.session);
+      }
+    }
+  }
+  size_t num_warmed = 0;
+  for (auto &want : wanted) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        break;
+      }
+    }
+    auto server_group = factory_();
+    if (server_group.get() == nullptr) {
+      // Retried in the next round.
+      break;
+    }
+    std::unique_ptr<MySQLSession> session(new MySQLSession(want.second));
+    if (!server_group->AuthenticateBackends(std::move(session), nullptr)) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = idle_.find(want.first);
+    if (iter != idle_.end() && iter->second.groups.size() < max_idle_) {
+      iter->second.groups.push_back(std::move(server_group));
+      num_warmed++;
+    }
+  }
+  return num_warmed;
+}
@@ -0,0 +1,105 @@
+#ifndef ROUTING_SRC_SERVER_GROUP_POOL_H_
+#define ROUTING_SRC_SERVER_GROUP_POOL_H_
+
+#include "server_group.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Authenticated server groups kept warm between client sessions, keyed by
+// the user and schema the client connected with. A client whose key has an
+// idle group skips connecting and authenticating with every server.
+//
+// Released groups are reset and returned to the idle list by a background
+// thread, which also evicts groups older than max_lifetime and keeps
+// min_idle groups ready for every key used within max_lifetime. Keys
+// unused for longer are dropped once they have no idle group left. With
+// max_idle == 0 the pool is disabled: Acquire() always misses and
+// released groups are closed.
+class ServerGroupPool {
+public:
+  // Opens a new, unauthenticated group; returns nullptr on failure.
+  using Factory = std::function<std::unique_ptr<ServerGroup>()>;
+
+  ServerGroupPool(Factory factory, size_t min_idle, size_t max_idle,
+                  std::chrono::seconds max_lifetime);
+  ~ServerGroupPool();
+
+  static std::string Key(const MySQLSession &session);
+
+  void Start();
+  void Stop();
+  bool Enabled() const {
+    return max_idle_ > 0;
+  }
+  // Returns an idle group for key, or nullptr on a miss. session is
+  // remembered to warm up groups for key.
+  std::unique_ptr<ServerGroup> Acquire(const std::string &key, const MySQLSession &session);
+  std::unique_ptr<ServerGroup> Create() {
+    return factory_();
+  }
+  // Hands back a group whose client has left cleanly.
+  void Release(const std::string &key, std::unique_ptr<ServerGroup> server_group);
+  // Blocks until every group released so far is idle again or closed,
+  // and expired groups and keys are evicted. Only with the pool started.
+  void Drain();
+
+  uint64_t hits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+  uint64_t misses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+  size_t NumIdle();
+  size_t NumKeys();
+
+private:
+  struct IdleList {
+    MySQLSession session;
+    std::deque<std::unique_ptr<ServerGroup>> groups;
+    std::chrono::steady_clock::time_point last_used;
+  };
+  using Released = std::pair<std::string, std::unique_ptr<ServerGroup>>;
+
+  void Run();
+  void ResetReleased(std::vector<Released> &released);
+  void EvictExpired();
+  size_t WarmUp();
+  bool IsExpired(const ServerGroup &server_group) const {
+    return server_group.Age() >= max_lifetime_;
+  }
+  bool IsRecent(const IdleList &idle_list) const {
+    return std::chrono::steady_clock::now() - idle_list.last_used < max_lifetime_;
+  }
+
+  Factory factory_;
+  const size_t min_idle_;
+  const size_t max_idle_;
+  const std::chrono::steady_clock::duration max_lifetime_;
+
+  std::mutex mutex_;
+  std::condition_variable released_cond_;
+  std::condition_variable handled_cond_;
+  std::unordered_map<std::string, IdleList> idle_;
+  std::vector<Released> released_;
+  // Groups released, and those the thread is done with.
+  uint64_t num_released_;
+  uint64_t num_handled_;
+  bool stopping_;
+  std::thread thread_;
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+#endif // ROUTING_SRC_SERVER_GROUP_POOL_H_
@@ -0,0 +1,472 @@
+#include "session.h"
+#include "logger.h"
+
+Session::Session(Connection &&client, ServerGroupPool *server_group_pool,
+                 const SpeculatorFactory &speculator_factory, ResultCache *result_cache,
+                 const SpeculationThrottle::Options &throttle_options) :
+    client_(std::move(client)), server_group_pool_(server_group_pool),
+    speculator_factory_(speculator_factory), state_(kClientHandshake),
+    handshake_done_(false), query_type_(StatementType::kOther), query_id_(-1),
+    num_sub_queries_(1), is_query_(false), hit_(false), cached_(false),
+    fingerprint_(0), cache_version_(0), speculation_is_write_(false),
+    previous_is_write_(false), result_server_(-1), result_request_(0),
+    client_read_(false), speculate_after_result_(false),
+    reserved_server_(-1), after_speculation_(kSendResult), packet_size_(0),
+    result_cache_(result_cache), throttle_(throttle_options), has_begun_(false), id_(-1), bytes_up_(0), bytes_down_(0),
+    num_misses_(0), num_queries_(0) {}
+
+Session::~Session() {
+  Close();
+}
+
+bool Session::Start() {
+  mysql_session_ = StartClientHandshake(&client_);
+  if (mysql_session_.get() == nullptr) {
+    Close();
+    return false;
+  }
+  state_ = kClientHandshake;
+  return true;
+}
+
+size_t Session::MemoryFootprint() {
+  size_t footprint = sizeof(*this) + Connection::kBufferSize;
+  if (server_group_.get() != nullptr) {
+    footprint += server_group_->MemoryFootprint();
+  }
+  return footprint;
+}
+
+void Session::OnClientReadable() {
+  if (state_ == kClientHandshake) {
+    if (!FinishClientHandshake(mysql_session_.get(), &client_) || !AcquireServerGroup()) {
+      Close();
+      return;
+    }
+    Poll();
+    return;
+  }
+  if (state_ != kIdle) {
+    // The client is not supposed to send anything before it gets the
+    // result of its previous packet; leave it in the socket until then.
+    return;
+  }
+  log_debug("Reading packet from the client...");
+  ssize_t bytes_read = client_.Recv();
+  if (bytes_read <= 0) {
+    log_debug("Client closed the connection");
+    Close();
+    return;
+  }
+  is_query_ = IsQuery(client_.Buffer());
+  if (!is_query_ && server_group_pool_->Enabled() &&
+      server_group_->IsExitPacket(client_.Buffer(), bytes_read)) {
+    // Not forwarded: the servers stay logged in for the next client.
+    Close();
+    return;
+  }
+  if (is_query_) {
+    HandleQuery();
+  } else {
+    packet_size_ = static_cast<size_t>(bytes_read);
+    result_cache_.OnPacket();
+    state_ = kForwardPacket;
+  }
+  Poll();
+}
+
+bool Session::AcquireServerGroup() {
+  pool_key_ = ServerGroupPool::Key(*mysql_session_);
+  server_group_ = server_group_pool_->Acquire(pool_key_, *mysql_session_);
+  if (server_group_.get() != nullptr) {
+    if (!server_group_->AcceptClient(&client_)) {
+      return false;
+    }
+    speculator_ = speculator_factory_(server_group_.get());
+    speculator_->Prepare();
+    result_cache_.SetSchema(server_group_->Schema());
+    handshake_done_ = true;
+    need_rollback_.assign(server_group_->Size(), false);
+    state_ = kIdle;
+    return true;
+  }
+  // Connecting to the servers still blocks the worker for the duration
+  // of the connection setup.
+  server_group_ = server_group_pool_->Create();
+  if (server_group_.get() == nullptr) {
+    return false;
+  }
+  speculator_ = speculator_factory_(server_group_.get());
+  server_group_->StartAuthentication(std::move(mysql_session_));
+  state_ = kBackendAuth;
+  return true;
+}
+
+void Session::HandleQuery() {
+  int query_index;
+  ExtractQuery(client_.Buffer(), query_, query_index, query_id_);
+  if (id_ == -1 && query_.find("ID=") == 0) {
+    id_ = ExtractID(query_);
+    if (client_.Send(kOkPacket, sizeof(kOkPacket)) <= 0) {
+      Close();
+    }
+    return;
+  }
+  query_start_ = Now();
+  query_type_ = ClassifyStatement(query_);
+  bool is_begin = query_type_ == StatementType::kBegin;
+  if (is_begin) {
+    SetNeedRollback(need_rollback_, false);
+  }
+  has_begun_ = has_begun_ || is_begin;
+  speculator_->CheckBegin(query_);
+  speculator_->SetQueryIndex(query_index);
+  log_debug("Query is %s", query_.c_str());
+
+  query_stat_ = IsReadStatement(query_type_) ? "R," : "W,";
+  previous_is_write_ = HasWritePrefetch(prefetches_);
+  query_stat_ += previous_is_write_ ? "W," : "R,";
+  query_stat_ += std::to_string(speculation_index) + ",";
+
+  Prefetch prefetch;
+  fingerprint_ = PrefetchTable::Fingerprint(query_);
+  throttle_.Observe(query_, fingerprint_);
+  hit_ = prefetches_.Take(query_, fingerprint_, &prefetch);
+  cached_ = false;
+  if (hit_) {
+    query_stat_ += "H,";
+    cache_version_ = prefetch.cache_version;
+    HandleHit(prefetch);
+  } else if (!previous_is_write_ && HandleCacheHit(fingerprint_)) {
+    query_stat_ += "C,";
+  } else {
+    query_stat_ += "M,";
+    // Read before the query is sent.
+    cache_version_ = result_cache_.Version();
+    HandleMiss();
+  }
+}
+
+bool Session::HandleCacheHit(uint64_t fingerprint) {
+  packet_size_ = result_cache_.Lookup(query_, fingerprint, query_type_, client_.Buffer(),
+                                      Connection::kBufferSize);
+  if (packet_size_ == 0) {
+    return false;
+  }
+  log_debug("Result is cached");
+  cached_ = true;
+  SpeculateThen(-1, kSendResult);
+  return true;
+}
+
+void Session::HandleHit(const Prefetch &prefetch) {
+  int server_for_current_query = -1;
+  packet_size_ = 0;
+  log_debug("Prediction hits, check for result");
+  if (server_group_->IsResultReady(prefetch.server, prefetch.request)) {
+    log_debug("Result has already arrived");
+    packet_size_ = CopyToClient(server_group_->GetResult(prefetch.server, prefetch.request),
+                                &client_);
+  } else {
+    log_debug("Result is pending");
+    server_for_current_query = prefetch.server;
+  }
+  if (!IsReadStatement(query_type_)) {
+    if (server_for_current_query != -1) {
+      AwaitResult(server_for_current_query, prefetch.request, true);
+    } else {
+      SpeculateThen(-1, kSendResult);
+    }
+  } else if (server_for_current_query != -1) {
+    result_server_ = server_for_current_query;
+    result_request_ = prefetch.request;
+    client_read_ = false;
+    speculate_after_result_ = false;
+    SpeculateThen(server_for_current_query, kAwaitResult);
+  } else {
+    SpeculateThen(-1, kSendResult);
+  }
+}
+
+void Session::HandleMiss() {
+  log_debug("Prediction fails");
+  auto next_speculation = speculator_->TrySpeculate(query_, server_group_->Capacity());
+  speculation_is_write_ = next_speculation.size() > 0 && IsWrite(next_speculation[0]);
+  query_to_send_ = query_;
+  num_sub_queries_ = 1;
+  undo_.clear();
+  SetNeedRollback(need_rollback_, false);
+  if (previous_is_write_) {
+    SetNeedRollback(need_rollback_, true);
+    // Only now is the undo built, pre-image and all.
+    undo_ = speculator_->GetUndo();
+    if (undo_.size() > 0) {
+      query_to_send_ = undo_ + "; " + query_;
+      num_sub_queries_ = 2;
+    }
+  }
+  result_cache_.OnSend(query_to_send_);
+  if (!IsReadStatement(query_type_)) {
+    if (previous_is_write_) {
+      SetNeedRollback(need_rollback_, false);
+    }
+    state_ = kForwardQuery;
+  } else {
+    state_ = kAwaitFreeServer;
+  }
+}
+
+void Session::AwaitResult(int server, uint64_t request, bool speculate_after_result) {
+  result_server_ = server;
+  result_request_ = request;
+  client_read_ = false;
+  speculate_after_result_ = speculate_after_result;
+  state_ = kAwaitResult;
+}
+
+void Session::SpeculateThen(int reserved_server, State next_state) {
+  reserved_server_ = reserved_server;
+  after_speculation_ = next_state;
+  speculate_start_ = Now();
+  state_ = kSpeculate;
+}
+
+bool Session::AllServersReady() {
+  for (size_t i = 0; i < server_group_->Size(); i++) {
+    if (!server_group_->IsReadyForQuery(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Session::Poll() {
+  State start_state = state_;
+  State previous_state;
+  do {
+    previous_state = state_;
+    switch (state_) {
+    case kBackendAuth: {
+      int res = server_group_->PollAuthentication(&client_);
+      if (res < 0) {
+        Close();
+      } else if (res > 0) {
+        log_debug("Authentication done");
+        // Blocks the worker for a query while the schema catalog is stale.
+        speculator_->Prepare();
+        result_cache_.SetSchema(server_group_->Schema());
+        handshake_done_ = true;
+        need_rollback_.assign(server_group_->Size(), false);
+        state_ = kIdle;
+      }
+      break;
+    }
+    case kForwardQuery:
+      if (!AllServersReady()) {
+        break;
+      }
+      log_debug("Sending query %s to all servers", query_to_send_.c_str());
+      if (!server_group_->ForwardToAll(query_to_send_, num_sub_queries_)) {
+        log_error("Failed to forward query to servers");
+        Close();
+        break;
+      }
+      AwaitResult(-1, 0, true);
+      break;
+    case kAwaitFreeServer: {
+      int server = server_group_->SelectServer();
+      if (server == -1) {
+        break;
+      }
+      if (previous_is_write_) {
+        need_rollback_[server] = false;
+      }
+      // The server may still be busy with speculations, so the undo is a
+      // request of its own rather than a statement the transport skips.
+      if (undo_.size() > 0 && !server_group_->SendDiscarded(server, undo_)) {
+        log_error("Failed to send undo to server");
+        Close();
+        break;
+      }
+      log_debug("Sending query %s to server %d", query_.c_str(), server);
+      // Held, since speculations may be queued behind it.
+      if (!server_group_->SendQuery(server, query_, 1, true)) {
+        log_error("Failed to send query to server");
+        Close();
+        break;
+      }
+      uint64_t request = server_group_->LastRequest(server);
+      // Only a plain read can be answered by another server.
+      server_group_->StartRead(server, request, query_, !previous_is_write_);
+      if (speculation_is_write_) {
+        AwaitResult(server, request, true);
+      } else {
+        result_server_ = server;
+        result_request_ = request;
+        speculate_after_result_ = false;
+        SpeculateThen(server, kAwaitResult);
+      }
+      client_read_ = true;
+      break;
+    }
+    case kForwardPacket:
+      if (!AllServersReady()) {
+        break;
+      }
+      log_debug("Forwarding packet to the server...");
+      if (server_group_->Write(client_.Buffer(), packet_size_) <= 0) {
+        log_debug("Write to servers fails");
+        Close();
+        break;
+      }
+      bytes_up_ += packet_size_;
+      state_ = kAwaitAllResults;
+      break;
+    case kAwaitAllResults:
+      if (!AllServersReady()) {
+        break;
+      }
+      for (size_t i = 0; i < server_group_->Size(); i++) {
+        if (server_group_->GetResult(i).first == nullptr) {
+          log_error("Read from servers fail");
+          Close();
+          return true;
+        }
+      }
+      packet_size_ = CopyToClient(server_group_->GetResult(0), &client_);
+      state_ = kSendResult;
+      break;
+    case kAwaitResult: {
+      int server = result_server_;
+      if (server == -1) {
+        for (size_t i = 0; i < server_group_->Size(); i++) {
+          if (server_group_->IsReadyForQuery(i)) {
+            server = static_cast<int>(i);
+            break;
+          }
+        }
+      } else if (client_read_) {
+        server = server_group_->PollRead(&result_request_);
+      } else if (!server_group_->IsResultReady(server, result_request_)) {
+        server = -1;
+      }
+      if (server == -1) {
+        break;
+      }
+      auto result = result_server_ == -1 ? server_group_->GetResult(server)
+                                         : server_group_->GetResult(server, result_request_);
+      if (result.first == nullptr) {
+        log_error("Failed to read result from server %d", server);
+        Close();
+        break;
+      }
+      packet_size_ = CopyToClient(std::move(result), &client_);
+      if (speculate_after_result_) {
+        SpeculateThen(-1, kSendResult);
+      } else {
+        state_ = kSendResult;
+      }
+      break;
+    }
+    case kSpeculate:
+      if (!CanSpeculate(query_, server_group_.get(), reserved_server_, speculator_.get(),
+                        &throttle_)) {
+        break;
+      }
+      // The wait for the servers happened above, not in DoSpeculation().
+      throttle_.OnWait(GetDuration(speculate_start_));
+      if (!DoSpeculation(query_, query_type_, server_group_.get(), reserved_server_,
+                         speculator_.get(), need_rollback_, prefetches_, &result_cache_,
+                         &throttle_)) {
+        log_error("Failed to send speculations");
+        Close();
+        break;
+      }
+      state_ = after_speculation_;
+      break;
+    case kSendResult:
+      log_debug("Send results back to client");
+      if (client_.Send(packet_size_) <= 0) {
+        log_error("Write to client fails");
+        Close();
+        break;
+      }
+      bytes_down_ += packet_size_;
+      if (is_query_) {
+        FinishQuery();
+      }
+      state_ = kIdle;
+      break;
+    default:
+      break;
+    }
+  } while (state_ != previous_state && NeedsPolling());
+  return state_ != start_state;
+}
+
+void Session::FinishQuery() {
+  if (!cached_) {
+    result_cache_.Insert(query_, fingerprint_, query_type_, cache_version_, client_.Buffer(),
+                         packet_size_);
+  }
+  speculator_->OnResult(client_.Buffer(), packet_size_);
+  result_cache_.OnResult(query_type_);
+  if (!hit_ && !cached_) {
+    throttle_.OnMiss(GetDuration(query_start_), previous_is_write_);
+  }
+  bool is_begin_or_commit = query_type_ == StatementType::kBegin ||
+                            query_type_ == StatementType::kCommit;
+  if (!is_begin_or_commit) {
+    num_queries_++;
+    if (!hit_ && !cached_) {
+      num_misses_++;
+    }
+  }
+  if (!has_begun_) {
+    return;
+  }
+  auto latency = GetDuration(query_start_);
+  if (IsReadStatement(query_type_)) {
+    read_latencies_.push_back(std::make_pair(query_id_, latency));
+    query_process_latencies_.push_back(std::make_pair(query_id_, latency));
+    query_stat_ += std::to_string(query_id_) + "," + std::to_string(latency);
+  } else if (!is_begin_or_commit) {
+    write_latencies_.push_back(std::make_pair(query_id_, latency));
+    query_process_latencies_.push_back(std::make_pair(query_id_, latency));
+    query_stat_ += std::to_string(query_id_) + "," + std::to_string(latency);
+  } else {
+    query_stat_ += "-1," + std::to_string(latency);
+  }
+  query_stats_.push_back(query_stat_);
+}
+
+void Session::Close() {
+  if (state_ == kClosed) {
+    return;
+  }
+  // Only a session closed between two requests leaves the servers in a
+  // state the pool can reset.
+  bool reusable = state_ == kIdle;
+  state_ = kClosed;
+  client_.Disconnect();
+  speculator_.reset();
+  if (server_group_.get() != nullptr && handshake_done_) {
+    server_group_->LogStats();
+  }
+  if (reusable) {
+    server_group_pool_->Release(pool_key_, std::move(server_group_));
+  }
+  if (!handshake_done_) {
+    return;
+  }
+  DumpQueryStats(query_stats_, "query_stats" + std::to_string(id_));
+  DumpLatency(query_process_latencies_, "query_process" + std::to_string(id_));
+  DumpLatency(read_latencies_, "read_process" + std::to_string(id_));
+  DumpLatency(write_latencies_, "write_process" + std::to_string(id_));
+  log_info("%lu misses out of %lu queries", num_misses_, num_queries_);
+  if (throttle_.Enabled()) {
+    throttle_.Dump("speculation_estimates" + std::to_string(id_));
+    log_info("%lu of %lu speculations throttled", throttle_.num_throttled(),
+             throttle_.num_sent() + throttle_.num_throttled());
+  }
+}
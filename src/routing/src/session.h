@@ -0,0 +1,146 @@
+#ifndef ROUTING_SRC_SESSION_H_
+#define ROUTING_SRC_SESSION_H_
+
+#include "mysqlrouter/connection.h"
+#include "query_utils.h"
+#include "result_cache.h"
+#include "server_group.h"
+#include "server_group_pool.h"
+#include "speculation_throttle.h"
+#include "speculator/speculator.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using SpeculatorFactory = std::function<std::unique_ptr<Speculator>(ServerGroup *)>;
+
+// A client session driven by a reactor worker. It implements the same
+// protocol as MySQLRouting::routing_select_thread(), but instead of
+// blocking on the client or the servers every step is a state that is
+// re-entered from OnClientReadable() or Poll() until it can make progress.
+class Session {
+public:
+  enum State {
+    kClientHandshake,   // greeting sent, waiting for the handshake response
+    kBackendAuth,       // authenticating with the servers
+    kIdle,              // waiting for the next client packet
+    kForwardQuery,      // write miss, waiting for all servers to be idle
+    kAwaitFreeServer,   // read miss, waiting for room in some pipeline
+    kForwardPacket,     // non-query packet, waiting for all servers to be idle
+    kAwaitAllResults,   // non-query packet sent, waiting for every server
+    kAwaitResult,       // waiting for result_server_ (-1 means any server)
+    kSpeculate,         // waiting until DoSpeculation() would not block
+    kSendResult,        // result copied into the client buffer
+    kClosed,
+  };
+
+  Session(Connection &&client, ServerGroupPool *server_group_pool,
+          const SpeculatorFactory &speculator_factory, ResultCache *result_cache,
+          const SpeculationThrottle::Options &throttle_options);
+  ~Session();
+
+  bool Start();
+  void OnClientReadable();
+  // Drives every state that is waiting on the servers. Returns whether
+  // the session made progress.
+  bool Poll();
+  void Close();
+
+  State state() const {
+    return state_;
+  }
+  bool IsClosed() const {
+    return state_ == kClosed;
+  }
+  // Whether the session waits on the servers, which have no file
+  // descriptor to epoll on and have to be polled.
+  bool NeedsPolling() const {
+    return state_ != kClientHandshake && state_ != kIdle && state_ != kClosed;
+  }
+  int FileDescriptor() {
+    return client_.FileDescriptor();
+  }
+  bool handshake_done() const {
+    return handshake_done_;
+  }
+  size_t bytes_up() const {
+    return bytes_up_;
+  }
+  size_t bytes_down() const {
+    return bytes_down_;
+  }
+  size_t MemoryFootprint();
+
+private:
+  bool AcquireServerGroup();
+  void HandleQuery();
+  void HandleHit(const Prefetch &prefetch);
+  void HandleMiss();
+  // Whether the result cache answered the query.
+  bool HandleCacheHit(uint64_t fingerprint);
+  // With server == -1 the result of whichever server answers first.
+  void AwaitResult(int server, uint64_t request, bool speculate_after_result);
+  void SpeculateThen(int reserved_server, State next_state);
+  void FinishQuery();
+  bool AllServersReady();
+
+  Connection client_;
+  ServerGroupPool *server_group_pool_;
+  const SpeculatorFactory &speculator_factory_;
+  std::string pool_key_;
+  std::unique_ptr<ServerGroup> server_group_;
+  std::unique_ptr<Speculator> speculator_;
+  std::unique_ptr<MySQLSession> mysql_session_;
+  State state_;
+  bool handshake_done_;
+
+  // State of the query in flight.
+  std::string query_;
+  // Classified once per client packet.
+  StatementType query_type_;
+  std::string query_to_send_;
+  // Undo of the write speculations the query follows, "" if none.
+  std::string undo_;
+  int query_id_;
+  int num_sub_queries_;
+  bool is_query_;
+  bool hit_;
+  bool cached_;
+  uint64_t fingerprint_;
+  // ResultCache version the query was sent at.
+  uint64_t cache_version_;
+  bool speculation_is_write_;
+  bool previous_is_write_;
+  int result_server_;
+  uint64_t result_request_;
+  // Whether the result is tracked with ServerGroup::StartRead().
+  bool client_read_;
+  bool speculate_after_result_;
+  int reserved_server_;
+  State after_speculation_;
+  // When kSpeculate was entered.
+  TimePoint speculate_start_;
+  size_t packet_size_;
+  TimePoint query_start_;
+  std::string query_stat_;
+
+  Prefetches prefetches_;
+  ResultCacheClient result_cache_;
+  SpeculationThrottle throttle_;
+  std::vector<bool> need_rollback_;
+  bool has_begun_;
+  int id_;
+  size_t bytes_up_;
+  size_t bytes_down_;
+  size_t num_misses_;
+  size_t num_queries_;
+  std::vector<std::pair<int, long>> query_process_latencies_;
+  std::vector<std::pair<int, long>> read_latencies_;
+  std::vector<std::pair<int, long>> write_latencies_;
+  std::vector<std::string> query_stats_;
+};
+
+#endif // ROUTING_SRC_SESSION_H_
@@ -0,0 +1,325 @@
+#include "mysqlrouter/shm_channel.h"
+
+#include <algorithm>
+#include <new>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const uint64_t kShmMagic = 0x314d485350515351ULL;  // "QSQPSHM1"
+static const size_t kMinRingSize = 4096;
+
+struct ShmChannel::Ring {
+  Ring() : head(0), tail(0), data(true), space(true) {}
+
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) Notifier data;
+  alignas(64) Notifier space;
+};
+
+// Followed by the data of both rings.
+struct ShmChannel::Segment {
+  explicit Segment(size_t size) : magic(kShmMagic), ring_size(size), closed(0) {}
+
+  uint64_t magic;
+  uint64_t ring_size;
+  std::atomic<uint32_t> closed;
+  // To the listener, then to the connector.
+  Ring rings[2];
+};
+
+static socklen_t AbstractAddress(const std::string &name, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  auto length = std::min(name.size(), sizeof(address->sun_path) - 1);
+  memcpy(address->sun_path + 1, name.data(), length);
+  return static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + 1 + length);
+}
+
+static bool SendFd(int sock, int fd) {
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  auto cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(sock, &message, MSG_NOSIGNAL) == 1;
+}
+
+static int ReceiveFd(int sock) {
+  char byte;
+  struct iovec iov = {&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr message = {};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  if (recvmsg(sock, &message, MSG_CMSG_CLOEXEC) != 1) {
+    return -1;
+  }
+  auto cmsg = CMSG_FIRSTHDR(&message);
+  if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+    return -1;
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+std::string ShmChannelName(int port) {
+  return "mysqlrouter-shm-" + std::to_string(port);
+}
+
+ShmChannel::ShmChannel(Segment *segment, size_t map_size, bool connector) :
+    segment_(segment), map_size_(map_size), wait_policy_(WaitPolicy::Default()),
+    record_left_(0) {
+  auto data = reinterpret_cast<char *>(segment) + sizeof(Segment);
+  int in = connector ? 1 : 0;
+  in_ = &segment->rings[in];
+  out_ = &segment->rings[1 - in];
+  in_data_ = data + in * segment->ring_size;
+  out_data_ = data + (1 - in) * segment->ring_size;
+}
+
+ShmChannel::~ShmChannel() {
+  Close();
+  munmap(segment_, map_size_);
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Connect(const std::string &name, size_t ring_size) {
+  size_t size = kMinRingSize;
+  while (size < ring_size) {
+    size *= 2;
+  }
+  size_t map_size = sizeof(Segment) + 2 * size;
+  int memfd = memfd_create("mysqlrouter-shm", MFD_CLOEXEC);
+  if (memfd < 0) {
+    return nullptr;
+  }
+  void *addr = MAP_FAILED;
+  if (ftruncate(memfd, static_cast<off_t>(map_size)) == 0) {
+    addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    close(memfd);
+    return nullptr;
+  }
+  std::unique_ptr<ShmChannel> channel(new ShmChannel(new (addr) Segment(size), map_size, true));
+
+  struct sockaddr_un address;
+  auto length = AbstractAddress(name, &address);
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  char ack = 0;
+  bool ok = sock >= 0 &&
+      connect(sock, reinterpret_cast<struct sockaddr *>(&address), length) == 0 &&
+      SendFd(sock, memfd) && recv(sock, &ack, 1, 0) == 1;
+  if (sock >= 0) {
+    close(sock);
+  }
+  close(memfd);
+  if (!ok) {
+    return nullptr;
+  }
+  return channel;
+}
+
+ssize_t ShmChannel::Write(const void *data, size_t size) {
+  uint64_t length = size;
+  // The length goes into the ring along with the start of the record,
+  // so that a reader seeing it does not wait for the rest.
+  struct iovec pieces[2] = {{&length, sizeof(length)}, {const_cast<void *>(data), size}};
+  return WriteBytes(pieces, 2) ? static_cast<ssize_t>(size) : -1;
+}
+
+bool ShmChannel::WriteBytes(const struct iovec *pieces, int num_pieces) {
+  uint64_t ring_size = segment_->ring_size;
+  int piece = 0;
+  size_t written = 0;
+  while (piece < num_pieces) {
+    auto tail = out_->tail.load(std::memory_order_relaxed);
+    WaitUntil(wait_policy_, &out_->space, [this, tail, ring_size] {
+      return tail - out_->head.load(std::memory_order_acquire) < ring_size ||
+          segment_->closed.load();
+    });
+    if (segment_->closed.load()) {
+      return false;
+    }
+    size_t space = ring_size - (tail - out_->head.load(std::memory_order_acquire));
+    uint64_t end = tail;
+    while (space > 0 && piece < num_pieces) {
+      auto bytes = static_cast<const char *>(pieces[piece].iov_base) + written;
+      size_t chunk = std::min(pieces[piece].iov_len - written, space);
+      size_t offset = end & (ring_size - 1);
+      size_t first = std::min<size_t>(chunk, ring_size - offset);
+      memcpy(out_data_ + offset, bytes, first);
+      memcpy(out_data_, bytes + first, chunk - first);
+      end += chunk;
+      space -= chunk;
+      written += chunk;
+      if (written == pieces[piece].iov_len) {
+        piece++;
+        written = 0;
+      }
+    }
+    out_->tail.store(end, std::memory_order_release);
+    out_->data.Notify();
+  }
+  return true;
+}
+
+ssize_t ShmChannel::Read(void *buffer, size_t size) {
+  if (record_left_ == 0) {
+    uint64_t length;
+    if (!ReadBytes(reinterpret_cast<char *>(&length), sizeof(length))) {
+      return -1;
+    }
+    if (length == 0) {
+      return 0;
+    }
+    record_left_ = length;
+  }
+  size_t chunk = std::min<uint64_t>(size, record_left_);
+  if (!ReadBytes(static_cast<char *>(buffer), chunk)) {
+    return -1;
+  }
+  record_left_ -= chunk;
+  return static_cast<ssize_t>(chunk);
+}
+
+bool ShmChannel::ReadBytes(char *buffer, size_t size) {
+  uint64_t ring_size = segment_->ring_size;
+  size_t read = 0;
+  while (read < size) {
+    WaitUntil(wait_policy_, &in_->data, [this] {
+      return in_->head.load(std::memory_order_relaxed) !=
+          in_->tail.load(std::memory_order_acquire) || segment_->closed.load();
+    });
+    auto head = in_->head.load(std::memory_order_relaxed);
+    auto tail = in_->tail.load(std::memory_order_acquire);
+    if (head == tail) {
+      return false;
+    }
+    size_t chunk = std::min<uint64_t>(size - read, tail - head);
+    size_t offset = head & (ring_size - 1);
+    size_t first = std::min<size_t>(chunk, ring_size - offset);
+    memcpy(buffer + read, in_data_ + offset, first);
+    memcpy(buffer + read + first, in_data_, chunk - first);
+    in_->head.store(head + chunk, std::memory_order_release);
+    in_->space.Notify();
+    read += chunk;
+  }
+  return true;
+}
+
+bool ShmChannel::HasData() {
+  return record_left_ > 0 ||
+      in_->head.load(std::memory_order_relaxed) != in_->tail.load(std::memory_order_acquire);
+}
+
+bool ShmChannel::HasError() {
+  return segment_->closed.load() && !HasData();
+}
+
+void ShmChannel::Close() {
+  if (segment_->closed.exchange(1) != 0) {
+    return;
+  }
+  for (auto &ring : segment_->rings) {
+    ring.data.Notify();
+    ring.space.Notify();
+  }
+}
+
+ShmListener::ShmListener(std::string name) : name_(std::move(name)), fd_(-1) {}
+
+ShmListener::~ShmListener() {
+  Close();
+}
+
+Status ShmListener::Listen() {
+  struct sockaddr_un address;
+  auto length = AbstractAddress(name_, &address);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return Status::Err();
+  }
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), length) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    auto status = Status::Err();
+    close(fd);
+    return status;
+  }
+  fd_ = fd;
+  return Status::Ok();
+}
+
+std::unique_ptr<ShmChannel> ShmListener::Accept() {
+  while (true) {
+    int sock = accept4(fd_.load(), nullptr, nullptr, SOCK_CLOEXEC);
+    if (sock < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return nullptr;
+    }
+    std::unique_ptr<ShmChannel> channel;
+    int memfd = ReceiveFd(sock);
+    struct stat st;
+    if (memfd >= 0 && fstat(memfd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(ShmChannel::Segment)) {
+      size_t map_size = static_cast<size_t>(st.st_size);
+      void *addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+      if (addr != MAP_FAILED) {
+        auto segment = static_cast<ShmChannel::Segment *>(addr);
+        uint64_t ring_size = segment->ring_size;
+        if (segment->magic == kShmMagic && ring_size >= kMinRingSize &&
+            (ring_size & (ring_size - 1)) == 0 &&
+            map_size == sizeof(ShmChannel::Segment) + 2 * ring_size) {
+          channel.reset(new ShmChannel(segment, map_size, false));
+        } else {
+          munmap(addr, map_size);
+        }
+      }
+    }
+    if (memfd >= 0) {
+      close(memfd);
+    }
+    if (channel) {
+      char ack = 1;
+      if (send(sock, &ack, 1, MSG_NOSIGNAL) != 1) {
+        channel.reset();
+      }
+    }
+    close(sock);
+    if (channel) {
+      return channel;
+    }
+  }
+}
+
+void ShmListener::Close() {
+  int fd = fd_.exchange(-1);
+  if (fd >= 0) {
+    // Wakes up a thread blocked in Accept().
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+  }
+}
@@ -0,0 +1,290 @@
+#include "shm_forwarder.h"
+
+#include "mysqlrouter/mysql_constant.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include <cstring>
+
+#include <sys/socket.h>
+
+static const size_t kChunkSize = 1 << 16;
+static const uint16_t kServerMoreResultsExist = 0x0008;
+static const uint16_t kServerCursorExists = 0x0040;
+
+// Offset past the length-encoded integer at offset, or size if cut off.
+static size_t SkipLengthEncodedInt(const uint8_t *payload, size_t size, size_t offset,
+                                   uint64_t *value) {
+  if (offset >= size) {
+    return size;
+  }
+  uint8_t first = payload[offset];
+  size_t length = first < 0xfb ? 0 : first == 0xfc ? 2 : first == 0xfd ? 3 : 8;
+  if (offset + 1 + length > size) {
+    return size;
+  }
+  *value = first < 0xfb ? first : 0;
+  for (size_t i = 0; i < length; i++) {
+    *value |= static_cast<uint64_t>(payload[offset + 1 + i]) << (8 * i);
+  }
+  return offset + 1 + length;
+}
+
+static uint16_t OkStatus(const uint8_t *payload, size_t size) {
+  uint64_t ignored;
+  size_t offset = SkipLengthEncodedInt(payload, size, 1, &ignored);
+  offset = SkipLengthEncodedInt(payload, size, offset, &ignored);
+  return offset + 2 <= size ? mysql_get_byte2(payload + offset) : 0;
+}
+
+static uint16_t EofStatus(const uint8_t *payload, size_t size) {
+  return size >= 5 ? mysql_get_byte2(payload + 3) : 0;
+}
+
+ShmForwarder::ShmForwarder(std::shared_ptr<ShmChannel> channel, int fd) :
+    channel_(std::move(channel)), fd_(fd), client_capabilities_(0), server_capabilities_(0),
+    num_skips_(0), num_requests_(0), request_size_(0), request_left_(0),
+    state_(State::kHandshake), num_left_(0), continued_(false), end_after_continued_(false) {}
+
+void ShmForwarder::Run() {
+  std::thread to_server(&ShmForwarder::ToServer, this);
+  ToRouter();
+  to_server.join();
+}
+
+void ShmForwarder::ToServer() {
+  std::unique_ptr<char[]> buffer(new char[kChunkSize]);
+  ssize_t size;
+  while ((size = channel_->Read(buffer.get(), kChunkSize)) >= 0) {
+    if (size == 0) {
+      num_skips_++;
+      continue;
+    }
+    // Before the server can answer what is sent.
+    ScanRequests(buffer.get(), static_cast<size_t>(size));
+    for (ssize_t sent = 0, n; sent < size; sent += n) {
+      if ((n = send(fd_, buffer.get() + sent, size - sent, MSG_NOSIGNAL)) <= 0) {
+        channel_->Close();
+        break;
+      }
+    }
+  }
+  // Also wakes up ToRouter() if the server does not hang up.
+  shutdown(fd_, SHUT_RDWR);
+}
+
+void ShmForwarder::ScanRequests(const char *data, size_t size) {
+  auto bytes = reinterpret_cast<const uint8_t *>(data);
+  while (size > 0) {
+    if (request_size_ < kMySQLHeaderLen) {
+      request_[request_size_++] = *bytes++;
+      size--;
+      if (request_size_ < kMySQLHeaderLen) {
+        continue;
+      }
+      request_left_ = mysql_get_byte3(request_);
+    } else {
+      size_t chunk = std::min(size, request_left_);
+      size_t prefix = std::min(chunk, sizeof(request_) - request_size_);
+      memcpy(request_ + request_size_, bytes, prefix);
+      request_size_ += prefix;
+      request_left_ -= chunk;
+      bytes += chunk;
+      size -= chunk;
+    }
+    if (request_left_ == 0) {
+      OnRequest(request_[kMySQLSeqOffset], request_ + kMySQLHeaderLen,
+                request_size_ - kMySQLHeaderLen);
+      request_size_ = 0;
+    }
+  }
+}
+
+void ShmForwarder::OnRequest(uint8_t seq, const uint8_t *prefix, size_t size) {
+  if (num_requests_++ == 0) {
+    // The handshake response.
+    if (size >= 4) {
+      client_capabilities_ = mysql_get_byte4(prefix);
+    }
+    return;
+  }
+  // Other packets than the first of a command go on with the last one.
+  if (seq != 0 || size == 0) {
+    return;
+  }
+  uint8_t command = prefix[0];
+  if (command == COM_QUIT || command == COM_STMT_SEND_LONG_DATA || command == COM_STMT_CLOSE) {
+    // Never answered.
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  commands_.push_back(command);
+}
+
+void ShmForwarder::ToRouter() {
+  std::unique_ptr<char[]> buffer(new char[kChunkSize]);
+  // Received but not forwarded yet; complete packets up to parsed.
+  std::string pending;
+  size_t parsed = 0;
+  ssize_t size;
+  while ((size = recv(fd_, buffer.get(), kChunkSize, 0)) > 0) {
+    pending.append(buffer.get(), static_cast<size_t>(size));
+    while (pending.size() - parsed >= kMySQLHeaderLen) {
+      auto packet = reinterpret_cast<const uint8_t *>(pending.data()) + parsed;
+      size_t length = mysql_get_byte3(packet);
+      if (pending.size() - parsed < kMySQLHeaderLen + length) {
+        break;
+      }
+      parsed += kMySQLHeaderLen + length;
+      if (!OnResponse(packet + kMySQLHeaderLen, length)) {
+        continue;
+      }
+      // Only ToServer() adds skips.
+      if (num_skips_.load() > 0) {
+        num_skips_--;
+      } else if (channel_->Write(pending.data(), parsed) < 0) {
+        channel_->Close();
+        return;
+      }
+      pending.erase(0, parsed);
+      parsed = 0;
+    }
+  }
+  channel_->Close();
+}
+
+bool ShmForwarder::OnResponse(const uint8_t *payload, size_t size) {
+  if (continued_) {
+    continued_ = size == kMySQLMaxPacketLen;
+    return !continued_ && end_after_continued_;
+  }
+  bool end = OnPacket(payload, size);
+  if (size == kMySQLMaxPacketLen) {
+    continued_ = true;
+    end_after_continued_ = end;
+    return false;
+  }
+  return end;
+}
+
+bool ShmForwarder::OnPacket(const uint8_t *payload, size_t size) {
+  uint8_t first = size > 0 ? payload[0] : 0;
+  switch (state_) {
+  case State::kHandshake:
+    if (first == kMySQLProtocolVersion && server_capabilities_ == 0) {
+      // The greeting: capabilities around the first part of the scramble.
+      auto version_end = static_cast<const uint8_t *>(memchr(payload + 1, 0, size - 1));
+      size_t offset = version_end != nullptr ? version_end - payload + 1 + 4 + 8 + 1 : size;
+      if (offset + 7 <= size) {
+        server_capabilities_ = mysql_get_byte2(payload + offset) |
+            static_cast<uint32_t>(mysql_get_byte2(payload + offset + 5)) << 16;
+      }
+    }
+    if (first == kMySQLReplyOk || first == kMySQLReplyErr) {
+      state_ = State::kIdle;
+    }
+    return true;
+
+  case State::kIdle: {
+    uint8_t command = COM_QUERY;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!commands_.empty()) {
+        command = commands_.front();
+      }
+    }
+    if (command == COM_CHANGE_USER) {
+      EndResult(0);
+      state_ = State::kHandshake;
+      return OnPacket(payload, size);
+    }
+    if (first == kMySQLReplyErr || command == COM_STATISTICS) {
+      return EndResult(0);
+    }
+    if (command == COM_STMT_FETCH || command == COM_FIELD_LIST) {
+      // No column count ahead of the rows.
+      state_ = State::kRows;
+      return OnPacket(payload, size);
+    }
+    if (command == COM_STMT_PREPARE && first == kMySQLReplyOk && size >= 9) {
+      uint16_t num_columns = mysql_get_byte2(payload + 5);
+      uint16_t num_params = mysql_get_byte2(payload + 7);
+      num_left_ = num_columns + num_params;
+      if (!DeprecateEof()) {
+        num_left_ += (num_columns > 0) + (num_params > 0);
+      }
+      if (num_left_ == 0) {
+        return EndResult(0);
+      }
+      state_ = State::kDefinitions;
+      return false;
+    }
+    if (first == kMySQLReplyOk) {
+      return EndResult(OkStatus(payload, size));
+    }
+    if (first == kMySQLReplyEof && size < 9) {
+      return EndResult(EofStatus(payload, size));
+    }
+    if (first == kMySQLReplyLocalInfile) {
+      // The server answers once more after the router sent the file.
+      return true;
+    }
+    num_left_ = 0;
+    SkipLengthEncodedInt(payload, size, 0, &num_left_);
+    if (num_left_ == 0) {
+      return EndResult(0);
+    }
+    state_ = State::kColumns;
+    return false;
+  }
+
+  case State::kColumns:
+    if (--num_left_ == 0) {
+      state_ = DeprecateEof() ? State::kRows : State::kColumnsEof;
+    }
+    return false;
+
+  case State::kColumnsEof:
+    state_ = State::kRows;
+    if (EofStatus(payload, size) & kServerCursorExists) {
+      // The rows come with COM_STMT_FETCH.
+      return EndResult(EofStatus(payload, size));
+    }
+    return false;
+
+  case State::kRows:
+    if (first == kMySQLReplyErr) {
+      return EndResult(0);
+    }
+    // A row starting with 0xfe is at least a full packet long.
+    if (first == kMySQLReplyEof && size < (DeprecateEof() ? kMySQLMaxPacketLen : 9)) {
+      return EndResult(DeprecateEof() ? OkStatus(payload, size) : EofStatus(payload, size));
+    }
+    return false;
+
+  case State::kDefinitions:
+    if (--num_left_ == 0) {
+      return EndResult(0);
+    }
+    return false;
+  }
+  return false;
+}
+
+bool ShmForwarder::EndResult(uint16_t status) {
+  state_ = State::kIdle;
+  if ((status & kServerMoreResultsExist) == 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!commands_.empty()) {
+      commands_.pop_front();
+    }
+  }
+  return true;
+}
+
+bool ShmForwarder::DeprecateEof() const {
+  return (client_capabilities_.load() & server_capabilities_ &
+          MYSQL_CAPABILITIES_DEPRECATE_EOF) != 0;
+}
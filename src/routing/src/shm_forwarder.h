@@ -0,0 +1,81 @@
+#ifndef ROUTING_SRC_SHM_FORWARDER_H_
+#define ROUTING_SRC_SHM_FORWARDER_H_
+
+#include "mysqlrouter/shm_channel.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <cstddef>
+#include <cstdint>
+
+// Forwards the channel of a router to a TCP connection to a MySQL server,
+// as the shim does for every channel it accepts.
+//
+// The router reads a response per record, the way a remote server sends
+// them over RDMA, so the byte stream of the server is cut into whole
+// responses: a packet each during authentication, and a result each
+// afterwards, every result of a multi-statement query being one of its
+// own. An empty record from the router sends nothing to the server and
+// drops the next result instead, like the skip markers of RDMA, so that
+// only the last answer of a query sent behind an undo gets back.
+//
+// TLS and compression between router and server are not understood.
+class ShmForwarder {
+public:
+  ShmForwarder(std::shared_ptr<ShmChannel> channel, int fd);
+
+  // Forwards both ways until either side closes, then closes the
+  // channel; fd stays open.
+  void Run();
+
+private:
+  enum class State {
+    kHandshake,  // A record per packet until OK or ERR.
+    kIdle,       // The next packet starts a result.
+    kColumns,
+    kColumnsEof,
+    kRows,
+    kDefinitions,  // Parameters and columns of a prepared statement.
+  };
+
+  void ToServer();
+  void ToRouter();
+
+  // Notes the capabilities and commands the router sends.
+  void ScanRequests(const char *data, size_t size);
+  void OnRequest(uint8_t seq, const uint8_t *prefix, size_t size);
+  // Take one complete packet of the server; true if it ends a record.
+  bool OnResponse(const uint8_t *payload, size_t size);
+  bool OnPacket(const uint8_t *payload, size_t size);
+  // Ends a result; the command is done unless more results follow.
+  bool EndResult(uint16_t status);
+  bool DeprecateEof() const;
+
+  std::shared_ptr<ShmChannel> channel_;
+  int fd_;
+  std::atomic<uint32_t> client_capabilities_;
+  uint32_t server_capabilities_;
+  // Results still to be dropped.
+  std::atomic<uint32_t> num_skips_;
+
+  // Commands sent whose responses are still to come, oldest first.
+  std::mutex mutex_;
+  std::deque<uint8_t> commands_;
+
+  // The header and first payload bytes of the request packet being sent.
+  size_t num_requests_;
+  uint8_t request_[8];
+  size_t request_size_;
+  size_t request_left_;
+
+  State state_;
+  uint64_t num_left_;
+  // Within a packet that goes on in the next one, whose end decides.
+  bool continued_;
+  bool end_after_continued_;
+};
+
+#endif // ROUTING_SRC_SHM_FORWARDER_H_
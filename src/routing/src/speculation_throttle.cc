@@ -0,0 +1,159 @@
+#include "speculation_throttle.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+// Estimates are running means over their first samples, then follow the
+// recent ones.
+const double kMinWeight = 1.0 / 32;
+
+} // namespace
+
+SpeculationThrottle::SpeculationThrottle(const Options &options) :
+    options_(options), observed_template_(0), latency_us_(-1), latency_samples_(0),
+    undo_us_(0), undo_samples_(0), write_wait_us_(0), write_wait_samples_(0),
+    pending_wait_us_(0), num_sent_(0), num_throttled_(0) {}
+
+void SpeculationThrottle::Update(double *mean, size_t *samples, double sample) {
+  (*samples)++;
+  double weight = std::max(1.0 / static_cast<double>(*samples), kMinWeight);
+  *mean += weight * (sample - *mean);
+}
+
+uint64_t SpeculationThrottle::TemplateOf(const std::string &query) {
+  arguments_.clear();
+  templatizer_.Templatize(query, &arguments_);
+  return templatizer_.hash();
+}
+
+void SpeculationThrottle::Observe(const std::string &query, uint64_t fingerprint) {
+  if (!Enabled()) {
+    return;
+  }
+  pending_wait_us_ = 0;
+  for (auto it = predictions_.begin(); it != predictions_.end(); ++it) {
+    if (it->fingerprint == fingerprint && it->query == query) {
+      auto &estimate = estimates_[it->template_hash];
+      Update(&estimate.hit_rate, &estimate.predictions, 1);
+      observed_template_ = it->template_hash;
+      predictions_.erase(it);
+      return;
+    }
+  }
+  observed_template_ = TemplateOf(query);
+}
+
+void SpeculationThrottle::Predict(const std::vector<std::string> &speculations,
+                                  const std::vector<uint64_t> &fingerprints) {
+  if (!Enabled()) {
+    return;
+  }
+  std::vector<Prediction> predictions;
+  predicted_.clear();
+  for (size_t i = 0; i < speculations.size(); i++) {
+    auto it = std::find_if(predictions_.begin(), predictions_.end(),
+                           [&](const Prediction &prediction) {
+      return prediction.fingerprint == fingerprints[i] && prediction.query == speculations[i];
+    });
+    if (it != predictions_.end()) {
+      predictions.push_back(std::move(*it));
+      predictions_.erase(it);
+    } else {
+      predictions.push_back(Prediction{fingerprints[i], TemplateOf(speculations[i]),
+                                       speculations[i]});
+    }
+    predicted_.push_back(predictions.back().template_hash);
+  }
+  for (auto &prediction : predictions_) {
+    auto &estimate = estimates_[prediction.template_hash];
+    Update(&estimate.hit_rate, &estimate.predictions, 0);
+  }
+  predictions_ = std::move(predictions);
+}
+
+bool SpeculationThrottle::IsWorthwhile(const Estimate &estimate, bool is_write) const {
+  double p = estimate.hit_rate;
+  if (p < options_.min_confidence) {
+    return false;
+  }
+  double latency = estimate.latency_samples > 0 ? estimate.latency_us : latency_us_;
+  if (latency < 0) {
+    return true;
+  }
+  double cost = options_.waste_cost * latency;
+  double fixed_cost = 0;
+  if (is_write) {
+    cost += undo_us_;
+    fixed_cost = write_wait_us_;
+  }
+  return p * latency > (1 - p) * cost + fixed_cost;
+}
+
+bool SpeculationThrottle::Admit(size_t index, bool is_write) {
+  if (!Enabled()) {
+    return true;
+  }
+  auto &estimate = estimates_[predicted_[index]];
+  if (!IsWorthwhile(estimate, is_write)) {
+    estimate.throttled++;
+    num_throttled_++;
+    return false;
+  }
+  estimate.sent++;
+  num_sent_++;
+  return true;
+}
+
+bool SpeculationThrottle::Worthwhile(const std::string &speculation, bool is_write) {
+  if (!Enabled()) {
+    return true;
+  }
+  auto it = estimates_.find(TemplateOf(speculation));
+  return it == estimates_.end() || IsWorthwhile(it->second, is_write);
+}
+
+void SpeculationThrottle::OnMiss(long latency_us, bool with_undo) {
+  if (!Enabled()) {
+    return;
+  }
+  auto &estimate = estimates_[observed_template_];
+  double latency = static_cast<double>(latency_us);
+  if (with_undo) {
+    // What the undo added on top of the query.
+    if (estimate.latency_samples > 0) {
+      Update(&undo_us_, &undo_samples_, std::max(latency - estimate.latency_us, 0.0));
+    }
+    return;
+  }
+  Update(&estimate.latency_us, &estimate.latency_samples, latency);
+  Update(&latency_us_, &latency_samples_, latency);
+}
+
+void SpeculationThrottle::OnWait(long wait_us) {
+  pending_wait_us_ += wait_us;
+}
+
+void SpeculationThrottle::OnWriteSent(long wait_us) {
+  if (Enabled()) {
+    Update(&write_wait_us_, &write_wait_samples_,
+           static_cast<double>(pending_wait_us_ + wait_us));
+  }
+  pending_wait_us_ = 0;
+}
+
+void SpeculationThrottle::Dump(const std::string &filename) const {
+  if (!Enabled()) {
+    return;
+  }
+  std::ofstream outfile(filename);
+  for (auto &entry : estimates_) {
+    auto &estimate = entry.second;
+    outfile << entry.first << ' ' << estimate.hit_rate << ' ' << estimate.latency_us << ' '
+            << estimate.predictions << ' ' << estimate.sent << ' ' << estimate.throttled
+            << std::endl;
+  }
+  outfile << "undo " << undo_us_ << std::endl;
+  outfile << "write_wait " << write_wait_us_ << std::endl;
+}
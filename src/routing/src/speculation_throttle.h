@@ -0,0 +1,124 @@
+#ifndef ROUTING_SRC_SPECULATION_THROTTLE_H_
+#define ROUTING_SRC_SPECULATION_THROTTLE_H_
+
+#include "speculator/speculation_model/sql_templatizer.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Decides which speculations of a session are worth sending.
+//
+// Every speculation the speculator proposes is tracked, sent or not, so
+// that the hit rate of its template is still learned while the template
+// is throttled: a prediction hits if the client sends the same query
+// while it is still predicted. Per template, p is the estimated hit rate
+// and L the latency a hit saves, that of the query run on demand. A miss
+// wastes backend work, counted as waste_cost * L, and a write also costs
+// the wait for every server and its undo, both measured. A speculation
+// is sent if p >= min_confidence and
+//
+//   p * L > (1 - p) * (waste_cost * L + undo) + write_wait  (writes)
+//   p * L > (1 - p) * waste_cost * L                         (reads)
+//
+// Until a template has been run on demand, the mean over all templates
+// stands in for its L, and until then nothing is throttled.
+class SpeculationThrottle {
+public:
+  struct Options {
+    // Share of a wasted speculation's backend time counted against it.
+    double waste_cost = 0;
+    // Hit rate below which a template is never speculated.
+    double min_confidence = 0;
+  };
+
+  struct Estimate {
+    double hit_rate = 1;
+    // -1 until the template has been run on demand.
+    double latency_us = -1;
+    size_t latency_samples = 0;
+    size_t predictions = 0;
+    size_t sent = 0;
+    size_t throttled = 0;
+  };
+
+  explicit SpeculationThrottle(const Options &options);
+
+  // With neither cost nor confidence, every speculation is sent.
+  bool Enabled() const {
+    return options_.waste_cost > 0 || options_.min_confidence > 0;
+  }
+  // Scores the predictions against the query the client sent.
+  void Observe(const std::string &query, uint64_t fingerprint);
+  // The speculations that follow the query; predictions that are not
+  // among them any more were wrong.
+  void Predict(const std::vector<std::string> &speculations,
+               const std::vector<uint64_t> &fingerprints);
+  // Whether the index-th speculation passed to Predict() is worth sending.
+  bool Admit(size_t index, bool is_write);
+  // Whether a speculation would be admitted, without counting it.
+  bool Worthwhile(const std::string &speculation, bool is_write);
+  // The query last observed was sent on demand and took latency_us, with
+  // an undo ahead of it if with_undo.
+  void OnMiss(long latency_us, bool with_undo);
+  // Time spent waiting before speculating, for callers that wait for the
+  // servers before they call DoSpeculation().
+  void OnWait(long wait_us);
+  // A write speculation was sent, wait_us after speculating started; with
+  // the time passed to OnWait() since the last query, that is the write
+  // wait.
+  void OnWriteSent(long wait_us);
+
+  const std::unordered_map<uint64_t, Estimate> &estimates() const {
+    return estimates_;
+  }
+  double undo_us() const {
+    return undo_us_;
+  }
+  double write_wait_us() const {
+    return write_wait_us_;
+  }
+  size_t num_sent() const {
+    return num_sent_;
+  }
+  size_t num_throttled() const {
+    return num_throttled_;
+  }
+  // One line per template: hash, hit rate, latency, predictions, sent,
+  // throttled; then the undo and write wait estimates.
+  void Dump(const std::string &filename) const;
+
+private:
+  struct Prediction {
+    uint64_t fingerprint;
+    uint64_t template_hash;
+    std::string query;
+  };
+
+  uint64_t TemplateOf(const std::string &query);
+  bool IsWorthwhile(const Estimate &estimate, bool is_write) const;
+  static void Update(double *mean, size_t *samples, double sample);
+
+  Options options_;
+  model::SqlTemplatizer templatizer_;
+  std::vector<model::SqlValue> arguments_;
+  std::unordered_map<uint64_t, Estimate> estimates_;
+  std::vector<Prediction> predictions_;
+  // Templates of the predictions, in the order of Predict().
+  std::vector<uint64_t> predicted_;
+  uint64_t observed_template_;
+  double latency_us_;
+  size_t latency_samples_;
+  double undo_us_;
+  size_t undo_samples_;
+  double write_wait_us_;
+  size_t write_wait_samples_;
+  long pending_wait_us_;
+  size_t num_sent_;
+  size_t num_throttled_;
+};
+
+#endif // ROUTING_SRC_SPECULATION_THROTTLE_H_
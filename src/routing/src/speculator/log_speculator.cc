@@ -1,43 +1,65 @@
 #include "log_speculator.h"
 #include "logger.h"
 
-#include <fstream>
+#include <mutex>
 #include <unordered_map>
 
 #include <cassert>
+#include <strings.h>
 
-LogSpeculator::LogSpeculator(Undoer &&undoer, const std::string &filename) :
-    undoer_(undoer), start_(false), current_query_(0), previous_write_(-1),
-    has_speculation_(false), rand_gen_(rd_()), dist_(1, 100), rand_index_(rd_()) {
-  std::ifstream sql_file(filename);
-  if (sql_file.fail()) {
-    return;
-  }
-  std::string line;
-  while (!sql_file.eof()) {
-    std::getline(sql_file, line);
-    queries_.push_back(line);
+static const char *kSavepoint = "SAVEPOINT speculative_write";
+static const char *kRollbackToSavepoint = "ROLLBACK TO SAVEPOINT speculative_write";
+
+// Seeds for the per-session generators; a random_device per session
+// would open /dev/urandom on every connection.
+static unsigned int NextSeed() {
+  static std::random_device rd;
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  return rd();
+}
+
+LogSpeculator::LogSpeculator(Undoer &&undoer, std::shared_ptr<const TraceStore> trace,
+                             bool use_savepoints) :
+    trace_(std::move(trace)), undoer_(undoer), use_savepoints_(use_savepoints),
+    in_transaction_(false), start_(false), current_query_(0),
+    previous_write_(-1), has_speculation_(false), rand_gen_(NextSeed()), dist_(1, 100),
+    rand_index_(NextSeed()) {
+  if (trace_ && trace_->Size() > 0) {
+    index_dist_ = std::uniform_int_distribution<int>(0, static_cast<int>(trace_->Size() - 1));
   }
-  index_dist_ = std::uniform_int_distribution<int>(0, static_cast<int>(queries_.size() - 1));
 }
 
 void LogSpeculator::BackupFor(const std::string &query) {
-  next_undo_ = undoer_.GetUndoQuery(query);
+  // A savepoint outside a transaction would be gone with the autocommit.
+  if (use_savepoints_ && in_transaction_) {
+    undoer_.Clear();
+    next_savepoint_ = kSavepoint;
+    return;
+  }
+  undoer_.Capture(query);
+  next_savepoint_.clear();
 }
 
 std::string LogSpeculator::GetUndo() {
-  return next_undo_;
-  // if (previous_write_ == -1) {
-  //   return "";
-  // }
-  // auto &speculation = queries_[previous_write_];
-  // return undoer_.GetUndoQuery(speculation);
+  if (next_savepoint_.size() > 0) {
+    return kRollbackToSavepoint;
+  }
+  return undoer_.GetUndoQuery();
 }
 
 void LogSpeculator::CheckBegin(const std::string &query) {
+  undoer_.Observe(query);
   if (!start_ && query == "BEGIN") {
     start_ = true;
   }
+  if (strcasecmp(query.c_str(), "BEGIN") == 0 ||
+      strncasecmp(query.c_str(), "START TRANSACTION", 17) == 0) {
+    in_transaction_ = true;
+  } else if (strcasecmp(query.c_str(), "COMMIT") == 0 ||
+             strcasecmp(query.c_str(), "ROLLBACK") == 0) {
+    in_transaction_ = false;
+  }
 }
 
 std::vector<std::string> LogSpeculator::Speculate(const std::string &query, int num_speculations) {
@@ -52,7 +74,8 @@ std::vector<std::string> LogSpeculator::TrySpeculate(const std::string &query, i
     return speculations_;
   }
   // return speculations_;
-  if (!start_ || current_query_ == -1) {
+  if (!start_ || current_query_ == -1 || !trace_ ||
+      static_cast<size_t>(current_query_) + 1 >= trace_->Size()) {
     return speculations_;
   }
   if (indices_.size() > 0 &&
@@ -63,28 +86,36 @@ std::vector<std::string> LogSpeculator::TrySpeculate(const std::string &query, i
   has_speculation_ = true;
   speculations_.clear();
   indices_.clear();
-  int rand_num = dist_(rand_gen_);
-  auto &next_query = queries_[current_query_ + 1];
-  if (next_query == "BEGIN" || rand_num <= 58) {
-    if (next_query.find("BEGIN") == std::string::npos &&
-        next_query.find("COMMIT") == std::string::npos) {
+  // The i-th speculation stands for the i-th query after the current
+  // one: the right query 58% of the time, a random one otherwise.
+  for (int i = 1; i <= num_speculations; i++) {
+    size_t next_index = static_cast<size_t>(current_query_ + i);
+    if (next_index >= trace_->Size()) {
+      break;
+    }
+    int rand_num = dist_(rand_gen_);
+    std::string next_query(trace_->Query(next_index));
+    if (next_query == "BEGIN" || rand_num <= 58) {
+      if (next_query.find("BEGIN") != std::string::npos ||
+          next_query.find("COMMIT") != std::string::npos) {
+        log_debug("Cannot predict BEGIN or COMMIT");
+        break;
+      }
       log_debug("Will make prediction hit with %s", next_query.c_str());
       speculations_.push_back(next_query);
-      indices_.push_back(current_query_ + 1);
-    } else {
-      log_debug("Cannot predict BEGIN or COMMIT");
-    }
-    num_speculations--;
-  }
-  while (num_speculations > 0) {
-    auto index = index_dist_(rand_index_);
-    auto speculation = queries_[index];
-    if (speculation == "BEGIN" || speculation == "COMMIT" || speculation.find("DELETE") == 0) {
+      indices_.push_back(static_cast<int>(next_index));
       continue;
     }
-    speculations_.push_back(speculation);
-    indices_.push_back(index);
-    num_speculations--;
+    while (true) {
+      auto index = index_dist_(rand_index_);
+      std::string speculation(trace_->Query(index));
+      if (speculation == "BEGIN" || speculation == "COMMIT" || speculation.find("DELETE") == 0) {
+        continue;
+      }
+      speculations_.push_back(speculation);
+      indices_.push_back(index);
+      break;
+    }
   }
 
   return speculations_;
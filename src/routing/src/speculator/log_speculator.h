@@ -2,15 +2,22 @@
 #define SPECULATOR_LOG_SPECULATOR_H_
 
 #include "speculator.h"
+#include "trace_store.h"
 #include "undoer.h"
 
+#include <memory>
 #include <random>
 #include <unordered_map>
 #include <vector>
 
+// A per-session cursor over a shared TraceStore.
 class LogSpeculator : public Speculator {
 public:
-  LogSpeculator(Undoer &&undoer, const std::string &filename);
+  // With use_savepoints, write speculations inside a transaction are
+  // reverted with ROLLBACK TO SAVEPOINT instead of the Undoer's inverse
+  // statement.
+  LogSpeculator(Undoer &&undoer, std::shared_ptr<const TraceStore> trace,
+                bool use_savepoints=false);
   virtual void CheckBegin(const std::string &query) override;
   virtual void SkipQuery() override {
     if (start_) {
@@ -25,26 +32,33 @@ public:
   }
   virtual void BackupFor(const std::string &query) override;
   virtual std::string GetUndo() override;
+  virtual std::string GetSavepoint() override {
+    return next_savepoint_;
+  }
   virtual std::vector<std::string> Speculate(const std::string &query) override {
     return Speculate(query, 1);
   }
   virtual std::vector<std::string> Speculate(const std::string &query, int num_speculations=1) override;
   virtual std::vector<std::string> TrySpeculate(const std::string &query, int num_speculations) override;
+  virtual void Prepare() override {
+    undoer_.Prepare();
+  }
 
 private:
-  std::vector<std::string> queries_;
+  std::shared_ptr<const TraceStore> trace_;
   Undoer undoer_;
-  std::string next_undo_;
+  std::string next_savepoint_;
+  bool use_savepoints_;
+  bool in_transaction_;
   bool start_;
   int current_query_;
   int previous_write_;
   bool has_speculation_;
   std::vector<int> indices_;
   std::vector<std::string> speculations_;
-  std::random_device rd_;
-  std::mt19937 rand_gen_;
+  std::minstd_rand rand_gen_;
   std::uniform_int_distribution<int> dist_;
-  std::mt19937 rand_index_;
+  std::minstd_rand rand_index_;
   std::uniform_int_distribution<int> index_dist_;
 
   int ExtractKeyValue(const std::string &query);
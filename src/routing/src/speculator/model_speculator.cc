@@ -0,0 +1,179 @@
+#include "model_speculator.h"
+#include "result_set.h"
+
+#include <algorithm>
+
+#include <cctype>
+#include <strings.h>
+
+static const char *kSavepoint = "SAVEPOINT speculative_write";
+static const char *kRollbackToSavepoint = "ROLLBACK TO SAVEPOINT speculative_write";
+
+namespace {
+
+// A number as SqlTemplatizer takes it from a query: digits with an
+// optional fraction.
+bool IsNumber(const std::string &value) {
+  size_t i = 0;
+  while (i < value.size() && isdigit(static_cast<unsigned char>(value[i]))) {
+    i++;
+  }
+  if (i == 0) {
+    return false;
+  }
+  if (i < value.size() && value[i] == '.') {
+    size_t fraction = ++i;
+    while (i < value.size() && isdigit(static_cast<unsigned char>(value[i]))) {
+      i++;
+    }
+    if (i == fraction) {
+      return false;
+    }
+  }
+  return i == value.size();
+}
+
+// Typed as the arguments of a query, so that the model can compare them.
+model::SqlValue ToSqlValue(const std::optional<std::string> &column) {
+  if (!column) {
+    return model::SqlValue(model::Null());
+  }
+  if (IsNumber(*column)) {
+    return model::SqlValue(model::Double(strtod(column->c_str(), nullptr)));
+  }
+  return model::SqlValue(*column);
+}
+
+bool IsTransactionBoundary(const std::string &query) {
+  return strncasecmp(query.c_str(), "BEGIN", 5) == 0 ||
+         strncasecmp(query.c_str(), "START TRANSACTION", 17) == 0 ||
+         strncasecmp(query.c_str(), "COMMIT", 6) == 0 ||
+         strncasecmp(query.c_str(), "ROLLBACK", 8) == 0;
+}
+
+} // namespace
+
+ModelSpeculator::ModelSpeculator(Undoer &&undoer, std::shared_ptr<const model::GraphModel> model,
+                                 bool use_savepoints) :
+    model_(std::move(model)), predictor_(model_->CreatePredictor()), undoer_(undoer),
+    use_savepoints_(use_savepoints), in_transaction_(false), current_query_(0),
+    has_speculation_(false), depth_(1), step_hit_rates_(kMaxLookahead, 0),
+    step_samples_(kMaxLookahead, 0) {}
+
+void ModelSpeculator::BackupFor(const std::string &query) {
+  // A savepoint outside a transaction would be gone with the autocommit.
+  if (use_savepoints_ && in_transaction_) {
+    undoer_.Clear();
+    next_savepoint_ = kSavepoint;
+    return;
+  }
+  undoer_.Capture(query);
+  next_savepoint_.clear();
+}
+
+std::string ModelSpeculator::GetUndo() {
+  if (next_savepoint_.size() > 0) {
+    return kRollbackToSavepoint;
+  }
+  return undoer_.GetUndoQuery();
+}
+
+void ModelSpeculator::CheckBegin(const std::string &query) {
+  undoer_.Observe(query);
+  if (strcasecmp(query.c_str(), "BEGIN") == 0 ||
+      strncasecmp(query.c_str(), "START TRANSACTION", 17) == 0) {
+    in_transaction_ = true;
+  } else if (strcasecmp(query.c_str(), "COMMIT") == 0 ||
+             strcasecmp(query.c_str(), "ROLLBACK") == 0) {
+    in_transaction_ = false;
+  }
+  std::vector<model::SqlValue> arguments;
+  templatizer_.Templatize(query, &arguments);
+  int query_id = model_->manager().FindIdForTemplate(templatizer_.sql_template(),
+                                                     templatizer_.hash());
+  model::Query observed(query_id, std::move(arguments), {});
+  Score(observed);
+  predictor_->MoveToNext(std::move(observed));
+  has_speculation_ = false;
+}
+
+void ModelSpeculator::Score(const model::Query &query) {
+  if (!chain_.empty()) {
+    pending_.push_back(PendingChain{std::move(chain_), 0});
+    chain_.clear();
+  }
+  for (auto &pending : pending_) {
+    auto step = pending.observed++;
+    auto &samples = step_samples_[step];
+    samples++;
+    double weight = std::max(1.0 / static_cast<double>(samples), 1.0 / 32);
+    double hit = pending.queries[step] == query ? 1 : 0;
+    step_hit_rates_[step] += weight * (hit - step_hit_rates_[step]);
+  }
+  pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                [](const PendingChain &pending) {
+                                  return pending.observed == pending.queries.size();
+                                }),
+                 pending_.end());
+  depth_ = 1;
+  while (depth_ < kMaxLookahead && step_samples_[depth_] > 0 &&
+         step_hit_rates_[depth_] >= kMinStepHitRate) {
+    depth_++;
+  }
+}
+
+void ModelSpeculator::OnResult(const uint8_t *result, size_t size) {
+  std::vector<ResultRow> rows;
+  if (!ParseResultSet(result, size, &rows)) {
+    return;
+  }
+  if (rows.size() > kMaxResultRows) {
+    rows.resize(kMaxResultRows);
+  }
+  std::vector<std::vector<model::SqlValue>> result_set;
+  for (auto &row : rows) {
+    std::vector<model::SqlValue> values;
+    for (auto &column : row) {
+      values.push_back(ToSqlValue(column));
+    }
+    result_set.push_back(std::move(values));
+  }
+  predictor_->SetResult(std::move(result_set));
+  // Asked for again once the result is in, so that predictions from it
+  // can be made.
+  has_speculation_ = false;
+}
+
+std::vector<std::string> ModelSpeculator::Speculate(const std::string &query,
+                                                    int num_speculations) {
+  auto speculations = TrySpeculate(query, num_speculations);
+  current_query_++;
+  has_speculation_ = false;
+  return speculations;
+}
+
+std::vector<std::string> ModelSpeculator::TrySpeculate(const std::string & /* query */,
+                                                       int num_speculations) {
+  if (has_speculation_) {
+    return speculations_;
+  }
+  has_speculation_ = true;
+  speculations_.clear();
+  if (num_speculations < 1) {
+    return speculations_;
+  }
+  auto num_sent = std::min(depth_, static_cast<size_t>(num_speculations));
+  chain_ = predictor_->PredictNextQueries(std::min(depth_ + 1, kMaxLookahead));
+  for (size_t i = 0; i < chain_.size(); i++) {
+    auto sql = chain_[i].ToSql(model_->manager());
+    // As with the trace, transactions are left to the client.
+    if (IsTransactionBoundary(sql)) {
+      chain_.resize(i);
+      break;
+    }
+    if (speculations_.size() < num_sent) {
+      speculations_.push_back(std::move(sql));
+    }
+  }
+  return speculations_;
+}
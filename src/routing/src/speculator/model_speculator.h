@@ -1,23 +1,96 @@
-#ifndef SRC_SPECULATOR_H_
-#define SRC_SPECULATOR_H_
+#ifndef SPECULATOR_MODEL_SPECULATOR_H_
+#define SPECULATOR_MODEL_SPECULATOR_H_
 
 #include "speculator.h"
 #include "speculation_model/graph_model.h"
+#include "speculation_model/sql_templatizer.h"
+#include "undoer.h"
 
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Predicts the next query of a session from a GraphModel shared by all
+// sessions, with the arguments the model derives from the queries and
+// results seen so far. A prediction that needs a result that has not
+// come in yet, as when a read is speculated on before it is answered,
+// is not made.
+//
+// The model is walked several queries ahead, as long as the arguments of
+// the next query are known. How far is learned per session: each chain
+// is scored position by position against the queries that follow, and
+// one more step is speculated on while the hit rate of that step stays
+// at kMinStepHitRate or above. One step beyond is always predicted, and
+// scored, but not sent.
 class ModelSpeculator : public Speculator {
 public:
+  // Results beyond this many rows are not kept for predictions.
+  static const size_t kMaxResultRows = 128;
+  static constexpr size_t kMaxLookahead = 4;
+  static constexpr double kMinStepHitRate = 0.5;
+
+  ModelSpeculator(Undoer &&undoer, std::shared_ptr<const model::GraphModel> model,
+                  bool use_savepoints=false);
   virtual void CheckBegin(const std::string &query) override;
-  virtual void SkipQuery() override;
-  virtual int GetQueryIndex() override;
-  virtual void SetQueryIndex(int query_index) override;
+  virtual void SkipQuery() override {
+    current_query_++;
+  }
+  virtual int GetQueryIndex() override {
+    return current_query_;
+  }
+  virtual void SetQueryIndex(int query_index) override {
+    current_query_ = query_index;
+  }
   virtual void BackupFor(const std::string &query) override;
   virtual std::string GetUndo() override;
-  virtual std::vector<std::string> Speculate(const std::string &query) override;
+  virtual std::string GetSavepoint() override {
+    return next_savepoint_;
+  }
+  virtual std::vector<std::string> Speculate(const std::string &query) override {
+    return Speculate(query, 1);
+  }
   virtual std::vector<std::string> Speculate(const std::string &query, int num_speculations) override;
   virtual std::vector<std::string> TrySpeculate(const std::string &query, int num_speculations) override;
+  virtual void OnResult(const uint8_t *result, size_t size) override;
+  virtual void Prepare() override {
+    undoer_.Prepare();
+  }
+
+  size_t depth() const {
+    return depth_;
+  }
+  // The measured hit rate of the step-th query of the chains, from 0.
+  double StepHitRate(size_t step) const {
+    return step_hit_rates_[step];
+  }
 
 private:
+  struct PendingChain {
+    std::vector<model::Query> queries;
+    size_t observed;
+  };
+
+  // Scores the chains in flight against the query the client sent.
+  void Score(const model::Query &query);
+
+  std::shared_ptr<const model::GraphModel> model_;
+  std::unique_ptr<model::Predictor> predictor_;
+  model::SqlTemplatizer templatizer_;
+  Undoer undoer_;
+  std::string next_savepoint_;
+  bool use_savepoints_;
+  bool in_transaction_;
+  int current_query_;
+  bool has_speculation_;
+  std::vector<std::string> speculations_;
 
+  size_t depth_;
+  std::vector<double> step_hit_rates_;
+  std::vector<size_t> step_samples_;
+  // Predicted after the last query, sent or not.
+  std::vector<model::Query> chain_;
+  std::deque<PendingChain> pending_;
 };
 
-#endif // SRC_SPECULATOR_H_
\ No newline at end of file
+#endif // SPECULATOR_MODEL_SPECULATOR_H_
@@ -0,0 +1,124 @@
+#include "result_set.h"
+#include "mysqlrouter/mysql_constant.h"
+
+namespace {
+
+struct Packet {
+  const uint8_t *payload;
+  size_t size;
+};
+
+bool ReadPacket(const uint8_t *&data, const uint8_t *end, Packet &packet) {
+  if (end - data < kMySQLHeaderLen) {
+    return false;
+  }
+  packet.size = mysql_get_byte3(data);
+  packet.payload = data + kMySQLHeaderLen;
+  if (static_cast<size_t>(end - packet.payload) < packet.size) {
+    return false;
+  }
+  data = packet.payload + packet.size;
+  return true;
+}
+
+bool IsEof(const Packet &packet) {
+  return packet.size > 0 && packet.size < 9 && packet.payload[0] == 0xfe;
+}
+
+// Returns false on 0xfb (NULL) or a truncated integer.
+bool ReadLengthEncodedInt(const uint8_t *&cur, const uint8_t *end, uint64_t &num) {
+  if (cur >= end || *cur == 0xfb) {
+    return false;
+  }
+  uint8_t first_byte = *cur++;
+  int size_size = 0;
+  if (first_byte < 0xfb) {
+    num = first_byte;
+    return true;
+  } else if (first_byte == 0xfc) {
+    size_size = 2;
+  } else if (first_byte == 0xfd) {
+    size_size = 3;
+  } else {
+    size_size = 8;
+  }
+  if (end - cur < size_size) {
+    return false;
+  }
+  num = 0;
+  for (int i = size_size - 1; i >= 0; i--) {
+    num = (num << 8) | cur[i];
+  }
+  cur += size_size;
+  return true;
+}
+
+} // namespace
+
+bool ParseResultSet(const uint8_t *data, size_t size, std::vector<ResultRow> *rows) {
+  const uint8_t *end = data + size;
+  Packet packet;
+  if (!ReadPacket(data, end, packet) || packet.size == 0 ||
+      packet.payload[0] == 0x00 || packet.payload[0] == 0xff) {
+    return false;
+  }
+  const uint8_t *cur = packet.payload;
+  uint64_t field_count;
+  if (!ReadLengthEncodedInt(cur, packet.payload + packet.size, field_count)) {
+    return false;
+  }
+  // The column definitions do not matter to us.
+  for (uint64_t i = 0; i < field_count; i++) {
+    if (!ReadPacket(data, end, packet)) {
+      return false;
+    }
+  }
+  if (!ReadPacket(data, end, packet)) {
+    return false;
+  }
+  // Without CLIENT_DEPRECATE_EOF the definitions end with an EOF too.
+  if (IsEof(packet) && data < end && !ReadPacket(data, end, packet)) {
+    return false;
+  }
+  while (!IsEof(packet)) {
+    if (packet.payload[0] == 0xff) {
+      return false;
+    }
+    ResultRow row;
+    cur = packet.payload;
+    const uint8_t *row_end = packet.payload + packet.size;
+    for (uint64_t i = 0; i < field_count; i++) {
+      if (cur < row_end && *cur == 0xfb) {
+        row.emplace_back();
+        cur++;
+        continue;
+      }
+      uint64_t length;
+      if (!ReadLengthEncodedInt(cur, row_end, length) ||
+          static_cast<uint64_t>(row_end - cur) < length) {
+        return false;
+      }
+      row.emplace_back(std::string(reinterpret_cast<const char *>(cur), length));
+      cur += length;
+    }
+    rows->push_back(std::move(row));
+    if (!ReadPacket(data, end, packet)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string SqlLiteral(const std::optional<std::string> &value) {
+  if (!value) {
+    return "NULL";
+  }
+  std::string literal = "'";
+  for (char c : *value) {
+    if (c == '\'' || c == '\\') {
+      literal += '\\';
+    }
+    literal += c;
+  }
+  return literal + "'";
+}
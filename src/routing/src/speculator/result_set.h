@@ -0,0 +1,21 @@
+#ifndef SPECULATOR_RESULT_SET_H_
+#define SPECULATOR_RESULT_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// A row of a text protocol result set; NULL columns are std::nullopt.
+using ResultRow = std::vector<std::optional<std::string>>;
+
+// Reads the rows of a text protocol result set held in one buffer, as a
+// ServerGroup result slot holds it. Returns false for an OK or error
+// packet, or a truncated result.
+bool ParseResultSet(const uint8_t *data, size_t size, std::vector<ResultRow> *rows);
+
+// value quoted as an SQL string literal, or NULL.
+std::string SqlLiteral(const std::optional<std::string> &value);
+
+#endif // SPECULATOR_RESULT_SET_H_
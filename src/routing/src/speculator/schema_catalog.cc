@@ -0,0 +1,126 @@
+#include "schema_catalog.h"
+#include "../server_group.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cctype>
+
+const char *SchemaCatalog::kQuery =
+    "SELECT TABLE_SCHEMA, TABLE_NAME, INDEX_NAME, COLUMN_NAME, NULLABLE "
+    "FROM information_schema.STATISTICS WHERE NON_UNIQUE = 0 AND TABLE_SCHEMA NOT IN "
+    "('mysql', 'information_schema', 'performance_schema', 'sys') "
+    "ORDER BY TABLE_SCHEMA, TABLE_NAME, INDEX_NAME <> 'PRIMARY', INDEX_NAME, SEQ_IN_INDEX";
+
+namespace {
+
+std::string Lower(std::string_view name) {
+  std::string lower(name);
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  return lower;
+}
+
+int CompareNoCase(std::string_view a, std::string_view b) {
+  size_t length = std::min(a.size(), b.size());
+  for (size_t i = 0; i < length; i++) {
+    int diff = tolower(static_cast<unsigned char>(a[i])) - tolower(static_cast<unsigned char>(b[i]));
+    if (diff != 0) {
+      return diff;
+    }
+  }
+  return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+} // namespace
+
+SchemaCatalog::SchemaCatalog() : stale_(true) {}
+
+std::shared_ptr<const std::vector<std::string>> SchemaCatalog::KeyColumns(
+    std::string_view schema, std::string_view table) const {
+  auto snapshot = std::atomic_load(&snapshot_);
+  if (snapshot == nullptr) {
+    return nullptr;
+  }
+  auto iter = std::lower_bound(snapshot->begin(), snapshot->end(), 0,
+                               [schema, table](const Table &entry, int) {
+    int order = CompareNoCase(entry.schema, schema);
+    return order < 0 || (order == 0 && CompareNoCase(entry.table, table) < 0);
+  });
+  if (iter == snapshot->end() || CompareNoCase(iter->schema, schema) != 0 ||
+      CompareNoCase(iter->table, table) != 0) {
+    return nullptr;
+  }
+  // Shares ownership of the snapshot.
+  return std::shared_ptr<const std::vector<std::string>>(snapshot, &iter->keys);
+}
+
+size_t SchemaCatalog::NumTables() const {
+  auto snapshot = std::atomic_load(&snapshot_);
+  return snapshot == nullptr ? 0 : snapshot->size();
+}
+
+void SchemaCatalog::Refresh(ServerGroup *server_group) {
+  if (!stale_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+  if (!lock.owns_lock() || !stale_.load(std::memory_order_acquire)) {
+    return;
+  }
+  // Not retried on failure: undos fall back to matching every column.
+  stale_.store(false, std::memory_order_release);
+  int server = server_group->GetAvailableServer();
+  if (server < 0 || !server_group->SendQuery(server, kQuery, 1, true)) {
+    log_error("Failed to query the schema catalog");
+    return;
+  }
+  uint64_t request = server_group->LastRequest(server);
+  server_group->WaitForResult(server, request);
+  auto result = server_group->GetResult(server, request);
+  std::vector<ResultRow> rows;
+  if (result.first == nullptr || !ParseResultSet(result.first, result.second, &rows)) {
+    log_error("Failed to read the schema catalog");
+    return;
+  }
+  Publish(rows);
+}
+
+void SchemaCatalog::Load(const std::vector<ResultRow> &rows) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stale_.store(false, std::memory_order_release);
+  Publish(rows);
+}
+
+void SchemaCatalog::Publish(const std::vector<ResultRow> &rows) {
+  std::shared_ptr<Snapshot> snapshot(new Snapshot());
+  // The rows come grouped by table and index, PRIMARY first; the first
+  // index without nullable columns wins.
+  size_t i = 0;
+  while (i < rows.size()) {
+    auto &first = rows[i];
+    if (first.size() < 5 || !first[0] || !first[1] || !first[2]) {
+      i++;
+      continue;
+    }
+    bool have_key = !snapshot->empty() && snapshot->back().schema == Lower(*first[0]) &&
+                    snapshot->back().table == Lower(*first[1]);
+    std::vector<std::string> keys;
+    bool usable = true;
+    size_t j = i;
+    for (; j < rows.size() && rows[j].size() >= 5 && rows[j][0] == first[0] &&
+           rows[j][1] == first[1] && rows[j][2] == first[2]; j++) {
+      usable = usable && rows[j][3] && rows[j][4].value_or("") != "YES";
+      if (rows[j][3]) {
+        keys.push_back(*rows[j][3]);
+      }
+    }
+    if (!have_key && usable) {
+      snapshot->push_back(Table{Lower(*first[0]), Lower(*first[1]), std::move(keys)});
+    }
+    i = j;
+  }
+  std::sort(snapshot->begin(), snapshot->end(), [](const Table &a, const Table &b) {
+    return a.schema < b.schema || (a.schema == b.schema && a.table < b.table);
+  });
+  log_info("Schema catalog: keys of %lu tables", snapshot->size());
+  std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(snapshot)));
+}
@@ -0,0 +1,70 @@
+#ifndef SPECULATOR_SCHEMA_CATALOG_H_
+#define SPECULATOR_SCHEMA_CATALOG_H_
+
+#include "result_set.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ServerGroup;
+
+// Key columns of every user table, read from information_schema, so that
+// undo statements can find a row by its primary key (or, lacking one, a
+// unique key on NOT NULL columns).
+//
+// Loads publish an immutable, sorted snapshot; a lookup keeps the
+// snapshot it found its keys in alive for as long as it holds them, and
+// the last one to let go of a replaced snapshot frees it. The catalog is
+// (re)loaded when a session starts while it was never loaded or DDL ran
+// since, never on the way to a speculation.
+class SchemaCatalog {
+public:
+  // Rows of (schema, table, index, column, nullable), PRIMARY first.
+  static const char *kQuery;
+
+  SchemaCatalog();
+  SchemaCatalog(const SchemaCatalog &other) = delete;
+  SchemaCatalog &operator=(const SchemaCatalog &other) = delete;
+
+  // nullptr if the table has no usable key or is unknown. Names are
+  // compared case-insensitively.
+  std::shared_ptr<const std::vector<std::string>> KeyColumns(std::string_view schema,
+                                                             std::string_view table) const;
+  size_t NumTables() const;
+
+  // Loads the catalog if it was never loaded or was invalidated since,
+  // with a query on server_group, whose servers have to be idle. Returns
+  // at once if another session is loading it.
+  void Refresh(ServerGroup *server_group);
+  void Invalidate() {
+    stale_.store(true, std::memory_order_release);
+  }
+  bool IsStale() const {
+    return stale_.load(std::memory_order_acquire);
+  }
+  // Publishes a snapshot built from rows of kQuery.
+  void Load(const std::vector<ResultRow> &rows);
+
+private:
+  struct Table {
+    std::string schema;
+    std::string table;
+    std::vector<std::string> keys;
+  };
+  // Sorted by (schema, table), lower case.
+  using Snapshot = std::vector<Table>;
+
+  void Publish(const std::vector<ResultRow> &rows);
+
+  // Only accessed through std::atomic_load() and std::atomic_store().
+  std::shared_ptr<const Snapshot> snapshot_;
+  std::atomic<bool> stale_;
+  // Serializes loads.
+  std::mutex mutex_;
+};
+
+#endif // SPECULATOR_SCHEMA_CATALOG_H_
@@ -5,8 +5,6 @@
 
 #include <sstream>
 
-#include <cassert>
-
 namespace model {
 
 class ArgumentListOperand : public Operand {
@@ -19,10 +17,16 @@ public:
   }
 
   virtual SqlValue GetValue(const Window<Query> &trx) const {
-    assert(query_index_ < trx.Size());
+    // Live history need not follow the model; what is not there predicts
+    // nothing.
+    if (static_cast<size_t>(query_index_) >= trx.Size()) {
+      return SqlValue();
+    }
     auto &query = trx[query_index_];
-    assert(query_id_ == query.query_id());
-    assert(arg_index_ < query.arguments().size());
+    if (query_id_ != query.query_id() ||
+        static_cast<size_t>(arg_index_) >= query.arguments().size()) {
+      return SqlValue();
+    }
     return query.arguments()[arg_index_];
   }
 
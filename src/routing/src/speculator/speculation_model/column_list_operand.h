@@ -5,8 +5,6 @@
 
 #include <sstream>
 
-#include <cassert>
-
 namespace model {
 
 class ColumnListOperand : public Operand {
@@ -19,11 +17,31 @@ public:
   }
 
   virtual SqlValue GetValue(const Window<Query> &trx) const {
-    assert(query_index_ < trx.Size());
+    if (static_cast<size_t>(query_index_) >= trx.Size()) {
+      return SqlValue();
+    }
     auto &query = trx[query_index_];
-    assert(query_id_ == query.query_id());
-    assert(column_index_ < query.arguments().size());
-    return query.arguments()[column_index_];
+    if (query_id_ != query.query_id()) {
+      return SqlValue();
+    }
+    // The column over all rows, as the list an IN takes.
+    DoubleList doubles;
+    StringList strings;
+    for (auto &row : query.result_set()) {
+      if (static_cast<size_t>(column_index_) >= row.size()) {
+        return SqlValue();
+      }
+      auto &value = row[column_index_];
+      if (value.IsDouble()) {
+        doubles.insert(boost::get<Double>(value));
+      } else if (value.IsString()) {
+        strings.insert(boost::get<String>(value));
+      }
+    }
+    if (doubles.empty() == strings.empty()) {
+      return SqlValue();
+    }
+    return doubles.empty() ? SqlValue(strings) : SqlValue(doubles);
   }
 
   virtual std::string ToString() const {
@@ -1,165 +1,96 @@
 #include "graph_model.h"
-#include "random_operation.h"
-#include "unary_operation.h"
-#include "const_operand.h"
-#include "query_result_operand.h"
-#include "query_argument_operand.h"
-#include "argument_list_operand.h"
-#include "column_list_operand.h"
-#include "rapidjson/document.h"
+#include "logger.h"
 
-#include <fstream>
+#include <mutex>
 
-#include <cassert>
+#include <cerrno>
+#include <cstring>
 
-namespace rjson=rapidjson;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-namespace {
+namespace model {
 
-model::QueryPath CreateQueryPath(const rjson::Value &obj) {
-  model::QueryPath path;
-  for (rjson::SizeType i = 0; i < obj.Size(); i++) {
-    path[i] = obj[i].GetInt();
-  }
-  return std::move(path);
-}
+GraphModel::GraphModel(std::shared_ptr<QueryManager> manager) :
+  manager_(manager), learner_(new ModelLearner(PredictionTable())),
+  mapped_(nullptr), mapped_size_(0) {}
 
-model::SqlValue GetValue(const rjson::Value &obj) {
-  if (obj.IsInt()) {
-    return model::SqlValue(obj.GetInt());
-  } else if (obj.IsString()) {
-    return model::SqlValue(std::string(obj.GetString()));
-  } else if (obj.IsDouble()) {
-    return model::SqlValue(obj.GetDouble());
-  } else if (obj.IsBool()) {
-    return model::SqlValue(obj.GetBool());
+GraphModel::~GraphModel() {
+  if (mapped_ != nullptr) {
+    munmap(const_cast<char *>(mapped_), mapped_size_);
   }
-  return model::SqlValue();
 }
 
-std::unique_ptr<model::Operand> CreateQueryResultOperand(const rjson::Value &obj) {
-  int query_id = obj["query"].GetInt();
-  int query_index = obj["index"].GetInt();
-  int row = obj["row"].GetInt();
-  int column = obj["column"].GetInt();
-  return std::unique_ptr<model::Operand>(
-    new model::QueryResultOperand(query_id, query_index, row, column));
-}
+std::shared_ptr<const GraphModel> GraphModel::Get(const std::string &query_set,
+                                                  const std::string &model) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const GraphModel>> models;
 
-std::unique_ptr<model::Operand> CreateQueryArgumentOperand(const rjson::Value &obj) {
-  int query_id = obj["query"].GetInt();
-  int query_index = obj["index"].GetInt();
-  int arg = obj["arg"].GetInt();
-  return std::unique_ptr<model::Operand>(
-    new model::QueryArgumentOperand(query_id, query_index, arg));
-}
-
-std::unique_ptr<model::Operand> CreateArgumentListOperand(const rjson::Value &obj) {
-  int query_id = obj["query"].GetInt();
-  int query_index = obj["index"].GetInt();
-  int arg = obj["arg"].GetInt();
-  return std::unique_ptr<model::Operand>(
-    new model::ArgumentListOperand(query_id, query_index, arg));
-}
-
-std::unique_ptr<model::Operand> CreateColumnListOperand(const rjson::Value &obj) {
-  int query_id = obj["query"].GetInt();
-  int query_index = obj["index"].GetInt();
-  int column = obj["column"].GetInt();
-  return std::unique_ptr<model::Operand>(
-    new model::ColumnListOperand(query_id, query_index, column));
-}
-
-std::unique_ptr<model::Operand> CreateOperand(const rjson::Value &obj) {
-  assert(obj.IsObject());
-  auto type = std::string(obj["type"].GetString());
-  if (type == "const") {
-    return std::unique_ptr<model::Operand>(
-      new model::ConstOperand(std::move(GetValue(obj["value"]))));
-  } else if (type == "result") {
-    return CreateQueryResultOperand(obj);
-  } else if (type == "arg") {
-    return CreateQueryArgumentOperand(obj);
-  } else if (type == "arglist") {
-    return CreateArgumentListOperand(obj);
-  } else if (type == "columnlist") {
-    return CreateColumnListOperand(obj);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto key = query_set + '\n' + model;
+  auto iter = models.find(key);
+  if (iter != models.end()) {
+    return iter->second;
   }
-  return std::unique_ptr<model::Operand>(
-    new model::ConstOperand(model::SqlValue()));
-}
-
-std::unique_ptr<model::Operation> CreateOperation(const rjson::Value &obj) {
-  assert(obj.IsObject());
-  if (std::string(obj["type"].GetString()) == "rand") {
-    return std::unique_ptr<model::Operation>(
-      new model::RandomOperation());
+  auto graph_model = std::make_shared<GraphModel>(std::make_shared<QueryManager>());
+  if (!graph_model->Load(query_set, model)) {
+    return nullptr;
   }
-  return std::unique_ptr<model::Operation>(
-    new model::UnaryOperation(CreateOperand(obj)));
+  log_info("Loaded model %s with %lu vertices", model.c_str(),
+           graph_model->file_.NumVertices());
+  models[key] = graph_model;
+  return graph_model;
 }
 
-std::vector<model::Prediction> CreatePredictions(const rjson::Value &obj) {
-  assert(obj.IsArray());
-  std::vector<model::Prediction> predictions;
-  for (rjson::SizeType i = 0; i < obj.Size(); i++) {
-    auto &prediction = obj[i];
-    int query = prediction["query"].GetInt();
-    int hit = prediction["hit"].GetInt();
-    auto &ops = prediction["ops"];
-    std::vector<std::unique_ptr<model::Operation>> operations;
-    for (rjson::SizeType j = 0; j < ops.Size(); j++) {
-      operations.push_back(std::move(CreateOperation(ops[j])));
-    }
-    predictions.push_back(model::Prediction(query, hit, std::move(operations)));
+bool GraphModel::Load(const std::string &query_set, const std::string &model) {
+  if (!manager_->Load(query_set)) {
+    return false;
   }
-  return std::move(predictions);
-}
-
-void FillPredictions(const rjson::Value &obj, model::Edge &edge) {
-  assert(obj.IsArray());
-  for (auto &mapping : obj.GetArray()) {
-    auto path = CreateQueryPath(mapping["path"]);
-    auto predictions = CreatePredictions(mapping["predictions"]);
-    edge.AddPredictions(path, std::move(predictions));
+  int fd = open(model.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    log_error("Failed to open model %s: %s", model.c_str(), strerror(errno));
+    return false;
   }
-}
-
-model::EdgeList CreateEdgeList(const rjson::Value &obj) {
-  assert(obj.IsArray());
-  model::EdgeList edge_list;
-  for (rjson::SizeType i = 0; i < obj.Size(); i++) {
-    auto &pair = obj[i];
-    auto vertex = pair["vertex"].GetInt();
-    auto &edge_obj = pair["edge"];
-    model::Edge edge(edge_obj["to"].GetInt(), edge_obj["weight"].GetInt());
-    FillPredictions(edge_obj["prediction_map"], edge);
-    edge_list.AddEdge(vertex, std::move(edge));
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    log_error("Failed to read model %s", model.c_str());
+    close(fd);
+    return false;
   }
-  return std::move(edge_list);
-}
-
-} // namespace
-
-namespace model {
-
-void GraphModel::Load(const std::string &query_set, const std::string &model) {
-  manager_->Load(query_set);
-  std::ifstream infile(model);
-  std::string content((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
-  rjson::Document document;
-  document.Parse(content.c_str());
-  for (rjson::SizeType i = 0; i < document.Size(); i++) {
-    auto &vertex_edge = document[i];
-    auto vertex = vertex_edge["vertex"].GetInt();
-    auto edge_list = ::CreateEdgeList(vertex_edge["edgelist"]);
-    vertex_edges_[vertex] = std::move(edge_list);
+  size_t size = static_cast<size_t>(st.st_size);
+  void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    log_error("Failed to map model %s: %s", model.c_str(), strerror(errno));
+    return false;
+  }
+  std::string error;
+  if (ModelFile::IsCompiled(reinterpret_cast<const char *>(data), size)) {
+    mapped_ = reinterpret_cast<const char *>(data);
+    mapped_size_ = size;
+    madvise(data, size, MADV_WILLNEED);
+    if (!file_.Attach(mapped_, mapped_size_, &error)) {
+      log_error("Failed to load model %s: %s", model.c_str(), error.c_str());
+      return false;
+    }
+    learner_.reset(new ModelLearner(PredictionTable(file_)));
+    return true;
+  }
+  std::string json(reinterpret_cast<const char *>(data), size);
+  munmap(data, size);
+  if (!ModelFile::Compile(json, &image_, &error) ||
+      !file_.Attach(image_.data(), image_.size(), &error)) {
+    log_error("Failed to load model %s: %s", model.c_str(), error.c_str());
+    return false;
   }
+  learner_.reset(new ModelLearner(PredictionTable(file_)));
+  return true;
 }
 
-std::unique_ptr<Predictor> GraphModel::CreatePredictor() {
-  return std::unique_ptr<Predictor>(
-    new Predictor(std::shared_ptr<GraphModel>(this), manager_));
+std::unique_ptr<Predictor> GraphModel::CreatePredictor() const {
+  return std::unique_ptr<Predictor>(new Predictor(shared_from_this()));
 }
 
-} // namespace model
\ No newline at end of file
+} // namespace model
@@ -1,7 +1,9 @@
 #ifndef PREDICTION_GRAPH_MODEL_H_
 #define PREDICTION_GRAPH_MODEL_H_
 
-#include "edge_list.h"
+#include "model_file.h"
+#include "model_learner.h"
+#include "prediction_table.h"
 #include "predictor.h"
 #include "query.h"
 #include "query_parser.h"
@@ -12,21 +14,51 @@ namespace model {
 
 class Predictor;
 
-class GraphModel {
+// Once loaded, a model is only read, so one instance serves the
+// predictors of every session. The model is kept compiled (see
+// ModelFile): a compiled file is mapped and used in place, a JSON one is
+// compiled into memory while loading.
+class GraphModel : public std::enable_shared_from_this<GraphModel> {
 public:
-  GraphModel(std::shared_ptr<QueryManager> manager) : manager_(manager) {}
+  GraphModel(std::shared_ptr<QueryManager> manager);
+  GraphModel(const GraphModel &other) = delete;
+  GraphModel &operator=(const GraphModel &other) = delete;
+  ~GraphModel();
 
-  void Load(const std::string &query_set, const std::string &model);
+  // Returns the model loaded from the two files, loading it on first use.
+  // Returns nullptr if either cannot be read.
+  static std::shared_ptr<const GraphModel> Get(const std::string &query_set,
+                                               const std::string &model);
 
-  EdgeList *GetEdgeList(int query_id) {
-    return &vertex_edges_[query_id];
+  bool Load(const std::string &query_set, const std::string &model);
+
+  const ModelFile &file() const {
+    return file_;
+  }
+  // The current snapshot of the hit counts, see ModelLearner::table().
+  std::shared_ptr<const PredictionTable> table() const {
+    return learner_->table();
+  }
+  // Learning is off until it is started, and then serves every predictor
+  // of the model.
+  ModelLearner &learner() const {
+    return *learner_;
+  }
+
+  const QueryManager &manager() const {
+    return *manager_;
   }
 
-  std::unique_ptr<Predictor> CreatePredictor();
+  std::unique_ptr<Predictor> CreatePredictor() const;
 
 private:
   std::shared_ptr<QueryManager> manager_;
-  std::unordered_map<int, EdgeList> vertex_edges_;
+  ModelFile file_;
+  std::unique_ptr<ModelLearner> learner_;
+  // What file_ views: either mapped_ or image_.
+  const char *mapped_;
+  size_t mapped_size_;
+  std::string image_;
 };
 
 } // namespace model
@@ -0,0 +1,331 @@
+#include "model_file.h"
+#include "value.h"
+#include "rapidjson/document.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <cstring>
+
+namespace rjson = rapidjson;
+
+namespace {
+
+struct PendingPrediction {
+  int query_id;
+  int hit_count;
+  std::vector<model::file::Operand> operands;
+};
+
+using PathPredictions = std::map<model::QueryPath, std::vector<PendingPrediction>>;
+
+bool IsInt(const rjson::Value &obj, const char *name) {
+  return obj.IsObject() && obj.HasMember(name) && obj[name].IsInt();
+}
+
+bool IsArray(const rjson::Value &obj, const char *name) {
+  return obj.IsObject() && obj.HasMember(name) && obj[name].IsArray();
+}
+
+bool ReadConst(const rjson::Value &value, std::string *strings, model::file::Operand *operand) {
+  if (value.IsInt()) {
+    operand->value_type = model::SqlValue::kInt;
+    operand->value = static_cast<uint32_t>(value.GetInt());
+  } else if (value.IsString()) {
+    operand->value_type = model::SqlValue::kString;
+    operand->value = strings->size();
+    operand->string_length = value.GetStringLength();
+    strings->append(value.GetString(), value.GetStringLength());
+  } else if (value.IsDouble()) {
+    operand->value_type = model::SqlValue::kDouble;
+    double number = value.GetDouble();
+    memcpy(&operand->value, &number, sizeof(number));
+  } else if (value.IsBool()) {
+    operand->value_type = model::SqlValue::kBool;
+    operand->value = value.GetBool();
+  } else {
+    operand->value_type = model::SqlValue::kNull;
+  }
+  return true;
+}
+
+bool ReadOperand(const rjson::Value &obj, std::string *strings, model::file::Operand *operand) {
+  memset(operand, 0, sizeof(*operand));
+  if (!obj.IsObject() || !obj.HasMember("type") || !obj["type"].IsString()) {
+    return false;
+  }
+  std::string type = obj["type"].GetString();
+  if (type == "rand") {
+    operand->kind = model::file::kRandom;
+    return true;
+  }
+  if (type == "const") {
+    operand->kind = model::file::kConst;
+    return obj.HasMember("value") && ReadConst(obj["value"], strings, operand);
+  }
+  const char *first = nullptr;
+  const char *second = nullptr;
+  if (type == "result") {
+    operand->kind = model::file::kResult;
+    first = "row";
+    second = "column";
+  } else if (type == "arg") {
+    operand->kind = model::file::kArgument;
+    first = "arg";
+  } else if (type == "arglist") {
+    operand->kind = model::file::kArgumentList;
+    first = "arg";
+  } else if (type == "columnlist") {
+    operand->kind = model::file::kColumnList;
+    first = "column";
+  } else {
+    // As before, an operand of unknown type is a null constant.
+    operand->kind = model::file::kConst;
+    operand->value_type = model::SqlValue::kNull;
+    return true;
+  }
+  if (!IsInt(obj, "query") || !IsInt(obj, "index") || !IsInt(obj, first) ||
+      (second != nullptr && !IsInt(obj, second))) {
+    return false;
+  }
+  operand->query_id = obj["query"].GetInt();
+  operand->query_index = obj["index"].GetInt();
+  operand->first = obj[first].GetInt();
+  operand->second = second == nullptr ? 0 : obj[second].GetInt();
+  return true;
+}
+
+bool ReadPredictions(const rjson::Value &obj, std::string *strings,
+                     std::vector<PendingPrediction> *predictions) {
+  for (auto &prediction : obj.GetArray()) {
+    if (!IsInt(prediction, "query") || !IsInt(prediction, "hit") ||
+        !IsArray(prediction, "ops")) {
+      return false;
+    }
+    PendingPrediction pending{prediction["query"].GetInt(), prediction["hit"].GetInt(), {}};
+    for (auto &op : prediction["ops"].GetArray()) {
+      model::file::Operand operand;
+      if (!ReadOperand(op, strings, &operand)) {
+        return false;
+      }
+      pending.operands.push_back(operand);
+    }
+    predictions->push_back(std::move(pending));
+  }
+  return true;
+}
+
+// The predictions of every edge of a vertex, by path.
+bool ReadEdgeList(const rjson::Value &obj, std::string *strings, PathPredictions *paths) {
+  for (auto &pair : obj.GetArray()) {
+    if (!pair.IsObject() || !pair.HasMember("edge") ||
+        !IsArray(pair["edge"], "prediction_map")) {
+      return false;
+    }
+    for (auto &mapping : pair["edge"]["prediction_map"].GetArray()) {
+      if (!IsArray(mapping, "path") || !IsArray(mapping, "predictions")) {
+        return false;
+      }
+      model::QueryPath path;
+      path.fill(-1);
+      auto &path_obj = mapping["path"];
+      for (rjson::SizeType i = 0; i < path_obj.Size() && i < path.size(); i++) {
+        if (!path_obj[i].IsInt()) {
+          return false;
+        }
+        path[i] = path_obj[i].GetInt();
+      }
+      if (!ReadPredictions(mapping["predictions"], strings, &(*paths)[path])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+size_t Align(size_t offset) {
+  return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+template<typename T>
+void Append(std::string *image, uint64_t *offset, const std::vector<T> &table) {
+  image->resize(Align(image->size()));
+  *offset = image->size();
+  image->append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(T));
+}
+
+// Whether count records of size bytes at offset are all within size.
+bool InBounds(uint64_t offset, uint64_t count, uint64_t record_size, uint64_t size) {
+  return offset % 8 == 0 && offset <= size && count <= (size - offset) / record_size;
+}
+
+bool InRange(uint32_t first, uint32_t count, uint32_t size) {
+  return first <= size && count <= size - first;
+}
+
+} // namespace
+
+namespace model {
+
+ModelFile::ModelFile() :
+  header_(nullptr), vertices_(nullptr), paths_(nullptr),
+  predictions_(nullptr), operands_(nullptr), strings_(nullptr) {}
+
+bool ModelFile::IsCompiled(const char *data, size_t size) {
+  return size >= sizeof(file::kMagic) && memcmp(data, file::kMagic, sizeof(file::kMagic)) == 0;
+}
+
+bool ModelFile::Compile(const std::string &json, std::string *image, std::string *error) {
+  rjson::Document document;
+  document.Parse(json.c_str());
+  if (document.HasParseError() || !document.IsArray()) {
+    *error = "not a JSON array";
+    return false;
+  }
+  std::string strings;
+  std::map<int, PathPredictions> vertices;
+  for (auto &vertex_edge : document.GetArray()) {
+    if (!IsInt(vertex_edge, "vertex") || !IsArray(vertex_edge, "edgelist") ||
+        !ReadEdgeList(vertex_edge["edgelist"], &strings,
+                      &vertices[vertex_edge["vertex"].GetInt()])) {
+      *error = "malformed vertex";
+      return false;
+    }
+  }
+
+  std::vector<file::Vertex> vertex_table;
+  std::vector<file::Path> path_table;
+  std::vector<file::Prediction> prediction_table;
+  std::vector<file::Operand> operand_table;
+  for (auto &vertex : vertices) {
+    vertex_table.push_back(file::Vertex{vertex.first, static_cast<uint32_t>(path_table.size()),
+                                        static_cast<uint32_t>(vertex.second.size())});
+    for (auto &path : vertex.second) {
+      auto &predictions = path.second;
+      std::stable_sort(predictions.begin(), predictions.end(),
+                       [](const PendingPrediction &a, const PendingPrediction &b) {
+                         return a.hit_count > b.hit_count;
+                       });
+      file::Path entry;
+      std::copy(path.first.begin(), path.first.end(), entry.path);
+      entry.first_prediction = static_cast<uint32_t>(prediction_table.size());
+      entry.num_predictions = static_cast<uint32_t>(predictions.size());
+      path_table.push_back(entry);
+      for (auto &prediction : predictions) {
+        prediction_table.push_back(file::Prediction{
+            prediction.query_id, prediction.hit_count,
+            static_cast<uint32_t>(operand_table.size()),
+            static_cast<uint32_t>(prediction.operands.size())});
+        operand_table.insert(operand_table.end(), prediction.operands.begin(),
+                             prediction.operands.end());
+      }
+    }
+  }
+
+  file::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, file::kMagic, sizeof(file::kMagic));
+  header.version = file::kVersion;
+  header.num_vertices = static_cast<uint32_t>(vertex_table.size());
+  header.num_paths = static_cast<uint32_t>(path_table.size());
+  header.num_predictions = static_cast<uint32_t>(prediction_table.size());
+  header.num_operands = static_cast<uint32_t>(operand_table.size());
+  header.strings_size = static_cast<uint32_t>(strings.size());
+  image->assign(sizeof(header), '\0');
+  Append(image, &header.vertices_offset, vertex_table);
+  Append(image, &header.paths_offset, path_table);
+  Append(image, &header.predictions_offset, prediction_table);
+  Append(image, &header.operands_offset, operand_table);
+  Append(image, &header.strings_offset, std::vector<char>(strings.begin(), strings.end()));
+  memcpy(&(*image)[0], &header, sizeof(header));
+  return true;
+}
+
+bool ModelFile::Convert(const std::string &json_path, const std::string &image_path,
+                        std::string *error) {
+  std::ifstream infile(json_path);
+  if (!infile) {
+    *error = "cannot read " + json_path;
+    return false;
+  }
+  std::string json((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+  std::string image;
+  if (!Compile(json, &image, error)) {
+    return false;
+  }
+  std::ofstream outfile(image_path, std::ios::binary | std::ios::trunc);
+  if (!outfile.write(image.data(), image.size())) {
+    *error = "cannot write " + image_path;
+    return false;
+  }
+  return true;
+}
+
+bool ModelFile::Attach(const char *data, size_t size, std::string *error) {
+  if (!IsCompiled(data, size) || size < sizeof(file::Header)) {
+    *error = "not a compiled model";
+    return false;
+  }
+  auto header = reinterpret_cast<const file::Header *>(data);
+  if (header->version != file::kVersion) {
+    *error = "unsupported version " + std::to_string(header->version);
+    return false;
+  }
+  if (!InBounds(header->vertices_offset, header->num_vertices, sizeof(file::Vertex), size) ||
+      !InBounds(header->paths_offset, header->num_paths, sizeof(file::Path), size) ||
+      !InBounds(header->predictions_offset, header->num_predictions,
+                sizeof(file::Prediction), size) ||
+      !InBounds(header->operands_offset, header->num_operands, sizeof(file::Operand), size) ||
+      !InBounds(header->strings_offset, header->strings_size, 1, size)) {
+    *error = "truncated";
+    return false;
+  }
+  auto vertices = reinterpret_cast<const file::Vertex *>(data + header->vertices_offset);
+  auto paths = reinterpret_cast<const file::Path *>(data + header->paths_offset);
+  auto predictions = reinterpret_cast<const file::Prediction *>(
+      data + header->predictions_offset);
+  auto operands = reinterpret_cast<const file::Operand *>(data + header->operands_offset);
+  // Lookups trust the indices, so they are all checked once here.
+  for (uint32_t i = 0; i < header->num_vertices; i++) {
+    if (!InRange(vertices[i].first_path, vertices[i].num_paths, header->num_paths) ||
+        (i > 0 && vertices[i - 1].query_id >= vertices[i].query_id)) {
+      *error = "bad vertex table";
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_paths; i++) {
+    if (!InRange(paths[i].first_prediction, paths[i].num_predictions,
+                 header->num_predictions)) {
+      *error = "bad path table";
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_predictions; i++) {
+    if (!InRange(predictions[i].first_operand, predictions[i].num_operands,
+                 header->num_operands)) {
+      *error = "bad prediction table";
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_operands; i++) {
+    auto &operand = operands[i];
+    if (operand.kind > file::kRandom ||
+        (operand.kind == file::kConst && operand.value_type == SqlValue::kString &&
+         (operand.value > header->strings_size ||
+          operand.string_length > header->strings_size - operand.value))) {
+      *error = "bad operand table";
+      return false;
+    }
+  }
+  header_ = header;
+  vertices_ = vertices;
+  paths_ = paths;
+  predictions_ = predictions;
+  operands_ = operands;
+  strings_ = data + header->strings_offset;
+  return true;
+}
+
+} // namespace model
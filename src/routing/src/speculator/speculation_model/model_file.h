@@ -0,0 +1,149 @@
+#ifndef PREDICTION_MODEL_FILE_H_
+#define PREDICTION_MODEL_FILE_H_
+
+#include "query_window.h"
+
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace model {
+
+// The compiled form of a model: flat tables of fixed-size records that
+// refer to each other by index, so that a file can be memory-mapped and
+// used in place. All tables follow the header, each at an 8-byte aligned
+// offset, in native byte order.
+//
+//   vertices     sorted by query_id, each a range of paths
+//   paths        sorted by path within a vertex, each a range of
+//                predictions, those of every edge of the vertex merged
+//                and ordered by hit count, best first
+//   predictions  each a range of operands, one per argument
+//   operands
+//   strings      the text of string constants
+namespace file {
+
+const char kMagic[8] = {'S', 'Q', 'P', 'M', 'O', 'D', 'L', '1'};
+const uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_vertices;
+  uint32_t num_paths;
+  uint32_t num_predictions;
+  uint32_t num_operands;
+  uint32_t strings_size;
+  uint64_t vertices_offset;
+  uint64_t paths_offset;
+  uint64_t predictions_offset;
+  uint64_t operands_offset;
+  uint64_t strings_offset;
+};
+
+struct Vertex {
+  int32_t query_id;
+  uint32_t first_path;
+  uint32_t num_paths;
+};
+
+struct Path {
+  int32_t path[kLookBackLen];
+  uint32_t first_prediction;
+  uint32_t num_predictions;
+};
+
+struct Prediction {
+  int32_t query_id;
+  int32_t hit_count;
+  uint32_t first_operand;
+  uint32_t num_operands;
+};
+
+enum OperandKind : uint8_t {
+  kConst = 0,
+  kResult = 1,
+  kArgument = 2,
+  kArgumentList = 3,
+  kColumnList = 4,
+  kRandom = 5,
+};
+
+// Only the fields of its kind are set: query_id and query_index locate
+// the query in the history, first is the argument or the row, second the
+// column. A constant is an SqlValue::Type in value_type with its value in
+// value: an int, a bool, the bits of a double or the offset of a string
+// of string_length bytes.
+struct Operand {
+  uint8_t kind;
+  uint8_t value_type;
+  uint16_t reserved;
+  int32_t query_id;
+  int32_t query_index;
+  int32_t first;
+  int32_t second;
+  uint32_t string_length;
+  uint64_t value;
+};
+
+static_assert(sizeof(Operand) == 32, "operands are read in place");
+
+} // namespace file
+
+// A read-only view of a compiled model in memory it does not own.
+class ModelFile {
+public:
+  ModelFile();
+
+  // Whether data starts like a compiled model.
+  static bool IsCompiled(const char *data, size_t size);
+  // Compiles a model in the JSON format into image. On failure, returns
+  // false with the reason in error.
+  static bool Compile(const std::string &json, std::string *image, std::string *error);
+  // Reads a JSON model from json_path and writes it compiled to
+  // image_path.
+  static bool Convert(const std::string &json_path, const std::string &image_path,
+                      std::string *error);
+
+  // Points the view at data, which has to outlive it, after checking
+  // that every table is within size and every index within its table.
+  bool Attach(const char *data, size_t size, std::string *error);
+
+  size_t NumVertices() const {
+    return header_ == nullptr ? 0 : header_->num_vertices;
+  }
+  size_t NumPaths() const {
+    return header_ == nullptr ? 0 : header_->num_paths;
+  }
+  size_t NumPredictions() const {
+    return header_ == nullptr ? 0 : header_->num_predictions;
+  }
+  const file::Vertex &vertex(size_t index) const {
+    return vertices_[index];
+  }
+  const file::Path &path(size_t index) const {
+    return paths_[index];
+  }
+  const file::Prediction &prediction(size_t index) const {
+    return predictions_[index];
+  }
+  const file::Operand *Operands(const file::Prediction &prediction) const {
+    return operands_ + prediction.first_operand;
+  }
+  std::string String(const file::Operand &operand) const {
+    return std::string(strings_ + operand.value, operand.string_length);
+  }
+
+private:
+  const file::Header *header_;
+  const file::Vertex *vertices_;
+  const file::Path *paths_;
+  const file::Prediction *predictions_;
+  const file::Operand *operands_;
+  const char *strings_;
+};
+
+} // namespace model
+
+#endif // PREDICTION_MODEL_FILE_H_
@@ -0,0 +1,132 @@
+#include "model_learner.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace model {
+
+ModelLearner::ModelLearner(PredictionTable &&table) :
+  table_(new PredictionTable(std::move(table))),
+  num_dropped_(0), learning_(false), stop_(false) {
+  static std::atomic<uint64_t> next_id(0);
+  id_ = next_id++;
+}
+
+ModelLearner::~ModelLearner() {
+  Stop();
+}
+
+void ModelLearner::Start(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> lock(stop_mutex_);
+  if (thread_.joinable()) {
+    return;
+  }
+  learning_ = true;
+  thread_ = std::thread(&ModelLearner::Run, this, interval);
+}
+
+void ModelLearner::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stop_ = true;
+  }
+  stop_cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  learning_ = false;
+}
+
+void ModelLearner::Run(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_cond_.wait_for(lock, interval, [this] { return stop_; })) {
+    lock.unlock();
+    auto num_hits = Merge();
+    if (num_hits > 0) {
+      log_debug("Learned %lu prediction hits", num_hits);
+    }
+    lock.lock();
+  }
+}
+
+ModelLearner::Buffer *ModelLearner::BufferOfThisThread() {
+  // Closes the buffers of a thread as it exits; the merge after that
+  // drains and drops them.
+  struct ThreadBuffers {
+    ~ThreadBuffers() {
+      for (auto &pair : buffers) {
+        pair.second->closed = true;
+      }
+    }
+    std::vector<std::pair<uint64_t, std::shared_ptr<Buffer>>> buffers;
+  };
+  thread_local ThreadBuffers thread_buffers;
+
+  for (auto &pair : thread_buffers.buffers) {
+    if (pair.first == id_) {
+      return pair.second.get();
+    }
+  }
+  auto buffer = std::make_shared<Buffer>();
+  thread_buffers.buffers.emplace_back(id_, buffer);
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  buffers_.push_back(buffer);
+  return buffer.get();
+}
+
+void ModelLearner::RecordHit(int query_id, const QueryPath &path, uint32_t prediction) {
+  auto buffer = BufferOfThisThread();
+  auto tail = buffer->tail.load(std::memory_order_relaxed);
+  if (tail - buffer->head.load(std::memory_order_acquire) == Buffer::kCapacity) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto &hit = buffer->hits[tail % Buffer::kCapacity];
+  hit.query_id = query_id;
+  std::copy(path.begin(), path.end(), hit.path);
+  hit.prediction = prediction;
+  buffer->tail.store(tail + 1, std::memory_order_release);
+}
+
+size_t ModelLearner::Merge() {
+  std::lock_guard<std::mutex> merge_lock(merge_mutex_);
+  std::vector<std::shared_ptr<Buffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers = buffers_;
+    // A closed buffer is never written again, so this drain is its last.
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                  [](const std::shared_ptr<Buffer> &buffer) {
+                                    return buffer->closed.load();
+                                  }),
+                   buffers_.end());
+  }
+
+  std::shared_ptr<PredictionTable> table;
+  size_t num_hits = 0;
+  for (auto &buffer : buffers) {
+    auto head = buffer->head.load(std::memory_order_relaxed);
+    auto tail = buffer->tail.load(std::memory_order_acquire);
+    if (head == tail) {
+      continue;
+    }
+    if (!table) {
+      table.reset(new PredictionTable(*table_));
+    }
+    for (; head != tail; head++) {
+      auto &hit = buffer->hits[head % Buffer::kCapacity];
+      QueryPath path;
+      std::copy(hit.path, hit.path + kLookBackLen, path.begin());
+      num_hits += table->Hit(hit.query_id, path, hit.prediction);
+    }
+    buffer->head.store(head, std::memory_order_release);
+  }
+  if (!table) {
+    return 0;
+  }
+  std::atomic_store(&table_, std::shared_ptr<const PredictionTable>(std::move(table)));
+  return num_hits;
+}
+
+} // namespace model
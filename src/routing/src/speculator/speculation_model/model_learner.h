@@ -0,0 +1,99 @@
+#ifndef PREDICTION_MODEL_LEARNER_H_
+#define PREDICTION_MODEL_LEARNER_H_
+
+#include "prediction_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace model {
+
+// Learns the hit counts of a model's predictions while it serves.
+//
+// Predictors record the predictions their sessions' next queries matched
+// into a buffer of their own thread, without locking. A background thread
+// periodically drains every buffer into a copy of the current
+// PredictionTable, which re-ranks the predictions of each path as it
+// counts, and publishes the copy with std::atomic_store(). Readers share
+// ownership of the table they look up in, so a replaced table is freed
+// by whoever lets go of it last.
+class ModelLearner {
+public:
+  explicit ModelLearner(PredictionTable &&table);
+  ModelLearner(const ModelLearner &other) = delete;
+  ModelLearner &operator=(const ModelLearner &other) = delete;
+  ~ModelLearner();
+
+  // The current snapshot.
+  std::shared_ptr<const PredictionTable> table() const {
+    return std::atomic_load(&table_);
+  }
+  bool Learning() const {
+    return learning_.load(std::memory_order_relaxed);
+  }
+
+  // Merges every interval from now on. Only the first call starts it.
+  void Start(std::chrono::milliseconds interval);
+  void Stop();
+  // Counts a hit of the prediction after query_id along path. Dropped if
+  // the buffer of this thread is full.
+  void RecordHit(int query_id, const QueryPath &path, uint32_t prediction);
+  // Publishes a table with the hits recorded so far. Returns how many
+  // were merged.
+  size_t Merge();
+
+  size_t num_dropped() const {
+    return num_dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Hit {
+    int32_t query_id;
+    int32_t path[kLookBackLen];
+    uint32_t prediction;
+  };
+
+  // Written by one thread, drained by the merging one.
+  struct Buffer {
+    static const size_t kCapacity = 1024;
+
+    Buffer() : head(0), tail(0), closed(false) {}
+
+    Hit hits[kCapacity];
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    std::atomic<bool> closed;
+  };
+
+  Buffer *BufferOfThisThread();
+  void Run(std::chrono::milliseconds interval);
+
+  uint64_t id_;
+  // The table published last. Accessed through std::atomic_load() and
+  // std::atomic_store(), but for plain reads by Merge(), which alone
+  // stores it.
+  std::shared_ptr<const PredictionTable> table_;
+  std::mutex merge_mutex_;
+
+  std::mutex buffers_mutex_;
+  std::vector<std::shared_ptr<Buffer>> buffers_;
+  std::atomic<size_t> num_dropped_;
+
+  std::atomic<bool> learning_;
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cond_;
+  bool stop_;
+  std::thread thread_;
+};
+
+} // namespace model
+
+#endif // PREDICTION_MODEL_LEARNER_H_
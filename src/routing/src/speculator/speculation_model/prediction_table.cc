@@ -0,0 +1,91 @@
+#include "prediction_table.h"
+
+#include <algorithm>
+
+namespace model {
+
+PredictionTable::PredictionTable() : mask_(0), size_(0) {}
+
+PredictionTable::PredictionTable(const ModelFile &file) : size_(file.NumPaths()) {
+  size_t capacity = 16;
+  while (capacity < 2 * size_) {
+    capacity *= 2;
+  }
+  Slot empty = {};
+  empty.best = kNone;
+  slots_.assign(capacity, empty);
+  mask_ = capacity - 1;
+
+  hits_.resize(file.NumPredictions());
+  for (size_t i = 0; i < hits_.size(); i++) {
+    hits_[i] = file.prediction(i).hit_count;
+  }
+  for (size_t v = 0; v < file.NumVertices(); v++) {
+    auto &vertex = file.vertex(v);
+    for (uint32_t p = vertex.first_path; p < vertex.first_path + vertex.num_paths; p++) {
+      auto &entry = file.path(p);
+      if (entry.num_predictions == 0) {
+        continue;
+      }
+      QueryPath path;
+      std::copy(entry.path, entry.path + kLookBackLen, path.begin());
+      auto index = HashPath(path, vertex.query_id) & mask_;
+      while (slots_[index].best != kNone) {
+        index = (index + 1) & mask_;
+      }
+      auto &slot = slots_[index];
+      slot.vertex = vertex.query_id;
+      std::copy(path.begin(), path.end(), slot.path);
+      slot.first_prediction = entry.first_prediction;
+      slot.num_predictions = entry.num_predictions;
+      // The compiler orders the predictions of a path best first.
+      slot.best = entry.first_prediction;
+    }
+  }
+}
+
+const PredictionTable::Slot *PredictionTable::Find(int query_id, const QueryPath &path) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+  auto index = HashPath(path, query_id) & mask_;
+  while (slots_[index].best != kNone) {
+    auto &slot = slots_[index];
+    if (slot.vertex == query_id && std::equal(path.begin(), path.end(), slot.path)) {
+      return &slot;
+    }
+    index = (index + 1) & mask_;
+  }
+  return nullptr;
+}
+
+uint32_t PredictionTable::FindBest(int query_id, const QueryPath &path) const {
+  auto slot = Find(query_id, path);
+  return slot == nullptr ? kNone : slot->best;
+}
+
+bool PredictionTable::FindRange(int query_id, const QueryPath &path, uint32_t *first,
+                                uint32_t *count) const {
+  auto slot = Find(query_id, path);
+  if (slot == nullptr) {
+    return false;
+  }
+  *first = slot->first_prediction;
+  *count = slot->num_predictions;
+  return true;
+}
+
+bool PredictionTable::Hit(int query_id, const QueryPath &path, uint32_t prediction) {
+  auto slot = const_cast<Slot *>(Find(query_id, path));
+  if (slot == nullptr || prediction < slot->first_prediction ||
+      prediction - slot->first_prediction >= slot->num_predictions) {
+    return false;
+  }
+  // On a tie the prediction that was best stays best.
+  if (++hits_[prediction] > hits_[slot->best]) {
+    slot->best = prediction;
+  }
+  return true;
+}
+
+} // namespace model
@@ -0,0 +1,64 @@
+#ifndef PREDICTION_PREDICTION_TABLE_H_
+#define PREDICTION_PREDICTION_TABLE_H_
+
+#include "model_file.h"
+#include "query_window.h"
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace model {
+
+// The paths of a compiled model, open-addressed by vertex and path with
+// linear probing at a load factor of at most one half. A slot is a cache
+// line and holds the whole key and the path's best prediction, so that a
+// lookup usually touches one line before the prediction itself. Hit
+// counts live here rather than in the model, which may be mapped read
+// only; each hit keeps the best prediction of its path up to date.
+class PredictionTable {
+public:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  PredictionTable();
+  explicit PredictionTable(const ModelFile &file);
+
+  // The index in the model of the best prediction after query_id along
+  // path; kNone if there is none.
+  uint32_t FindBest(int query_id, const QueryPath &path) const;
+  // The predictions after query_id along path, as a range of indices in
+  // the model. Returns false if there are none.
+  bool FindRange(int query_id, const QueryPath &path, uint32_t *first, uint32_t *count) const;
+  // Counts a hit of the prediction, one of those after query_id along
+  // path. Returns false if it is not.
+  bool Hit(int query_id, const QueryPath &path, uint32_t prediction);
+
+  int32_t hit_count(uint32_t prediction) const {
+    return hits_[prediction];
+  }
+  size_t Size() const {
+    return size_;
+  }
+
+private:
+  struct alignas(64) Slot {
+    int32_t vertex;
+    int32_t path[kLookBackLen];
+    uint32_t first_prediction;
+    uint32_t num_predictions;
+    // kNone marks an empty slot.
+    uint32_t best;
+  };
+
+  const Slot *Find(int query_id, const QueryPath &path) const;
+
+  std::vector<Slot> slots_;
+  uint64_t mask_;
+  size_t size_;
+  std::vector<int32_t> hits_;
+};
+
+} // namespace model
+
+#endif // PREDICTION_PREDICTION_TABLE_H_
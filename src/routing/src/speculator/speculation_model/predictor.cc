@@ -1,43 +1,143 @@
 #include "predictor.h"
+#include "argument_list_operand.h"
+#include "column_list_operand.h"
+#include "query_argument_operand.h"
+#include "query_result_operand.h"
+
+#include <cstring>
 
 namespace model {
 
-Predictor::Predictor(std::shared_ptr<GraphModel> model,
-          std::shared_ptr<QueryManager> query_manager) :
+Predictor::Predictor(std::shared_ptr<const GraphModel> model) :
   model_(model), current_query_(-1),
-  history_(kLookBackLen),
-  query_manager_(query_manager) {}
+  history_(kLookBackLen) {}
 
 std::string Predictor::PredictNextSQL() {
   auto query = PredictNextQuery();
   if (query.get() == nullptr) {
     return "";
   }
-  return query->ToSql();
+  return query->ToSql(model_->manager());
 }
 
 std::unique_ptr<Query> Predictor::PredictNextQuery() {
   if (history_.Size() == 0) {
     return nullptr;
   }
-  auto path = query_window_.GenPath();
-  auto best_match = model_->GetEdgeList(current_query_)->FindBestPrediction(path);
-  if (best_match.get() == nullptr) {
+  auto best = model_->table()->FindBest(current_query_, query_window_.GenPath());
+  if (best == PredictionTable::kNone) {
     return nullptr;
   }
+  auto &file = model_->file();
+  auto &best_match = file.prediction(best);
   std::vector<SqlValue> arguments;
-  for (auto &operation : best_match->param_ops()) {
-    arguments.push_back(operation->GetValue(history_));
+  auto operands = file.Operands(best_match);
+  for (uint32_t i = 0; i < best_match.num_operands; i++) {
+    arguments.push_back(Evaluate(operands[i]));
   }
   std::vector<std::vector<SqlValue>> result_set;
   return std::unique_ptr<Query>(new Query(
-    best_match->query_id(), std::move(arguments), std::move(result_set)));
+    best_match.query_id, std::move(arguments), std::move(result_set)));
+}
+
+SqlValue Predictor::Evaluate(const file::Operand &operand) const {
+  switch (operand.kind) {
+  case file::kConst:
+    switch (operand.value_type) {
+    case SqlValue::kBool:
+      return SqlValue(operand.value != 0);
+    case SqlValue::kInt:
+      // Typed as SqlTemplatizer types the numbers of a query.
+      return SqlValue(Double(static_cast<int32_t>(operand.value)));
+    case SqlValue::kDouble: {
+      double value;
+      memcpy(&value, &operand.value, sizeof(value));
+      return SqlValue(value);
+    }
+    case SqlValue::kString:
+      return SqlValue(model_->file().String(operand));
+    default:
+      return SqlValue();
+    }
+  case file::kResult:
+    return QueryResultOperand(operand.query_id, operand.query_index, operand.first,
+                              operand.second).GetValue(history_);
+  case file::kArgument:
+    return QueryArgumentOperand(operand.query_id, operand.query_index,
+                                operand.first).GetValue(history_);
+  case file::kArgumentList:
+    return ArgumentListOperand(operand.query_id, operand.query_index,
+                               operand.first).GetValue(history_);
+  case file::kColumnList:
+    return ColumnListOperand(operand.query_id, operand.query_index,
+                             operand.first).GetValue(history_);
+  default:
+    // A random operand predicts nothing.
+    return SqlValue();
+  }
+}
+
+std::vector<Query> Predictor::PredictNextQueries(size_t max_depth) {
+  std::vector<Query> chain;
+  std::vector<Query> replaced_queries;
+  std::vector<int> replaced_ids;
+  int current_query = current_query_;
+  while (chain.size() < max_depth) {
+    auto query = PredictNextQuery();
+    if (query.get() == nullptr || query->ToSql(model_->manager()).empty()) {
+      break;
+    }
+    chain.push_back(*query);
+    current_query_ = query->query_id();
+    replaced_ids.push_back(query_window_.Exchange(query->query_id()));
+    replaced_queries.push_back(history_.Exchange(std::move(*query)));
+  }
+  for (size_t i = replaced_queries.size(); i-- > 0;) {
+    history_.Restore(std::move(replaced_queries[i]));
+    query_window_.Restore(std::move(replaced_ids[i]));
+  }
+  current_query_ = current_query;
+  return chain;
 }
 
 void Predictor::MoveToNext(Query &&query) {
+  if (history_.Size() > 0 && model_->learner().Learning()) {
+    LearnFrom(query);
+  }
   current_query_ = query.query_id();
   query_window_.Add(query.query_id());
   history_.Add(std::move(query));
 }
 
+void Predictor::LearnFrom(const Query &query) {
+  auto path = query_window_.GenPath();
+  uint32_t first;
+  uint32_t count;
+  if (!model_->table()->FindRange(current_query_, path, &first, &count)) {
+    return;
+  }
+  auto &file = model_->file();
+  for (uint32_t index = first; index < first + count; index++) {
+    auto &prediction = file.prediction(index);
+    if (prediction.query_id != query.query_id() ||
+        prediction.num_operands != query.arguments().size()) {
+      continue;
+    }
+    auto operands = file.Operands(prediction);
+    bool matches = true;
+    for (uint32_t i = 0; i < prediction.num_operands && matches; i++) {
+      matches = Evaluate(operands[i]) == query.arguments()[i];
+    }
+    if (matches) {
+      model_->learner().RecordHit(current_query_, path, index);
+    }
+  }
+}
+
+void Predictor::SetResult(std::vector<std::vector<SqlValue>> &&result_set) {
+  if (history_.Size() > 0) {
+    history_[0].result_set() = std::move(result_set);
+  }
+}
+
 } // namespace model
@@ -2,6 +2,7 @@
 #define PREDICTION_PREDICTOR_H_
 
 #include "graph_model.h"
+#include "model_file.h"
 #include "window.h"
 #include "query_parser.h"
 
@@ -14,21 +15,35 @@ class GraphModel;
 
 class Predictor {
 public:
-  Predictor(std::shared_ptr<GraphModel> model,
-            std::shared_ptr<QueryManager> query_manager);
+  Predictor(std::shared_ptr<const GraphModel> model);
 
+  // Empty if there is no prediction, or if one of its arguments is not
+  // known yet.
   std::string PredictNextSQL();
   std::unique_ptr<Query> PredictNextQuery();
-
+  // Up to max_depth queries ahead, each predicted as if the ones before
+  // it had been sent. The chain ends at the first query with an argument
+  // that is not known, such as one taken from the result of a query in
+  // the chain.
+  std::vector<Query> PredictNextQueries(size_t max_depth);
+
+  // While the model learns, also records which predictions query
+  // matched.
   void MoveToNext(Query &&query);
+  // Attaches the result of the query last moved to, which comes in after
+  // it.
+  void SetResult(std::vector<std::vector<SqlValue>> &&result_set);
 
 private:
-  std::shared_ptr<GraphModel> model_;
+  // The operands are evaluated in place, without building an Operation.
+  SqlValue Evaluate(const file::Operand &operand) const;
+  void LearnFrom(const Query &query);
+
+  std::shared_ptr<const GraphModel> model_;
   int current_query_;
   Window<Query> history_;
   QueryWindow query_window_;
   QueryParser query_parser_;
-  std::shared_ptr<QueryManager> query_manager_;
 };
 
 } // namespace model
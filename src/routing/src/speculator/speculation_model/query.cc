@@ -1,9 +1,16 @@
 #include "query.h"
+#include "sql_templatizer.h"
 
 #include <fstream>
 
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
 namespace model {
 
+static const char *kPlaceholder = "?v";
+
 static std::string &Replace(std::string& str, const std::string& from, const std::string& to) {
   size_t start_pos = str.find(from);
   if (start_pos != std::string::npos) {
@@ -12,16 +19,77 @@ static std::string &Replace(std::string& str, const std::string& from, const std
   return str;
 }
 
-void QueryManager::Load(const std::string &path) {
+// As a client would write it, so that a predicted query matches the one
+// sent; empty if it cannot be written.
+static std::string NumberLiteral(double value) {
+  char buffer[32];
+  if (std::trunc(value) == value && std::fabs(value) < 1e15) {
+    snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+  } else {
+    snprintf(buffer, sizeof(buffer), "%.15g", value);
+  }
+  return buffer;
+}
+
+static std::string StringLiteral(const std::string &value) {
+  // Templates take strings without escapes, so neither can this.
+  if (value.find_first_of("'\\") != std::string::npos) {
+    return "";
+  }
+  return "'" + value + "'";
+}
+
+static std::string Literal(const SqlValue &value) {
+  std::string items;
+  switch (value.type()) {
+  case SqlValue::kBool:
+    return boost::get<Bool>(value) ? "1" : "0";
+  case SqlValue::kInt:
+    return std::to_string(boost::get<Int>(value));
+  case SqlValue::kDouble:
+    return NumberLiteral(boost::get<Double>(value).value());
+  case SqlValue::kString:
+    return StringLiteral(boost::get<String>(value));
+  case SqlValue::kIntList:
+    for (auto item : boost::get<IntList>(value)) {
+      items += (items.empty() ? "" : ", ") + std::to_string(item);
+    }
+    break;
+  case SqlValue::kDoubleList:
+    for (auto &item : boost::get<DoubleList>(value)) {
+      items += (items.empty() ? "" : ", ") + NumberLiteral(item.value());
+    }
+    break;
+  case SqlValue::kStringList:
+    for (auto &item : boost::get<StringList>(value)) {
+      auto literal = StringLiteral(item);
+      if (literal.empty()) {
+        return "";
+      }
+      items += (items.empty() ? "" : ", ") + literal;
+    }
+    break;
+  default:
+    return "";
+  }
+  // A list stands for the whole IN, see SqlTemplatizer.
+  return items.empty() ? "" : "IN (" + items + ")";
+}
+
+bool QueryManager::Load(const std::string &path) {
   std::ifstream in_file(path);
-  while (!in_file.eof()) {
-    int query_id = 0;
+  if (!in_file) {
+    return false;
+  }
+  int query_id = 0;
+  while (in_file >> query_id) {
     std::string sql_template;
-    in_file >> query_id;
-    std::getline(in_file, sql_template);
+    std::getline(in_file >> std::ws, sql_template);
     id_to_template_[query_id] = sql_template;
     template_to_id_[sql_template] = query_id;
+    hash_to_id_[SqlTemplatizer::Hash(sql_template)] = query_id;
   }
+  return true;
 }
 
 int QueryManager::GetIdForTemplate(const std::string &query_template) {
@@ -31,9 +99,33 @@ int QueryManager::GetIdForTemplate(const std::string &query_template) {
   }
   int id = static_cast<int>(template_to_id_.size());
   template_to_id_[query_template] = id;
+  id_to_template_[id] = query_template;
+  hash_to_id_[SqlTemplatizer::Hash(query_template)] = id;
   return id;
 }
 
+int QueryManager::GetIdForTemplate(const std::string &query_template, uint64_t hash) {
+  auto iter = hash_to_id_.find(hash);
+  if (iter != hash_to_id_.end() && id_to_template_[iter->second] == query_template) {
+    return iter->second;
+  }
+  return GetIdForTemplate(query_template);
+}
+
+int QueryManager::FindIdForTemplate(const std::string &query_template, uint64_t hash) const {
+  auto iter = hash_to_id_.find(hash);
+  if (iter != hash_to_id_.end() && id_to_template_.at(iter->second) == query_template) {
+    return iter->second;
+  }
+  auto template_iter = template_to_id_.find(query_template);
+  return template_iter == template_to_id_.end() ? -1 : template_iter->second;
+}
+
+const std::string *QueryManager::FindTemplateForId(int query_id) const {
+  auto iter = id_to_template_.find(query_id);
+  return iter == id_to_template_.end() ? nullptr : &iter->second;
+}
+
 Query::Query() : query_id_(-1) {}
 
 Query::Query(int query_id, std::vector<SqlValue> &&arguments,
@@ -44,7 +136,26 @@ Query::Query(int query_id, std::vector<SqlValue> &&arguments,
 std::string Query::ToSql() const {
   std::string sql = QueryManager::GetInstance().GetTemplateForId(query_id_);
   for (auto &arg : arguments_) {
-    Replace(sql, "%v", arg.ToString());
+    Replace(sql, kPlaceholder, arg.ToString());
+  }
+  return sql;
+}
+
+std::string Query::ToSql(const QueryManager &manager) const {
+  auto sql_template = manager.FindTemplateForId(query_id_);
+  if (sql_template == nullptr) {
+    return "";
+  }
+  std::string sql = *sql_template;
+  size_t pos = 0;
+  for (auto &arg : arguments_) {
+    auto literal = Literal(arg);
+    pos = sql.find(kPlaceholder, pos);
+    if (literal.empty() || pos == std::string::npos) {
+      return "";
+    }
+    sql.replace(pos, strlen(kPlaceholder), literal);
+    pos += literal.size();
   }
   return sql;
 }
@@ -4,6 +4,8 @@
 #include "value.h"
 
 #include <unordered_map>
+
+#include <cstdint>
 #include <vector>
 
 namespace model {
@@ -14,15 +16,23 @@ public:
     static QueryManager manager;
     return manager;
   }
-  void Load(const std::string &path);
+  // One "<id> <template>" per line. Returns false if path cannot be read.
+  bool Load(const std::string &path);
   int GetIdForTemplate(const std::string &query_template);
+  // Looks the template up by its SqlTemplatizer hash first.
+  int GetIdForTemplate(const std::string &query_template, uint64_t hash);
+  // Without adding the template; -1 if it is unknown.
+  int FindIdForTemplate(const std::string &query_template, uint64_t hash) const;
   std::string GetTemplateForId(int query_id) const {
     return id_to_template_.at(query_id);
   }
+  // nullptr if query_id is unknown.
+  const std::string *FindTemplateForId(int query_id) const;
 
 private:
   std::unordered_map<int, std::string> id_to_template_;
   std::unordered_map<std::string, int> template_to_id_;
+  std::unordered_map<uint64_t, int> hash_to_id_;
 };
 
 class Query {
@@ -32,6 +42,9 @@ public:
     std::vector<std::vector<SqlValue>> &&result_set);
 
   std::string ToSql() const;
+  // Empty if the template is unknown or an argument cannot be written
+  // as a literal.
+  std::string ToSql(const QueryManager &manager) const;
 
   bool operator==(const Query &other) const;
 
@@ -2,9 +2,7 @@
 #define BASIC_QUERY_PARSER_H_
 
 #include "query.h"
-
-#include <fstream>
-#include <boost/regex.hpp>
+#include "sql_templatizer.h"
 
 namespace model {
 
@@ -13,17 +11,7 @@ public:
   Query ParseQuery(const std::string &json);
 
 private:
-  std::vector<std::string> RegexFindAll(const boost::regex &regex, std::string str);
-  SqlValue CreateListValue(const std::vector<std::string> &values);
-  std::vector<SqlValue> ConvertArguments(const std::vector<std::string> &args);
-  std::string ExtractTemplate(const std::string &sql);
-
-  static boost::regex argument_pattern_;
-  static boost::regex num_str_pattern_;
-  static boost::regex string_pattern_;
-  static boost::regex number_pattern_;
-  static boost::regex str_list_pattern_;
-  static boost::regex num_list_pattern_;
+  SqlTemplatizer templatizer_;
 };
 
 
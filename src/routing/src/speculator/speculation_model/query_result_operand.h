@@ -5,8 +5,6 @@
 
 #include <sstream>
 
-#include <cassert>
-
 namespace model {
 
 class QueryResultOperand : public Operand {
@@ -20,13 +18,21 @@ public:
   }
 
   virtual SqlValue GetValue(const Window<Query> &trx) const {
-    assert(query_index_ < trx.Size());
+    // Live history need not follow the model, and the result may not be
+    // in yet; what is not there predicts nothing.
+    if (static_cast<size_t>(query_index_) >= trx.Size()) {
+      return SqlValue();
+    }
     auto &query = trx[query_index_];
-    assert(query_id_ == query.query_id());
-    if (static_cast<size_t>(row_index_) >= query.result_set().size()) {
+    if (query_id_ != query.query_id() ||
+        static_cast<size_t>(row_index_) >= query.result_set().size()) {
+      return SqlValue();
+    }
+    auto &row = query.result_set()[row_index_];
+    if (static_cast<size_t>(column_index_) >= row.size()) {
       return SqlValue();
     }
-    return query.result_set()[row_index_][column_index_];
+    return row[column_index_];
   }
 
   virtual std::string ToString() const {
@@ -5,12 +5,28 @@
 
 #include <array>
 
+#include <cstdint>
+
 namespace model {
 
 static const int kLookBackLen = 7;
 
 using QueryPath = std::array<int, kLookBackLen>;
 
+// Every id is mixed in on its own, so that permutations of a path, which
+// are common, hash apart.
+inline uint64_t HashPath(const QueryPath &path, int vertex = 0) {
+  uint64_t hash = (static_cast<uint32_t>(vertex) ^ 0x9e3779b97f4a7c15ULL) * 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 32;
+  for (int id : path) {
+    hash = (hash ^ static_cast<uint32_t>(id)) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 32;
+  }
+  hash ^= hash >> 29;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  return hash ^ (hash >> 32);
+}
+
 class QueryWindow : public Window<int> {
 public:
   QueryWindow();
@@ -22,11 +38,7 @@ public:
 namespace std {
   template<> struct hash<model::QueryPath> {
     size_t operator()(const model::QueryPath &path) const {
-      size_t hash_val = 0;
-      for (int i = 0; i < model::kLookBackLen; i++) {
-        hash_val = hash_val ^ path[i];
-      }
-      return hash_val;
+      return static_cast<size_t>(model::HashPath(path));
     }
   };
 }
@@ -0,0 +1,225 @@
+#include "sql_templatizer.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace model {
+
+namespace {
+
+const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+const char *kPlaceholder = "?v";
+const char *kListStart = "IN (";
+const size_t kMaxNumberLen = 64;
+
+bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool IsWordChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsSpace(char c) {
+  return isspace(static_cast<unsigned char>(c));
+}
+
+bool StartsWith(std::string_view sql, size_t pos, const char *prefix) {
+  return sql.compare(pos, strlen(prefix), prefix) == 0;
+}
+
+bool EndsWith(std::string_view sql, size_t pos, const char *suffix) {
+  size_t len = strlen(suffix);
+  return pos >= len && sql.compare(pos - len, len, suffix) == 0;
+}
+
+// Whether the value at pos is a LIMIT or OFFSET count.
+bool IsExcluded(std::string_view sql, size_t pos) {
+  return EndsWith(sql, pos, "LIMIT ") || EndsWith(sql, pos, "OFFSET ");
+}
+
+// Past the closing quote of the string at begin; npos if it is unclosed.
+size_t StringEnd(std::string_view sql, size_t begin) {
+  size_t close = sql.find('\'', begin + 1);
+  return close == std::string_view::npos ? close : close + 1;
+}
+
+// Past the number at begin, which has a word boundary before it; npos if
+// its digits run into a word character. A fraction only counts if a
+// word boundary follows it.
+size_t NumberEnd(std::string_view sql, size_t begin) {
+  size_t end = begin;
+  while (end < sql.size() && IsDigit(sql[end])) {
+    end++;
+  }
+  size_t integer_end = end;
+  if (end + 1 < sql.size() && sql[end] == '.' && IsDigit(sql[end + 1])) {
+    end += 2;
+    while (end < sql.size() && IsDigit(sql[end])) {
+      end++;
+    }
+    if (end == sql.size() || !IsWordChar(sql[end])) {
+      return end;
+    }
+  }
+  if (integer_end == sql.size() || !IsWordChar(sql[integer_end])) {
+    return integer_end;
+  }
+  return std::string_view::npos;
+}
+
+double ToDouble(std::string_view number) {
+  char buffer[kMaxNumberLen + 1];
+  if (number.size() > kMaxNumberLen) {
+    return ::atof(std::string(number).c_str());
+  }
+  memcpy(buffer, number.data(), number.size());
+  buffer[number.size()] = '\0';
+  return ::atof(buffer);
+}
+
+std::string_view Trim(std::string_view sql) {
+  size_t begin = 0;
+  size_t end = sql.size();
+  while (begin < end && IsSpace(sql[begin])) {
+    begin++;
+  }
+  while (end > begin && IsSpace(sql[end - 1])) {
+    end--;
+  }
+  return sql.substr(begin, end - begin);
+}
+
+} // namespace
+
+uint64_t SqlTemplatizer::Hash(std::string_view sql_template) {
+  uint64_t hash = kFnvOffsetBasis;
+  for (auto c : sql_template) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * kFnvPrime;
+  }
+  return hash;
+}
+
+void SqlTemplatizer::Append(char c) {
+  template_.push_back(c);
+  hash_ = (hash_ ^ static_cast<uint8_t>(c)) * kFnvPrime;
+}
+
+void SqlTemplatizer::Append(std::string_view str) {
+  for (auto c : str) {
+    Append(c);
+  }
+}
+
+void SqlTemplatizer::Templatize(std::string_view sql, std::vector<SqlValue> *arguments) {
+  sql = Trim(sql);
+  template_.clear();
+  hash_ = kFnvOffsetBasis;
+  size_t pos = 0;
+  while (pos < sql.size()) {
+    char c = sql[pos];
+    if (c == 'I' && StartsWith(sql, pos, kListStart)) {
+      size_t end = ScanList(sql, pos, arguments);
+      if (end != pos) {
+        pos = end;
+        continue;
+      }
+    } else if (c == '\'') {
+      size_t end = StringEnd(sql, pos);
+      if (end != std::string_view::npos) {
+        if (!IsExcluded(sql, pos)) {
+          arguments->emplace_back(std::string(sql.substr(pos + 1, end - pos - 2)));
+        }
+        Append(kPlaceholder);
+        pos = end;
+        continue;
+      }
+    } else if (IsDigit(c) && (template_.empty() || !IsWordChar(template_.back()))) {
+      size_t end = NumberEnd(sql, pos);
+      if (end != std::string_view::npos) {
+        if (!IsExcluded(sql, pos)) {
+          arguments->emplace_back(Double(ToDouble(sql.substr(pos, end - pos))));
+        }
+        Append(kPlaceholder);
+        pos = end;
+        continue;
+      }
+    }
+    Append(c);
+    pos++;
+  }
+}
+
+size_t SqlTemplatizer::ScanList(std::string_view sql, size_t begin,
+                                std::vector<SqlValue> *arguments) {
+  size_t content = begin + strlen(kListStart);
+  // Strings hide any ')' in them; an unclosed one leaves a quote in the
+  // template, which no list may hold.
+  size_t end = content;
+  while (end < sql.size() && sql[end] != ')') {
+    if (sql[end] == '\'') {
+      end = StringEnd(sql, end);
+      if (end == std::string_view::npos) {
+        return begin;
+      }
+    } else {
+      end++;
+    }
+  }
+  if (end == sql.size() || end == content) {
+    return begin;
+  }
+
+  StringList strings;
+  DoubleList numbers;
+  bool is_string_list = false;
+  bool empty = true;
+  // The character before pos once strings are replaced, for the word
+  // boundary before a number.
+  char previous = '(';
+  size_t pos = content;
+  while (pos < end) {
+    if (sql[pos] == '\'') {
+      size_t string_end = StringEnd(sql, pos);
+      if (empty) {
+        is_string_list = true;
+        empty = false;
+      }
+      if (is_string_list) {
+        strings.emplace(sql.substr(pos + 1, string_end - pos - 2));
+      }
+      previous = 'v';
+      pos = string_end;
+      continue;
+    }
+    if (IsDigit(sql[pos]) && !IsWordChar(previous)) {
+      size_t number_end = NumberEnd(sql, pos);
+      if (number_end != std::string_view::npos) {
+        empty = false;
+        if (!is_string_list) {
+          numbers.insert(Double(ToDouble(sql.substr(pos, number_end - pos))));
+        }
+        previous = 'v';
+        pos = number_end;
+        continue;
+      }
+    }
+    previous = sql[pos];
+    pos++;
+  }
+  if (!IsExcluded(sql, begin)) {
+    if (empty) {
+      arguments->emplace_back();
+    } else if (is_string_list) {
+      arguments->emplace_back(std::move(strings));
+    } else {
+      arguments->emplace_back(std::move(numbers));
+    }
+  }
+  Append(kPlaceholder);
+  return end + 1;
+}
+
+} // namespace model
@@ -0,0 +1,53 @@
+#ifndef BASIC_SQL_TEMPLATIZER_H_
+#define BASIC_SQL_TEMPLATIZER_H_
+
+#include "value.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cstdint>
+
+namespace model {
+
+// Splits a query into its template and its arguments in a single scan.
+//
+// String literals, numbers and IN lists become "?v" in the template, as
+// the regular expressions QueryParser used did: strings are '...' without
+// escapes, a number is digits with an optional fraction between word
+// boundaries, and "IN (" up to the first ')' outside a string is one
+// list. Arguments are typed: a String, a Double,
+// or a StringList or DoubleList after the type of the list's first item.
+// Values right after "LIMIT " or "OFFSET " stay out of the arguments.
+//
+// The template buffer is reused across calls, so scanning allocates
+// nothing but the argument values.
+class SqlTemplatizer {
+public:
+  // FNV-1a of a template, as hash() returns it.
+  static uint64_t Hash(std::string_view sql_template);
+
+  void Templatize(std::string_view sql, std::vector<SqlValue> *arguments);
+
+  const std::string &sql_template() const {
+    return template_;
+  }
+  uint64_t hash() const {
+    return hash_;
+  }
+
+private:
+  void Append(char c);
+  void Append(std::string_view str);
+  // Scans an IN list starting at "IN (", returning the position past its
+  // ')', or begin if it is not a list.
+  size_t ScanList(std::string_view sql, size_t begin, std::vector<SqlValue> *arguments);
+
+  std::string template_;
+  uint64_t hash_;
+};
+
+} // namespace model
+
+#endif // BASIC_SQL_TEMPLATIZER_H_
@@ -99,13 +99,15 @@ std::string SqlValue::ToString() const {
 }
 
 bool SqlValue::operator==(const SqlValue &other) const {
+  const BoostVariant &self = *this;
   const BoostVariant &other_variant = other;
-  return *this == other_variant;
+  return self == other_variant;
 }
 
 bool SqlValue::operator<(const SqlValue &other) const {
+  const BoostVariant &self = *this;
   const BoostVariant &other_variant = other;
-  return *this < other_variant;
+  return self < other_variant;
 }
 
 std::ostream &operator<<(std::ostream &out, const SqlValue &value) {
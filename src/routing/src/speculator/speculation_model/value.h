@@ -10,6 +10,13 @@ namespace model {
 
 struct Null{};
 
+inline bool operator==(const Null &, const Null &) {
+  return true;
+}
+inline bool operator<(const Null &, const Null &) {
+  return false;
+}
+
 class Double {
 public:
   Double();
@@ -29,6 +36,9 @@ public:
   std::string ToString() const {
     return std::to_string(value_);
   }
+  double value() const {
+    return value_;
+  }
 
 private:
   double value_;
@@ -14,6 +14,10 @@ public:
   Window(std::size_t size);
   virtual void Add(T &&val);
   virtual void Add(const T &val);
+  // Add() that returns the element it replaced, for Restore() to undo it.
+  T Exchange(T &&val);
+  // Undoes the last Exchange().
+  void Restore(T &&replaced);
 
   virtual std::size_t CumulativeSize() const {
     return cumulative_size_;
@@ -23,6 +27,7 @@ public:
     return std::min(size_, cumulative_size_);
   }
 
+  // The index-th most recent element, 0 being the last one added.
   T &operator[](std::size_t index);
   const T &operator[](std::size_t index) const;
 
@@ -58,16 +63,35 @@ void Window<T>::Add(const T &val) {
   elements_.get()[current_index_] = val;
 }
 
+template<typename T>
+T Window<T>::Exchange(T &&val) {
+  if (elements_.get() == nullptr) {
+    elements_.reset(new T[size_]);
+  }
+  cumulative_size_++;
+  current_index_ = (current_index_ + 1) % size_;
+  T replaced = std::move(elements_.get()[current_index_]);
+  elements_.get()[current_index_] = std::move(val);
+  return replaced;
+}
+
+template<typename T>
+void Window<T>::Restore(T &&replaced) {
+  elements_.get()[current_index_] = std::move(replaced);
+  current_index_ = (current_index_ + size_ - 1) % size_;
+  cumulative_size_--;
+}
+
 template<typename T>
 T &Window<T>::operator[](std::size_t index) {
-  index = (index + current_index_) % size_;
-  return elements_.get()[current_index_];
+  index = (current_index_ + size_ - index % size_) % size_;
+  return elements_.get()[index];
 }
 
 template<typename T>
 const T &Window<T>::operator[](std::size_t index) const {
-  index = (index + current_index_) % size_;
-  return elements_.get()[current_index_];
+  index = (current_index_ + size_ - index % size_) % size_;
+  return elements_.get()[index];
 }
 
 } // namespace model
@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 
+#include <cstddef>
+#include <cstdint>
+
 class Speculator {
 public:
   virtual ~Speculator() {}
@@ -13,9 +16,18 @@ public:
   virtual void SetQueryIndex(int query_index) = 0;
   virtual void BackupFor(const std::string &query) = 0;
   virtual std::string GetUndo() = 0;
+  // Statement to send ahead of the write speculation last passed to
+  // BackupFor(), in the same request, for GetUndo() to work; may be empty.
+  virtual std::string GetSavepoint() = 0;
   virtual std::vector<std::string> Speculate(const std::string &query) = 0;
   virtual std::vector<std::string> Speculate(const std::string &query, int num_speculations) = 0;
   virtual std::vector<std::string> TrySpeculate(const std::string &query, int num_speculations) = 0;
+  // The result the client got for the query last passed to CheckBegin(),
+  // for speculators that predict from results.
+  virtual void OnResult(const uint8_t * /* result */, size_t /* size */) {}
+  // Called once the session's servers are authenticated, before its
+  // first query, while they are idle.
+  virtual void Prepare() {}
 };
 
 #endif // SPECULATOR_SPECULATOR_H_
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "trace_store.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::shared_ptr<const TraceStore> TraceStore::Get(const std::string &path) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const TraceStore>> stores;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto iter = stores.find(path);
+  if (iter != stores.end()) {
+    return iter->second;
+  }
+  std::shared_ptr<TraceStore> store(new TraceStore(path));
+  if (!store->Map()) {
+    return nullptr;
+  }
+  log_info("Loaded %lu queries from trace %s", store->Size(), path.c_str());
+  stores[path] = store;
+  return store;
+}
+
+TraceStore::TraceStore(const std::string &path) :
+    path_(path), data_(nullptr), size_(0) {}
+
+TraceStore::~TraceStore() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+bool TraceStore::Map() {
+  int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    log_error("Failed to open trace %s: %s", path_.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    log_error("Failed to stat trace %s: %s", path_.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ == 0) {
+    close(fd);
+    return true;
+  }
+  void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    log_error("Failed to map trace %s: %s", path_.c_str(), strerror(errno));
+    size_ = 0;
+    return false;
+  }
+  data_ = reinterpret_cast<const char *>(data);
+  madvise(data, size_, MADV_WILLNEED);
+
+  size_t start = 0;
+  while (start < size_) {
+    line_starts_.push_back(start);
+    auto newline = reinterpret_cast<const char *>(memchr(data_ + start, '\n', size_ - start));
+    if (newline == nullptr) {
+      break;
+    }
+    start = static_cast<size_t>(newline - data_) + 1;
+  }
+  return true;
+}
+
+std::string_view TraceStore::Query(size_t index) const {
+  size_t start = line_starts_[index];
+  size_t end = index + 1 < line_starts_.size() ? line_starts_[index + 1] - 1 : size_;
+  if (end > start && data_[end - 1] == '\n') {
+    end--;
+  }
+  return std::string_view(data_ + start, end - start);
+}
@@ -0,0 +1,40 @@
+#ifndef SPECULATOR_TRACE_STORE_H_
+#define SPECULATOR_TRACE_STORE_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// An immutable query trace, one query per line, memory-mapped once per
+// process and shared by every session. Sessions only keep a cursor into
+// it (see LogSpeculator).
+class TraceStore {
+public:
+  // Returns the store for path, mapping the file on first use. Returns
+  // nullptr if the file cannot be mapped.
+  static std::shared_ptr<const TraceStore> Get(const std::string &path);
+
+  TraceStore(const TraceStore &other) = delete;
+  TraceStore &operator=(const TraceStore &other) = delete;
+  ~TraceStore();
+
+  size_t Size() const {
+    return line_starts_.size();
+  }
+  std::string_view Query(size_t index) const;
+  const std::string &path() const {
+    return path_;
+  }
+
+private:
+  explicit TraceStore(const std::string &path);
+  bool Map();
+
+  std::string path_;
+  const char *data_;
+  size_t size_;
+  std::vector<size_t> line_starts_;
+};
+
+#endif // SPECULATOR_TRACE_STORE_H_
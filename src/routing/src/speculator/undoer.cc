@@ -1,29 +1,22 @@
 #include "undoer.h"
-#include "mysqlrouter/mysql_constant.h"
 #include "logger.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include <cctype>
 #include <cstdint>
 #include <cstring>
+#include <strings.h>
 
 namespace {
 
-struct Packet {
-  uint8_t *payload;
-  size_t size;
-
-  Packet() : payload(nullptr), size(0) {}
-
-  bool IsEof() {
-    return payload != nullptr && *payload == 0xfe && size < 8;
-  }
-};
+const char *kDdlKeywords[] = {"CREATE", "ALTER", "DROP", "RENAME"};
+const char *kOnDuplicateKeyUpdate = " ON DUPLICATE KEY UPDATE ";
 
 size_t NameLen(const std::string &query, size_t start) {
   size_t end = start;
-  while (!isspace(query[end]) && query[end] != '(') {
+  while (end < query.size() && !isspace(query[end]) && query[end] != '(' && query[end] != '=') {
     end++;
   }
   return end - start;
@@ -34,6 +27,30 @@ std::string ExtractTableName(const std::string &query, const std::string &prefix
   return query.substr(table_start, NameLen(query, table_start));
 }
 
+std::string Unquote(const std::string &name) {
+  std::string unquoted;
+  for (auto c : name) {
+    if (c != '`') {
+      unquoted.push_back(c);
+    }
+  }
+  return unquoted;
+}
+
+bool SameName(const std::string &a, const std::string &b) {
+  return strcasecmp(Unquote(a).c_str(), Unquote(b).c_str()) == 0;
+}
+
+// Index of column in columns, or -1.
+int FindColumn(const std::vector<std::string> &columns, const std::string &column) {
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (SameName(columns[i], column)) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
 size_t TokenLen(const std::string &query, size_t start, size_t tokens_end) {
   size_t end = start;
   while (end < tokens_end && query[end] != ',') {
@@ -74,55 +91,9 @@ std::vector<std::string> ExtractInsertValues(const std::string &query) {
   return std::move(values);
 }
 
-uint8_t *ReadNextPacket(uint8_t *data, Packet &packet) {
-  packet.payload = data + kMySQLHeaderLen;
-  packet.size = mysql_get_byte3(data);
-  return data + kMySQLHeaderLen + packet.size;
-}
-
-uint64_t ReadNByteInt(uint8_t *bytes, int num_bytes) {
-  uint64_t num = 0;
-  for (int i = 0; i < num_bytes; i++) {
-    num = (num << 8) + bytes[i];
-  }
-  return num;
-}
-
-uint8_t *ReadLengthEncodedInt(uint8_t *payload, uint64_t &num) {
-  auto first_byte = *payload;
-  payload++;
-  int size_size = 0;
-  if (first_byte < 0xfb) {
-    payload--;
-    size_size = 1;
-  } else if (first_byte == 0xfc) {
-    size_size = 2;
-  } else if (first_byte == 0xfd) {
-    size_size = 3;
-  } else if (first_byte == 0xfe) {
-    size_size = 4;
-  }
-  num = ReadNByteInt(payload, size_size);
-  return payload + size_size;
-}
-
-uint8_t *ReadLengthEncodedString(uint8_t *payload, std::string &str) {
-  uint64_t size;
-  payload = ReadLengthEncodedInt(payload, size);
-  str = std::string(reinterpret_cast<char *>(payload), size);
-  return payload + size;
-}
-
-uint8_t *GetFieldCount(uint8_t *payload, uint64_t field_count) {
-  Packet packet;
-  payload = ReadNextPacket(payload, packet);
-  ReadLengthEncodedInt(packet.payload, field_count);
-  return payload;
-}
-
-size_t NextColumnStart(const std::string &query, size_t cursor, size_t where_start) {
+size_t NextColumnStart(const std::string &query, size_t cursor, size_t end) {
   while (query[cursor] != ',') {
-    if (cursor >= where_start) {
+    if (cursor >= end) {
       return std::string::npos;
     }
     cursor++;
@@ -134,131 +105,279 @@ size_t NextColumnStart(const std::string &query, size_t cursor, size_t where_sta
   return cursor;
 }
 
-std::vector<std::string> ExtractUpdateColumns(const std::string &query) {
-  auto column_start = query.find(" SET ") + 5;
-  auto where_start = query.find(" WHERE ");
+// Columns assigned in "col = expr, ..." from start up to end.
+std::vector<std::string> ExtractAssignedColumns(const std::string &query, size_t start,
+                                                size_t end) {
+  end = std::min(end, query.size());
   std::vector<std::string> columns;
+  auto column_start = start;
   while (column_start != std::string::npos) {
     auto column_len = NameLen(query, column_start);
     columns.push_back(query.substr(column_start, column_len));
-    column_start = NextColumnStart(query, column_start + column_len, where_start);
+    column_start = NextColumnStart(query, column_start + column_len, end);
   }
   return std::move(columns);
 }
 
+std::vector<std::string> ExtractUpdateColumns(const std::string &query) {
+  return ExtractAssignedColumns(query, query.find(" SET ") + 5, query.find(" WHERE "));
+}
+
+std::vector<std::string> ExtractUpsertColumns(const std::string &query) {
+  return ExtractAssignedColumns(query, query.find(kOnDuplicateKeyUpdate) +
+                                strlen(kOnDuplicateKeyUpdate), std::string::npos);
+}
+
+bool IsUpsert(const std::string &query) {
+  return strncmp(query.c_str(), "INSERT", 6) == 0 &&
+         query.find(kOnDuplicateKeyUpdate) != std::string::npos;
+}
+
 } // namespace
 
-Undoer::Undoer(ServerGroup *server_group) : server_group_(server_group) {}
+Undoer::Undoer(ServerGroup *server_group, SchemaCatalog *catalog) :
+    server_group_(server_group), catalog_(catalog), capturing_(false), capture_request_(0),
+    built_(true) {}
 
-std::string Undoer::GetUndoQuery(const std::string &query) {
-  log_debug("Generating undo for query %s", query.c_str());
-  if (strncmp(query.c_str(), "INSERT", 6) == 0) {
-    return GetInsertUndo(query);
-  } else if (strncmp(query.c_str(), "UPDATE", 6) == 0) {
-    return GetUpdateUndo(query);
+void Undoer::Observe(const std::string &query) {
+  if (catalog_ == nullptr) {
+    return;
+  }
+  for (auto keyword : kDdlKeywords) {
+    size_t length = strlen(keyword);
+    if (strncasecmp(query.c_str(), keyword, length) != 0) {
+      continue;
+    }
+    // Temporary tables are not in information_schema.STATISTICS.
+    size_t next = query.find_first_not_of(" \t\n", length);
+    if (next == std::string::npos || strncasecmp(query.c_str() + next, "TEMPORARY", 9) != 0) {
+      catalog_->Invalidate();
+    }
+    return;
   }
-  return "";
 }
 
-std::string Undoer::GetInsertUndo(const std::string &query) {
-  log_debug("Generating undo query for insert");
-  if (query.find("ON DUPLICATE") != std::string::npos) {
-    auto values = ::ExtractInsertValues(query);
-    return "UPDATE `keystores` SET `value` = `value` - 1 WHERE `key` = " + values[0];
+void Undoer::Prepare() {
+  if (catalog_ != nullptr) {
+    catalog_->Refresh(server_group_);
   }
-  auto table_name = ::ExtractTableName(query, "INSERT INTO ");
-  auto columns = ::ExtractInsertColumns(query);
-  auto values = ::ExtractInsertValues(query);
-  std::stringstream ss;
-  ss << "DELETE FROM " << table_name << " WHERE " << columns[0] << '=' << values[0];
-  for (size_t i = 1; i < columns.size(); i++) {
-    auto &column = columns[i];
-    auto &val = values[i];
-    ss << " AND " << column << '=' << val;
+}
+
+void Undoer::Capture(const std::string &query) {
+  Clear();
+  query_ = query;
+  built_ = false;
+  std::string select;
+  if (strncmp(query.c_str(), "UPDATE", 6) == 0) {
+    select = GetSelectFromUpdate(query);
+  } else if (IsUpsert(query)) {
+    select = GetSelectFromUpsert(query);
+  }
+  if (select.size() == 0) {
+    return;
+  }
+  log_debug("Pre-image select is %s", select.c_str());
+  if (!server_group_->SendQuery(0, select, 1, true)) {
+    log_error("Error sending pre-image select");
+    built_ = true;
+    return;
+  }
+  capturing_ = true;
+  capture_request_ = server_group_->LastRequest(0);
+}
+
+void Undoer::Clear() {
+  if (capturing_) {
+    server_group_->Discard(0, capture_request_);
+    capturing_ = false;
+  }
+  query_.clear();
+  keys_.clear();
+  key_where_.clear();
+  undo_.clear();
+  built_ = true;
+}
+
+std::string Undoer::GetUndoQuery() {
+  if (built_) {
+    return undo_;
+  }
+  built_ = true;
+  log_debug("Generating undo for query %s", query_.c_str());
+  bool is_update = strncmp(query_.c_str(), "UPDATE", 6) == 0;
+  if (is_update || IsUpsert(query_)) {
+    std::vector<ResultRow> rows;
+    if (ReadPreImage(&rows)) {
+      undo_ = is_update ? GetUpdateUndo(query_, rows) : GetUpsertUndo(query_, rows);
+    }
+  } else if (strncmp(query_.c_str(), "INSERT", 6) == 0) {
+    undo_ = GetInsertUndo(query_);
   }
-  auto undo_query = ss.str();
-  log_debug("Undo is %s", undo_query.c_str());
-  return undo_query;
+  log_debug("Undo is %s", undo_.c_str());
+  return undo_;
 }
 
-// Get a select or new update query from an update
-std::string Undoer::GetQueryFromUpdate(
-  const std::string &query,
-  const std::vector<std::string> &values) {
+std::shared_ptr<const std::vector<std::string>> Undoer::KeyColumns(const std::string &table) {
+  if (catalog_ == nullptr) {
+    return nullptr;
+  }
+  auto name = Unquote(table);
+  auto dot = name.find('.');
+  if (dot == std::string::npos) {
+    return catalog_->KeyColumns(server_group_->Schema(), name);
+  }
+  return catalog_->KeyColumns(std::string_view(name).substr(0, dot),
+                              std::string_view(name).substr(dot + 1));
+}
+
+std::string Undoer::GetSelectFromUpdate(const std::string &query) {
   auto table_name = ::ExtractTableName(query, "UPDATE ");
   auto columns = ::ExtractUpdateColumns(query);
+  auto keys = KeyColumns(table_name);
+  bool updates_key = false;
+  for (size_t i = 0; keys != nullptr && i < keys->size(); i++) {
+    updates_key = updates_key || ::FindColumn(columns, (*keys)[i]) != -1;
+  }
+  // A row whose key changes is not found again by its old key.
+  if (keys != nullptr && !updates_key) {
+    keys_ = *keys;
+  }
   std::stringstream ss;
-  if (values.size() > 0) {
-    ss << "UPDATE " << table_name << " SET " << columns[0] << '=' << values[0];
-  } else {
-    ss << "SELECT " << columns[0];
+  ss << "SELECT ";
+  for (auto &key : keys_) {
+    ss << '`' << key << "`,";
   }
-
+  ss << columns[0];
   for (size_t i = 1; i < columns.size(); i++) {
-    auto column = columns[i];
-    if (values.size() > 0) {
-      ss << ',' << column << '=' << values[i];
-    } else {
-      ss << ',' << column;
-    }
+    ss << ',' << columns[i];
   }
   ss << " FROM " << table_name;
   auto where_index = query.find(" WHERE ");
-  if (where_index == std::string::npos) {
-    return ss.str();
+  if (where_index != std::string::npos) {
+    ss << query.substr(where_index);
   }
-  auto where_clause = query.substr(where_index, query.size() - where_index);
-  return ss.str() + where_clause;
+  return ss.str();
 }
 
-std::vector<std::string> Undoer::ParseResults(std::unique_ptr<uint8_t[]> result) {
-  Packet packet;
-  std::vector<std::string> values;
-  uint8_t *payload = result.get();
-  uint64_t field_count = 0;
-  payload = ::GetFieldCount(payload, field_count);
-  // The column definitions do not matter to us, so just consume them
-  for (uint64_t i = 0; i < field_count; i++) {
-    payload = ::ReadNextPacket(payload, packet);
-  }
-  payload = ::ReadNextPacket(payload, packet);
-  if (packet.IsEof()) {
-    return std::move(values);
-  }
-  std::string str;
-  uint8_t *cur = packet.payload;
-  for (uint64_t i = 0; i < field_count; i++) {
-    cur = ::ReadLengthEncodedString(cur, str);
-    values.push_back(str);
+std::string Undoer::GetSelectFromUpsert(const std::string &query) {
+  auto table_name = ::ExtractTableName(query, "INSERT INTO ");
+  auto keys = KeyColumns(table_name);
+  if (keys == nullptr) {
+    return "";
   }
-  return std::move(values);
+  auto insert_columns = ::ExtractInsertColumns(query);
+  auto values = ::ExtractInsertValues(query);
+  auto columns = ::ExtractUpsertColumns(query);
+  std::stringstream where;
+  where << " WHERE ";
+  for (size_t i = 0; i < keys->size(); i++) {
+    auto &key = (*keys)[i];
+    int index = ::FindColumn(insert_columns, key);
+    if (index == -1 || static_cast<size_t>(index) >= values.size() ||
+        ::FindColumn(columns, key) != -1) {
+      return "";
+    }
+    where << (i > 0 ? " AND `" : "`") << key << "`=" << values[index];
+  }
+  key_where_ = where.str();
+  std::stringstream ss;
+  ss << "SELECT " << columns[0];
+  for (size_t i = 1; i < columns.size(); i++) {
+    ss << ',' << columns[i];
+  }
+  ss << " FROM " << table_name << key_where_;
+  return ss.str();
 }
 
-std::string Undoer::GetSelectFromUpdate(
-  const std::string &query) {
-  std::vector<std::string> values;
-  return GetQueryFromUpdate(query, values);
+std::string Undoer::GetInsertUndo(const std::string &query) {
+  auto table_name = ::ExtractTableName(query, "INSERT INTO ");
+  auto columns = ::ExtractInsertColumns(query);
+  auto values = ::ExtractInsertValues(query);
+  if (columns.size() == 0 || columns.size() != values.size()) {
+    return "";
+  }
+  // The key alone if the insert sets all of it, else every column.
+  std::vector<int> matched;
+  auto keys = KeyColumns(table_name);
+  for (size_t i = 0; keys != nullptr && i < keys->size(); i++) {
+    int index = ::FindColumn(columns, (*keys)[i]);
+    if (index == -1) {
+      matched.clear();
+      break;
+    }
+    matched.push_back(index);
+  }
+  if (matched.size() == 0) {
+    for (size_t i = 0; i < columns.size(); i++) {
+      matched.push_back(static_cast<int>(i));
+    }
+  }
+  std::stringstream ss;
+  ss << "DELETE FROM " << table_name << " WHERE ";
+  for (size_t i = 0; i < matched.size(); i++) {
+    ss << (i > 0 ? " AND " : "") << columns[matched[i]] << '=' << values[matched[i]];
+  }
+  return ss.str();
 }
 
-std::string Undoer::GetUpdateUndo(
-  const std::string &query) {
-  log_debug("Generating undo query for update %s", query.c_str());
-  auto select = GetSelectFromUpdate(query);
-  log_debug("Select for update is %s", select.c_str());
-  int server = server_group_->GetAvailableServer();
-  if (!server_group_->SendQuery(server, select)) {
-    log_error("Error sending select for update");
+std::string Undoer::GetUpdateUndo(const std::string &query,
+                                  const std::vector<ResultRow> &rows) {
+  auto table_name = ::ExtractTableName(query, "UPDATE ");
+  auto columns = ::ExtractUpdateColumns(query);
+  // One statement cannot restore rows with different values.
+  if (rows.size() != 1 || rows[0].size() != keys_.size() + columns.size()) {
+    log_debug("Update changed %lu rows, no undo", rows.size());
     return "";
   }
-  server_group_->WaitForServer(server);
-  auto res = server_group_->GetResult(server);
-  auto res_packet = std::unique_ptr<uint8_t[]>(new uint8_t[res.second]);
-  memcpy(res_packet.get(), res.first, res.second);
-  auto values = ParseResults(std::move(res_packet));
-  if (values.size() == 0) {
+  auto &row = rows[0];
+  std::stringstream ss;
+  ss << "UPDATE " << table_name << " SET ";
+  for (size_t i = 0; i < columns.size(); i++) {
+    ss << (i > 0 ? "," : "") << columns[i] << '=' << SqlLiteral(row[keys_.size() + i]);
+  }
+  if (keys_.size() == 0) {
+    auto where_index = query.find(" WHERE ");
+    if (where_index != std::string::npos) {
+      ss << query.substr(where_index);
+    }
+    return ss.str();
+  }
+  ss << " WHERE ";
+  for (size_t i = 0; i < keys_.size(); i++) {
+    ss << (i > 0 ? " AND `" : "`") << keys_[i] << "`=" << SqlLiteral(row[i]);
+  }
+  return ss.str();
+}
+
+std::string Undoer::GetUpsertUndo(const std::string &query,
+                                  const std::vector<ResultRow> &rows) {
+  auto table_name = ::ExtractTableName(query, "INSERT INTO ");
+  if (rows.size() == 0) {
+    return "DELETE FROM " + table_name + key_where_;
+  }
+  auto columns = ::ExtractUpsertColumns(query);
+  if (rows[0].size() != columns.size()) {
     return "";
   }
-  auto undo = GetQueryFromUpdate(query, values);
-  log_debug("New update for the update is %s", undo.c_str());
-  return undo;
-}
\ No newline at end of file
+  std::stringstream ss;
+  ss << "UPDATE " << table_name << " SET ";
+  for (size_t i = 0; i < columns.size(); i++) {
+    ss << (i > 0 ? "," : "") << columns[i] << '=' << SqlLiteral(rows[0][i]);
+  }
+  ss << key_where_;
+  return ss.str();
+}
+
+bool Undoer::ReadPreImage(std::vector<ResultRow> *rows) {
+  if (!capturing_) {
+    return false;
+  }
+  capturing_ = false;
+  server_group_->WaitForResult(0, capture_request_);
+  auto res = server_group_->GetResult(0, capture_request_);
+  if (res.first == nullptr || !ParseResultSet(res.first, res.second, rows)) {
+    log_error("Error reading pre-image select");
+    return false;
+  }
+  return true;
+}
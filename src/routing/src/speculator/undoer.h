@@ -2,28 +2,59 @@
 #define SRC_SPECULATOR_UNDOER_H_
 
 #include "../server_group.h"
+#include "result_set.h"
+#include "schema_catalog.h"
 
+#include <cstdint>
+#include <string>
 #include <vector>
-#include <unordered_map>
 
+// Reverts write speculations with an inverse statement. The undo is only
+// built when a rollback asks for it; for an UPDATE or an upsert, the rows
+// it overwrites are read by a SELECT pipelined right ahead of it on
+// server 0. Rows are found again by the key columns the catalog knows
+// of; without a catalog or a key, an INSERT is undone by matching every
+// column and an UPDATE by its own WHERE clause.
 class Undoer {
 public:
-  Undoer(ServerGroup *server_group);
-  std::string GetUndoQuery(const std::string &query);
+  Undoer(ServerGroup *server_group, SchemaCatalog *catalog = nullptr);
+  // Sees every client query; DDL makes the catalog reload, unless it
+  // only touches temporary tables.
+  void Observe(const std::string &query);
+  // Loads the catalog if it is stale; the servers have to be idle.
+  void Prepare();
+  // Starts backing up query, which has to be the next request sent to
+  // server 0. Drops the previous backup.
+  void Capture(const std::string &query);
+  // Undo of the captured query, waiting for its pre-image if needed;
+  // empty if there is none.
+  std::string GetUndoQuery();
+  // Drops the backup.
+  void Clear();
 
 private:
-  static std::unordered_map<std::string, std::vector<std::string>> kTablePkeys;
-
   ServerGroup *server_group_;
+  SchemaCatalog *catalog_;
+  std::string query_;
+  // Key columns the pre-image of an UPDATE starts with, and the key
+  // condition of an upsert.
+  std::vector<std::string> keys_;
+  std::string key_where_;
+  // The pre-image SELECT on server 0, while its result is unclaimed.
+  bool capturing_;
+  uint64_t capture_request_;
+  bool built_;
+  std::string undo_;
 
-  std::string GetInsertUndo(const std::string &query);
-  // Get a select or new update query from an update
-  std::string GetQueryFromUpdate(
-    const std::string &query,
-    const std::vector<std::string> &values);
-  std::vector<std::string> ParseResults(std::unique_ptr<uint8_t[]> result);
+  // Key columns of the table, nullptr if unknown.
+  std::shared_ptr<const std::vector<std::string>> KeyColumns(const std::string &table);
+  // Empty if the rows cannot be read back.
   std::string GetSelectFromUpdate(const std::string &query);
-  std::string GetUpdateUndo(const std::string &query);
+  std::string GetSelectFromUpsert(const std::string &query);
+  std::string GetInsertUndo(const std::string &query);
+  std::string GetUpdateUndo(const std::string &query, const std::vector<ResultRow> &rows);
+  std::string GetUpsertUndo(const std::string &query, const std::vector<ResultRow> &rows);
+  bool ReadPreImage(std::vector<ResultRow> *rows);
 };
 
-#endif // SRC_SPECULATOR_UNDOER_H_
\ No newline at end of file
+#endif // SRC_SPECULATOR_UNDOER_H_
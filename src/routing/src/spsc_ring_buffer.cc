@@ -1,7 +1,13 @@
 #include "mysqlrouter/spsc_ring_buffer.h"
 
+#include <algorithm>
+#include <new>
+
 #include <cstring>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 template<typename T>
 static size_t ReadValue(char *buffer, size_t loc, T &value) {
   value = *(reinterpret_cast<T *>(buffer + loc));
@@ -20,19 +26,33 @@ static T min(T num1, T num2) {
 }
 
 SpscRingBuffer::SpscRingBuffer(size_t buf_size) :
-    error_(false), read_loc_(0), write_loc_(0),
-    buf_size_(buf_size), buffer_(new char[buf_size]) {}
+    error_(false), wait_policy_(WaitPolicy::Default()), notifier_(nullptr),
+    read_loc_(0), write_loc_(0), buf_size_(buf_size), buffer_(new char[buf_size]) {}
+
+void SpscRingBuffer::NotifyData() {
+  data_notifier_.Notify();
+  Notifier *notifier = notifier_.load();
+  if (notifier != nullptr) {
+    notifier->Notify();
+  }
+}
+
+void SpscRingBuffer::SignalError() {
+  error_ = true;
+  NotifyData();
+  space_notifier_.Notify();
+}
 
 ssize_t SpscRingBuffer::Read(void *buffer, ssize_t size) {
   ssize_t read_loc = 0;
   ssize_t write_loc = 0;
   ssize_t size_left = 0;
   ssize_t read_size = 0;
-  while (!HasData()) {
-    // Left empty.
-    if (error_) {
-      return -1;
-    }
+  WaitUntil(wait_policy_, &data_notifier_, [this] {
+    return HasData() || error_;
+  });
+  if (!HasData()) {
+    return -1;
   }
   read_loc = read_loc_.load();
   write_loc = write_loc_.load();
@@ -56,6 +76,7 @@ ssize_t SpscRingBuffer::Read(void *buffer, ssize_t size) {
       read_loc_ = read_loc + read_size;
     }
   }
+  space_notifier_.Notify();
   return (size_t) read_size;
 }
 
@@ -65,9 +86,9 @@ void SpscRingBuffer::Write(const char *data, size_t size) {
   if (size > buf_size_) {
     return;
   }
-  while (DataSize() + size > buf_size_) {
-    // Left empty.
-  }
+  WaitUntil(wait_policy_, &space_notifier_, [this, size] {
+    return DataSize() + size <= buf_size_;
+  });
   if ((ssize_t) size > size_left) {
     memcpy(buffer_.get() + write_loc, data, size_left);
     memcpy(buffer_.get(), data + size_left, size - size_left);
@@ -76,6 +97,7 @@ void SpscRingBuffer::Write(const char *data, size_t size) {
     memcpy(buffer_.get() + write_loc, data, size);
     write_loc_ = static_cast<ssize_t>(write_loc + size);
   }
+  NotifyData();
 }
 
 size_t SpscRingBuffer::DataSize() {
@@ -86,3 +108,125 @@ size_t SpscRingBuffer::DataSize() {
   }
   return write_loc - read_loc;
 }
+
+// Maps the capacity bytes of a memfd twice in a row.
+static char *MapMirrored(size_t capacity) {
+  int fd = memfd_create("spsc-record-buffer", MFD_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  char *base = nullptr;
+  if (ftruncate(fd, static_cast<off_t>(capacity)) == 0) {
+    void *addr = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr != MAP_FAILED) {
+      base = static_cast<char *>(addr);
+      for (char *half : {base, base + capacity}) {
+        if (mmap(half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+          munmap(base, 2 * capacity);
+          base = nullptr;
+          break;
+        }
+      }
+    }
+  }
+  close(fd);
+  return base;
+}
+
+SpscRecordBuffer::SpscRecordBuffer(size_t buf_size) :
+    head_(0), cached_tail_(0), peek_(0), record_(nullptr), record_size_(0), read_offset_(0),
+    tail_(0), cached_head_(0),
+    error_(false), wait_policy_(WaitPolicy::Default()), notifier_(nullptr) {
+  capacity_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  while (capacity_ < buf_size) {
+    capacity_ *= 2;
+  }
+  mask_ = capacity_ - 1;
+  buffer_ = MapMirrored(capacity_);
+  if (buffer_ == nullptr) {
+    throw std::bad_alloc();
+  }
+}
+
+SpscRecordBuffer::~SpscRecordBuffer() {
+  munmap(buffer_, 2 * capacity_);
+}
+
+void SpscRecordBuffer::NotifyData() {
+  data_notifier_.Notify();
+  Notifier *notifier = notifier_.load();
+  if (notifier != nullptr) {
+    notifier->Notify();
+  }
+}
+
+void SpscRecordBuffer::SignalError() {
+  error_ = true;
+  NotifyData();
+  space_notifier_.Notify();
+}
+
+bool SpscRecordBuffer::Write(const char *data, size_t size) {
+  if (size > MaxRecordSize()) {
+    return false;
+  }
+  // Keeps headers aligned.
+  uint64_t length = kHeaderSize + ((size + kHeaderSize - 1) & ~(kHeaderSize - 1));
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail + length - cached_head_ > capacity_) {
+    WaitUntil(wait_policy_, &space_notifier_, [this, tail, length] {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      return tail + length - cached_head_ <= capacity_ || error_;
+    });
+    if (tail + length - cached_head_ > capacity_) {
+      return false;
+    }
+  }
+  char *record = buffer_ + (tail & mask_);
+  *reinterpret_cast<uint64_t *>(record) = size;
+  memcpy(record + kHeaderSize, data, size);
+  tail_.store(tail + length, std::memory_order_release);
+  NotifyData();
+  return true;
+}
+
+bool SpscRecordBuffer::TryPeek(const char **data, size_t *size) {
+  if (peek_ == cached_tail_ &&
+      peek_ == (cached_tail_ = tail_.load(std::memory_order_acquire))) {
+    return false;
+  }
+  const char *record = buffer_ + (peek_ & mask_);
+  *size = *reinterpret_cast<const uint64_t *>(record);
+  *data = record + kHeaderSize;
+  peek_ += kHeaderSize + ((*size + kHeaderSize - 1) & ~(kHeaderSize - 1));
+  return true;
+}
+
+bool SpscRecordBuffer::Peek(const char **data, size_t *size) {
+  if (TryPeek(data, size)) {
+    return true;
+  }
+  WaitUntil(wait_policy_, &data_notifier_, [this] {
+    return peek_ != (cached_tail_ = tail_.load(std::memory_order_acquire)) || error_;
+  });
+  return TryPeek(data, size);
+}
+
+void SpscRecordBuffer::Commit() {
+  head_.store(peek_, std::memory_order_release);
+  space_notifier_.Notify();
+}
+
+ssize_t SpscRecordBuffer::Read(void *buffer, ssize_t size) {
+  if (read_offset_ == 0 && !Peek(&record_, &record_size_)) {
+    return -1;
+  }
+  size_t read_size = std::min(static_cast<size_t>(size), record_size_ - read_offset_);
+  memcpy(buffer, record_ + read_offset_, read_size);
+  read_offset_ += read_size;
+  if (read_offset_ == record_size_) {
+    read_offset_ = 0;
+    Commit();
+  }
+  return static_cast<ssize_t>(read_size);
+}
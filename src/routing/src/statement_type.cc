@@ -0,0 +1,144 @@
+#include "statement_type.h"
+
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const size_t kWindowSize = 16;
+
+struct Verb {
+  const char *name;
+  StatementType type;
+};
+
+// Lower case, at most kWindowSize bytes each.
+const Verb kVerbs[] = {
+  {"select", StatementType::kSelect},
+  {"insert", StatementType::kInsert},
+  {"update", StatementType::kUpdate},
+  {"delete", StatementType::kDelete},
+  {"replace", StatementType::kReplace},
+  {"show", StatementType::kShow},
+  {"begin", StatementType::kBegin},
+  {"start", StatementType::kBegin},
+  {"commit", StatementType::kCommit},
+  {"rollback", StatementType::kRollback},
+  {"savepoint", StatementType::kSavepoint},
+  {"release", StatementType::kSavepoint},
+  {"set", StatementType::kSet},
+  {"create", StatementType::kDdl},
+  {"alter", StatementType::kDdl},
+  {"drop", StatementType::kDdl},
+  {"rename", StatementType::kDdl},
+  {"truncate", StatementType::kDdl},
+};
+const size_t kNumVerbs = sizeof(kVerbs) / sizeof(kVerbs[0]);
+
+bool IsIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Past the whitespace and comments at pos.
+size_t SkipIgnorable(const char *sql, size_t pos, size_t size) {
+  while (pos < size) {
+    char c = sql[pos];
+    if (isspace(static_cast<unsigned char>(c))) {
+      pos++;
+    } else if (c == '/' && pos + 1 < size && sql[pos + 1] == '*') {
+      auto close = static_cast<const char *>(memmem(sql + pos + 2, size - pos - 2, "*/", 2));
+      pos = close == nullptr ? size : close - sql + 2;
+    } else if (c == '#' || (c == '-' && pos + 2 < size && sql[pos + 1] == '-' &&
+                            isspace(static_cast<unsigned char>(sql[pos + 2])))) {
+      auto newline = static_cast<const char *>(memchr(sql + pos, '\n', size - pos));
+      pos = newline == nullptr ? size : newline - sql + 1;
+    } else {
+      break;
+    }
+  }
+  return pos;
+}
+
+// Matches words against the verbs; the window holds the next bytes of
+// the statement, zero-padded.
+class WordMatcher {
+public:
+  WordMatcher(const char *sql, size_t pos, size_t size) {
+    size_t length = size - pos < kWindowSize ? size - pos : kWindowSize;
+    memset(window_, 0, sizeof(window_));
+    memcpy(window_, sql + pos, length);
+    // Only the byte right after a word is looked at beyond it.
+    next_ = pos + length < size ? sql[pos + length] : '\0';
+#if defined(__SSE2__)
+    // Setting 0x20 lower-cases letters and maps no other byte to one.
+    folded_ = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(window_)),
+                           _mm_set1_epi8(0x20));
+#endif
+  }
+
+  // Whether the window starts with word (lower case) as a whole word.
+  bool Matches(const char *word) const {
+    size_t length = strlen(word);
+    char after = length < kWindowSize ? window_[length] : next_;
+    if (IsIdentifierChar(after)) {
+      return false;
+    }
+#if defined(__SSE2__)
+    alignas(16) char pattern[kWindowSize] = {};
+    memcpy(pattern, word, length);
+    auto equal = _mm_cmpeq_epi8(folded_, _mm_load_si128(reinterpret_cast<const __m128i *>(pattern)));
+    unsigned int mask = (1u << length) - 1;
+    return (static_cast<unsigned int>(_mm_movemask_epi8(equal)) & mask) == mask;
+#else
+    for (size_t i = 0; i < length; i++) {
+      if ((window_[i] | 0x20) != word[i]) {
+        return false;
+      }
+    }
+    return true;
+#endif
+  }
+
+private:
+  alignas(16) char window_[kWindowSize];
+  char next_;
+#if defined(__SSE2__)
+  __m128i folded_;
+#endif
+};
+
+// Whether the word after the verbs ends at pos is word.
+bool NextWordIs(const char *sql, size_t pos, size_t size, const char *word) {
+  pos = SkipIgnorable(sql, pos, size);
+  return pos < size && WordMatcher(sql, pos, size).Matches(word);
+}
+
+} // namespace
+
+StatementType ClassifyStatement(const char *sql, size_t size) {
+  size_t pos = SkipIgnorable(sql, 0, size);
+  if (pos == size) {
+    return StatementType::kOther;
+  }
+  WordMatcher matcher(sql, pos, size);
+  for (size_t i = 0; i < kNumVerbs; i++) {
+    auto &verb = kVerbs[i];
+    if (!matcher.Matches(verb.name)) {
+      continue;
+    }
+    size_t end = pos + strlen(verb.name);
+    if (verb.type == StatementType::kBegin && verb.name[0] == 's') {
+      return NextWordIs(sql, end, size, "transaction") ? StatementType::kBegin
+                                                        : StatementType::kOther;
+    }
+    if (verb.type == StatementType::kRollback && NextWordIs(sql, end, size, "to")) {
+      return StatementType::kSavepoint;
+    }
+    return verb.type;
+  }
+  return StatementType::kOther;
+}
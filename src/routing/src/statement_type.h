@@ -0,0 +1,40 @@
+#ifndef ROUTING_SRC_STATEMENT_TYPE_H_
+#define ROUTING_SRC_STATEMENT_TYPE_H_
+
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+// What a statement does, after its leading keywords.
+enum class StatementType : uint8_t {
+  kOther,
+  kSelect,
+  kShow,
+  kInsert,
+  kUpdate,
+  kDelete,
+  kReplace,
+  kBegin,       // BEGIN, START TRANSACTION
+  kCommit,
+  kRollback,
+  kSavepoint,   // SAVEPOINT, ROLLBACK TO, RELEASE SAVEPOINT
+  kSet,
+  kDdl,         // CREATE, ALTER, DROP, RENAME, TRUNCATE
+};
+
+// Classifies a statement without copying it: leading whitespace and
+// comments are skipped and the verb is matched case-insensitively, 16
+// bytes at a time where SSE2 is available.
+StatementType ClassifyStatement(const char *sql, size_t size);
+
+inline StatementType ClassifyStatement(const std::string &sql) {
+  return ClassifyStatement(sql.data(), sql.size());
+}
+
+// Reads can go to any server; everything else is forwarded to all.
+inline bool IsReadStatement(StatementType type) {
+  return type == StatementType::kSelect || type == StatementType::kShow;
+}
+
+#endif // ROUTING_SRC_STATEMENT_TYPE_H_
@@ -0,0 +1,178 @@
+#include "mysqlrouter/cq_poller_pool.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A completion queue the test posts completions to; Wait() blocks until
+// there is one, and fails once closed so that Run() returns.
+class MockCompletionQueue : public CompletionQueue {
+public:
+  explicit MockCompletionQueue(int size) : size_(size), num_arms_(0), closed_(false) {}
+
+  void Complete(uint32_t qp_num, uint64_t wr_id) {
+    struct ibv_wc wc = {};
+    wc.qp_num = qp_num;
+    wc.wr_id = wr_id;
+    std::lock_guard<std::mutex> lock(mutex_);
+    wcs_.push_back(wc);
+    cond_.notify_all();
+  }
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cond_.notify_all();
+  }
+  int num_arms() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_arms_;
+  }
+
+  struct ibv_cq *cq() override {
+    return nullptr;
+  }
+  int Size() override {
+    return size_;
+  }
+  int Poll(int max, struct ibv_wc *wcs) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int num_wcs = 0;
+    while (num_wcs < max && !wcs_.empty()) {
+      wcs[num_wcs++] = wcs_.front();
+      wcs_.pop_front();
+    }
+    return num_wcs;
+  }
+  bool Arm() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_arms_++;
+    return true;
+  }
+  bool Wait() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return closed_ || !wcs_.empty(); });
+    return !closed_;
+  }
+
+private:
+  int size_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<struct ibv_wc> wcs_;
+  int num_arms_;
+  bool closed_;
+};
+
+// Completions handed to the contexts, in order.
+class Recorder {
+public:
+  CqPoller::Handler Handler() {
+    return [this](Context *context, struct ibv_wc *wc) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      handled_.emplace_back(context, wc->wr_id);
+      cond_.notify_all();
+    };
+  }
+  bool WaitFor(size_t num_handled) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, std::chrono::seconds(10),
+                          [&] { return handled_.size() >= num_handled; });
+  }
+  std::vector<std::pair<Context *, uint64_t>> handled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return handled_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::pair<Context *, uint64_t>> handled_;
+};
+
+// Contexts are only passed through, never dereferenced.
+Context *FakeContext(int index) {
+  static char contexts[8];
+  return reinterpret_cast<Context *>(&contexts[index]);
+}
+
+} // namespace
+
+TEST(CqPollerTest, DispatchesByQueuePair) {
+  auto queue = new MockCompletionQueue(64);
+  Recorder recorder;
+  CqPoller poller(std::unique_ptr<CompletionQueue>(queue), recorder.Handler(), 0);
+  poller.Add(1, FakeContext(1));
+  poller.Add(2, FakeContext(2));
+
+  queue->Complete(2, 20);
+  queue->Complete(1, 10);
+  queue->Complete(3, 30);
+  queue->Complete(2, 21);
+  queue->Close();
+  poller.Run();
+
+  std::vector<std::pair<Context *, uint64_t>> expected{
+      {FakeContext(2), 20}, {FakeContext(1), 10}, {FakeContext(2), 21}};
+  ASSERT_EQ(recorder.handled(), expected);
+}
+
+TEST(CqPollerTest, RemovedQueuePairGetsNoMoreCompletions) {
+  auto queue = new MockCompletionQueue(64);
+  Recorder recorder;
+  CqPoller poller(std::unique_ptr<CompletionQueue>(queue), recorder.Handler(), 0);
+  ASSERT_TRUE(poller.Reserve(16));
+  poller.Add(1, FakeContext(1));
+  std::thread thread(&CqPoller::Run, &poller);
+
+  queue->Complete(1, 10);
+  ASSERT_TRUE(recorder.WaitFor(1));
+  poller.Remove(1, 16);
+  queue->Complete(1, 11);
+  poller.Add(2, FakeContext(2));
+  queue->Complete(2, 20);
+  ASSERT_TRUE(recorder.WaitFor(2));
+  queue->Close();
+  thread.join();
+
+  std::vector<std::pair<Context *, uint64_t>> expected{
+      {FakeContext(1), 10}, {FakeContext(2), 20}};
+  ASSERT_EQ(recorder.handled(), expected);
+  // Parked for an event after each completion.
+  ASSERT_GE(queue->num_arms(), 2);
+}
+
+TEST(CqPollerTest, ReservesNoMoreThanTheQueueHolds) {
+  CqPoller poller(std::unique_ptr<CompletionQueue>(new MockCompletionQueue(64)),
+                  [](Context *, struct ibv_wc *) {}, 0);
+  ASSERT_TRUE(poller.Reserve(32));
+  ASSERT_TRUE(poller.Reserve(32));
+  ASSERT_FALSE(poller.Reserve(1));
+  poller.Remove(5, 32);
+  ASSERT_TRUE(poller.Reserve(16));
+  poller.Release(16);
+  ASSERT_TRUE(poller.Reserve(32));
+  ASSERT_FALSE(poller.Reserve(1));
+}
+
+TEST(CqPollerTest, BusyPollsBeforeWaitingForEvents) {
+  auto queue = new MockCompletionQueue(64);
+  Recorder recorder;
+  CqPoller poller(std::unique_ptr<CompletionQueue>(queue), recorder.Handler(), 20000);
+  poller.Add(1, FakeContext(1));
+
+  queue->Complete(1, 10);
+  queue->Close();
+  auto start = std::chrono::steady_clock::now();
+  poller.Run();
+
+  ASSERT_EQ(recorder.handled().size(), 1u);
+  ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::microseconds(20000));
+  ASSERT_EQ(queue->num_arms(), 1);
+}
@@ -0,0 +1,38 @@
+#include "latency_window.h"
+
+#include "gtest/gtest.h"
+
+using std::chrono::microseconds;
+
+TEST(LatencyWindowTest, NeedsEnoughSamples) {
+  LatencyWindow window;
+  for (size_t i = 0; i < LatencyWindow::kMinSamples - 1; i++) {
+    window.Record(microseconds(10));
+  }
+  ASSERT_EQ(window.Percentile(50), std::chrono::steady_clock::duration::max());
+  window.Record(microseconds(10));
+  ASSERT_EQ(window.Percentile(50), microseconds(10));
+}
+
+TEST(LatencyWindowTest, Percentile) {
+  LatencyWindow window;
+  for (int i = 100; i > 0; i--) {
+    window.Record(microseconds(i));
+  }
+  ASSERT_EQ(window.Percentile(0), microseconds(1));
+  ASSERT_EQ(window.Percentile(50), microseconds(51));
+  ASSERT_EQ(window.Percentile(95), microseconds(96));
+  ASSERT_EQ(window.Percentile(100), microseconds(100));
+}
+
+TEST(LatencyWindowTest, KeepsOnlyRecentSamples) {
+  LatencyWindow window;
+  for (size_t i = 0; i < LatencyWindow::kSize; i++) {
+    window.Record(microseconds(1000));
+  }
+  for (size_t i = 0; i < LatencyWindow::kSize; i++) {
+    window.Record(microseconds(1));
+  }
+  ASSERT_EQ(window.NumSamples(), LatencyWindow::kSize);
+  ASSERT_EQ(window.Percentile(99), microseconds(1));
+}
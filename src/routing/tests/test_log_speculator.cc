@@ -0,0 +1,28 @@
+#include "speculator/log_speculator.h"
+
+#include "gtest/gtest.h"
+
+TEST(LogSpeculatorTest, SavepointInsideTransaction) {
+  LogSpeculator speculator(Undoer(nullptr), nullptr, true);
+  speculator.CheckBegin("BEGIN");
+  speculator.BackupFor("DELETE FROM t WHERE id = 1");
+  ASSERT_EQ(speculator.GetSavepoint(), "SAVEPOINT speculative_write");
+  ASSERT_EQ(speculator.GetUndo(), "ROLLBACK TO SAVEPOINT speculative_write");
+}
+
+TEST(LogSpeculatorTest, NoSavepointOutsideTransaction) {
+  LogSpeculator speculator(Undoer(nullptr), nullptr, true);
+  speculator.CheckBegin("BEGIN");
+  speculator.CheckBegin("COMMIT");
+  // Not an INSERT or UPDATE, so the Undoer has no inverse for it either.
+  speculator.BackupFor("DELETE FROM t WHERE id = 1");
+  ASSERT_EQ(speculator.GetSavepoint(), "");
+  ASSERT_EQ(speculator.GetUndo(), "");
+}
+
+TEST(LogSpeculatorTest, NoSavepointInUndoMode) {
+  LogSpeculator speculator(Undoer(nullptr), nullptr);
+  speculator.CheckBegin("BEGIN");
+  speculator.BackupFor("DELETE FROM t WHERE id = 1");
+  ASSERT_EQ(speculator.GetSavepoint(), "");
+}
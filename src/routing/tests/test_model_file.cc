@@ -0,0 +1,141 @@
+#include "speculator/speculation_model/graph_model.h"
+#include "speculator/speculation_model/model_file.h"
+#include "speculator/speculation_model/prediction_table.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <string>
+
+namespace {
+
+const char *kQuerySet =
+    "0 SELECT * FROM users WHERE id = ?v\n"
+    "1 SELECT * FROM orders WHERE user_id = ?v AND state = ?v\n"
+    "2 SELECT * FROM items WHERE id = ?v\n";
+
+// Two edges leave users; along [0] the prediction of the second edge has
+// more hits.
+const char *kModel = R"([
+  {"vertex": 0, "edgelist": [
+    {"vertex": 2, "edge": {"to": 2, "weight": 1, "prediction_map": [
+      {"path": [0], "predictions": [{"query": 2, "hit": 1, "ops": [
+        {"type": "const", "value": 5}]}]}]}},
+    {"vertex": 1, "edge": {"to": 1, "weight": 4, "prediction_map": [
+      {"path": [0], "predictions": [{"query": 1, "hit": 4, "ops": [
+        {"type": "arg", "query": 0, "index": 0, "arg": 0},
+        {"type": "const", "value": "open"}]}]},
+      {"path": [0, 2], "predictions": [{"query": 1, "hit": 2, "ops": [
+        {"type": "const", "value": 1.5},
+        {"type": "rand"}]}]}]}}]}
+])";
+
+std::string WriteFile(const std::string &name, const std::string &content) {
+  auto path = testing::TempDir() + name;
+  std::ofstream out(path, std::ios::binary);
+  out << content;
+  return path;
+}
+
+model::QueryPath Path(std::initializer_list<int> ids) {
+  model::QueryPath path;
+  path.fill(-1);
+  std::copy(ids.begin(), ids.end(), path.begin());
+  return path;
+}
+
+} // namespace
+
+TEST(ModelFileTest, BestPredictionOverAllEdges) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error)) << error;
+  model::ModelFile file;
+  ASSERT_TRUE(file.Attach(image.data(), image.size(), &error)) << error;
+  ASSERT_EQ(file.NumVertices(), 1u);
+
+  model::PredictionTable table(file);
+  ASSERT_EQ(table.Size(), 2u);
+  auto best = table.FindBest(0, Path({0}));
+  ASSERT_NE(best, model::PredictionTable::kNone);
+  auto &prediction = file.prediction(best);
+  ASSERT_EQ(prediction.query_id, 1);
+  ASSERT_EQ(prediction.hit_count, 4);
+  ASSERT_EQ(prediction.num_operands, 2u);
+  auto operands = file.Operands(prediction);
+  ASSERT_EQ(operands[0].kind, model::file::kArgument);
+  ASSERT_EQ(operands[1].kind, model::file::kConst);
+  ASSERT_EQ(file.String(operands[1]), "open");
+
+  ASSERT_NE(table.FindBest(0, Path({0, 2})), model::PredictionTable::kNone);
+  ASSERT_EQ(table.FindBest(0, Path({2, 0})), model::PredictionTable::kNone);
+  ASSERT_EQ(table.FindBest(0, Path({0, 1})), model::PredictionTable::kNone);
+  ASSERT_EQ(table.FindBest(1, Path({1})), model::PredictionTable::kNone);
+}
+
+TEST(ModelFileTest, HitsUpdateBestPrediction) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error));
+  model::ModelFile file;
+  ASSERT_TRUE(file.Attach(image.data(), image.size(), &error));
+  model::PredictionTable table(file);
+  auto best = table.FindBest(0, Path({0}));
+  auto other = best == 0 ? 1u : 0u;
+  ASSERT_EQ(file.prediction(other).query_id, 2);
+
+  ASSERT_FALSE(table.Hit(0, Path({0, 2}), other));
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(table.Hit(0, Path({0}), other));
+  }
+  // Tied at four hits.
+  ASSERT_EQ(table.FindBest(0, Path({0})), best);
+  ASSERT_TRUE(table.Hit(0, Path({0}), other));
+  ASSERT_EQ(table.FindBest(0, Path({0})), other);
+  ASSERT_EQ(table.hit_count(other), 5);
+}
+
+TEST(ModelFileTest, PermutedPathsHashApart) {
+  ASSERT_NE(model::HashPath(Path({1, 2, 3})), model::HashPath(Path({3, 2, 1})));
+  ASSERT_NE(model::HashPath(Path({1, 2})), model::HashPath(Path({2, 1})));
+  ASSERT_NE(model::HashPath(Path({1}), 2), model::HashPath(Path({2}), 1));
+}
+
+TEST(ModelFileTest, RejectsBadImages) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error));
+  model::ModelFile file;
+  ASSERT_FALSE(file.Attach(image.data(), image.size() - 1, &error));
+  ASSERT_FALSE(file.Attach(kModel, strlen(kModel), &error));
+  auto corrupt = image;
+  // The first path of the vertex table points past the path table.
+  auto header = reinterpret_cast<const model::file::Header *>(corrupt.data());
+  corrupt[header->vertices_offset + 4] = 100;
+  ASSERT_FALSE(file.Attach(corrupt.data(), corrupt.size(), &error));
+  ASSERT_EQ(file.NumVertices(), 0u);
+
+  ASSERT_FALSE(model::ModelFile::Compile("{}", &image, &error));
+  ASSERT_FALSE(model::ModelFile::Compile(R"([{"vertex": 0}])", &image, &error));
+}
+
+TEST(ModelFileTest, ConvertedModelPredictsAsJson) {
+  auto query_set = WriteFile("model_file_queries", kQuerySet);
+  auto json = WriteFile("model_file_model.json", kModel);
+  auto binary = testing::TempDir() + "model_file_model.bin";
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Convert(json, binary, &error)) << error;
+
+  for (auto &path : {json, binary}) {
+    auto graph_model = model::GraphModel::Get(query_set, path);
+    ASSERT_NE(graph_model.get(), nullptr);
+    auto predictor = graph_model->CreatePredictor();
+    predictor->MoveToNext(model::Query(0, {model::SqlValue(7)}, {}));
+    ASSERT_EQ(predictor->PredictNextSQL(),
+              "SELECT * FROM orders WHERE user_id = 7 AND state = 'open'");
+    predictor->MoveToNext(model::Query(2, {model::SqlValue(5)}, {}));
+    predictor->MoveToNext(model::Query(0, {model::SqlValue(8)}, {}));
+    // Along [0, 2, 0] nothing is predicted.
+    ASSERT_EQ(predictor->PredictNextSQL(), "");
+  }
+}
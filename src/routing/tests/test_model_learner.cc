@@ -0,0 +1,149 @@
+#include "speculator/speculation_model/graph_model.h"
+#include "speculator/speculation_model/model_learner.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char *kQuerySet =
+    "0 SELECT * FROM users WHERE id = ?v\n"
+    "1 SELECT * FROM orders WHERE user_id = ?v\n"
+    "2 SELECT * FROM items WHERE id = ?v\n";
+
+// After users, the orders of the user, or less likely item 5.
+const char *kModel = R"([
+  {"vertex": 0, "edgelist": [
+    {"vertex": 1, "edge": {"to": 1, "weight": 2, "prediction_map": [
+      {"path": [0], "predictions": [{"query": 1, "hit": 2, "ops": [
+        {"type": "arg", "query": 0, "index": 0, "arg": 0}]}]}]}},
+    {"vertex": 2, "edge": {"to": 2, "weight": 1, "prediction_map": [
+      {"path": [0], "predictions": [{"query": 2, "hit": 1, "ops": [
+        {"type": "const", "value": 5}]}]}]}}]}
+])";
+
+std::string WriteFile(const std::string &name, const std::string &content) {
+  auto path = testing::TempDir() + name;
+  std::ofstream out(path);
+  out << content;
+  return path;
+}
+
+model::QueryPath Path(std::initializer_list<int> ids) {
+  model::QueryPath path;
+  path.fill(-1);
+  std::copy(ids.begin(), ids.end(), path.begin());
+  return path;
+}
+
+} // namespace
+
+TEST(ModelLearnerTest, MergesHitsOfEveryThread) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error));
+  model::ModelFile file;
+  ASSERT_TRUE(file.Attach(image.data(), image.size(), &error));
+  model::ModelLearner learner((model::PredictionTable(file)));
+  auto path = Path({0});
+  auto best = learner.table()->FindBest(0, path);
+  auto other = best == 0 ? 1u : 0u;
+
+  auto before = learner.table();
+  learner.RecordHit(0, path, other);
+  std::thread writer([&] {
+    learner.RecordHit(0, path, other);
+    learner.RecordHit(0, path, other);
+  });
+  writer.join();
+  // Not counted before the merge.
+  ASSERT_EQ(learner.table()->FindBest(0, path), best);
+  ASSERT_EQ(learner.Merge(), 3u);
+  ASSERT_NE(learner.table().get(), before.get());
+  ASSERT_EQ(learner.table()->FindBest(0, path), other);
+  ASSERT_EQ(learner.table()->hit_count(other), 4);
+  // The snapshot replaced is still there for readers that held it.
+  ASSERT_EQ(before->FindBest(0, path), best);
+  ASSERT_EQ(learner.Merge(), 0u);
+}
+
+TEST(ModelLearnerTest, DropsHitsOfFullBuffer) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error));
+  model::ModelFile file;
+  ASSERT_TRUE(file.Attach(image.data(), image.size(), &error));
+  model::ModelLearner learner((model::PredictionTable(file)));
+  for (int i = 0; i < 5000; i++) {
+    learner.RecordHit(0, Path({0}), 0);
+  }
+  ASSERT_GT(learner.num_dropped(), 0u);
+  ASSERT_EQ(learner.Merge() + learner.num_dropped(), 5000u);
+}
+
+TEST(ModelLearnerTest, PredictorLearnsFromLiveQueries) {
+  auto graph_model = model::GraphModel::Get(WriteFile("model_learner_queries", kQuerySet),
+                                            WriteFile("model_learner_model.json", kModel));
+  ASSERT_NE(graph_model.get(), nullptr);
+  // Merged by hand below.
+  graph_model->learner().Start(std::chrono::hours(1));
+  ASSERT_TRUE(graph_model->learner().Learning());
+
+  auto predictor = graph_model->CreatePredictor();
+  predictor->MoveToNext(model::Query(0, {model::SqlValue(model::Double(7))}, {}));
+  ASSERT_EQ(predictor->PredictNextSQL(), "SELECT * FROM orders WHERE user_id = 7");
+  // Sessions that went on to item 5, and one to another item, which
+  // matches neither prediction.
+  for (int item : {5, 5, 6}) {
+    auto session = graph_model->CreatePredictor();
+    session->MoveToNext(model::Query(0, {model::SqlValue(model::Double(7))}, {}));
+    session->MoveToNext(model::Query(2, {model::SqlValue(model::Double(item))}, {}));
+  }
+  ASSERT_EQ(graph_model->learner().Merge(), 2u);
+  ASSERT_EQ(predictor->PredictNextSQL(), "SELECT * FROM items WHERE id = 5");
+  graph_model->learner().Stop();
+}
+
+TEST(ModelLearnerTest, ReadersOutliveMerges) {
+  std::string image;
+  std::string error;
+  ASSERT_TRUE(model::ModelFile::Compile(kModel, &image, &error));
+  model::ModelFile file;
+  ASSERT_TRUE(file.Attach(image.data(), image.size(), &error));
+  model::ModelLearner learner((model::PredictionTable(file)));
+  learner.Start(std::chrono::milliseconds(1));
+  auto path = Path({0});
+
+  // Every hit makes the next merge publish a new table, while readers
+  // keep looking up in the ones they got, well past two merges.
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) {
+    readers.emplace_back([&learner, &stop, path] {
+      while (!stop.load()) {
+        auto table = learner.table();
+        uint32_t first;
+        uint32_t count;
+        ASSERT_TRUE(table->FindRange(0, path, &first, &count));
+        std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        for (uint32_t index = first; index < first + count; index++) {
+          ASSERT_GE(table->hit_count(index), 1);
+        }
+        ASSERT_NE(table->FindBest(0, path), model::PredictionTable::kNone);
+        learner.RecordHit(0, path, first);
+      }
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  stop = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  learner.Stop();
+  ASSERT_GT(learner.table()->hit_count(0) + learner.table()->hit_count(1), 3);
+}
@@ -0,0 +1,144 @@
+#include "speculator/model_speculator.h"
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <string>
+
+namespace {
+
+const char *kQuerySet =
+    "0 SELECT * FROM users WHERE id = ?v\n"
+    "1 SELECT * FROM orders WHERE user_id = ?v\n"
+    "2 SELECT * FROM items WHERE id = ?v\n";
+
+// After users, orders of the same user; after orders, the item of the
+// first order.
+const char *kModel = R"([
+  {"vertex": 0, "edgelist": [{"vertex": 1, "edge": {"to": 1, "weight": 3, "prediction_map": [
+    {"path": [0], "predictions": [{"query": 1, "hit": 3, "ops": [
+      {"type": "arg", "query": 0, "index": 0, "arg": 0}]}]}]}}]},
+  {"vertex": 1, "edgelist": [{"vertex": 2, "edge": {"to": 2, "weight": 2, "prediction_map": [
+    {"path": [1, 0], "predictions": [{"query": 2, "hit": 2, "ops": [
+      {"type": "result", "query": 1, "index": 0, "row": 0, "column": 1}]}]}]}}]}
+])";
+
+std::string WriteFile(const std::string &name, const char *content) {
+  auto path = testing::TempDir() + name;
+  std::ofstream out(path);
+  out << content;
+  return path;
+}
+
+std::shared_ptr<const model::GraphModel> LoadModel() {
+  return model::GraphModel::Get(WriteFile("model_speculator_queries", kQuerySet),
+                                WriteFile("model_speculator_model.json", kModel));
+}
+
+void AppendPacket(std::string &buffer, uint8_t sequence, const std::string &payload) {
+  buffer.push_back(static_cast<char>(payload.size()));
+  buffer.append(2, '\0');
+  buffer.push_back(static_cast<char>(sequence));
+  buffer += payload;
+}
+
+// Two columns, one row: id 1, item_id 42.
+std::string OrdersResult() {
+  std::string buffer;
+  AppendPacket(buffer, 1, std::string(1, '\x02'));
+  AppendPacket(buffer, 2, "column definition id");
+  AppendPacket(buffer, 3, "column definition item_id");
+  AppendPacket(buffer, 4, std::string("\x01" "1" "\x02" "42", 5));
+  AppendPacket(buffer, 5, std::string("\xfe\x00\x00\x02\x00", 5));
+  return buffer;
+}
+
+} // namespace
+
+TEST(ModelSpeculatorTest, PredictsArgumentsOfPreviousQuery) {
+  auto graph_model = LoadModel();
+  ASSERT_NE(graph_model.get(), nullptr);
+  ModelSpeculator speculator(Undoer(nullptr), graph_model);
+  std::string query = "SELECT * FROM users WHERE id = 7";
+  speculator.CheckBegin(query);
+  ASSERT_EQ(speculator.TrySpeculate(query, 1),
+            std::vector<std::string>{"SELECT * FROM orders WHERE user_id = 7"});
+  ASSERT_EQ(speculator.Speculate(query, 1).size(), 1u);
+}
+
+TEST(ModelSpeculatorTest, PredictsFromResultOnceItIsIn) {
+  ModelSpeculator speculator(Undoer(nullptr), LoadModel());
+  speculator.CheckBegin("SELECT * FROM users WHERE id = 7");
+  speculator.Speculate("SELECT * FROM users WHERE id = 7", 1);
+
+  std::string query = "SELECT * FROM orders WHERE user_id = 7";
+  speculator.CheckBegin(query);
+  ASSERT_TRUE(speculator.TrySpeculate(query, 1).empty());
+  auto result = OrdersResult();
+  speculator.OnResult(reinterpret_cast<const uint8_t *>(result.data()), result.size());
+  ASSERT_EQ(speculator.TrySpeculate(query, 1),
+            std::vector<std::string>{"SELECT * FROM items WHERE id = 42"});
+}
+
+TEST(ModelSpeculatorTest, NothingForUnknownQuery) {
+  ModelSpeculator speculator(Undoer(nullptr), LoadModel());
+  std::string query = "SELECT * FROM logs WHERE id = 7";
+  speculator.CheckBegin(query);
+  ASSERT_TRUE(speculator.Speculate(query, 1).empty());
+}
+
+TEST(ModelSpeculatorTest, MissingModel) {
+  ASSERT_EQ(model::GraphModel::Get("/nonexistent/queries", "/nonexistent/model.json").get(),
+            nullptr);
+}
+
+namespace {
+
+const char *kChainQuerySet =
+    "0 SELECT * FROM users WHERE id = ?v\n"
+    "1 SELECT * FROM orders WHERE user_id = ?v\n"
+    "2 SELECT * FROM payments WHERE user_id = ?v\n";
+
+// Users, then the user's orders, then the user's payments; the payments
+// only need the user, so they can be predicted along with the orders.
+const char *kChainModel = R"([
+  {"vertex": 0, "edgelist": [{"vertex": 1, "edge": {"to": 1, "weight": 2, "prediction_map": [
+    {"path": [0], "predictions": [{"query": 1, "hit": 1, "ops": [
+      {"type": "arg", "query": 0, "index": 0, "arg": 0}]}]},
+    {"path": [0, 2, 1, 0], "predictions": [{"query": 1, "hit": 1, "ops": [
+      {"type": "arg", "query": 0, "index": 0, "arg": 0}]}]}]}}]},
+  {"vertex": 1, "edgelist": [{"vertex": 2, "edge": {"to": 2, "weight": 2, "prediction_map": [
+    {"path": [1, 0], "predictions": [{"query": 2, "hit": 1, "ops": [
+      {"type": "arg", "query": 0, "index": 1, "arg": 0}]}]},
+    {"path": [1, 0, 2, 1, 0], "predictions": [{"query": 2, "hit": 1, "ops": [
+      {"type": "arg", "query": 0, "index": 1, "arg": 0}]}]}]}}]}
+])";
+
+} // namespace
+
+TEST(ModelSpeculatorTest, LooksFurtherAheadAsStepsHit) {
+  auto graph_model = model::GraphModel::Get(
+      WriteFile("model_speculator_chain_queries", kChainQuerySet),
+      WriteFile("model_speculator_chain_model.json", kChainModel));
+  ASSERT_NE(graph_model.get(), nullptr);
+  ModelSpeculator speculator(Undoer(nullptr), graph_model);
+  std::string users = "SELECT * FROM users WHERE id = 7";
+  std::string orders = "SELECT * FROM orders WHERE user_id = 7";
+  std::string payments = "SELECT * FROM payments WHERE user_id = 7";
+
+  // The second step is predicted but not sent until it has hit.
+  speculator.CheckBegin(users);
+  ASSERT_EQ(speculator.Speculate(users, 4), std::vector<std::string>{orders});
+  speculator.CheckBegin(orders);
+  ASSERT_EQ(speculator.Speculate(orders, 4), std::vector<std::string>{payments});
+  speculator.CheckBegin(payments);
+  ASSERT_EQ(speculator.depth(), 2u);
+  ASSERT_EQ(speculator.StepHitRate(1), 1.0);
+
+  speculator.CheckBegin(users);
+  ASSERT_EQ(speculator.TrySpeculate(users, 4), (std::vector<std::string>{orders, payments}));
+  // No more than the servers can take.
+  ModelSpeculator other(Undoer(nullptr), graph_model);
+  other.CheckBegin(users);
+  ASSERT_EQ(other.TrySpeculate(users, 0).size(), 0u);
+}
@@ -0,0 +1,86 @@
+#include "prefetch_table.h"
+
+#include "gtest/gtest.h"
+
+#include <map>
+#include <random>
+#include <string>
+
+namespace {
+
+Prefetch MakePrefetch(int server, uint64_t request) {
+  return Prefetch{server, request, StatementType::kSelect, 0};
+}
+
+} // namespace
+
+TEST(PrefetchTableTest, InsertFindTake) {
+  PrefetchTable table;
+  std::string query = "SELECT * FROM t WHERE id = 1";
+  auto fingerprint = PrefetchTable::Fingerprint(query);
+  table.Insert(query, fingerprint, MakePrefetch(1, 7));
+  ASSERT_EQ(table.size(), 1u);
+  ASSERT_NE(table.Find(query, fingerprint), nullptr);
+  ASSERT_EQ(table.Find("SELECT * FROM t WHERE id = 2",
+                       PrefetchTable::Fingerprint("SELECT * FROM t WHERE id = 2")), nullptr);
+  Prefetch prefetch;
+  ASSERT_TRUE(table.Take(query, fingerprint, &prefetch));
+  ASSERT_EQ(prefetch.server, 1);
+  ASSERT_EQ(prefetch.request, 7u);
+  ASSERT_TRUE(table.empty());
+  ASSERT_FALSE(table.Take(query, fingerprint, &prefetch));
+}
+
+TEST(PrefetchTableTest, SameFingerprintComparesText) {
+  PrefetchTable table;
+  table.Insert("a", 42, MakePrefetch(0, 1));
+  table.Insert("b", 42, MakePrefetch(1, 2));
+  ASSERT_EQ(table.size(), 2u);
+  ASSERT_EQ(table.Find("a", 42)->request, 1u);
+  ASSERT_EQ(table.Find("b", 42)->request, 2u);
+  ASSERT_EQ(table.Find("c", 42), nullptr);
+  Prefetch prefetch;
+  ASSERT_TRUE(table.Take("a", 42, &prefetch));
+  ASSERT_EQ(table.Find("b", 42)->request, 2u);
+}
+
+TEST(PrefetchTableTest, EraseIf) {
+  PrefetchTable table;
+  for (int i = 0; i < 40; i++) {
+    auto query = std::to_string(i);
+    table.Insert(query, PrefetchTable::Fingerprint(query), MakePrefetch(i % 2, i));
+  }
+  ASSERT_EQ(table.size(), 40u);
+  table.EraseIf([](const std::string &, uint64_t, const Prefetch &prefetch) {
+    return prefetch.server == 0;
+  });
+  ASSERT_EQ(table.size(), 20u);
+  for (int i = 0; i < 40; i++) {
+    auto query = std::to_string(i);
+    ASSERT_EQ(table.Find(query, PrefetchTable::Fingerprint(query)) != nullptr, i % 2 == 1);
+  }
+}
+
+TEST(PrefetchTableTest, MatchesMap) {
+  PrefetchTable table;
+  std::map<std::string, uint64_t> expected;
+  std::mt19937 random(1);
+  for (uint64_t i = 0; i < 20000; i++) {
+    auto query = "q" + std::to_string(random() % 64);
+    // Few distinct fingerprints, so that probe sequences collide.
+    uint64_t fingerprint = PrefetchTable::Fingerprint(query) % 8;
+    Prefetch prefetch;
+    if (random() % 2 == 0) {
+      table.Insert(query, fingerprint, MakePrefetch(0, i));
+      expected[query] = i;
+    } else {
+      bool taken = table.Take(query, fingerprint, &prefetch);
+      ASSERT_EQ(taken, expected.count(query) == 1);
+      if (taken) {
+        ASSERT_EQ(prefetch.request, expected[query]);
+        expected.erase(query);
+      }
+    }
+    ASSERT_EQ(table.size(), expected.size());
+  }
+}
@@ -0,0 +1,99 @@
+#include "mysqlrouter/recv_pool.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <deque>
+#include <string>
+
+namespace {
+
+// The receive queue of a queue pair: a send from the peer lands in the
+// receive posted first; with none posted, the peer gets a
+// receiver-not-ready.
+class MockQueuePair {
+public:
+  explicit MockQueuePair(RecvPool *pool) : pool_(pool), fail_(false) {
+    pool_->SetPostFunction([this](uint32_t slot) {
+      if (fail_) {
+        return false;
+      }
+      posted_.push_back(slot);
+      return true;
+    });
+  }
+
+  void set_fail(bool fail) {
+    fail_ = fail;
+  }
+
+  // Returns false where the peer would get a receiver-not-ready.
+  bool Send(const std::string &message, ReceivedMessage *received) {
+    if (posted_.empty()) {
+      return false;
+    }
+    auto slot = posted_.front();
+    posted_.pop_front();
+    size_t size = message.size();
+    memcpy(pool_->Slot(slot), &size, sizeof(size));
+    memcpy(pool_->Slot(slot) + sizeof(size), message.data(), size);
+    pool_->OnReceived(slot);
+    received->slot = slot;
+    received->size = static_cast<uint32_t>(size);
+    return true;
+  }
+
+private:
+  RecvPool *pool_;
+  bool fail_;
+  std::deque<uint32_t> posted_;
+};
+
+std::string Payload(RecvPool *pool, const ReceivedMessage &message) {
+  return std::string(pool->Slot(message.slot) + sizeof(size_t), message.size);
+}
+
+} // namespace
+
+TEST(RecvPoolTest, SlotsShareOneRegion) {
+  RecvPool pool(4, 256);
+  ASSERT_EQ(pool.RegionSize(), 1024u);
+  ASSERT_EQ(pool.Slot(0), pool.Region());
+  ASSERT_EQ(pool.Slot(3), pool.Region() + 768);
+}
+
+TEST(RecvPoolTest, PeerSendsAheadUpToNumSlots) {
+  RecvPool pool(3, 64);
+  MockQueuePair queue_pair(&pool);
+  ASSERT_TRUE(pool.PostAll());
+  ASSERT_EQ(pool.NumPosted(), 3u);
+
+  ReceivedMessage messages[4];
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(queue_pair.Send("response " + std::to_string(i), &messages[i]));
+  }
+  ASSERT_EQ(pool.NumPosted(), 0u);
+  ASSERT_FALSE(queue_pair.Send("response 3", &messages[3]));
+
+  // Each message stays in its slot until drained.
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(Payload(&pool, messages[i]), "response " + std::to_string(i));
+  }
+  ASSERT_TRUE(pool.Release(messages[1].slot));
+  ASSERT_EQ(pool.NumPosted(), 1u);
+  ASSERT_TRUE(queue_pair.Send("response 3", &messages[3]));
+  ASSERT_EQ(messages[3].slot, messages[1].slot);
+  ASSERT_EQ(Payload(&pool, messages[3]), "response 3");
+  ASSERT_EQ(Payload(&pool, messages[0]), "response 0");
+}
+
+TEST(RecvPoolTest, FailedPostIsNotCounted) {
+  RecvPool pool(2, 64);
+  MockQueuePair queue_pair(&pool);
+  queue_pair.set_fail(true);
+  ASSERT_FALSE(pool.PostAll());
+  ASSERT_EQ(pool.NumPosted(), 0u);
+  queue_pair.set_fail(false);
+  ASSERT_TRUE(pool.PostAll());
+  ASSERT_EQ(pool.NumPosted(), 2u);
+}
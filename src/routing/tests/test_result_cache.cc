@@ -0,0 +1,179 @@
+#include "prefetch_table.h"
+#include "result_cache.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kSchema = "shop";
+
+// A column count packet, as the first packet of a result set.
+std::string ResultSet(char columns, const std::string &rest = "") {
+  return std::string("\x01\x00\x00\x01", 4) + columns + rest;
+}
+
+const uint8_t *Bytes(const std::string &result) {
+  return reinterpret_cast<const uint8_t *>(result.data());
+}
+
+size_t Lookup(ResultCache *cache, const std::string &schema, const std::string &query) {
+  uint8_t buffer[256];
+  return cache->Lookup(schema, query, PrefetchTable::Fingerprint(query), buffer, sizeof(buffer));
+}
+
+void Insert(ResultCache *cache, const std::string &query, const std::string &result,
+            uint64_t version) {
+  cache->Insert(kSchema, query, PrefetchTable::Fingerprint(query), version, Bytes(result),
+                result.size());
+}
+
+} // namespace
+
+TEST(ResultCacheTest, ReadTables) {
+  std::vector<std::string> tables;
+  ASSERT_TRUE(ResultCache::ReadTables(
+      "SELECT a.x, b.y FROM `Orders` a JOIN shop.items AS b ON a.id = b.order_id, users u "
+      "WHERE a.id IN (SELECT order_id FROM lines WHERE qty > 1) ORDER BY a.id",
+      &tables));
+  ASSERT_EQ(tables, (std::vector<std::string>{"orders", "items", "users", "lines"}));
+  tables.clear();
+  ASSERT_TRUE(ResultCache::ReadTables("SELECT 1", &tables));
+  ASSERT_TRUE(tables.empty());
+  ASSERT_TRUE(ResultCache::ReadTables("SELECT user FROM accounts", &tables));
+
+  ASSERT_FALSE(ResultCache::ReadTables("SELECT * FROM (SELECT 1) d", &tables));
+  ASSERT_FALSE(ResultCache::ReadTables("SELECT * FROM t WHERE id = 1 FOR UPDATE", &tables));
+  ASSERT_FALSE(ResultCache::ReadTables("SELECT * FROM t WHERE d < NOW()", &tables));
+  ASSERT_FALSE(ResultCache::ReadTables("SELECT * FROM t WHERE id = @id", &tables));
+  ASSERT_FALSE(ResultCache::ReadTables("SELECT 1; SELECT 2", &tables));
+  ASSERT_FALSE(ResultCache::ReadTables("UPDATE t SET v = 1", &tables));
+}
+
+TEST(ResultCacheTest, WrittenTables) {
+  std::vector<std::string> tables;
+  ASSERT_TRUE(ResultCache::WrittenTables(
+      "UPDATE `Orders` SET v='a;b' WHERE id = 1; DELETE FROM shop.items WHERE id = 2; "
+      "INSERT IGNORE INTO lines (id) VALUES (3); REPLACE users VALUES (4)",
+      &tables));
+  ASSERT_EQ(tables, (std::vector<std::string>{"orders", "items", "lines", "users"}));
+  tables.clear();
+  ASSERT_TRUE(ResultCache::WrittenTables("SAVEPOINT s1; SELECT 1", &tables));
+  ASSERT_TRUE(tables.empty());
+
+  ASSERT_FALSE(ResultCache::WrittenTables("UPDATE a, b SET a.v = b.v", &tables));
+  ASSERT_FALSE(ResultCache::WrittenTables("DELETE a FROM a JOIN b ON a.id = b.id", &tables));
+  ASSERT_FALSE(ResultCache::WrittenTables("DROP TABLE t", &tables));
+  ASSERT_FALSE(ResultCache::WrittenTables("CALL refresh()", &tables));
+}
+
+TEST(ResultCacheTest, InvalidatedPerTable) {
+  ResultCache cache(1 << 20);
+  std::string orders = "SELECT * FROM orders WHERE id = 1";
+  std::string items = "SELECT * FROM items WHERE id = 1";
+  Insert(&cache, orders, ResultSet(1, "orders"), cache.Version());
+  Insert(&cache, items, ResultSet(1, "items"), cache.Version());
+  ASSERT_EQ(Lookup(&cache, kSchema, orders), ResultSet(1, "orders").size());
+  ASSERT_EQ(Lookup(&cache, "other", orders), 0u);
+
+  cache.Invalidate("orders");
+  ASSERT_EQ(Lookup(&cache, kSchema, orders), 0u);
+  ASSERT_EQ(Lookup(&cache, kSchema, items), ResultSet(1, "items").size());
+  cache.InvalidateAll();
+  ASSERT_EQ(Lookup(&cache, kSchema, items), 0u);
+  ASSERT_EQ(cache.bytes(), 0u);
+}
+
+TEST(ResultCacheTest, WriteWhileInFlight) {
+  ResultCache cache(1 << 20);
+  std::string query = "SELECT * FROM orders WHERE id = 1";
+  uint64_t sent_at = cache.Version();
+  cache.Invalidate("orders");
+  Insert(&cache, query, ResultSet(1), sent_at);
+  ASSERT_EQ(Lookup(&cache, kSchema, query), 0u);
+  Insert(&cache, query, ResultSet(1), cache.Version());
+  ASSERT_NE(Lookup(&cache, kSchema, query), 0u);
+}
+
+TEST(ResultCacheTest, OnlyResultSets) {
+  ResultCache cache(1 << 20);
+  std::string query = "SELECT * FROM orders WHERE id = 1";
+  Insert(&cache, query, std::string("\x07\x00\x00\x01\x00\x00\x00\x02\x00\x00\x00", 11),
+         cache.Version());
+  Insert(&cache, query, std::string("\x05\x00\x00\x01\xff\x15\x04#28", 9), cache.Version());
+  ASSERT_EQ(Lookup(&cache, kSchema, query), 0u);
+}
+
+TEST(ResultCacheTest, EvictsLeastRecentlyUsed) {
+  // Two entries of this size fit in a shard.
+  ResultCache cache(16 * 400);
+  std::string result = ResultSet(1, std::string(120, 'x'));
+  std::vector<std::string> queries;
+  for (int i = 0; i < 64; i++) {
+    queries.push_back("SELECT * FROM t WHERE id = " + std::to_string(i));
+    Insert(&cache, queries.back(), result, cache.Version());
+    // The first one is kept in use.
+    ASSERT_NE(Lookup(&cache, kSchema, queries[0]), 0u);
+  }
+  ASSERT_LE(cache.bytes(), 16u * 400);
+  ASSERT_NE(Lookup(&cache, kSchema, queries.back()), 0u);
+  size_t cached = 0;
+  for (auto &query : queries) {
+    cached += Lookup(&cache, kSchema, query) != 0;
+  }
+  ASSERT_LT(cached, queries.size());
+}
+
+TEST(ResultCacheTest, ClientWritesInvalidatedOnCommit) {
+  ResultCache cache(1 << 20);
+  ResultCacheClient writer(&cache);
+  ResultCacheClient reader(&cache);
+  writer.SetSchema(kSchema.c_str());
+  reader.SetSchema(kSchema.c_str());
+  std::string query = "SELECT * FROM orders WHERE id = 1";
+  auto fingerprint = PrefetchTable::Fingerprint(query);
+  auto result = ResultSet(1);
+  uint8_t buffer[64];
+
+  writer.OnResult(StatementType::kBegin);
+  writer.OnSend("UPDATE orders SET v = 2 WHERE id = 1");
+  writer.OnResult(StatementType::kUpdate);
+  ASSERT_FALSE(writer.Usable());
+
+  // The update is not committed yet, so the reader still sees the row
+  // as it was.
+  reader.Insert(query, fingerprint, StatementType::kSelect, reader.Version(), Bytes(result),
+                result.size());
+  ASSERT_NE(reader.Lookup(query, fingerprint, StatementType::kSelect, buffer, sizeof(buffer)),
+            0u);
+
+  writer.OnSend("COMMIT");
+  writer.OnResult(StatementType::kCommit);
+  ASSERT_TRUE(writer.Usable());
+  ASSERT_EQ(reader.Lookup(query, fingerprint, StatementType::kSelect, buffer, sizeof(buffer)),
+            0u);
+}
+
+TEST(ResultCacheTest, ClientSpeculationDoneAfterNextResult) {
+  ResultCache cache(1 << 20);
+  ResultCacheClient client(&cache);
+  client.SetSchema(kSchema.c_str());
+  std::string query = "SELECT * FROM orders WHERE id = 1";
+  auto fingerprint = PrefetchTable::Fingerprint(query);
+  auto result = ResultSet(1);
+  uint8_t buffer[64];
+
+  client.OnSpeculate("UPDATE orders SET v = 2 WHERE id = 1");
+  client.OnResult(StatementType::kSelect);
+  ASSERT_FALSE(client.Usable());
+  cache.Insert(kSchema, query, fingerprint, cache.Version(), Bytes(result), result.size());
+  client.OnResult(StatementType::kUpdate);
+  ASSERT_TRUE(client.Usable());
+  ASSERT_EQ(client.Lookup(query, fingerprint, StatementType::kSelect, buffer, sizeof(buffer)),
+            0u);
+
+  client.OnPacket();
+  ASSERT_FALSE(client.Usable());
+}
@@ -80,6 +80,45 @@ TEST_F(RoutingTests, GetAccessLiteralName) {
   ASSERT_THAT(get_access_mode_name(AccessMode::kReadOnly), StrEq("read-only"));
 }
 
+TEST_F(RoutingTests, IoModeLiteralNames) {
+  using routing::IoMode;
+  using routing::get_io_mode;
+  using routing::get_io_mode_name;
+  ASSERT_THAT(get_io_mode("thread"), Eq(IoMode::kThreadPerConnection));
+  ASSERT_THAT(get_io_mode("reactor"), Eq(IoMode::kReactor));
+  ASSERT_THAT(get_io_mode("epoll"), Eq(IoMode::kUndefined));
+  ASSERT_THAT(get_io_mode_name(IoMode::kReactor), StrEq("reactor"));
+}
+
+TEST_F(RoutingTests, WaitModeLiteralNames) {
+  using routing::WaitMode;
+  using routing::get_wait_mode;
+  using routing::get_wait_mode_name;
+  ASSERT_THAT(get_wait_mode("spin"), Eq(WaitMode::kSpin));
+  ASSERT_THAT(get_wait_mode("park"), Eq(WaitMode::kPark));
+  ASSERT_THAT(get_wait_mode_name(WaitMode::kPark), StrEq("park"));
+}
+
+TEST_F(RoutingTests, RollbackModeLiteralNames) {
+  using routing::RollbackMode;
+  using routing::get_rollback_mode;
+  using routing::get_rollback_mode_name;
+  ASSERT_THAT(get_rollback_mode("undo"), Eq(RollbackMode::kUndo));
+  ASSERT_THAT(get_rollback_mode("savepoint"), Eq(RollbackMode::kSavepoint));
+  ASSERT_THAT(get_rollback_mode("rollback"), Eq(RollbackMode::kUndefined));
+  ASSERT_THAT(get_rollback_mode_name(RollbackMode::kSavepoint), StrEq("savepoint"));
+}
+
+TEST_F(RoutingTests, SpeculatorTypeLiteralNames) {
+  using routing::SpeculatorType;
+  using routing::get_speculator_type;
+  using routing::get_speculator_type_name;
+  ASSERT_THAT(get_speculator_type("log"), Eq(SpeculatorType::kLog));
+  ASSERT_THAT(get_speculator_type("model"), Eq(SpeculatorType::kModel));
+  ASSERT_THAT(get_speculator_type("graph"), Eq(SpeculatorType::kUndefined));
+  ASSERT_THAT(get_speculator_type_name(SpeculatorType::kModel), StrEq("model"));
+}
+
 TEST_F(RoutingTests, Defaults) {
   ASSERT_EQ(routing::kDefaultWaitTimeout, 0);
   ASSERT_EQ(routing::kDefaultMaxConnections, 512);
@@ -88,6 +127,21 @@ TEST_F(RoutingTests, Defaults) {
   ASSERT_EQ(routing::kDefaultNetBufferLength, 16384U);
   ASSERT_EQ(routing::kDefaultMaxConnectErrors, 100ULL);
   ASSERT_EQ(routing::kDefaultClientConnectTimeout, 9UL);
+  ASSERT_EQ(routing::kDefaultWorkerThreads, 4U);
+  ASSERT_EQ(routing::kDefaultSpinBudget, 1000U);
+  ASSERT_EQ(routing::kDefaultPoolMinIdle, 0U);
+  ASSERT_EQ(routing::kDefaultPoolMaxIdle, 0U);
+  ASSERT_EQ(routing::kDefaultPoolMaxLifetime, 3600U);
+  ASSERT_EQ(routing::kDefaultPipelineDepth, 1U);
+  ASSERT_EQ(routing::kDefaultHedgePercentile, 0U);
+  ASSERT_EQ(routing::kDefaultResultCacheSize, 0U);
+  ASSERT_EQ(routing::kDefaultSpeculationWasteCost, 0U);
+  ASSERT_EQ(routing::kDefaultSpeculationMinConfidence, 0U);
+  ASSERT_EQ(routing::kDefaultModelLearningInterval, 0U);
+  ASSERT_STREQ(routing::kDefaultShmDestinations, "");
+  ASSERT_STREQ(routing::kDefaultTraceFile, "");
+  ASSERT_EQ(routing::kDefaultRdmaPollerThreads, 0U);
+  ASSERT_EQ(routing::kDefaultRdmaBusyPoll, 0U);
 }
 
 #ifndef _WIN32
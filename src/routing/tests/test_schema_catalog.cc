@@ -0,0 +1,116 @@
+#include "speculator/schema_catalog.h"
+#include "speculator/undoer.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+
+namespace {
+
+ResultRow Row(const char *schema, const char *table, const char *index, const char *column,
+              const char *nullable = "") {
+  return ResultRow{std::string(schema), std::string(table), std::string(index),
+                   std::string(column), std::string(nullable)};
+}
+
+void AppendPacket(std::string &buffer, uint8_t sequence, const std::string &payload) {
+  buffer.push_back(static_cast<char>(payload.size() & 0xff));
+  buffer.push_back(static_cast<char>((payload.size() >> 8) & 0xff));
+  buffer.push_back(static_cast<char>((payload.size() >> 16) & 0xff));
+  buffer.push_back(static_cast<char>(sequence));
+  buffer += payload;
+}
+
+} // namespace
+
+TEST(SchemaCatalogTest, PrefersPrimaryKey) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("shop", "orders", "PRIMARY", "w_id"),
+                Row("shop", "orders", "PRIMARY", "o_id"),
+                Row("shop", "orders", "uniq", "code")});
+  auto keys = catalog.KeyColumns("shop", "orders");
+  ASSERT_NE(keys, nullptr);
+  ASSERT_EQ(*keys, (std::vector<std::string>{"w_id", "o_id"}));
+  ASSERT_EQ(catalog.NumTables(), 1u);
+}
+
+TEST(SchemaCatalogTest, FallsBackToNotNullUniqueKey) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("shop", "items", "a_nullable", "a", "YES"),
+                Row("shop", "items", "b_unique", "b"),
+                Row("shop", "logs", "c_nullable", "c", "YES")});
+  auto keys = catalog.KeyColumns("shop", "items");
+  ASSERT_NE(keys, nullptr);
+  ASSERT_EQ(*keys, std::vector<std::string>{"b"});
+  ASSERT_EQ(catalog.KeyColumns("shop", "logs"), nullptr);
+}
+
+TEST(SchemaCatalogTest, CaseInsensitiveLookup) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("Shop", "Users", "PRIMARY", "id"), Row("a", "b", "PRIMARY", "id")});
+  ASSERT_NE(catalog.KeyColumns("shop", "USERS"), nullptr);
+  ASSERT_NE(catalog.KeyColumns("A", "b"), nullptr);
+  ASSERT_EQ(catalog.KeyColumns("shop", "user"), nullptr);
+  ASSERT_EQ(catalog.KeyColumns("other", "users"), nullptr);
+}
+
+TEST(SchemaCatalogTest, InsertUndoUsesKey) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("shop", "users", "PRIMARY", "id")});
+  Undoer undoer(nullptr, &catalog);
+  undoer.Capture("INSERT INTO shop.users (name, id) VALUES ('bob', 7)");
+  ASSERT_EQ(undoer.GetUndoQuery(), "DELETE FROM shop.users WHERE id=7");
+  undoer.Capture("INSERT INTO shop.logs (a, b) VALUES (1, 2)");
+  ASSERT_EQ(undoer.GetUndoQuery(), "DELETE FROM shop.logs WHERE a=1 AND b=2");
+}
+
+TEST(SchemaCatalogTest, KeepsReplacedSnapshotWhileKeysAreHeld) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("shop", "users", "PRIMARY", "id")});
+  auto keys = catalog.KeyColumns("shop", "users");
+  catalog.Load({Row("shop", "orders", "PRIMARY", "o_id")});
+  ASSERT_EQ(catalog.KeyColumns("shop", "users"), nullptr);
+  ASSERT_EQ(*keys, std::vector<std::string>{"id"});
+}
+
+TEST(SchemaCatalogTest, TemporaryTablesKeepCatalog) {
+  SchemaCatalog catalog;
+  catalog.Load({Row("shop", "users", "PRIMARY", "id")});
+  Undoer undoer(nullptr, &catalog);
+  undoer.Observe("CREATE TEMPORARY TABLE scratch (id INT PRIMARY KEY)");
+  undoer.Observe("drop  temporary table scratch");
+  ASSERT_FALSE(catalog.IsStale());
+  undoer.Observe("SELECT 1");
+  ASSERT_FALSE(catalog.IsStale());
+  undoer.Observe("CREATE TABLE items (id INT PRIMARY KEY)");
+  ASSERT_TRUE(catalog.IsStale());
+}
+
+TEST(ResultSetTest, ParsesRows) {
+  std::string buffer;
+  AppendPacket(buffer, 1, std::string(1, '\x02'));
+  AppendPacket(buffer, 2, "column definition a");
+  AppendPacket(buffer, 3, "column definition b");
+  AppendPacket(buffer, 4, std::string("\xfe\x00\x00\x02\x00", 5));
+  AppendPacket(buffer, 5, std::string("\x04" "it's" "\xfb", 6));
+  AppendPacket(buffer, 6, std::string("\x01" "1" "\x00", 3));
+  AppendPacket(buffer, 7, std::string("\xfe\x00\x00\x02\x00", 5));
+  std::vector<ResultRow> rows;
+  ASSERT_TRUE(ParseResultSet(reinterpret_cast<const uint8_t *>(buffer.data()), buffer.size(),
+                             &rows));
+  ASSERT_EQ(rows.size(), 2u);
+  ASSERT_EQ(rows[0][0], std::string("it's"));
+  ASSERT_FALSE(rows[0][1].has_value());
+  ASSERT_EQ(rows[1][0], std::string("1"));
+  ASSERT_EQ(rows[1][1], std::string(""));
+  ASSERT_EQ(SqlLiteral(rows[0][0]), "'it\\'s'");
+  ASSERT_EQ(SqlLiteral(rows[0][1]), "NULL");
+}
+
+TEST(ResultSetTest, RejectsOkPacket) {
+  std::string buffer;
+  AppendPacket(buffer, 1, std::string("\x00\x00\x00\x02\x00\x00\x00", 7));
+  std::vector<ResultRow> rows;
+  ASSERT_FALSE(ParseResultSet(reinterpret_cast<const uint8_t *>(buffer.data()), buffer.size(),
+                              &rows));
+}
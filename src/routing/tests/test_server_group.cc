@@ -0,0 +1,308 @@
+#include "server_group.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// The far end of a server connection. A sequenced-packet socket keeps
+// every query and response a message of its own, as the RDMA transport
+// does.
+class FakeServer {
+public:
+  FakeServer() {
+    int fds[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    router_fd_ = fds[0];
+    fd_ = fds[1];
+  }
+  ~FakeServer() {
+    close(fd_);
+  }
+  // Handed to the ServerGroup, which closes it.
+  int router_fd() const {
+    return router_fd_;
+  }
+
+  // The statement of the next COM_QUERY.
+  std::string ReadQuery() {
+    char buffer[1024];
+    ssize_t size = read(fd_, buffer, sizeof(buffer));
+    EXPECT_GT(size, static_cast<ssize_t>(kMySQLHeaderLen + 1));
+    return std::string(buffer + kMySQLHeaderLen + 1, static_cast<size_t>(size) - kMySQLHeaderLen - 1);
+  }
+  void Reply(const std::string &response) {
+    std::string packet = Packet(response);
+    EXPECT_EQ(write(fd_, packet.data(), packet.size()), static_cast<ssize_t>(packet.size()));
+  }
+
+  static std::string Packet(const std::string &payload) {
+    std::string packet(kMySQLHeaderLen, '\0');
+    packet[0] = static_cast<char>(payload.size());
+    packet[kMySQLSeqOffset] = 1;
+    return packet + payload;
+  }
+
+private:
+  int router_fd_;
+  int fd_;
+};
+
+class ServerGroupTest : public ::testing::Test {
+protected:
+  void Connect(size_t num_servers, size_t pipeline_depth) {
+    std::vector<int> fds;
+    for (size_t i = 0; i < num_servers; i++) {
+      servers_.emplace_back(new FakeServer);
+      fds.push_back(servers_.back()->router_fd());
+    }
+    group_.reset(new ServerGroup(fds, routing::SocketOperations::instance()));
+    group_->SetPipelineDepth(pipeline_depth);
+  }
+
+  std::string Result(size_t server, uint64_t request) {
+    group_->WaitForResult(server, request);
+    auto result = group_->GetResult(server, request);
+    if (result.first == nullptr) {
+      return "";
+    }
+    return std::string(reinterpret_cast<char *>(result.first), result.second);
+  }
+
+  // Enough client reads answered by server after latency for the hedge
+  // delay to be known.
+  void WarmUpReads(size_t server, std::chrono::milliseconds latency) {
+    for (size_t i = 0; i < LatencyWindow::kMinSamples; i++) {
+      ASSERT_TRUE(group_->SendQuery(server, "warm up", 1, true));
+      group_->StartRead(static_cast<int>(server), group_->LastRequest(server), "warm up", true);
+      servers_[server]->ReadQuery();
+      std::this_thread::sleep_for(latency);
+      servers_[server]->Reply("warm");
+      uint64_t request;
+      ASSERT_EQ(group_->WaitForRead(&request), static_cast<int>(server));
+      group_->GetResult(server, request);
+    }
+    ASSERT_EQ(group_->num_hedged(), 0u);
+  }
+
+  std::vector<std::unique_ptr<FakeServer>> servers_;
+  std::unique_ptr<ServerGroup> group_;
+};
+
+const auto kReadLatency = std::chrono::milliseconds(10);
+
+} // namespace
+
+TEST_F(ServerGroupTest, AnswersPipelinedRequestsInOrder) {
+  Connect(1, 3);
+  std::vector<uint64_t> requests;
+  for (auto query : {"q1", "q2", "q3"}) {
+    ASSERT_TRUE(group_->SendQuery(0, query, 1, true));
+    requests.push_back(group_->LastRequest(0));
+  }
+  ASSERT_EQ(group_->NumPending(0), 3u);
+  ASSERT_FALSE(group_->HasCapacity(0));
+  for (auto query : {"q1", "q2", "q3"}) {
+    ASSERT_EQ(servers_[0]->ReadQuery(), query);
+  }
+  servers_[0]->Reply("r1");
+  servers_[0]->Reply("r2");
+  servers_[0]->Reply("r3");
+  // Claimed last to first, so the earlier ones have been moved out of
+  // the connection buffer.
+  ASSERT_EQ(Result(0, requests[2]), FakeServer::Packet("r3"));
+  ASSERT_EQ(Result(0, requests[1]), FakeServer::Packet("r2"));
+  ASSERT_EQ(Result(0, requests[0]), FakeServer::Packet("r1"));
+  ASSERT_TRUE(group_->IsReadyForQuery(0));
+}
+
+TEST_F(ServerGroupTest, DiscardedRequestDoesNotShiftTheNext) {
+  Connect(1, 2);
+  ASSERT_TRUE(group_->SendQuery(0, "speculation", 1, true));
+  uint64_t speculation = group_->LastRequest(0);
+  // An undo queued behind a request in flight.
+  ASSERT_TRUE(group_->SendDiscarded(0, "undo"));
+  ASSERT_TRUE(group_->SendQuery(0, "read", 1, true));
+  uint64_t read = group_->LastRequest(0);
+  ASSERT_EQ(servers_[0]->ReadQuery(), "speculation");
+  ASSERT_EQ(servers_[0]->ReadQuery(), "undo");
+  ASSERT_EQ(servers_[0]->ReadQuery(), "read");
+  servers_[0]->Reply("speculated rows");
+  servers_[0]->Reply("undone");
+  servers_[0]->Reply("rows");
+  ASSERT_EQ(Result(0, read), FakeServer::Packet("rows"));
+  ASSERT_EQ(Result(0, speculation), FakeServer::Packet("speculated rows"));
+  ASSERT_EQ(group_->NumPending(0), 0u);
+}
+
+TEST_F(ServerGroupTest, DiscardsResultsThatHaveArrived) {
+  Connect(1, 2);
+  ASSERT_TRUE(group_->SendQuery(0, "prefetch", 1, true));
+  uint64_t prefetch = group_->LastRequest(0);
+  servers_[0]->ReadQuery();
+  servers_[0]->Reply("stale");
+  group_->WaitForServer(0);
+  group_->Discard(0, prefetch);
+  ASSERT_EQ(group_->GetResult(0, prefetch).first, nullptr);
+}
+
+TEST_F(ServerGroupTest, HeldResultOutlivesLaterRequests) {
+  Connect(1, 1);
+  ASSERT_TRUE(group_->SendQuery(0, "prefetch", 1, true));
+  uint64_t prefetch = group_->LastRequest(0);
+  servers_[0]->ReadQuery();
+  servers_[0]->Reply("prefetched");
+  group_->WaitForServer(0);
+  for (auto query : {"a", "b"}) {
+    ASSERT_TRUE(group_->SendQuery(0, query));
+    servers_[0]->ReadQuery();
+    servers_[0]->Reply(query);
+    group_->WaitForServer(0);
+  }
+  auto result = group_->GetResult(0);
+  ASSERT_EQ(std::string(reinterpret_cast<char *>(result.first), result.second),
+            FakeServer::Packet("b"));
+  // Claiming it releases it to the next request.
+  ASSERT_EQ(Result(0, prefetch), FakeServer::Packet("prefetched"));
+  ASSERT_TRUE(group_->SendQuery(0, "c"));
+  ASSERT_EQ(group_->GetResult(0, prefetch).first, nullptr);
+}
+
+TEST_F(ServerGroupTest, ResultNotHeldIsReleasedByTheNextRequest) {
+  Connect(1, 1);
+  ASSERT_TRUE(group_->SendQuery(0, "a"));
+  uint64_t first = group_->LastRequest(0);
+  servers_[0]->ReadQuery();
+  servers_[0]->Reply("a");
+  group_->WaitForServer(0);
+  ASSERT_NE(group_->GetResult(0).first, nullptr);
+  ASSERT_TRUE(group_->SendQuery(0, "b"));
+  ASSERT_EQ(group_->GetResult(0, first).first, nullptr);
+  ASSERT_EQ(group_->GetResult(0).first, nullptr);
+}
+
+TEST_F(ServerGroupTest, SelectsOnlyServersWithRoom) {
+  Connect(2, 1);
+  int first = group_->SelectServer();
+  ASSERT_NE(first, -1);
+  ASSERT_TRUE(group_->SendQuery(first, "a", 1, true));
+  int second = group_->SelectServer();
+  ASSERT_EQ(second, 1 - first);
+  ASSERT_TRUE(group_->SendQuery(second, "b", 1, true));
+  ASSERT_EQ(group_->SelectServer(), -1);
+  servers_[second]->ReadQuery();
+  servers_[second]->Reply("b");
+  ASSERT_EQ(Result(second, group_->LastRequest(second)), FakeServer::Packet("b"));
+  ASSERT_EQ(group_->SelectServer(), second);
+}
+
+TEST_F(ServerGroupTest, HedgesStalledReadAndForwardsFirstAnswer) {
+  Connect(2, 1);
+  group_->SetHedgePercentile(50);
+  WarmUpReads(0, kReadLatency);
+
+  ASSERT_TRUE(group_->SendQuery(0, "select", 1, true));
+  group_->StartRead(0, group_->LastRequest(0), "select", true);
+  ASSERT_EQ(servers_[0]->ReadQuery(), "select");
+  uint64_t request;
+  ASSERT_EQ(group_->PollRead(&request), -1);
+  ASSERT_EQ(group_->num_hedged(), 0u);
+  std::this_thread::sleep_for(2 * kReadLatency);
+  ASSERT_EQ(group_->PollRead(&request), -1);
+  ASSERT_EQ(group_->num_hedged(), 1u);
+
+  ASSERT_EQ(servers_[1]->ReadQuery(), "select");
+  servers_[1]->Reply("fast rows");
+  ASSERT_EQ(group_->WaitForRead(&request), 1);
+  ASSERT_EQ(Result(1, request), FakeServer::Packet("fast rows"));
+  ASSERT_EQ(group_->num_hedge_wins(), 1u);
+
+  // The stalled answer is dropped, not taken for the next one.
+  servers_[0]->Reply("slow rows");
+  ASSERT_TRUE(group_->SendQuery(0, "next", 1, true));
+  uint64_t next = group_->LastRequest(0);
+  ASSERT_EQ(servers_[0]->ReadQuery(), "next");
+  servers_[0]->Reply("next rows");
+  ASSERT_EQ(Result(0, next), FakeServer::Packet("next rows"));
+  ASSERT_EQ(group_->NumPending(0), 0u);
+}
+
+TEST_F(ServerGroupTest, DropsHedgeAnsweredLast) {
+  Connect(2, 1);
+  group_->SetHedgePercentile(50);
+  WarmUpReads(0, kReadLatency);
+
+  ASSERT_TRUE(group_->SendQuery(0, "select", 1, true));
+  uint64_t read = group_->LastRequest(0);
+  group_->StartRead(0, read, "select", true);
+  servers_[0]->ReadQuery();
+  std::this_thread::sleep_for(2 * kReadLatency);
+  uint64_t request;
+  ASSERT_EQ(group_->PollRead(&request), -1);
+  ASSERT_EQ(group_->num_hedged(), 1u);
+  servers_[0]->Reply("rows");
+  ASSERT_EQ(group_->WaitForRead(&request), 0);
+  ASSERT_EQ(request, read);
+  ASSERT_EQ(Result(0, request), FakeServer::Packet("rows"));
+  ASSERT_EQ(group_->num_hedge_wins(), 0u);
+
+  ASSERT_EQ(servers_[1]->ReadQuery(), "select");
+  servers_[1]->Reply("late rows");
+  ASSERT_TRUE(group_->SendQuery(1, "next", 1, true));
+  uint64_t next = group_->LastRequest(1);
+  servers_[1]->ReadQuery();
+  servers_[1]->Reply("next rows");
+  ASSERT_EQ(Result(1, next), FakeServer::Packet("next rows"));
+  ASSERT_EQ(group_->NumPending(1), 0u);
+}
+
+TEST_F(ServerGroupTest, HedgesOnlyToIdleServersWhenPipelined) {
+  Connect(2, 2);
+  group_->SetHedgePercentile(50);
+  WarmUpReads(0, kReadLatency);
+
+  // Server 0 is stalled on a speculation queued ahead of the read, and
+  // server 1 is busy with one of its own.
+  ASSERT_TRUE(group_->SendQuery(0, "speculation", 1, true));
+  uint64_t speculation = group_->LastRequest(0);
+  ASSERT_TRUE(group_->SendQuery(0, "select", 1, true));
+  group_->StartRead(0, group_->LastRequest(0), "select", true);
+  ASSERT_TRUE(group_->SendQuery(1, "other speculation", 1, true));
+  uint64_t other_speculation = group_->LastRequest(1);
+  std::this_thread::sleep_for(2 * kReadLatency);
+  uint64_t request;
+  ASSERT_EQ(group_->PollRead(&request), -1);
+  ASSERT_EQ(group_->num_hedged(), 0u);
+
+  ASSERT_EQ(servers_[1]->ReadQuery(), "other speculation");
+  servers_[1]->Reply("other rows");
+  group_->WaitForResult(1, other_speculation);
+  ASSERT_EQ(group_->PollRead(&request), -1);
+  ASSERT_EQ(group_->num_hedged(), 1u);
+  ASSERT_EQ(servers_[1]->ReadQuery(), "select");
+  servers_[1]->Reply("fast rows");
+  ASSERT_EQ(group_->WaitForRead(&request), 1);
+  ASSERT_EQ(Result(1, request), FakeServer::Packet("fast rows"));
+  ASSERT_EQ(Result(1, other_speculation), FakeServer::Packet("other rows"));
+
+  // Both answers of server 0 land in their own slots.
+  ASSERT_EQ(servers_[0]->ReadQuery(), "speculation");
+  ASSERT_EQ(servers_[0]->ReadQuery(), "select");
+  servers_[0]->Reply("speculated rows");
+  servers_[0]->Reply("slow rows");
+  ASSERT_EQ(Result(0, speculation), FakeServer::Packet("speculated rows"));
+  ASSERT_TRUE(group_->SendQuery(0, "next", 1, true));
+  uint64_t next = group_->LastRequest(0);
+  servers_[0]->ReadQuery();
+  servers_[0]->Reply("next rows");
+  ASSERT_EQ(Result(0, next), FakeServer::Packet("next rows"));
+  ASSERT_EQ(group_->NumPending(0), 0u);
+}
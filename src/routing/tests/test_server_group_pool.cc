@@ -0,0 +1,69 @@
+#include "server_group_pool.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+MySQLSession MakeSession(const char *user, const char *db) {
+  MySQLSession session;
+  memset(&session, 0, sizeof(session));
+  strcpy(session.user, user);
+  strcpy(session.db, db);
+  return session;
+}
+
+std::unique_ptr<ServerGroup> CreateEmptyGroup() {
+  return std::unique_ptr<ServerGroup>(new ServerGroup(std::vector<int>()));
+}
+
+} // namespace
+
+TEST(ServerGroupPoolTest, KeyedByUserAndSchema) {
+  ASSERT_EQ(ServerGroupPool::Key(MakeSession("app", "lobsters")), "app/lobsters");
+  ASSERT_NE(ServerGroupPool::Key(MakeSession("app", "lobsters")),
+            ServerGroupPool::Key(MakeSession("app", "")));
+}
+
+TEST(ServerGroupPoolTest, DisabledPoolAlwaysMisses) {
+  ServerGroupPool pool(CreateEmptyGroup, 0, 0, std::chrono::seconds(60));
+  ASSERT_FALSE(pool.Enabled());
+  auto session = MakeSession("app", "lobsters");
+  auto key = ServerGroupPool::Key(session);
+  ASSERT_EQ(pool.Acquire(key, session), nullptr);
+  pool.Release(key, CreateEmptyGroup());
+  ASSERT_EQ(pool.Acquire(key, session), nullptr);
+  ASSERT_EQ(pool.hits(), 0u);
+  ASSERT_EQ(pool.misses(), 2u);
+}
+
+TEST(ServerGroupPoolTest, DropsGroupsThatFailToReset) {
+  ServerGroupPool pool(CreateEmptyGroup, 0, 4, std::chrono::seconds(60));
+  pool.Start();
+  auto session = MakeSession("app", "lobsters");
+  auto key = ServerGroupPool::Key(session);
+  ASSERT_EQ(pool.Acquire(key, session), nullptr);
+  // Never authenticated, so it cannot be reset.
+  pool.Release(key, CreateEmptyGroup());
+  pool.Drain();
+  ASSERT_EQ(pool.NumIdle(), 0u);
+  ASSERT_EQ(pool.Acquire(key, session), nullptr);
+  ASSERT_EQ(pool.misses(), 2u);
+  pool.Stop();
+}
+
+TEST(ServerGroupPoolTest, DropsKeysNoLongerUsed) {
+  // Every group and key expires right away.
+  ServerGroupPool pool(CreateEmptyGroup, 0, 4, std::chrono::seconds(0));
+  pool.Start();
+  auto session = MakeSession("app", "lobsters");
+  auto key = ServerGroupPool::Key(session);
+  ASSERT_EQ(pool.Acquire(key, session), nullptr);
+  ASSERT_EQ(pool.NumKeys(), 1u);
+  pool.Release(key, CreateEmptyGroup());
+  pool.Drain();
+  ASSERT_EQ(pool.NumKeys(), 0u);
+  pool.Stop();
+}
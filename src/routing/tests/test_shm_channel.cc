@@ -0,0 +1,182 @@
+#include "mysqlrouter/shm_channel.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+class ShmChannelTest : public ::testing::TestWithParam<bool> {
+protected:
+  WaitPolicy Policy() {
+    return GetParam() ? WaitPolicy::Park(10) : WaitPolicy::Spin();
+  }
+
+  // A name of this process, so that concurrent test runs do not meet.
+  std::string Name(const char *test) {
+    return std::string("shm-channel-test-") + test + "-" + std::to_string(getpid());
+  }
+};
+
+TEST_P(ShmChannelTest, ConnectFailsWithoutListener) {
+  ASSERT_EQ(ShmChannel::Connect(Name("none")), nullptr);
+}
+
+TEST_P(ShmChannelTest, CarriesBothDirections) {
+  ShmListener listener(Name("echo"));
+  ASSERT_TRUE(listener.Listen().ok());
+  std::unique_ptr<ShmChannel> server;
+  std::thread acceptor([&] {
+    server = listener.Accept();
+  });
+  auto client = ShmChannel::Connect(Name("echo"));
+  acceptor.join();
+  ASSERT_NE(client, nullptr);
+  ASSERT_NE(server, nullptr);
+  client->SetWaitPolicy(Policy());
+  server->SetWaitPolicy(Policy());
+
+  ASSERT_FALSE(server->HasData());
+  ASSERT_EQ(client->Write("ping", 4), 4);
+  ASSERT_TRUE(server->HasData());
+  char data[16] = {};
+  ASSERT_EQ(server->Read(data, sizeof(data)), 4);
+  ASSERT_EQ(memcmp(data, "ping", 4), 0);
+  ASSERT_FALSE(client->HasData());
+  ASSERT_EQ(server->Write("pong", 4), 4);
+  ASSERT_EQ(client->Read(data, sizeof(data)), 4);
+  ASSERT_EQ(memcmp(data, "pong", 4), 0);
+}
+
+TEST_P(ShmChannelTest, ReadsRecordByRecord) {
+  ShmListener listener(Name("records"));
+  ASSERT_TRUE(listener.Listen().ok());
+  std::unique_ptr<ShmChannel> server;
+  std::thread acceptor([&] {
+    server = listener.Accept();
+  });
+  auto client = ShmChannel::Connect(Name("records"));
+  acceptor.join();
+  ASSERT_NE(server, nullptr);
+  client->SetWaitPolicy(Policy());
+  server->SetWaitPolicy(Policy());
+
+  ASSERT_EQ(client->Write("ab", 2), 2);
+  ASSERT_EQ(client->Write("", 0), 0);
+  ASSERT_EQ(client->Write("0123456789", 10), 10);
+  char data[16] = {};
+  ASSERT_EQ(server->Read(data, sizeof(data)), 2);
+  ASSERT_EQ(memcmp(data, "ab", 2), 0);
+  ASSERT_EQ(server->Read(data, sizeof(data)), 0);
+  // The rest of a record comes with the next reads, never the next one.
+  ASSERT_EQ(server->Read(data, 4), 4);
+  ASSERT_EQ(server->Read(data + 4, 4), 4);
+  ASSERT_TRUE(server->HasData());
+  ASSERT_EQ(server->Read(data + 8, sizeof(data)), 2);
+  ASSERT_EQ(memcmp(data, "0123456789", 10), 0);
+  ASSERT_FALSE(server->HasData());
+}
+
+TEST_P(ShmChannelTest, WriteLargerThanRingWaitsForReader) {
+  ShmListener listener(Name("large"));
+  ASSERT_TRUE(listener.Listen().ok());
+  std::unique_ptr<ShmChannel> server;
+  std::thread acceptor([&] {
+    server = listener.Accept();
+  });
+  auto client = ShmChannel::Connect(Name("large"), 4096);
+  acceptor.join();
+  ASSERT_NE(server, nullptr);
+  client->SetWaitPolicy(Policy());
+  server->SetWaitPolicy(Policy());
+
+  std::vector<char> sent(100000);
+  for (size_t i = 0; i < sent.size(); i++) {
+    sent[i] = static_cast<char>(i * 7);
+  }
+  std::thread writer([&] {
+    client->Write(sent.data(), sent.size());
+  });
+  std::vector<char> received(sent.size());
+  size_t offset = 0;
+  while (offset < received.size()) {
+    auto size = server->Read(received.data() + offset, 3000);
+    ASSERT_GT(size, 0);
+    offset += static_cast<size_t>(size);
+  }
+  writer.join();
+  ASSERT_EQ(received, sent);
+}
+
+TEST_P(ShmChannelTest, CloseWakesUpPeerAfterDrain) {
+  ShmListener listener(Name("close"));
+  ASSERT_TRUE(listener.Listen().ok());
+  std::unique_ptr<ShmChannel> server;
+  std::thread acceptor([&] {
+    server = listener.Accept();
+  });
+  auto client = ShmChannel::Connect(Name("close"));
+  acceptor.join();
+  ASSERT_NE(server, nullptr);
+  client->SetWaitPolicy(Policy());
+  server->SetWaitPolicy(Policy());
+
+  server->Write("bye", 3);
+  server.reset();
+  ASSERT_FALSE(client->HasError());
+  char data[16];
+  ASSERT_EQ(client->Read(data, sizeof(data)), 3);
+  ASSERT_TRUE(client->HasError());
+  ASSERT_EQ(client->Read(data, sizeof(data)), -1);
+  ASSERT_EQ(client->Write("x", 1), -1);
+}
+
+TEST_P(ShmChannelTest, AcceptReturnsOnceClosed) {
+  ShmListener listener(Name("stop"));
+  ASSERT_TRUE(listener.Listen().ok());
+  std::thread closer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    listener.Close();
+  });
+  ASSERT_EQ(listener.Accept(), nullptr);
+  closer.join();
+}
+
+TEST_P(ShmChannelTest, WakesUpAnotherProcess) {
+  auto name = Name("fork");
+  ShmListener listener(name);
+  ASSERT_TRUE(listener.Listen().ok());
+  auto policy = Policy();
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    auto client = ShmChannel::Connect(name);
+    if (client == nullptr) {
+      _exit(1);
+    }
+    client->SetWaitPolicy(policy);
+    char data[4];
+    bool ok = client->Read(data, sizeof(data)) == 4 && client->Write(data, 4) == 4;
+    _exit(ok ? 0 : 2);
+  }
+  auto server = listener.Accept();
+  ASSERT_NE(server, nullptr);
+  server->SetWaitPolicy(policy);
+  // The child is parked by now, or about to be.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_EQ(server->Write("ping", 4), 4);
+  char data[4];
+  ASSERT_EQ(server->Read(data, sizeof(data)), 4);
+  ASSERT_EQ(memcmp(data, "ping", 4), 0);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+}
+
+INSTANTIATE_TEST_CASE_P(SpinAndPark, ShmChannelTest, ::testing::Bool());
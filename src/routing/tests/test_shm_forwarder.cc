@@ -0,0 +1,203 @@
+#include "shm_forwarder.h"
+
+#include "mysqlrouter/mysql_constant.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::string Packet(uint8_t seq, const std::string &payload) {
+  std::string packet(kMySQLHeaderLen, '\0');
+  packet[0] = static_cast<char>(payload.size() & 0xff);
+  packet[1] = static_cast<char>((payload.size() >> 8) & 0xff);
+  packet[2] = static_cast<char>((payload.size() >> 16) & 0xff);
+  packet[3] = static_cast<char>(seq);
+  return packet + payload;
+}
+
+std::string Capabilities(uint32_t capabilities) {
+  std::string bytes;
+  for (int i = 0; i < 4; i++) {
+    bytes += static_cast<char>((capabilities >> (8 * i)) & 0xff);
+  }
+  return bytes;
+}
+
+// An OK packet with the given status flags.
+std::string Ok(uint8_t seq, uint16_t status) {
+  return Packet(seq, std::string("\x00\x00\x00", 3) + static_cast<char>(status & 0xff) +
+                         static_cast<char>(status >> 8) + std::string("\x00\x00", 2));
+}
+
+std::string Eof(uint8_t seq) {
+  return Packet(seq, std::string("\xfe\x00\x00\x02\x00", 5));
+}
+
+// Two columns and three rows, the first of them with an empty value.
+std::string ResultSet(bool deprecate_eof) {
+  std::string result = Packet(1, "\x02");
+  result += Packet(2, "\x03" "def" "\x01s" "\x01t" "\x01t" "\x01" "a" "\x01" "a");
+  result += Packet(3, "\x03" "def" "\x01s" "\x01t" "\x01t" "\x01" "b" "\x01" "b");
+  uint8_t seq = 4;
+  if (!deprecate_eof) {
+    result += Eof(seq++);
+  }
+  result += Packet(seq++, std::string("\x00\x01x", 3));
+  result += Packet(seq++, "\x01y\x01z");
+  result += Packet(seq++, "\x02yy\x02zz");
+  if (deprecate_eof) {
+    // Longer than an EOF packet, with a message.
+    result += Packet(seq++, std::string("\xfe\x00\x00\x02\x00\x00\x00\x04" "done", 12));
+  } else {
+    result += Eof(seq++);
+  }
+  return result;
+}
+
+class ShmForwarderTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_), 0);
+    auto name = "shm-forwarder-test-" + std::to_string(getpid());
+    ShmListener listener(name);
+    ASSERT_TRUE(listener.Listen().ok());
+    std::unique_ptr<ShmChannel> accepted;
+    std::thread acceptor([&] {
+      accepted = listener.Accept();
+    });
+    router_ = ShmChannel::Connect(name);
+    acceptor.join();
+    ASSERT_NE(router_, nullptr);
+    ASSERT_NE(accepted, nullptr);
+    forwarder_.reset(new ShmForwarder(std::move(accepted), fds_[0]));
+    thread_ = std::thread(&ShmForwarder::Run, forwarder_.get());
+  }
+
+  void TearDown() override {
+    router_.reset();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  // Connects with the capabilities that both sides share.
+  void Handshake(uint32_t capabilities) {
+    std::string greeting = "\x0a" "8.0.0";
+    greeting += std::string("\x00\x01\x00\x00\x00", 5) + "abcdefgh" + std::string(1, '\0');
+    greeting += Capabilities(capabilities).substr(0, 2) + "\x21" + std::string("\x02\x00", 2);
+    greeting += Capabilities(capabilities).substr(2, 2) + std::string(11, '\0') + "ijklmnopqrst";
+    Reply(Packet(0, greeting));
+    ASSERT_EQ(Receive(), Packet(0, greeting));
+    auto response = Packet(1, Capabilities(capabilities) + std::string(28, '\0') + "user");
+    Send(response);
+    ASSERT_EQ(ReadRequest(), response);
+    Reply(Ok(2, 2));
+    ASSERT_EQ(Receive(), Ok(2, 2));
+  }
+
+  // From the router.
+  void Send(const std::string &data) {
+    ASSERT_EQ(router_->Write(data.data(), data.size()), static_cast<ssize_t>(data.size()));
+  }
+  std::string Receive() {
+    std::vector<char> buffer(1 << 16);
+    auto size = router_->Read(buffer.data(), buffer.size());
+    return size < 0 ? "" : std::string(buffer.data(), static_cast<size_t>(size));
+  }
+
+  // At the server.
+  std::string ReadRequest() {
+    char header[kMySQLHeaderLen];
+    if (recv(fds_[1], header, sizeof(header), MSG_WAITALL) != sizeof(header)) {
+      return "";
+    }
+    std::string payload(mysql_get_byte3(reinterpret_cast<uint8_t *>(header)), '\0');
+    if (!payload.empty() &&
+        recv(fds_[1], &payload[0], payload.size(), MSG_WAITALL) !=
+            static_cast<ssize_t>(payload.size())) {
+      return "";
+    }
+    return std::string(header, sizeof(header)) + payload;
+  }
+  void Reply(const std::string &data) {
+    ASSERT_EQ(send(fds_[1], data.data(), data.size(), 0), static_cast<ssize_t>(data.size()));
+  }
+
+  int fds_[2];
+  std::unique_ptr<ShmChannel> router_;
+  std::unique_ptr<ShmForwarder> forwarder_;
+  std::thread thread_;
+};
+
+} // namespace
+
+TEST_F(ShmForwarderTest, ForwardsResultSetAsOneRecord) {
+  Handshake(MYSQL_CAPABILITIES_PROTOCOL_41);
+  auto query = Packet(0, "\x03SELECT a, b FROM t");
+  Send(query);
+  ASSERT_EQ(ReadRequest(), query);
+  // Cut in the middle of a packet.
+  auto result = ResultSet(false);
+  Reply(result.substr(0, 30));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_FALSE(router_->HasData());
+  Reply(result.substr(30));
+  ASSERT_EQ(Receive(), result);
+
+  auto insert = Packet(0, "\x03INSERT INTO t VALUES (1, 2)");
+  Send(insert);
+  ASSERT_EQ(ReadRequest(), insert);
+  Reply(Ok(1, 2));
+  ASSERT_EQ(Receive(), Ok(1, 2));
+  ASSERT_FALSE(router_->HasData());
+}
+
+TEST_F(ShmForwarderTest, DropsResultOfUndoSentAhead) {
+  Handshake(MYSQL_CAPABILITIES_PROTOCOL_41 | MYSQL_CAPABILITIES_MULTI_STATEMENTS);
+  // The skip marker does not reach the server.
+  Send("");
+  auto query = Packet(0, "\x03ROLLBACK TO s1; SELECT a, b FROM t");
+  Send(query);
+  ASSERT_EQ(ReadRequest(), query);
+  auto result = ResultSet(false);
+  Reply(Ok(1, 0x0008 | 2) + result);
+  ASSERT_EQ(Receive(), result);
+
+  // Without a marker, every result of a query comes back.
+  Send(query);
+  ASSERT_EQ(ReadRequest(), query);
+  Reply(Ok(1, 0x0008 | 2) + result);
+  ASSERT_EQ(Receive(), Ok(1, 0x0008 | 2));
+  ASSERT_EQ(Receive(), result);
+  ASSERT_FALSE(router_->HasData());
+}
+
+TEST_F(ShmForwarderTest, EndsResultSetsWithOkWithoutEof) {
+  Handshake(MYSQL_CAPABILITIES_PROTOCOL_41 | MYSQL_CAPABILITIES_DEPRECATE_EOF);
+  auto query = Packet(0, "\x03SELECT a, b FROM t");
+  Send(query);
+  ASSERT_EQ(ReadRequest(), query);
+  auto result = ResultSet(true);
+  Reply(result);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_TRUE(router_->HasData());
+  ASSERT_EQ(Receive(), result);
+}
+
+TEST_F(ShmForwarderTest, ClosesChannelWhenServerHangsUp) {
+  Handshake(MYSQL_CAPABILITIES_PROTOCOL_41);
+  shutdown(fds_[1], SHUT_RDWR);
+  ASSERT_EQ(router_->Read(nullptr, 0), -1);
+  ASSERT_TRUE(router_->HasError());
+}
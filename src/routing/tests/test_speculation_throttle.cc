@@ -0,0 +1,97 @@
+#include "prefetch_table.h"
+#include "speculation_throttle.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string kRead = "SELECT * FROM orders WHERE id = 1";
+const std::string kOtherRead = "SELECT * FROM items WHERE id = 2";
+const std::string kWrite = "UPDATE orders SET v = 2 WHERE id = 1";
+
+std::string Read(int id) {
+  return "SELECT * FROM orders WHERE id = " + std::to_string(id);
+}
+
+// Predicts speculation after the query and returns whether it is admitted.
+bool Speculate(SpeculationThrottle *throttle, const std::string &query,
+               const std::string &speculation, bool is_write) {
+  throttle->Observe(query, PrefetchTable::Fingerprint(query));
+  throttle->Predict({speculation}, {PrefetchTable::Fingerprint(speculation)});
+  return throttle->Admit(0, is_write);
+}
+
+} // namespace
+
+TEST(SpeculationThrottleTest, DisabledSendsEverything) {
+  SpeculationThrottle throttle(SpeculationThrottle::Options{});
+  ASSERT_FALSE(throttle.Enabled());
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(Speculate(&throttle, kOtherRead, kRead, false));
+  }
+  ASSERT_TRUE(throttle.estimates().empty());
+}
+
+TEST(SpeculationThrottleTest, ThrottledTemplateStillLearns) {
+  SpeculationThrottle::Options options;
+  options.min_confidence = 0.5;
+  SpeculationThrottle throttle(options);
+
+  // Always wrong: the client reads another row than predicted.
+  for (int i = 0; i < 20; i++) {
+    Speculate(&throttle, Read(-i), Read(i), false);
+    throttle.OnMiss(100, false);
+  }
+  ASSERT_FALSE(Speculate(&throttle, kOtherRead, Read(100), false));
+  ASSERT_GT(throttle.num_throttled(), 0u);
+
+  // Right from now on, which is seen although nothing is sent.
+  bool admitted = false;
+  for (int i = 101; i < 140 && !admitted; i++) {
+    admitted = Speculate(&throttle, Read(i - 1), Read(i), false);
+  }
+  ASSERT_TRUE(admitted);
+}
+
+TEST(SpeculationThrottleTest, WriteCostsMoreThanRead) {
+  SpeculationThrottle::Options options;
+  options.waste_cost = 1.5;
+  SpeculationThrottle throttle(options);
+
+  // Half of the predictions hit.
+  for (int i = 1; i < 64; i++) {
+    Speculate(&throttle, i % 2 == 0 ? Read(-i) : Read(i - 1), Read(i), false);
+    if (i % 2 == 0) {
+      throttle.OnMiss(1000, false);
+    }
+  }
+  throttle.OnWait(400);
+  throttle.OnWriteSent(100);
+  ASSERT_DOUBLE_EQ(throttle.write_wait_us(), 500);
+
+  // p * L of about 500 is less than (1 - p) * 1.5 * L of about 750.
+  ASSERT_FALSE(throttle.Worthwhile(kRead, false));
+  options.waste_cost = 0.5;
+  SpeculationThrottle cheaper(options);
+  for (int i = 1; i < 64; i++) {
+    Speculate(&cheaper, i % 2 == 0 ? Read(-i) : Read(i - 1), Read(i), false);
+    if (i % 2 == 0) {
+      cheaper.OnMiss(1000, false);
+    }
+  }
+  cheaper.OnWriteSent(500);
+  ASSERT_TRUE(cheaper.Worthwhile(kRead, false));
+  // The write also waits 500us for every server.
+  ASSERT_FALSE(cheaper.Worthwhile(kRead, true));
+}
+
+TEST(SpeculationThrottleTest, UnknownLatencyIsAdmitted) {
+  SpeculationThrottle::Options options;
+  options.waste_cost = 10;
+  SpeculationThrottle throttle(options);
+  ASSERT_TRUE(Speculate(&throttle, kOtherRead, kWrite, true));
+  ASSERT_EQ(throttle.num_sent(), 1u);
+}
@@ -0,0 +1,152 @@
+#include "mysqlrouter/spsc_ring_buffer.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+class SpscRingBufferTest : public ::testing::TestWithParam<bool> {
+protected:
+  WaitPolicy Policy() {
+    return GetParam() ? WaitPolicy::Park(10) : WaitPolicy::Spin();
+  }
+};
+
+TEST_P(SpscRingBufferTest, ReadWaitsForWrite) {
+  SpscRingBuffer buffer(64);
+  buffer.SetWaitPolicy(Policy());
+  std::thread writer([&buffer] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    buffer.Write("hello", 5);
+  });
+  char data[16] = {};
+  ASSERT_EQ(buffer.Read(data, sizeof(data)), 5);
+  ASSERT_EQ(memcmp(data, "hello", 5), 0);
+  writer.join();
+}
+
+TEST_P(SpscRingBufferTest, ReadFailsOnError) {
+  SpscRingBuffer buffer(64);
+  buffer.SetWaitPolicy(Policy());
+  std::thread writer([&buffer] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    buffer.SignalError();
+  });
+  char data[16];
+  ASSERT_EQ(buffer.Read(data, sizeof(data)), -1);
+  writer.join();
+}
+
+TEST_P(SpscRingBufferTest, WriteWaitsForSpace) {
+  SpscRingBuffer buffer(8);
+  buffer.SetWaitPolicy(Policy());
+  buffer.Write("abcdef", 6);
+  std::thread reader([&buffer] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    char data[6];
+    buffer.Read(data, sizeof(data));
+  });
+  buffer.Write("ghij", 4);
+  reader.join();
+  char data[8] = {};
+  ASSERT_EQ(buffer.Read(data, sizeof(data)), 4);
+  ASSERT_EQ(memcmp(data, "ghij", 4), 0);
+}
+
+TEST(NotifierTest, WaitReturnsOnNotify) {
+  Notifier notifier;
+  std::atomic<bool> ready(false);
+  std::thread notifier_thread([&notifier, &ready] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ready = true;
+    notifier.Notify();
+  });
+  // A timeout long enough that the test would hang without the wake-up.
+  WaitPolicy policy{true, 0, 10000000};
+  WaitUntil(policy, &notifier, [&ready] {
+    return ready.load();
+  });
+  ASSERT_TRUE(ready);
+  notifier_thread.join();
+}
+
+TEST_P(SpscRingBufferTest, RecordsAreReadWhole) {
+  SpscRecordBuffer buffer(4096);
+  buffer.SetWaitPolicy(Policy());
+  ASSERT_FALSE(buffer.HasData());
+  ASSERT_TRUE(buffer.Write("hello", 5));
+  ASSERT_TRUE(buffer.Write("world!", 6));
+  ASSERT_TRUE(buffer.HasData());
+  char data[16] = {};
+  // Not merged with the next record.
+  ASSERT_EQ(buffer.Read(data, sizeof(data)), 5);
+  ASSERT_EQ(memcmp(data, "hello", 5), 0);
+  // Nor lost when the buffer is too small.
+  ASSERT_EQ(buffer.Read(data, 4), 4);
+  ASSERT_EQ(buffer.Read(data + 4, 4), 2);
+  ASSERT_EQ(memcmp(data, "world!", 6), 0);
+  ASSERT_FALSE(buffer.HasData());
+}
+
+TEST_P(SpscRingBufferTest, RecordsArePeekedInPlace) {
+  SpscRecordBuffer buffer(4096);
+  buffer.SetWaitPolicy(Policy());
+  ASSERT_FALSE(buffer.Write(std::string(4096, 'x').data(), 4096));
+  std::string record(1000, 'a');
+  // Wraps around the end of the ring several times.
+  for (int i = 0; i < 20; i++) {
+    record[0] = static_cast<char>('a' + i);
+    ASSERT_TRUE(buffer.Write(record.data(), record.size()));
+    const char *data;
+    size_t size;
+    ASSERT_TRUE(buffer.Peek(&data, &size));
+    ASSERT_EQ(std::string(data, size), record);
+    buffer.Commit();
+  }
+}
+
+TEST_P(SpscRingBufferTest, ConsumesRecordsInBatches) {
+  SpscRecordBuffer buffer(1 << 16);
+  buffer.SetWaitPolicy(Policy());
+  const int kNumRecords = 10000;
+  std::thread writer([&buffer] {
+    for (int i = 0; i < kNumRecords; i++) {
+      auto record = std::to_string(i);
+      buffer.Write(record.data(), record.size());
+    }
+  });
+  std::vector<int> records;
+  while (records.size() < kNumRecords) {
+    const char *data;
+    size_t size;
+    ASSERT_TRUE(buffer.Peek(&data, &size));
+    records.push_back(std::stoi(std::string(data, size)));
+    buffer.Consume([&records](const char *data, size_t size) {
+      records.push_back(std::stoi(std::string(data, size)));
+    }, 64);
+    buffer.Commit();
+  }
+  writer.join();
+  for (int i = 0; i < kNumRecords; i++) {
+    ASSERT_EQ(records[i], i);
+  }
+}
+
+TEST_P(SpscRingBufferTest, PeekFailsOnError) {
+  SpscRecordBuffer buffer(4096);
+  buffer.SetWaitPolicy(Policy());
+  std::thread writer([&buffer] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    buffer.SignalError();
+  });
+  const char *data;
+  size_t size;
+  ASSERT_FALSE(buffer.Peek(&data, &size));
+  writer.join();
+}
+
+INSTANTIATE_TEST_CASE_P(SpinAndPark, SpscRingBufferTest, ::testing::Bool());
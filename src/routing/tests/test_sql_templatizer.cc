@@ -0,0 +1,51 @@
+#include "speculator/speculation_model/sql_templatizer.h"
+
+#include "gtest/gtest.h"
+
+using model::Double;
+using model::DoubleList;
+using model::SqlTemplatizer;
+using model::SqlValue;
+using model::StringList;
+
+TEST(SqlTemplatizerTest, StringsAndNumbers) {
+  SqlTemplatizer templatizer;
+  std::vector<SqlValue> arguments;
+  templatizer.Templatize("  SELECT a1 FROM t2 WHERE b = 'x y' AND c > 1.5 AND d = 12abc ",
+                         &arguments);
+  ASSERT_EQ(templatizer.sql_template(), "SELECT a1 FROM t2 WHERE b = ?v AND c > ?v AND d = 12abc");
+  ASSERT_EQ(templatizer.hash(), SqlTemplatizer::Hash(templatizer.sql_template()));
+  ASSERT_EQ(arguments.size(), 2u);
+  ASSERT_EQ(arguments[0], SqlValue(std::string("x y")));
+  ASSERT_EQ(arguments[1], SqlValue(Double(1.5)));
+}
+
+TEST(SqlTemplatizerTest, InLists) {
+  SqlTemplatizer templatizer;
+  std::vector<SqlValue> arguments;
+  templatizer.Templatize("SELECT * FROM t WHERE a IN (3, 1, 2) AND b IN ('x', 'y)')", &arguments);
+  ASSERT_EQ(templatizer.sql_template(), "SELECT * FROM t WHERE a ?v AND b ?v");
+  ASSERT_EQ(arguments.size(), 2u);
+  ASSERT_EQ(arguments[0], SqlValue(DoubleList{Double(1), Double(2), Double(3)}));
+  ASSERT_EQ(arguments[1], SqlValue(StringList{"x", "y)"}));
+}
+
+TEST(SqlTemplatizerTest, LimitAndOffsetAreNotArguments) {
+  SqlTemplatizer templatizer;
+  std::vector<SqlValue> arguments;
+  templatizer.Templatize("SELECT * FROM t WHERE a = 7 LIMIT 10 OFFSET 20", &arguments);
+  ASSERT_EQ(templatizer.sql_template(), "SELECT * FROM t WHERE a = ?v LIMIT ?v OFFSET ?v");
+  ASSERT_EQ(arguments.size(), 1u);
+  ASSERT_EQ(arguments[0], SqlValue(Double(7)));
+}
+
+TEST(SqlTemplatizerTest, ReusesTemplate) {
+  SqlTemplatizer templatizer;
+  std::vector<SqlValue> arguments;
+  templatizer.Templatize("SELECT 1", &arguments);
+  auto hash = templatizer.hash();
+  templatizer.Templatize("SELECT 2", &arguments);
+  ASSERT_EQ(templatizer.sql_template(), "SELECT ?v");
+  ASSERT_EQ(templatizer.hash(), hash);
+  ASSERT_EQ(arguments.size(), 2u);
+}
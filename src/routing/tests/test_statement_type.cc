@@ -0,0 +1,34 @@
+#include "statement_type.h"
+
+#include "gtest/gtest.h"
+
+TEST(StatementTypeTest, Verbs) {
+  ASSERT_EQ(ClassifyStatement("SELECT * FROM t"), StatementType::kSelect);
+  ASSERT_EQ(ClassifyStatement("show tables"), StatementType::kShow);
+  ASSERT_EQ(ClassifyStatement("InSeRt INTO t VALUES (1)"), StatementType::kInsert);
+  ASSERT_EQ(ClassifyStatement("UPDATE`t` SET a = 1"), StatementType::kUpdate);
+  ASSERT_EQ(ClassifyStatement("delete from t"), StatementType::kDelete);
+  ASSERT_EQ(ClassifyStatement("COMMIT;"), StatementType::kCommit);
+  ASSERT_EQ(ClassifyStatement("TRUNCATE t"), StatementType::kDdl);
+  ASSERT_EQ(ClassifyStatement("selected"), StatementType::kOther);
+  ASSERT_EQ(ClassifyStatement(""), StatementType::kOther);
+}
+
+TEST(StatementTypeTest, SkipsWhitespaceAndComments) {
+  ASSERT_EQ(ClassifyStatement("  \n\tselect 1"), StatementType::kSelect);
+  ASSERT_EQ(ClassifyStatement("/* hint */ SELECT 1"), StatementType::kSelect);
+  ASSERT_EQ(ClassifyStatement("-- note\nUPDATE t SET a = 1"), StatementType::kUpdate);
+  ASSERT_EQ(ClassifyStatement("# note\n  DELETE FROM t"), StatementType::kDelete);
+  ASSERT_EQ(ClassifyStatement("/* unclosed SELECT"), StatementType::kOther);
+}
+
+TEST(StatementTypeTest, Transactions) {
+  ASSERT_EQ(ClassifyStatement("BEGIN"), StatementType::kBegin);
+  ASSERT_EQ(ClassifyStatement("start  transaction read only"), StatementType::kBegin);
+  ASSERT_EQ(ClassifyStatement("START SLAVE"), StatementType::kOther);
+  ASSERT_EQ(ClassifyStatement("ROLLBACK"), StatementType::kRollback);
+  ASSERT_EQ(ClassifyStatement("ROLLBACK TO SAVEPOINT a"), StatementType::kSavepoint);
+  ASSERT_EQ(ClassifyStatement("SAVEPOINT a"), StatementType::kSavepoint);
+  ASSERT_TRUE(IsReadStatement(ClassifyStatement("select 1")));
+  ASSERT_FALSE(IsReadStatement(ClassifyStatement("BEGIN")));
+}
@@ -0,0 +1,60 @@
+#include "speculator/trace_store.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+class TraceStoreTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char path[] = "/tmp/trace_store_testXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path_ = path;
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+  }
+
+  void WriteTrace(const std::string &content) {
+    std::ofstream trace(path_);
+    trace << content;
+  }
+
+  std::string path_;
+};
+
+TEST_F(TraceStoreTest, SplitsLines) {
+  WriteTrace("BEGIN\nSELECT * FROM t WHERE id = 1\n\nCOMMIT");
+  auto store = TraceStore::Get(path_);
+  ASSERT_NE(store, nullptr);
+  ASSERT_EQ(store->Size(), 4u);
+  ASSERT_EQ(store->Query(0), "BEGIN");
+  ASSERT_EQ(store->Query(1), "SELECT * FROM t WHERE id = 1");
+  ASSERT_EQ(store->Query(2), "");
+  ASSERT_EQ(store->Query(3), "COMMIT");
+}
+
+TEST_F(TraceStoreTest, IgnoresTrailingNewline) {
+  WriteTrace("BEGIN\nCOMMIT\n");
+  auto store = TraceStore::Get(path_);
+  ASSERT_NE(store, nullptr);
+  ASSERT_EQ(store->Size(), 2u);
+  ASSERT_EQ(store->Query(1), "COMMIT");
+}
+
+TEST_F(TraceStoreTest, LoadsOnce) {
+  WriteTrace("BEGIN\n");
+  auto store = TraceStore::Get(path_);
+  ASSERT_EQ(TraceStore::Get(path_), store);
+}
+
+TEST(TraceStoreMissingTest, ReturnsNull) {
+  ASSERT_EQ(TraceStore::Get("/nonexistent/trace.sql"), nullptr);
+}
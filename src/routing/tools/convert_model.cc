@@ -0,0 +1,23 @@
+// Compiles a model in the JSON format into the binary format of
+// model::ModelFile, which the routing plugin maps instead of parsing.
+// Either file works as model_file; the query set is not converted.
+//
+// Usage: routing_convert_model <model.json> <model.bin>
+
+#include "speculator/speculation_model/model_file.h"
+
+#include <cstdio>
+#include <string>
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <model.json> <model.bin>\n", argv[0]);
+    return 1;
+  }
+  std::string error;
+  if (!model::ModelFile::Convert(argv[1], argv[2], &error)) {
+    fprintf(stderr, "Failed to convert %s: %s\n", argv[1], error.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,74 @@
+// Serves a MySQL server to routers on the same host over shared memory.
+// Each channel a router opens for the port is forwarded to a TCP
+// connection to the server by a ShmForwarder, which hands the router one
+// response per record. List the server in the route's shm_destinations
+// to use it.
+//
+// Usage: routing_shm_shim <host> <port>
+
+#include "mysqlrouter/shm_channel.h"
+#include "shm_forwarder.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int ConnectServer(const char *host, const char *port) {
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *info;
+  if (getaddrinfo(host, port, &hints, &info) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for (auto ai = info; ai != nullptr && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(info);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+static void Serve(std::shared_ptr<ShmChannel> channel, const char *host, const char *port) {
+  int fd = ConnectServer(host, port);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to connect to %s:%s\n", host, port);
+    return;
+  }
+  ShmForwarder(std::move(channel), fd).Run();
+  close(fd);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <host> <port>\n", argv[0]);
+    return 1;
+  }
+  ShmListener listener(ShmChannelName(atoi(argv[2])));
+  auto status = listener.Listen();
+  if (!status.ok()) {
+    fprintf(stderr, "Failed to listen: %s\n", status.message().c_str());
+    return 1;
+  }
+  while (auto channel = listener.Accept()) {
+    std::thread(Serve, std::shared_ptr<ShmChannel>(std::move(channel)), argv[1], argv[2]).detach();
+  }
+  return 0;
+}